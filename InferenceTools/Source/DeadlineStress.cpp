@@ -0,0 +1,343 @@
+/*
+==============================================================================*/
+#include "DeadlineStress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ProcessorUtils.h"
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+    #include <time.h>
+#endif
+
+namespace InferenceTools {
+
+void printDeadlineStressUsage() {
+    std::cout << "stress [options]" << std::endl
+              << "    Run processBlock from a SCHED_FIFO thread at a fixed period under contention, reporting jitter and deadline misses" << std::endl
+              << "    --duration <s>       Run time in seconds, Ctrl+C stops earlier (default 60)" << std::endl
+              << "    --rate <hz>          Sample rate (default 48000)" << std::endl
+              << "    --block <n>          Block size, the period is block / rate (default 64)" << std::endl
+              << "    --channels <n>       1 or 2 (default 2)" << std::endl
+              << "    --instances <n>      Processor instances run in each callback, as the tracks of a rig (default 1)" << std::endl
+              << "    --gain <0..1>        Normalised gain parameter (default 0.5)" << std::endl
+              << "    --priority <n>       SCHED_FIFO priority of the audio thread (default 80)" << std::endl
+              << "    --cpu <n>            Pin the audio thread to a CPU (default: not pinned)" << std::endl
+              << "    --report <s>         Seconds between reports (default 10)" << std::endl
+              << "    --histogram <path>   Write the wake-up and completion histograms (1 us bins) as CSV" << std::endl
+              << "    --max-latency <us>   Range of the histograms, longer times go in the last bin (default 10000)" << std::endl
+              << "  Contention:" << std::endl
+              << "    --hotload <ms>       Create, prepare, run and destroy an instance every <ms> milliseconds" << std::endl
+              << "    --repaint            Render an editor-sized image at 60 Hz" << std::endl
+              << "    --memory <MB>        Allocate, touch and free <MB> megabytes in a loop" << std::endl
+              << "    --background <n>     Run <n> instances back to back at normal priority" << std::endl;
+}
+
+#if defined(__linux__)
+
+namespace {
+
+std::atomic<bool> interrupted{false};
+
+int64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Histogram with 1 us bins, filled by the audio thread while the reports read it */
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(int maxUs) : bins((size_t)std::max(1, maxUs) + 1) {}
+
+    /** Add a time (single writer) */
+    void add(int64_t ns) {
+        ns = std::max<int64_t>(0, ns);
+        auto& bin = bins[(size_t)std::min<int64_t>(ns / 1000, (int64_t)bins.size() - 1)];
+        bin.store(bin.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sumNs.store(sumNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns < minNs.load(std::memory_order_relaxed))
+            minNs.store(ns, std::memory_order_relaxed);
+        if (ns > maxNs.load(std::memory_order_relaxed))
+            maxNs.store(ns, std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    double getMinUs() const { return getCount() > 0 ? minNs.load(std::memory_order_relaxed) / 1e3 : 0.0; }
+    double getMaxUs() const { return maxNs.load(std::memory_order_relaxed) / 1e3; }
+    double getAverageUs() const { return getCount() > 0 ? sumNs.load(std::memory_order_relaxed) / 1e3 / getCount() : 0.0; }
+    int getNumBins() const { return (int)bins.size(); }
+    uint64_t getBin(int us) const { return bins[(size_t)us].load(std::memory_order_relaxed); }
+
+private:
+    std::vector<std::atomic<uint64_t>> bins;  // The last bin collects the longer times
+    std::atomic<uint64_t> count{0};
+    std::atomic<int64_t> sumNs{0}, minNs{INT64_MAX}, maxNs{0};
+};
+
+struct StressConfig {
+    double sampleRate = 48000.0;
+    int blockSize = 64;
+    int numChannels = 2;
+    int numInstances = 1;
+    float gain = 0.5f;
+    int priority = 80;
+    int cpu = -1;
+};
+
+struct StressStats {
+    explicit StressStats(int maxLatencyUs) : wakeup(maxLatencyUs), completion(maxLatencyUs) {}
+    LatencyHistogram wakeup;      // Actual - scheduled start of the callback
+    LatencyHistogram completion;  // End of the callback - scheduled start
+    std::atomic<uint64_t> deadlineMisses{0};
+    std::atomic<uint64_t> skippedPeriods{0};  // Periods that had already ended when an overrunning callback returned
+};
+
+/** One second (rounded up to whole blocks) of a sine with some noise, looped as the input of the processors */
+juce::AudioBuffer<float> createInputSignal(const StressConfig& config) {
+    const int numBlocks = (int)std::ceil(config.sampleRate / config.blockSize);
+    juce::AudioBuffer<float> signal(config.numChannels, numBlocks * config.blockSize);
+    juce::Random random(1234);
+    for (int channel = 0; channel < config.numChannels; ++channel)
+        for (int i = 0; i < signal.getNumSamples(); ++i)
+            signal.setSample(channel, i, 0.25f * std::sin(juce::MathConstants<float>::twoPi * 220.0f * i / (float)config.sampleRate) + 0.05f * (random.nextFloat() * 2.0f - 1.0f));
+    return signal;
+}
+
+void setRealtimePriority(const StressConfig& config) {
+    if (config.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            std::cerr << "Stress\t|\tCould not pin the audio thread to CPU " << config.cpu << std::endl;
+    }
+    sched_param param{};
+    param.sched_priority = config.priority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+        std::cerr << "Stress\t|\tCould not set SCHED_FIFO priority " << config.priority << " (needs root or an rtprio limit), running with the default policy" << std::endl;
+}
+
+/** Audio callback at a fixed period, as the audio thread of sushi */
+void runAudioThread(const StressConfig& config, std::vector<std::unique_ptr<juce::AudioProcessor>>& processors, StressStats& stats, const std::atomic<bool>& stop) {
+    setRealtimePriority(config);
+    // Prepare again from the audio thread, so that it is the first to touch the buffers of the processors
+    for (auto& processor : processors) {
+        processor->prepareToPlay(config.sampleRate, config.blockSize);
+        setParameter(*processor, "gain", config.gain);
+    }
+    const juce::AudioBuffer<float> input = createInputSignal(config);
+    juce::AudioBuffer<float> buffer(config.numChannels, config.blockSize);
+    juce::MidiBuffer midi;
+    if (mlockall(MCL_CURRENT) != 0)
+        std::cerr << "Stress\t|\tCould not lock the memory of the process" << std::endl;
+
+    const int64_t periodNs = (int64_t)std::llround(1e9 * config.blockSize / config.sampleRate);
+    int64_t scheduledNs = nowNs() + periodNs;
+    int inputPosition = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        const timespec wakeup = {(time_t)(scheduledNs / 1000000000), (long)(scheduledNs % 1000000000)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, nullptr) == EINTR) {
+        }
+        const int64_t startNs = nowNs();
+
+        for (auto& processor : processors) {
+            for (int channel = 0; channel < config.numChannels; ++channel)
+                buffer.copyFrom(channel, 0, input, channel, inputPosition, config.blockSize);
+            processor->processBlock(buffer, midi);
+        }
+        inputPosition = (inputPosition + config.blockSize) % input.getNumSamples();
+
+        const int64_t endNs = nowNs();
+        stats.wakeup.add(startNs - scheduledNs);
+        stats.completion.add(endNs - scheduledNs);
+        if (endNs - scheduledNs > periodNs)
+            stats.deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+
+        // The driver would have dropped the periods that ended during an overrun, the next callback is the current one
+        scheduledNs += periodNs;
+        if (endNs > scheduledNs + periodNs) {
+            const int64_t skipped = (endNs - scheduledNs) / periodNs;
+            stats.skippedPeriods.fetch_add((uint64_t)skipped, std::memory_order_relaxed);
+            scheduledNs += skipped * periodNs;
+        }
+    }
+    for (auto& processor : processors)
+        processor->releaseResources();
+}
+
+/** Run blocks of silence through a processor */
+void processBlocks(juce::AudioProcessor& processor, const StressConfig& config, int numBlocks) {
+    juce::AudioBuffer<float> buffer(config.numChannels, config.blockSize);
+    juce::MidiBuffer midi;
+    for (int i = 0; i < numBlocks; ++i) {
+        buffer.clear();
+        processor.processBlock(buffer, midi);
+    }
+}
+
+void runHotLoads(const StressConfig& config, int intervalMs, const std::atomic<bool>& stop) {
+    while (!stop.load(std::memory_order_relaxed)) {
+        auto processor = createPreparedProcessor(config.numChannels, config.sampleRate, config.blockSize);
+        processBlocks(*processor, config, 16);
+        processor.reset();
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+}
+
+void runRepaints(const std::atomic<bool>& stop) {
+    juce::Image image(juce::Image::ARGB, 800, 600, true);
+    for (int frame = 0; !stop.load(std::memory_order_relaxed); ++frame) {
+        {
+            juce::Graphics g(image);
+            g.setGradientFill(juce::ColourGradient(juce::Colours::darkblue, 0.0f, 0.0f, juce::Colours::black, 800.0f, 600.0f, false));
+            g.fillAll();
+            g.setColour(juce::Colours::white);
+            for (int i = 0; i < 100; ++i)
+                g.drawLine((float)((frame + i * 8) % 800), 0.0f, (float)(i * 8), 600.0f, 2.0f);
+            g.setFont(24.0f);
+            g.drawText("Frame " + juce::String(frame), image.getBounds(), juce::Justification::centred);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+}
+
+void runMemoryPressure(size_t bytes, const std::atomic<bool>& stop) {
+    while (!stop.load(std::memory_order_relaxed)) {
+        std::unique_ptr<char[]> block(new char[bytes]);
+        for (size_t i = 0; i < bytes; i += 4096)
+            block[i] = (char)i;
+    }
+}
+
+void runBackgroundInstance(const StressConfig& config, const std::atomic<bool>& stop) {
+    auto processor = createPreparedProcessor(config.numChannels, config.sampleRate, config.blockSize);
+    setParameter(*processor, "gain", config.gain);
+    while (!stop.load(std::memory_order_relaxed))
+        processBlocks(*processor, config, 64);
+}
+
+void printReport(const StressStats& stats, double elapsedSeconds) {
+    const int seconds = (int)elapsedSeconds;
+    std::cout << "T: " << std::setfill('0') << std::setw(2) << seconds / 3600 << ":" << std::setw(2) << (seconds / 60) % 60 << ":" << std::setw(2) << seconds % 60 << std::setfill(' ') << " | Cycles: " << stats.wakeup.getCount()
+              << std::fixed << std::setprecision(1) << " | Wake-up [us] min " << stats.wakeup.getMinUs() << " avg " << stats.wakeup.getAverageUs() << " max " << stats.wakeup.getMaxUs() << " | Completion [us] min "
+              << stats.completion.getMinUs() << " avg " << stats.completion.getAverageUs() << " max " << stats.completion.getMaxUs() << " | Misses: " << stats.deadlineMisses.load()
+              << " | Skipped: " << stats.skippedPeriods.load() << std::endl;
+}
+
+bool writeHistogram(const StressStats& stats, const juce::File& file) {
+    file.getParentDirectory().createDirectory();
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk())
+        return false;
+    stream.setPosition(0);
+    stream.truncate();
+    int lastBin = 0;
+    for (int us = 0; us < stats.wakeup.getNumBins(); ++us)
+        if (stats.wakeup.getBin(us) > 0 || stats.completion.getBin(us) > 0)
+            lastBin = us;
+    stream << "latency_us,wakeup,completion\n";
+    for (int us = 0; us <= lastBin; ++us)
+        stream << us << "," << (juce::int64)stats.wakeup.getBin(us) << "," << (juce::int64)stats.completion.getBin(us) << "\n";
+    return true;
+}
+
+}  // namespace
+
+int runDeadlineStress(const juce::StringArray& args) {
+    StressConfig config;
+    const double duration = getOptionValue(args, "--duration", "60").getDoubleValue();
+    config.sampleRate = getOptionValue(args, "--rate", "48000").getDoubleValue();
+    config.blockSize = getOptionValue(args, "--block", "64").getIntValue();
+    config.numChannels = getOptionValue(args, "--channels", "2").getIntValue();
+    config.numInstances = getOptionValue(args, "--instances", "1").getIntValue();
+    config.gain = getOptionValue(args, "--gain", "0.5").getFloatValue();
+    config.priority = getOptionValue(args, "--priority", "80").getIntValue();
+    config.cpu = getOptionValue(args, "--cpu", "-1").getIntValue();
+    const double reportSeconds = getOptionValue(args, "--report", "10").getDoubleValue();
+    const juce::String histogramPath = getOptionValue(args, "--histogram");
+    const int maxLatencyUs = getOptionValue(args, "--max-latency", "10000").getIntValue();
+    const int hotLoadMs = getOptionValue(args, "--hotload", "0").getIntValue();
+    const int memoryMB = getOptionValue(args, "--memory", "0").getIntValue();
+    const int numBackground = getOptionValue(args, "--background", "0").getIntValue();
+    if (duration <= 0.0 || config.sampleRate <= 0.0 || config.blockSize <= 0 || (config.numChannels != 1 && config.numChannels != 2) || config.numInstances <= 0 || reportSeconds <= 0.0 || maxLatencyUs <= 0) {
+        printDeadlineStressUsage();
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<juce::AudioProcessor>> processors;
+    for (int i = 0; i < config.numInstances; ++i)
+        processors.push_back(createPreparedProcessor(config.numChannels, config.sampleRate, config.blockSize));
+
+    StressStats stats(maxLatencyUs);
+    std::atomic<bool> stop{false};
+    interrupted = false;
+    auto previousHandler = std::signal(SIGINT, [](int) { interrupted = true; });
+
+    std::vector<std::thread> threads;
+    if (hotLoadMs > 0)
+        threads.emplace_back(runHotLoads, std::cref(config), hotLoadMs, std::cref(stop));
+    if (args.contains("--repaint"))
+        threads.emplace_back(runRepaints, std::cref(stop));
+    if (memoryMB > 0)
+        threads.emplace_back(runMemoryPressure, (size_t)memoryMB * 1024 * 1024, std::cref(stop));
+    for (int i = 0; i < numBackground; ++i)
+        threads.emplace_back(runBackgroundInstance, std::cref(config), std::cref(stop));
+    std::thread audioThread(runAudioThread, std::cref(config), std::ref(processors), std::ref(stats), std::cref(stop));
+
+    std::cout << "Stress\t|\t" << config.numInstances << " instance(s), " << config.blockSize << " samples at " << config.sampleRate << " Hz (period " << std::fixed << std::setprecision(1)
+              << 1e6 * config.blockSize / config.sampleRate << " us), contention threads: " << threads.size() << std::endl;
+    const int64_t startNs = nowNs();
+    double nextReport = reportSeconds;
+    double elapsed = 0.0;
+    while (elapsed < duration && !interrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        elapsed = (nowNs() - startNs) / 1e9;
+        if (elapsed >= nextReport) {
+            printReport(stats, elapsed);
+            nextReport += reportSeconds;
+        }
+    }
+    stop = true;
+    audioThread.join();
+    for (auto& thread : threads)
+        thread.join();
+    std::signal(SIGINT, previousHandler);
+
+    printReport(stats, elapsed);
+    if (histogramPath.isNotEmpty()) {
+        const juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(histogramPath);
+        if (!writeHistogram(stats, file)) {
+            std::cerr << "Stress\t|\tCould not write the histogram to '" << file.getFullPathName() << "'" << std::endl;
+            return 1;
+        }
+        std::cout << "Stress\t|\tHistogram written to '" << file.getFullPathName() << "'" << std::endl;
+    }
+    return stats.deadlineMisses.load() > 0 ? 1 : 0;
+}
+
+#else
+
+int runDeadlineStress(const juce::StringArray& args) {
+    juce::ignoreUnused(args);
+    std::cerr << "Stress\t|\tThe stress test needs Linux (SCHED_FIFO and clock_nanosleep)" << std::endl;
+    return 1;
+}
+
+#endif
+
+}  // namespace InferenceTools
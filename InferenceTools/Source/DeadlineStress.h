@@ -0,0 +1,33 @@
+/*
+ * Deadline stress test of the processor of the example
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Simulates the audio callback of Elk/sushi: a SCHED_FIFO thread wakes up at a fixed period (e.g. 64 samples at
+ * 48 kHz) and runs processBlock on one or more processor instances, while background threads generate contention:
+ *  - hot-loads: instances created, prepared, run and destroyed in a loop, as when a model is swapped;
+ *  - repaints: a software-rendered editor-sized image redrawn at 60 Hz;
+ *  - memory pressure: a large buffer allocated, written page by page and freed in a loop;
+ *  - other instances: processors run back to back at normal priority, loading the other cores.
+ *
+ * Like cyclictest, it measures the wake-up latency of every callback (actual - scheduled start) and its completion
+ * time (end - scheduled start). A callback misses its deadline when it completes after the period. Both are
+ * collected in 1 us histograms, for runs of hours, and periodically reported. Linux only.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'stress' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code (non-zero if any deadline was missed)
+ */
+int runDeadlineStress(const juce::StringArray& args);
+
+/** Print the usage of the 'stress' command */
+void printDeadlineStressUsage();
+
+}  // namespace InferenceTools
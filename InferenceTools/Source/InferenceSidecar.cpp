@@ -0,0 +1,155 @@
+/*
+==============================================================================*/
+#include "InferenceSidecar.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "PluginProcessor.h"  // InferenceEngine API of the example
+#include "ProcessorUtils.h"
+#include "fixedframeadapter.h"
+#include "inferencesidecar.h"
+
+#if defined(__linux__)
+    #include <sched.h>
+    #include <sys/mman.h>
+    #include <sys/prctl.h>
+    #include <sys/resource.h>
+    #include <unistd.h>
+#endif
+
+namespace InferenceTools {
+
+void printInferenceSidecarUsage() {
+    std::cout << "sidecar <shared memory name> [options]" << std::endl
+              << "    Run the model for a plugin built with USE_INFERENCE_SIDECAR, which starts this command itself" << std::endl
+              << "    --parent <pid>       Exit when this process exits (the plugin host)" << std::endl
+              << "    --model <path>       Model file (default: the model embedded in the tools)" << std::endl
+              << "    --cpus <mask>        Bitmask of the CPUs of the sidecar (default: inherited)" << std::endl
+              << "    --priority <n>       SCHED_FIFO priority of the sidecar (default: normal scheduler)" << std::endl
+              << "    --memory-limit <MB>  Address space limit of the sidecar (default: none)" << std::endl;
+}
+
+#if defined(__linux__)
+
+int runInferenceSidecar(const juce::StringArray& args) {
+    if (args.isEmpty() || args[0].startsWith("--")) {
+        printInferenceSidecarUsage();
+        return 1;
+    }
+    const pid_t parent = (pid_t)getOptionValue(args, "--parent", "0").getIntValue();
+    const juce::String modelPath = getOptionValue(args, "--model");
+    const juce::uint64 cpuMask = (juce::uint64)getOptionValue(args, "--cpus", "0").getLargeIntValue();
+    const int priority = getOptionValue(args, "--priority", "0").getIntValue();
+    const int memoryLimitMB = getOptionValue(args, "--memory-limit", "0").getIntValue();
+
+    // Do not outlive the host, even when it is killed
+    if (parent > 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent)
+            return 1;
+    }
+    auto channel = InferenceEngine::SidecarChannel::open(args[0].toStdString());
+    InferenceEngine::SidecarShared& shared = channel->getShared();
+
+    // Set before loading, so that the threads of the engine inherit them and its allocations are limited too
+    if (cpuMask != 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu)
+            if (cpuMask & (1ULL << cpu))
+                CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            std::cerr << "Sidecar\t|\tCould not set the CPUs (" << std::strerror(errno) << ")" << std::endl;
+    }
+    if (priority > 0) {
+        sched_param param;
+        param.sched_priority = priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+            std::cerr << "Sidecar\t|\tCould not set SCHED_FIFO priority " << priority << " (" << std::strerror(errno) << ")" << std::endl;
+    }
+    if (memoryLimitMB > 0) {
+        rlimit limit;
+        limit.rlim_cur = limit.rlim_max = (rlim_t)memoryLimitMB * 1024 * 1024;
+        if (setrlimit(RLIMIT_AS, &limit) != 0)
+            std::cerr << "Sidecar\t|\tCould not set the memory limit (" << std::strerror(errno) << ")" << std::endl;
+    }
+
+    InferenceEngine::InterpreterPtr interpreter = nullptr;
+    try {
+        if (modelPath.isNotEmpty()) {
+            interpreter = InferenceEngine::createInterpreter(modelPath.toStdString());
+        } else {
+            int size;
+            const char* model = getEmbeddedModel(size);
+            interpreter = InferenceEngine::createInterpreterFromBuffer(model, (size_t)size);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Sidecar\t|\tCould not load the model: " << e.what() << std::endl;
+        shared.state.store(InferenceEngine::SidecarShared::failed, std::memory_order_release);
+        return 1;
+    }
+    const int frameSize = (int)InferenceEngine::getModelBatchSize(interpreter);
+    std::vector<float> modelInput(2 * (size_t)frameSize), modelOutput((size_t)frameSize), block(InferenceEngine::sidecarMaxBlockSize);
+    std::vector<InferenceEngine::FixedFrameAdapter> adapters(InferenceEngine::sidecarMaxStreams);
+    for (auto& adapter : adapters)
+        adapter.prepare(frameSize);
+
+    // The first invocations allocate and fault in the engine buffers, then everything is locked in RAM
+    for (int invocation = 0; invocation < 16; ++invocation)
+        InferenceEngine::invoke(interpreter, modelInput.data(), modelInput.size(), modelOutput.data(), modelOutput.size());
+    InferenceEngine::resetModelState(interpreter);
+    if (mlockall(MCL_CURRENT) != 0)
+        std::cerr << "Sidecar\t|\tCould not lock the memory (" << std::strerror(errno) << ")" << std::endl;
+
+    shared.modelFrameSize = frameSize;
+    // The plugin runs the pre/post chain declared by the model around the sidecar
+    shared.prePostConfig = InferenceEngine::PrePostConfig::fromMetadata(InferenceEngine::getModelMetadata(interpreter));
+    shared.state.store(InferenceEngine::SidecarShared::ready, std::memory_order_release);
+
+    while (parent <= 0 || getppid() == parent) {
+        shared.heartbeat.fetch_add(1, std::memory_order_relaxed);
+        if (!InferenceEngine::SidecarChannel::wait(shared.requests, InferenceEngine::SidecarShared::heartbeatPeriodMs * 1000000LL))
+            continue;
+        while (const InferenceEngine::SidecarShared::Message* request = InferenceEngine::SidecarChannel::front(shared.requests)) {
+            const int numSamples = std::min(request->numSamples, InferenceEngine::sidecarMaxBlockSize);
+            if (request->command == InferenceEngine::SidecarShared::reset) {
+                for (auto& adapter : adapters)
+                    adapter.reset();
+                InferenceEngine::resetModelState(interpreter);
+            } else if (request->stream >= 0 && request->stream < InferenceEngine::sidecarMaxStreams) {
+                const float gain = request->gain;
+                std::copy(request->samples, request->samples + numSamples, block.begin());
+                adapters[(size_t)request->stream].process(block.data(), numSamples, [&](const float* frameIn, float* frameOut, int size) {
+                    for (int sample = 0; sample < size; ++sample) {
+                        modelInput[2 * (size_t)sample] = frameIn[sample];
+                        modelInput[2 * (size_t)sample + 1] = gain;
+                    }
+                    InferenceEngine::invoke(interpreter, modelInput.data(), modelInput.size(), modelOutput.data(), modelOutput.size());
+                    std::copy(modelOutput.begin(), modelOutput.end(), frameOut);
+                });
+            }
+            // If the plugin stopped reading the responses the ring is full and the response is dropped
+            InferenceEngine::SidecarChannel::push(shared.responses, request->sequence, request->command, request->stream, request->gain, block.data(), request->command == InferenceEngine::SidecarShared::reset ? 0 : numSamples);
+            InferenceEngine::SidecarChannel::pop(shared.requests);
+        }
+    }
+    InferenceEngine::deleteInterpreter(interpreter);
+    return 0;
+}
+
+#else
+
+int runInferenceSidecar(const juce::StringArray& args) {
+    juce::ignoreUnused(args);
+    std::cerr << "Sidecar\t|\tThe sidecar needs Linux (shared memory and futexes)" << std::endl;
+    return 1;
+}
+
+#endif
+
+}  // namespace InferenceTools
@@ -0,0 +1,27 @@
+/*
+ * Inference sidecar process
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * The process started by the plugin when it runs the saturation model out of process (USE_INFERENCE_SIDECAR, see
+ * inferencesidecar.h). It maps the shared memory region named by the plugin, loads the model (the one embedded in the
+ * tools or a file), then runs the blocks it receives until the plugin exits. The CPUs, scheduling priority and memory
+ * limit of the process are set here, before the engine creates any thread or allocation.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'sidecar' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code (non-zero if the model could not be loaded)
+ */
+int runInferenceSidecar(const juce::StringArray& args);
+
+/** Print the usage of the 'sidecar' command */
+void printInferenceSidecarUsage();
+
+}  // namespace InferenceTools
@@ -0,0 +1,71 @@
+/*
+ * Command line tools for the inference examples
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * The same sources are compiled against either example (see TFliteInferenceTools.jucer and
+ * OnnxInferenceTools.jucer), so every command runs the exact processing of the corresponding plugin.
+ */
+#include <JuceHeader.h>
+
+#include <iostream>
+
+#include "DeadlineStress.h"
+#include "InferenceSidecar.h"
+#include "MemoryFootprint.h"
+#include "OfflineRender.h"
+#include "OperatorProfiling.h"
+#include "PerfCounterBenchmark.h"
+#include "RegressionCheck.h"
+#include "SnapshotReplay.h"
+#include "perfcounters.h"
+
+static void printUsage(const char* executable) {
+    std::cout << "Usage: " << executable << " <command> [arguments]" << std::endl
+              << "Engine: " << INFERENCE_TOOLS_ENGINE << std::endl
+              << std::endl;
+    InferenceTools::printOfflineRenderUsage();
+    InferenceTools::printRegressionCheckUsage();
+    InferenceTools::printOperatorProfilingUsage();
+    InferenceTools::printPerfCounterBenchmarkUsage();
+    InferenceTools::printDeadlineStressUsage();
+    InferenceTools::printMemoryFootprintUsage();
+    InferenceTools::printSnapshotReplayUsage();
+    InferenceTools::printInferenceSidecarUsage();
+}
+
+int main(int argc, char* argv[]) {
+    // The processors use parameters and value trees, which expect the message manager to exist
+    juce::ScopedJuceInitialiser_GUI libraryInitialiser;
+    // The tools are built with INFERENCE_PERF_COUNTERS, but only the 'counters' command reads them
+    InferenceEngine::setPerfCountersEnabled(false);
+
+    juce::StringArray args;
+    for (int i = 2; i < argc; ++i)
+        args.add(argv[i]);
+    const juce::String command = (argc > 1) ? juce::String(argv[1]) : juce::String();
+
+    try {
+        if (command == "render")
+            return InferenceTools::runOfflineRender(args);
+        if (command == "check")
+            return InferenceTools::runRegressionCheck(args);
+        if (command == "profile")
+            return InferenceTools::runOperatorProfiling(args);
+        if (command == "counters")
+            return InferenceTools::runPerfCounterBenchmark(args);
+        if (command == "stress")
+            return InferenceTools::runDeadlineStress(args);
+        if (command == "footprint")
+            return InferenceTools::runMemoryFootprint(args);
+        if (command == "replay")
+            return InferenceTools::runSnapshotReplay(args);
+        if (command == "sidecar")
+            return InferenceTools::runInferenceSidecar(args);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
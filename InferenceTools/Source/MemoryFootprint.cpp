@@ -0,0 +1,141 @@
+/*
+==============================================================================*/
+#include "MemoryFootprint.h"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "PluginProcessor.h"  // InferenceEngine API
+#include "ProcessorUtils.h"
+#include "memoryusage.h"
+
+namespace InferenceTools {
+
+namespace {
+
+/** Cost of one instance, as differences of the process statistics */
+struct InstanceFootprint {
+    double creationMs = 0.0;   // Construction and prepareToPlay (model loading and warm-up included)
+    size_t residentBytes = 0;  // Resident set of the process after the instance was created
+    long long residentDelta = 0;
+    long long heapDelta = 0;
+    long minorFaults = 0;
+    long majorFaults = 0;
+    long firstBlockFaults = 0;  // Minor and major faults of the first processBlock
+};
+
+juce::String toKilobytes(long long bytes) {
+    return juce::String((double)bytes / 1024.0, 1) + " kB";
+}
+
+juce::String toKilobytesDelta(long long bytes) {
+    return (bytes >= 0 ? "+" : "") + toKilobytes(bytes);
+}
+
+/** Write one row per instance as CSV */
+bool writeCsv(const juce::File& file, const std::vector<InstanceFootprint>& instances) {
+    file.getParentDirectory().createDirectory();
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk())
+        return false;
+    stream.setPosition(0);
+    stream.truncate();
+    stream << "instance,creation_ms,resident_bytes,resident_delta_bytes,heap_delta_bytes,minor_faults,major_faults,first_block_faults\n";
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const InstanceFootprint& instance = instances[i];
+        stream << (int)i + 1 << "," << instance.creationMs << "," << (juce::int64)instance.residentBytes << "," << (juce::int64)instance.residentDelta << "," << (juce::int64)instance.heapDelta << ","
+               << (juce::int64)instance.minorFaults << "," << (juce::int64)instance.majorFaults << "," << (juce::int64)instance.firstBlockFaults << "\n";
+    }
+    return true;
+}
+
+}  // namespace
+
+void printMemoryFootprintUsage() {
+    std::cout << "footprint [options]" << std::endl
+              << "    Create processors one after the other and report the memory, page faults and time of each instance" << std::endl
+              << "    --instances <n>      Number of processors (default 8)" << std::endl
+              << "    --block <n>          Block size (default 128)" << std::endl
+              << "    --rate <hz>          Sample rate (default 48000)" << std::endl
+              << "    --channels <n>       1 or 2 (default 2)" << std::endl
+              << "    --csv <path>         Write one row per instance as CSV" << std::endl;
+}
+
+int runMemoryFootprint(const juce::StringArray& args) {
+    const int numInstances = getOptionValue(args, "--instances", "8").getIntValue();
+    const int blockSize = getOptionValue(args, "--block", "128").getIntValue();
+    const double sampleRate = getOptionValue(args, "--rate", "48000").getDoubleValue();
+    const int numChannels = getOptionValue(args, "--channels", "2").getIntValue();
+    const juce::String csvPath = getOptionValue(args, "--csv");
+    if (numInstances <= 0 || blockSize <= 0 || sampleRate <= 0.0 || (numChannels != 1 && numChannels != 2)) {
+        printMemoryFootprintUsage();
+        return 1;
+    }
+
+    // Instances are kept alive until the end, so that each one is measured on top of the previous ones
+    std::vector<std::unique_ptr<juce::AudioProcessor>> processors;
+    std::vector<InstanceFootprint> instances;
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midi;
+    for (int i = 0; i < numInstances; ++i) {
+        InstanceFootprint instance;
+        const InferenceEngine::ProcessMemoryStats before = InferenceEngine::getProcessMemoryStats();
+        const double start = juce::Time::getMillisecondCounterHiRes();
+        processors.push_back(createPreparedProcessor(numChannels, sampleRate, blockSize));
+        instance.creationMs = juce::Time::getMillisecondCounterHiRes() - start;
+        const InferenceEngine::ProcessMemoryStats created = InferenceEngine::getProcessMemoryStats();
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int sample = 0; sample < blockSize; ++sample)
+                buffer.setSample(channel, sample, 0.5f * std::sin(0.01f * (float)sample));
+        processors.back()->processBlock(buffer, midi);
+        const InferenceEngine::ProcessMemoryStats processed = InferenceEngine::getProcessMemoryStats();
+
+        instance.residentBytes = created.residentBytes;
+        instance.residentDelta = (long long)created.residentBytes - (long long)before.residentBytes;
+        instance.heapDelta = (long long)created.heapBytes - (long long)before.heapBytes;
+        instance.minorFaults = created.minorFaults - before.minorFaults;
+        instance.majorFaults = created.majorFaults - before.majorFaults;
+        instance.firstBlockFaults = (processed.minorFaults - created.minorFaults) + (processed.majorFaults - created.majorFaults);
+        instances.push_back(instance);
+        std::cout << "Footprint\t|\tInstance " << i + 1 << " | Created in " << juce::String(instance.creationMs, 2) << " ms | Resident " << toKilobytesDelta(instance.residentDelta) << " (" << toKilobytes((long long)instance.residentBytes)
+                  << ") | Heap " << toKilobytesDelta(instance.heapDelta) << " | Faults: " << instance.minorFaults << " minor, " << instance.majorFaults << " major | First block faults: " << instance.firstBlockFaults << std::endl;
+    }
+
+    // The first instance also pays for what the instances share (engine initialization, shared arenas, code pages)
+    if (instances.size() > 1) {
+        double creationMs = 0.0, residentDelta = 0.0, heapDelta = 0.0, faults = 0.0;
+        for (size_t i = 1; i < instances.size(); ++i) {
+            creationMs += instances[i].creationMs;
+            residentDelta += (double)instances[i].residentDelta;
+            heapDelta += (double)instances[i].heapDelta;
+            faults += (double)(instances[i].minorFaults + instances[i].majorFaults);
+        }
+        const double count = (double)(instances.size() - 1);
+        std::cout << "Footprint\t|\tEach additional instance: " << juce::String(creationMs / count, 2) << " ms | Resident " << toKilobytesDelta((long long)(residentDelta / count)) << " | Heap "
+                  << toKilobytesDelta((long long)(heapDelta / count)) << " | Faults: " << juce::String(faults / count, 1) << std::endl;
+    }
+    const InferenceEngine::ProcessMemoryStats total = InferenceEngine::getProcessMemoryStats();
+    std::cout << "Footprint\t|\tProcess: resident " << toKilobytes((long long)total.residentBytes) << ", peak " << toKilobytes((long long)total.peakResidentBytes) << ", heap " << toKilobytes((long long)total.heapBytes) << std::endl;
+
+    // Split of the memory of the model, as reported by the wrapper, for one more interpreter
+    int modelSize;
+    const char* model = getEmbeddedModel(modelSize);
+    InferenceEngine::InterpreterPtr interpreter = InferenceEngine::createInterpreterFromBuffer(model, (size_t)modelSize);
+    const InferenceEngine::ModelMemoryUsage usage = InferenceEngine::getModelMemoryUsage(interpreter);
+    InferenceEngine::deleteInterpreter(interpreter);
+    std::cout << "Footprint\t|\tModel (" << INFERENCE_TOOLS_ENGINE << "): " << usage.modelBytes << " bytes | Activations: " << usage.activationBytes << " bytes | Persistent: " << usage.persistentBytes << " bytes | I/O: " << usage.ioBytes
+              << " bytes | Runtime (estimated): " << usage.runtimeBytes << " bytes | Total: " << usage.getTotalBytes() << " bytes" << std::endl;
+
+    if (csvPath.isNotEmpty()) {
+        const juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(csvPath);
+        if (!writeCsv(file, instances))
+            throw std::runtime_error("Could not write " + file.getFullPathName().toStdString());
+        std::cout << "Footprint\t|\tInstances written to '" << file.getFullPathName() << "'" << std::endl;
+    }
+    return 0;
+}
+
+}  // namespace InferenceTools
@@ -0,0 +1,26 @@
+/*
+ * Memory footprint benchmark
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Creates processors one after the other and reports what each additional instance costs: resident memory, heap,
+ * page faults and instantiation time, plus the split of the memory of the model reported by the wrapper (see
+ * memoryusage.h). Tells how many instances fit on a board, and which part of an instance to shrink first.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'footprint' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code
+ */
+int runMemoryFootprint(const juce::StringArray& args);
+
+/** Print the usage of the 'footprint' command */
+void printMemoryFootprintUsage();
+
+}  // namespace InferenceTools
@@ -0,0 +1,227 @@
+/*
+==============================================================================*/
+#include "OfflineRender.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "ProcessorUtils.h"
+
+namespace InferenceTools {
+
+namespace {
+
+struct RenderFile {
+    juce::File input, output;
+    double sampleRate = 0.0;
+    int numChannels = 0;
+    int bitsPerSample = 0;
+    juce::int64 length = 0;
+    size_t firstJob = 0, numJobs = 0;  // Sorted by start, then channel
+};
+
+/** A contiguous section of one channel of one file */
+struct RenderJob {
+    int file;
+    int channel;
+    juce::int64 start;
+    juce::int64 length;
+    juce::File rendered;  // Raw float samples of the section
+};
+
+/**
+ * Render a section of a channel, compensating the processor latency by running it for 'latency' extra samples
+ * and discarding the first 'latency' output samples
+ */
+void renderJob(juce::AudioProcessor& processor, const RenderFile& file, const RenderJob& job, int blockSize, float gain) {
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader(wavFormat.createMemoryMappedReader(file.input));
+    if (reader == nullptr || !reader->mapEntireFile())
+        throw std::runtime_error("Could not map file " + file.input.getFullPathName().toStdString());
+
+    // Preparing again also clears the processor state left by the previous job
+    processor.setRateAndBufferSizeDetails(file.sampleRate, blockSize);
+    processor.prepareToPlay(file.sampleRate, blockSize);
+    if (gain >= 0.0f)
+        setParameter(processor, "gain", gain);
+    const int latency = processor.getLatencySamples();
+
+    juce::AudioBuffer<float> readBuffer(file.numChannels, blockSize);
+    juce::AudioBuffer<float> block(1, blockSize);
+    juce::MidiBuffer midi;
+
+    job.rendered.deleteFile();
+    juce::FileOutputStream rendered(job.rendered);
+    if (rendered.failedToOpen())
+        throw std::runtime_error("Could not create " + job.rendered.getFullPathName().toStdString());
+
+    const juce::int64 toProcess = job.length + latency;
+    for (juce::int64 pos = 0; pos < toProcess; pos += blockSize) {
+        const int numSamples = (int)std::min<juce::int64>(blockSize, toProcess - pos);
+        // Samples past the end of the file are read as zeros
+        reader->read(&readBuffer, 0, numSamples, job.start + pos, true, true);
+        block.setSize(1, numSamples, false, false, true);
+        block.copyFrom(0, 0, readBuffer, job.channel, 0, numSamples);
+
+        processor.processBlock(block, midi);
+
+        // Output sample i of this block belongs to input sample (pos + i - latency) of the job
+        const juce::int64 outStart = pos - latency;
+        const int skip = (int)std::max<juce::int64>(0, -outStart);
+        const int count = (int)std::min<juce::int64>(numSamples - skip, job.length - (outStart + skip));
+        if (count > 0 && !rendered.write(block.getReadPointer(0, skip), (size_t)count * sizeof(float)))
+            throw std::runtime_error("Could not write " + job.rendered.getFullPathName().toStdString());
+    }
+    rendered.flush();
+}
+
+/** Write the output WAV of a file from the sections rendered by its jobs, one block at a time */
+bool writeRenderedFile(const RenderFile& file, const std::vector<RenderJob>& jobs, int blockSize) {
+    juce::WavAudioFormat wavFormat;
+    file.output.deleteFile();
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(file.output.createOutputStream().release(), file.sampleRate, (unsigned int)file.numChannels, file.bitsPerSample, {}, 0));
+    if (writer == nullptr)
+        return false;
+
+    juce::AudioBuffer<float> block(file.numChannels, blockSize);
+    for (size_t j = file.firstJob; j < file.firstJob + file.numJobs; j += file.numChannels) {
+        // Jobs j to j + numChannels - 1 are the channels of the same section
+        std::vector<std::unique_ptr<juce::FileInputStream>> sections;
+        for (int channel = 0; channel < file.numChannels; ++channel) {
+            sections.push_back(std::make_unique<juce::FileInputStream>(jobs[j + channel].rendered));
+            if (sections.back()->failedToOpen())
+                return false;
+        }
+        for (juce::int64 pos = 0; pos < jobs[j].length; pos += blockSize) {
+            const int numSamples = (int)std::min<juce::int64>(blockSize, jobs[j].length - pos);
+            const int numBytes = numSamples * (int)sizeof(float);
+            for (int channel = 0; channel < file.numChannels; ++channel)
+                if (sections[channel]->read(block.getWritePointer(channel), numBytes) != numBytes)
+                    return false;
+            if (!writer->writeFromAudioSampleBuffer(block, 0, numSamples))
+                return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+void printOfflineRenderUsage() {
+    std::cout << "render <input.wav> [<input.wav> ...] --out <directory> [options]" << std::endl
+              << "    Render WAV files through the plugin processor, using all cores" << std::endl
+              << "    --block <samples>    Block size used for processBlock (default 64)" << std::endl
+              << "    --threads <n>        Number of worker threads (default: number of cores)" << std::endl
+              << "    --gain <0..1>        Normalised value of the gain parameter (default: processor default)" << std::endl
+              << "    --stateless          Split channels into chunks rendered in parallel (only for models without state)" << std::endl
+              << "    --chunk <seconds>    Chunk length for --stateless (default 10)" << std::endl;
+}
+
+int runOfflineRender(const juce::StringArray& args) {
+    const juce::File outputDir = juce::File::getCurrentWorkingDirectory().getChildFile(getOptionValue(args, "--out"));
+    const int blockSize = getOptionValue(args, "--block", "64").getIntValue();
+    const int numThreads = getOptionValue(args, "--threads", juce::String(juce::SystemStats::getNumCpus())).getIntValue();
+    const float gain = getOptionValue(args, "--gain", "-1").getFloatValue();
+    const bool stateless = args.contains("--stateless");
+    const double chunkSeconds = getOptionValue(args, "--chunk", "10").getDoubleValue();
+
+    if (!args.contains("--out") || blockSize <= 0 || numThreads <= 0 || chunkSeconds <= 0.0) {
+        printOfflineRenderUsage();
+        return 1;
+    }
+    outputDir.createDirectory();
+
+    // Positional arguments are input files
+    std::vector<RenderFile> files;
+    juce::WavAudioFormat wavFormat;
+    for (int i = 0; i < args.size(); ++i) {
+        if (args[i].startsWith("--")) {
+            if (args[i] != "--stateless")
+                ++i;  // Skip the option value
+            continue;
+        }
+        RenderFile file;
+        file.input = juce::File::getCurrentWorkingDirectory().getChildFile(args[i]);
+        std::unique_ptr<juce::AudioFormatReader> reader(wavFormat.createReaderFor(file.input.createInputStream().release(), true));
+        if (reader == nullptr) {
+            std::cerr << "Render\t|\tCould not open WAV file '" << file.input.getFullPathName() << "'" << std::endl;
+            return 1;
+        }
+        file.output = outputDir.getChildFile(file.input.getFileName());
+        file.sampleRate = reader->sampleRate;
+        file.numChannels = (int)reader->numChannels;
+        file.bitsPerSample = reader->usesFloatingPointData ? 32 : (int)reader->bitsPerSample;
+        file.length = reader->lengthInSamples;
+        files.push_back(std::move(file));
+    }
+    if (files.empty()) {
+        printOfflineRenderUsage();
+        return 1;
+    }
+
+    // Stateful models need every channel rendered from the start, stateless ones can be split further
+    std::vector<RenderJob> jobs;
+    double totalSeconds = 0.0;
+    for (int f = 0; f < (int)files.size(); ++f) {
+        const juce::int64 chunkLength = stateless ? std::max<juce::int64>(blockSize, (juce::int64)(chunkSeconds * files[f].sampleRate)) : files[f].length;
+        files[f].firstJob = jobs.size();
+        for (juce::int64 start = 0; start < files[f].length; start += chunkLength)
+            for (int channel = 0; channel < files[f].numChannels; ++channel) {
+                const juce::File rendered = outputDir.getChildFile(files[f].output.getFileName() + ".part" + juce::String((juce::int64)jobs.size()));
+                jobs.push_back({f, channel, start, std::min(chunkLength, files[f].length - start), rendered});
+            }
+        files[f].numJobs = jobs.size() - files[f].firstJob;
+        totalSeconds += files[f].length / files[f].sampleRate * files[f].numChannels;
+    }
+
+    // One processor (and interpreter) per worker, created upfront from the embedded model buffer
+    const auto setupStart = juce::Time::getMillisecondCounterHiRes();
+    const int numWorkers = std::min(numThreads, (int)jobs.size());
+    std::vector<std::unique_ptr<juce::AudioProcessor>> processors;
+    for (int w = 0; w < numWorkers; ++w)
+        processors.push_back(createPreparedProcessor(1, files[0].sampleRate, blockSize));
+    const auto renderStart = juce::Time::getMillisecondCounterHiRes();
+
+    std::atomic<size_t> nextJob{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> workers;
+    for (int w = 0; w < numWorkers; ++w) {
+        workers.emplace_back([&, w]() {
+            for (size_t j = nextJob++; j < jobs.size() && !failed; j = nextJob++) {
+                try {
+                    renderJob(*processors[w], files[jobs[j].file], jobs[j], blockSize, gain);
+                } catch (const std::exception& e) {
+                    std::cerr << "Render\t|\tWorker " << w << " failed: " << e.what() << std::endl;
+                    failed = true;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    const auto renderEnd = juce::Time::getMillisecondCounterHiRes();
+
+    for (const auto& file : files) {
+        if (!failed && !writeRenderedFile(file, jobs, blockSize)) {
+            std::cerr << "Render\t|\tCould not write '" << file.output.getFullPathName() << "'" << std::endl;
+            failed = true;
+        }
+    }
+    for (const auto& job : jobs)
+        job.rendered.deleteFile();
+    if (failed)
+        return 1;
+    const auto writeEnd = juce::Time::getMillisecondCounterHiRes();
+
+    const double renderSeconds = (renderEnd - renderStart) / 1000.0;
+    const double totalWallSeconds = (writeEnd - setupStart) / 1000.0;
+    std::cout << "Render\t|\tEngine: " << INFERENCE_TOOLS_ENGINE << " | Files: " << files.size() << " | Jobs: " << jobs.size() << " | Workers: " << numWorkers << " | Block size: " << blockSize << std::endl;
+    std::cout << "Render\t|\tAudio: " << totalSeconds << " channel-seconds | Setup: " << (renderStart - setupStart) / 1000.0 << " s | Render: " << renderSeconds << " s | Write: " << (writeEnd - renderEnd) / 1000.0 << " s" << std::endl;
+    std::cout << "Render\t|\tThroughput: " << totalSeconds / renderSeconds << "x real-time (processing) | " << totalSeconds / totalWallSeconds << "x real-time (overall)" << std::endl;
+    return 0;
+}
+
+}  // namespace InferenceTools
@@ -0,0 +1,31 @@
+/*
+ * Offline (faster than real-time) rendering of WAV files through the plugin processor
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Files are processed by the same AudioProcessor used in the plugin (createPluginFilter), so every processing mode
+ * compiled into the processor is available. Work is spread over all cores:
+ *  - stateful models (default): one job per file and channel, each rendered from start to end;
+ *  - stateless models (--stateless): every channel is further split into chunks rendered independently.
+ * Each worker thread owns a processor instance (and therefore its own interpreter), all created upfront from the
+ * same model buffer embedded as BinaryData. Input files are memory mapped and read one block at a time, and every job
+ * streams its output to a temporary file next to the outputs, interleaved into the output WAV one block at a time at
+ * the end. Files of any length are rendered with memory bounded by the block size.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'render' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code
+ */
+int runOfflineRender(const juce::StringArray& args);
+
+/** Print the usage of the 'render' command */
+void printOfflineRenderUsage();
+
+}  // namespace InferenceTools
@@ -0,0 +1,59 @@
+/*
+==============================================================================*/
+#include "OperatorProfiling.h"
+
+#include <iostream>
+#include <vector>
+
+#include "PluginProcessor.h"  // InferenceEngine API and saturation gain range of the example
+#include "ProcessorUtils.h"
+
+namespace InferenceTools {
+
+void printOperatorProfilingUsage() {
+    std::cout << "profile --out <prefix> [options]" << std::endl
+              << "    Time every operator of the embedded model, writing <prefix>.json (Chrome trace) and <prefix>.txt (summary)" << std::endl
+              << "    --invocations <n>    Number of invocations (default 10000)" << std::endl
+              << "    --gain <0..1>        Normalised gain fed to the model (default 0.25)" << std::endl;
+}
+
+int runOperatorProfiling(const juce::StringArray& args) {
+    const juce::String prefix = getOptionValue(args, "--out");
+    const int invocations = getOptionValue(args, "--invocations", "10000").getIntValue();
+    const float gain = getOptionValue(args, "--gain", "0.25").getFloatValue();
+    if (prefix.isEmpty() || invocations <= 0) {
+        printOperatorProfilingUsage();
+        return 1;
+    }
+
+    int modelSize;
+    const char* model = getEmbeddedModel(modelSize);
+    InferenceEngine::InterpreterPtr interpreter = InferenceEngine::createInterpreterFromBuffer(model, (size_t)modelSize, false, InferenceEngine::ThreadingConfig(), true);
+    const int batch = (int)InferenceEngine::getModelBatchSize(interpreter);
+    std::vector<float> inputVec(2 * batch), outputVec(batch);
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+
+    juce::Random random(1234);
+    for (int i = 0; i < invocations; ++i) {
+        for (int sample = 0; sample < batch; ++sample) {
+            inputVec[2 * sample] = random.nextFloat() * 2.0f - 1.0f;
+            inputVec[2 * sample + 1] = saturationGain;
+        }
+        InferenceEngine::invoke(interpreter, inputVec, outputVec);
+    }
+
+    const juce::File base = juce::File::getCurrentWorkingDirectory().getChildFile(prefix);
+    base.getParentDirectory().createDirectory();
+    const juce::String tracePath = base.getFullPathName() + ".json", summaryPath = base.getFullPathName() + ".txt";
+    const bool exported = InferenceEngine::exportProfile(interpreter, tracePath.toStdString(), summaryPath.toStdString());
+    InferenceEngine::deleteInterpreter(interpreter);
+    if (!exported) {
+        std::cerr << "Profile\t|\tCould not write the profile to '" << base.getFullPathName() << ".{json,txt}'" << std::endl;
+        return 1;
+    }
+
+    std::cout << juce::File(summaryPath).loadFileAsString() << "Profile\t|\tTrace written to '" << tracePath << "'" << std::endl;
+    return 0;
+}
+
+}  // namespace InferenceTools
@@ -0,0 +1,26 @@
+/*
+ * Per-operator profile of the model of the example
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Creates an interpreter with profiling enabled from the model embedded as BinaryData, runs it on random input at a
+ * fixed gain and exports the Chrome trace and the ranked summary of its operators (see opprofiler.h), to find the
+ * layers that dominate inference time on the target.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'profile' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code
+ */
+int runOperatorProfiling(const juce::StringArray& args);
+
+/** Print the usage of the 'profile' command */
+void printOperatorProfilingUsage();
+
+}  // namespace InferenceTools
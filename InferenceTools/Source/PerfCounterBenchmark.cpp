@@ -0,0 +1,141 @@
+/*
+==============================================================================*/
+#include "PerfCounterBenchmark.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "PluginProcessor.h"  // InferenceEngine API and saturation gain range of the example
+#include "ProcessorUtils.h"
+#include "perfcounters.h"
+
+namespace InferenceTools {
+
+namespace {
+
+/** Parse a comma separated list of positive integers */
+std::vector<int> parseSizes(const juce::String& list) {
+    std::vector<int> sizes;
+    for (const auto& token : juce::StringArray::fromTokens(list, ",", ""))
+        if (token.trim().getIntValue() > 0)
+            sizes.push_back(token.trim().getIntValue());
+    return sizes;
+}
+
+/** Write the totals of every region as CSV */
+bool writeCsv(const juce::File& file, const std::vector<InferenceEngine::PerfRegionStats>& stats) {
+    file.getParentDirectory().createDirectory();
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk())
+        return false;
+    stream.setPosition(0);
+    stream.truncate();
+    stream << "region,calls";
+    for (int counter = 0; counter < InferenceEngine::numPerfCounters; ++counter)
+        stream << "," << juce::String(InferenceEngine::getPerfCounterName(counter)).replace(" ", "_");
+    stream << "\n";
+    for (const auto& region : stats) {
+        stream << "\"" << region.name << "\"," << (juce::int64)region.calls;
+        for (uint64_t total : region.totals)
+            stream << "," << (juce::int64)total;
+        stream << "\n";
+    }
+    return true;
+}
+
+}  // namespace
+
+void printPerfCounterBenchmarkUsage() {
+    std::cout << "counters [options]" << std::endl
+              << "    Count cycles, instructions, cache and branch misses of processBlock and of the model invocations" << std::endl
+              << "    --blocks <list>      Block sizes of the processor, comma separated (default 32,64,128,256)" << std::endl
+              << "    --batches <list>     Batch sizes of the bare model, comma separated, for models with a dynamic batch (default 1,8,32,128)" << std::endl
+              << "    --threads <n>        Threads of the bare model (default 1)" << std::endl
+              << "    --seconds <s>        Audio processed at each size (default 10)" << std::endl
+              << "    --rate <hz>          Sample rate (default 48000)" << std::endl
+              << "    --channels <n>       1 or 2 (default 2)" << std::endl
+              << "    --gain <0..1>        Normalised gain parameter (default 0.5)" << std::endl
+              << "    --csv <path>         Write the totals of every region as CSV" << std::endl;
+}
+
+int runPerfCounterBenchmark(const juce::StringArray& args) {
+    const std::vector<int> blockSizes = parseSizes(getOptionValue(args, "--blocks", "32,64,128,256"));
+    const std::vector<int> batchSizes = parseSizes(getOptionValue(args, "--batches", "1,8,32,128"));
+    const int numThreads = getOptionValue(args, "--threads", "1").getIntValue();
+    const double seconds = getOptionValue(args, "--seconds", "10").getDoubleValue();
+    const double sampleRate = getOptionValue(args, "--rate", "48000").getDoubleValue();
+    const int numChannels = getOptionValue(args, "--channels", "2").getIntValue();
+    const float gain = getOptionValue(args, "--gain", "0.5").getFloatValue();
+    const juce::String csvPath = getOptionValue(args, "--csv");
+    if (seconds <= 0.0 || sampleRate <= 0.0 || numThreads <= 0 || (numChannels != 1 && numChannels != 2)) {
+        printPerfCounterBenchmarkUsage();
+        return 1;
+    }
+    if (!INFERENCE_PERF_COUNTERS) {
+        std::cerr << "Counters\t|\tThe tools were built without INFERENCE_PERF_COUNTERS" << std::endl;
+        return 1;
+    }
+    const int64_t numSamples = (int64_t)(seconds * sampleRate);
+    juce::Random random(1234);
+
+    // Processor: processBlock and the invocations it makes, with the warm-up of prepareToPlay excluded
+    for (int blockSize : blockSizes) {
+        auto processor = createPreparedProcessor(numChannels, sampleRate, blockSize);
+        setParameter(*processor, "gain", gain);
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+        juce::MidiBuffer midi;
+        InferenceEngine::setPerfCountersEnabled(true);
+        for (int64_t position = 0; position < numSamples; position += blockSize) {
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < blockSize; ++i)
+                    buffer.setSample(channel, i, 0.5f * std::sin(0.01f * (float)(position + i)) + 0.05f * (random.nextFloat() * 2.0f - 1.0f));
+            processor->processBlock(buffer, midi);
+        }
+        InferenceEngine::setPerfCountersEnabled(false);
+    }
+    std::vector<InferenceEngine::PerfRegionStats> stats = InferenceEngine::getPerfCounterStats();
+    std::cout << "Counters\t|\tProcessor, " << seconds << " s at each block size" << std::endl;
+    InferenceEngine::printPerfCounterReport(std::cout);
+    InferenceEngine::resetPerfCounters();
+
+    // Bare model at each batch size, on the same number of samples
+    int modelSize;
+    const char* model = getEmbeddedModel(modelSize);
+    InferenceEngine::ThreadingConfig threading;
+    threading.numThreads = numThreads;
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    for (int batchSize : batchSizes) {
+        InferenceEngine::InterpreterPtr interpreter = InferenceEngine::createInterpreterFromBuffer(model, (size_t)modelSize, false, threading);
+        if ((int)InferenceEngine::getModelBatchSize(interpreter) != batchSize && !InferenceEngine::setModelBatchSize(interpreter, (size_t)batchSize)) {
+            std::cout << "Counters\t|\tBatch " << batchSize << " skipped, the batch dimension of the model is fixed" << std::endl;
+            InferenceEngine::deleteInterpreter(interpreter);
+            continue;
+        }
+        std::vector<float> inputVec(2 * (size_t)batchSize), outputVec((size_t)batchSize);
+        InferenceEngine::setPerfCountersEnabled(true);
+        for (int64_t position = 0; position < numSamples; position += batchSize) {
+            for (int sample = 0; sample < batchSize; ++sample) {
+                inputVec[2 * (size_t)sample] = random.nextFloat() * 2.0f - 1.0f;
+                inputVec[2 * (size_t)sample + 1] = saturationGain;
+            }
+            InferenceEngine::invoke(interpreter, inputVec, outputVec);
+        }
+        InferenceEngine::setPerfCountersEnabled(false);
+        InferenceEngine::deleteInterpreter(interpreter);
+    }
+    std::cout << "Counters\t|\tModel, " << seconds << " s of samples at each batch size" << std::endl;
+    InferenceEngine::printPerfCounterReport(std::cout);
+    for (const auto& region : InferenceEngine::getPerfCounterStats())
+        stats.push_back(region);
+
+    if (csvPath.isNotEmpty()) {
+        const juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(csvPath);
+        if (!writeCsv(file, stats))
+            throw std::runtime_error("Could not write " + file.getFullPathName().toStdString());
+        std::cout << "Counters\t|\tTotals written to '" << file.getFullPathName() << "'" << std::endl;
+    }
+    return 0;
+}
+
+}  // namespace InferenceTools
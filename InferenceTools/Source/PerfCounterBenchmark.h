@@ -0,0 +1,27 @@
+/*
+ * Hardware performance counter benchmark
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Runs the processor at several block sizes and the bare model at several batch sizes with the performance counters
+ * of perfcounters.h enabled, and reports cycles, instructions, IPC and cache and branch misses per call, to choose
+ * block and batch sizes (and compare data layouts) on the target CPU. Needs the tools built with
+ * INFERENCE_PERF_COUNTERS=1 (the default of the tools projects).
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'counters' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code
+ */
+int runPerfCounterBenchmark(const juce::StringArray& args);
+
+/** Print the usage of the 'counters' command */
+void printPerfCounterBenchmarkUsage();
+
+}  // namespace InferenceTools
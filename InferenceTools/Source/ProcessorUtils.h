@@ -0,0 +1,76 @@
+/*
+ * Helpers shared by the command line tools to drive the plugin processor outside of a host
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// Defined in the PluginProcessor.cpp of the example the tools are compiled with
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter();
+
+namespace InferenceTools {
+
+/**
+ * @brief Create a processor instance and prepare it with the requested layout (do not use in real time threads!)
+ *
+ * @param numChannels Number of input/output channels (mono or stereo)
+ * @param sampleRate  Sample rate
+ * @param blockSize   Maximum block size
+ * @return std::unique_ptr<juce::AudioProcessor>
+ */
+inline std::unique_ptr<juce::AudioProcessor> createPreparedProcessor(int numChannels, double sampleRate, int blockSize) {
+    std::unique_ptr<juce::AudioProcessor> processor(createPluginFilter());
+    auto channelSet = (numChannels == 1) ? juce::AudioChannelSet::mono() : juce::AudioChannelSet::stereo();
+    juce::AudioProcessor::BusesLayout layout;
+    layout.inputBuses.add(channelSet);
+    layout.outputBuses.add(channelSet);
+    if (!processor->setBusesLayout(layout))
+        throw std::runtime_error("The processor does not support " + std::to_string(numChannels) + " channels");
+    processor->setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor->prepareToPlay(sampleRate, blockSize);
+    return processor;
+}
+
+/**
+ * @brief Set a parameter by ID, using its normalised value
+ *
+ * @return bool False if no parameter has the given ID
+ */
+inline bool setParameter(juce::AudioProcessor& processor, const juce::String& paramID, float normalisedValue) {
+    for (auto* parameter : processor.getParameters()) {
+        if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*>(parameter)) {
+            if (withID->paramID == paramID) {
+                withID->setValue(normalisedValue);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get the model embedded as BinaryData (INFERENCE_TOOLS_MODEL is the original file name)
+ *
+ * @param size Size of the model in bytes
+ * @return const char* Model buffer, owned by BinaryData
+ */
+inline const char* getEmbeddedModel(int& size) {
+    for (int i = 0; i < BinaryData::namedResourceListSize; i++)
+        if (juce::String(BinaryData::originalFilenames[i]) == INFERENCE_TOOLS_MODEL)
+            return BinaryData::getNamedResource(BinaryData::namedResourceList[i], size);
+    throw std::runtime_error(std::string("Model ") + INFERENCE_TOOLS_MODEL + " not found in BinaryData");
+}
+
+/** Return the value following 'option' in args, or defaultValue if the option is missing */
+inline juce::String getOptionValue(const juce::StringArray& args, const juce::String& option, const juce::String& defaultValue = {}) {
+    const int index = args.indexOf(option);
+    if (index >= 0 && index + 1 < args.size())
+        return args[index + 1];
+    return defaultValue;
+}
+
+}  // namespace InferenceTools
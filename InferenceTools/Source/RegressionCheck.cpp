@@ -0,0 +1,557 @@
+/*
+==============================================================================*/
+#include "RegressionCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PluginProcessor.h"  // InferenceEngine API and saturation gain range of the example
+#include "ProcessorUtils.h"
+#include "curvetable.h"
+#include "fixedframeadapter.h"
+#include "modelengine.h"
+
+// Set by the tools of the engines that can extract the layers of the model (see getDenseLayers and conditionedmlp.h)
+#ifndef INFERENCE_TOOLS_NATIVE_MODEL
+    #define INFERENCE_TOOLS_NATIVE_MODEL 0
+#endif
+
+namespace InferenceTools {
+
+namespace {
+
+/**
+ * Render a mono input at a given (normalised) gain, returning the processing time in seconds (setup excluded).
+ * The model file is the one listed for the engine in the configuration of the mode, if the mode needs one.
+ */
+using RenderFunction = double (*)(const juce::AudioBuffer<float>& input, double sampleRate, float gain, const juce::File& modelFile, juce::AudioBuffer<float>& output);
+
+/** Interpreter of the embedded model (or of a model file), invoked on frames of its batch size */
+struct EmbeddedModel {
+    explicit EmbeddedModel(const juce::File& modelFile = juce::File()) {
+        if (modelFile != juce::File()) {
+            interpreter = InferenceEngine::createInterpreter(modelFile.getFullPathName().toStdString(), false);
+        } else {
+            int modelSize;
+            const char* model = getEmbeddedModel(modelSize);
+            interpreter = InferenceEngine::createInterpreterFromBuffer(model, (size_t)modelSize, false);
+        }
+        batch = (int)InferenceEngine::getModelBatchSize(interpreter);
+        inputVec.resize(2 * batch);
+        outputVec.resize(batch);
+    }
+    ~EmbeddedModel() { InferenceEngine::deleteInterpreter(interpreter); }
+
+    /** Process numSamples samples (at most batch, the rest of the frame is zero) */
+    void processFrame(const float* in, float* out, int numSamples, float saturationGain) {
+        for (int i = 0; i < batch; ++i) {
+            inputVec[2 * i] = (i < numSamples) ? in[i] : 0.0f;
+            inputVec[2 * i + 1] = saturationGain;
+        }
+        InferenceEngine::invoke(interpreter, inputVec, outputVec);
+        std::copy(outputVec.begin(), outputVec.begin() + numSamples, out);
+    }
+
+    InferenceEngine::InterpreterPtr interpreter = nullptr;
+    int batch = 1;
+    std::vector<float> inputVec, outputVec;
+
+    EmbeddedModel(const EmbeddedModel&) = delete;
+    EmbeddedModel& operator=(const EmbeddedModel&) = delete;
+};
+
+/**
+ * Run processBlock(float* samples, int numSamples) in place with the block sizes returned by nextBlockSize,
+ * compensating its latency, and return the processing time in seconds
+ */
+template <typename BlockSizeGenerator, typename BlockFunction>
+double renderBlocks(const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output, int latency, BlockSizeGenerator nextBlockSize, BlockFunction processBlock) {
+    const int numSamples = input.getNumSamples();
+    juce::AudioBuffer<float> padded(1, numSamples + latency);
+    padded.clear();
+    padded.copyFrom(0, 0, input, 0, 0, numSamples);
+
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+    for (int pos = 0; pos < padded.getNumSamples();) {
+        const int blockSize = std::min(nextBlockSize(), padded.getNumSamples() - pos);
+        processBlock(padded.getWritePointer(0, pos), blockSize);
+        pos += blockSize;
+    }
+    const auto end = juce::Time::getMillisecondCounterHiRes();
+
+    output.copyFrom(0, 0, padded, 0, latency, numSamples);
+    return (end - start) / 1000.0;
+}
+
+/** Block sizes between 1 and 512, the same sequence at every run */
+struct VariableBlockSizes {
+    juce::Random random{1234};
+    int operator()() { return random.nextInt({1, 513}); }
+};
+
+/** Direct invocation of the engine, without the processor, in frames of the model batch size */
+double renderEngine(const juce::AudioBuffer<float>& input, double, float gain, const juce::File& modelFile, juce::AudioBuffer<float>& output) {
+    EmbeddedModel model(modelFile);
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+
+    const int numSamples = input.getNumSamples();
+    const float* in = input.getReadPointer(0);
+    float* out = output.getWritePointer(0);
+
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+    for (int frameStart = 0; frameStart < numSamples; frameStart += model.batch)
+        model.processFrame(in + frameStart, out + frameStart, std::min(model.batch, numSamples - frameStart), saturationGain);
+    const auto end = juce::Time::getMillisecondCounterHiRes();
+    return (end - start) / 1000.0;
+}
+
+/** The engine through a ModelEngine: the frames are written to the input tensor and read from the output tensor in place */
+double renderModelEngine(const juce::AudioBuffer<float>& input, double, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    EmbeddedModel model;
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    InferenceEngine::ModelEngine<InferenceEngine::INFERENCE_TOOLS_BACKEND> engine;
+    engine.bind(model.interpreter, 2 * (size_t)model.batch, (size_t)model.batch);
+
+    const int numSamples = input.getNumSamples();
+    const float* in = input.getReadPointer(0);
+    float* out = output.getWritePointer(0);
+
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+    for (int frameStart = 0; frameStart < numSamples; frameStart += model.batch) {
+        const int frameSize = std::min(model.batch, numSamples - frameStart);
+        float* frameInput = engine.input();
+        for (int i = 0; i < model.batch; ++i) {
+            frameInput[2 * i] = (i < frameSize) ? in[frameStart + i] : 0.0f;
+            frameInput[2 * i + 1] = saturationGain;
+        }
+        engine.run();
+        std::copy(engine.output(), engine.output() + frameSize, out + frameStart);
+    }
+    const auto end = juce::Time::getMillisecondCounterHiRes();
+    return (end - start) / 1000.0;
+}
+
+/** Run the processor with the block sizes returned by nextBlockSize, compensating its latency */
+template <typename BlockSizeGenerator>
+double renderProcessor(const juce::AudioBuffer<float>& input, double sampleRate, float gain, juce::AudioBuffer<float>& output, int maxBlockSize, BlockSizeGenerator nextBlockSize) {
+    auto processor = createPreparedProcessor(1, sampleRate, maxBlockSize);
+    setParameter(*processor, "gain", gain);
+    juce::MidiBuffer midi;
+    return renderBlocks(input, output, processor->getLatencySamples(), nextBlockSize, [&](float* samples, int numSamples) {
+        juce::AudioBuffer<float> block(&samples, 1, numSamples);
+        processor->processBlock(block, midi);
+    });
+}
+
+double renderProcessorFixed(const juce::AudioBuffer<float>& input, double sampleRate, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    return renderProcessor(input, sampleRate, gain, output, 64, []() { return 64; });
+}
+
+double renderProcessorVariable(const juce::AudioBuffer<float>& input, double sampleRate, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    return renderProcessor(input, sampleRate, gain, output, 512, VariableBlockSizes());
+}
+
+/** The engine behind a FixedFrameAdapter of the model batch size, with variable blocks */
+double renderFrameAdapter(const juce::AudioBuffer<float>& input, double, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    EmbeddedModel model;
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    InferenceEngine::FixedFrameAdapter adapter;
+    adapter.prepare(model.batch);
+    return renderBlocks(input, output, adapter.getLatencySamples(), VariableBlockSizes(), [&](float* samples, int numSamples) {
+        adapter.process(samples, numSamples, [&](const float* frameIn, float* frameOut, int frameSize) { model.processFrame(frameIn, frameOut, frameSize, saturationGain); });
+    });
+}
+
+/** The frame adapter behind a ResamplingStage, with the model at twice the rate of the input (see MODEL_SAMPLE_RATE) */
+double renderResampled(const juce::AudioBuffer<float>& input, double sampleRate, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    EmbeddedModel model;
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    InferenceEngine::FixedFrameAdapter adapter;
+    adapter.prepare(model.batch);
+    InferenceEngine::ResamplingStage resampling;
+    resampling.prepare(sampleRate, 2.0 * sampleRate, 512);
+    const int latency = resampling.getLatencySamples() + (int)std::lround(adapter.getLatencySamples() / 2.0);
+    return renderBlocks(input, output, latency, VariableBlockSizes(), [&](float* samples, int numSamples) {
+        resampling.process(samples, numSamples, [&](float* modelSamples, int numModelSamples) {
+            adapter.process(modelSamples, numModelSamples, [&](const float* frameIn, float* frameOut, int frameSize) { model.processFrame(frameIn, frameOut, frameSize, saturationGain); });
+        });
+    });
+}
+
+/** Clients of a SharedInferenceScheduler on the shared interpreter, each one with its own fallback interpreter */
+struct SchedulerClients {
+    static constexpr int maxBlockSize = 512;
+
+    SchedulerClients(int numClients, double sampleRate) : sharedModel(std::make_unique<EmbeddedModel>()), scheduler(sharedModel->interpreter) {
+        // The scheduler takes the ownership of the shared interpreter
+        sharedModel->interpreter = nullptr;
+        const int batchTimeoutUs = (int)(1e6 * 0.05 * maxBlockSize / sampleRate);  // As SHARED_SCHEDULER_TIMEOUT in the processors
+        for (int i = 0; i < numClients; ++i) {
+            fallbackModels.push_back(std::make_unique<EmbeddedModel>());
+            clients.push_back(scheduler.registerClient(maxBlockSize, fallbackModels.back()->interpreter, batchTimeoutUs));
+            if (clients.back() < 0)
+                throw std::runtime_error("The batch size of the model cannot be changed, the shared scheduler cannot run it");
+        }
+    }
+    ~SchedulerClients() {
+        for (int client : clients)
+            if (client >= 0)
+                scheduler.unregisterClient(client);
+    }
+
+    std::unique_ptr<EmbeddedModel> sharedModel;
+    InferenceEngine::SharedInferenceScheduler scheduler;
+    std::vector<std::unique_ptr<EmbeddedModel>> fallbackModels;
+    std::vector<int> clients;
+};
+
+/**
+ * Two clients of a SharedInferenceScheduler in the same thread, with variable blocks: every period both process the
+ * block and the second one runs the batch. The output of each block is taken from the clients in turn.
+ */
+double renderSharedScheduler(const juce::AudioBuffer<float>& input, double sampleRate, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    SchedulerClients scheduler(2, sampleRate);
+    std::vector<std::vector<float>> blocks(scheduler.clients.size(), std::vector<float>(SchedulerClients::maxBlockSize));
+    int blockIndex = 0;
+    return renderBlocks(input, output, SchedulerClients::maxBlockSize, VariableBlockSizes(), [&](float* samples, int numSamples) {
+        for (size_t c = 0; c < blocks.size(); ++c) {
+            std::copy(samples, samples + numSamples, blocks[c].begin());
+            scheduler.scheduler.process(scheduler.clients[c], blocks[c].data(), numSamples, saturationGain);
+        }
+        const auto& block = blocks[(size_t)blockIndex++ % blocks.size()];
+        std::copy(block.begin(), block.begin() + numSamples, samples);
+    });
+}
+
+/** Releases the threads when all of them have finished the current period */
+class PeriodBarrier {
+public:
+    explicit PeriodBarrier(int numThreads) : numThreads(numThreads) {}
+
+    void arriveAndWait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const int period = currentPeriod;
+        if (++arrived == numThreads) {
+            arrived = 0;
+            ++currentPeriod;
+            condition.notify_all();
+        } else {
+            condition.wait(lock, [this, period]() { return currentPeriod != period; });
+        }
+    }
+
+private:
+    const int numThreads;
+    int arrived = 0, currentPeriod = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+/**
+ * Four clients of a SharedInferenceScheduler, each one in its own thread, in step with variable blocks: the clients
+ * race to submit, wait for the batch running on another thread and fall back to their own interpreter on timeout.
+ * The output is taken from the clients in turn, every 512 samples.
+ */
+double renderSharedSchedulerThreads(const juce::AudioBuffer<float>& input, double sampleRate, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    SchedulerClients scheduler(4, sampleRate);
+    const int numClients = (int)scheduler.clients.size();
+    PeriodBarrier barrier(numClients);
+    std::vector<juce::AudioBuffer<float>> outputs((size_t)numClients, juce::AudioBuffer<float>(1, input.getNumSamples()));
+    std::vector<double> seconds((size_t)numClients, 0.0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < numClients; ++c) {
+        threads.emplace_back([&, c]() {
+            seconds[(size_t)c] = renderBlocks(input, outputs[(size_t)c], SchedulerClients::maxBlockSize, VariableBlockSizes(), [&](float* samples, int numSamples) {
+                scheduler.scheduler.process(scheduler.clients[(size_t)c], samples, numSamples, saturationGain);
+                barrier.arriveAndWait();
+            });
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    const int segment = SchedulerClients::maxBlockSize;
+    for (int pos = 0; pos < input.getNumSamples(); pos += segment)
+        output.copyFrom(0, pos, outputs[(size_t)(pos / segment % numClients)], 0, pos, std::min(segment, input.getNumSamples() - pos));
+    return *std::max_element(seconds.begin(), seconds.end());
+}
+
+/** The model as the only stage of an InferencePipeline, in blocks of 64 */
+double renderPipeline(const juce::AudioBuffer<float>& input, double, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    EmbeddedModel model;
+    InferenceEngine::InferencePipeline pipeline;  // Destroyed first, its workers stop before the interpreter is deleted
+    pipeline.addOutput(pipeline.addModel("saturation", model.interpreter, {pipeline.addInput("input")}, &saturationGain, 1));
+    pipeline.prepare(64);
+    return renderBlocks(input, output, 0, []() { return 64; }, [&](float* samples, int numSamples) { pipeline.process(&samples, &samples, numSamples); });
+}
+
+#if (INFERENCE_TOOLS_NATIVE_MODEL)
+/** The layers of the model evaluated natively by a ConditionedMlp, with the gain folded (see USE_FOLDED_CONDITIONING) */
+double renderFolded(const juce::AudioBuffer<float>& input, double, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    EmbeddedModel model;
+    std::vector<InferenceEngine::DenseLayer> layers;
+    InferenceEngine::ConditionedMlp foldedModel;
+    if (!InferenceEngine::getDenseLayers(model.interpreter, layers) || !foldedModel.prepare(layers, {1}))
+        throw std::runtime_error("The model is not a chain of dense layers, it cannot be folded");
+    foldedModel.setConditioning(&saturationGain);
+    return renderBlocks(input, output, 0, []() { return 64; }, [&](float* samples, int numSamples) { foldedModel.process(samples, samples, numSamples); });
+}
+#endif
+
+/** The model sampled into a CurveTable (the table tier of USE_QUALITY_TIERS), in blocks of 64 */
+double renderCurveTable(const juce::AudioBuffer<float>& input, double, float gain, const juce::File&, juce::AudioBuffer<float>& output) {
+    const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    EmbeddedModel model;
+    InferenceEngine::CurveTable table;
+    table.build(
+        [&model](const float* inputs, float* outputs, int numSamples, float tableGain) {
+            for (int start = 0; start < numSamples; start += model.batch)
+                model.processFrame(inputs + start, outputs + start, std::min(model.batch, numSamples - start), tableGain);
+        },
+        MIN_SAT_GAIN, MIN_SAT_GAIN + MAX_SAT_GAIN);
+    return renderBlocks(input, output, 0, []() { return 64; }, [&](float* samples, int numSamples) {
+        table.setGain(saturationGain);
+        table.process(samples, samples, numSamples);
+    });
+}
+
+struct Mode {
+    const char* name;
+    RenderFunction render;    // nullptr if the mode is not available with this engine
+    bool needsModel = false;  // Runs the model file listed for the engine in the configuration of the mode
+};
+
+/** Processing modes that can be listed in the check configuration */
+const Mode availableModes[] = {
+    {"engine", renderEngine},
+    {"model-engine", renderModelEngine},
+    {"processor-64", renderProcessorFixed},
+    {"processor-variable", renderProcessorVariable},
+    {"frame-adapter", renderFrameAdapter},
+    {"resampled", renderResampled},
+    {"shared-scheduler", renderSharedScheduler},
+    {"shared-scheduler-threads", renderSharedSchedulerThreads},
+    {"pipeline", renderPipeline},
+#if (INFERENCE_TOOLS_NATIVE_MODEL)
+    {"folded", renderFolded},
+#else
+    {"folded", nullptr},
+#endif
+    {"curve-table", renderCurveTable},
+    {"quantized", renderEngine, true},
+};
+
+/** A mode listed in the configuration */
+struct CheckedMode {
+    const Mode* mode;
+    float tolerance;
+    juce::File modelFile;
+};
+
+const Mode* findMode(const juce::String& name) {
+    for (const auto& mode : availableModes)
+        if (name == mode.name)
+            return &mode;
+    return nullptr;
+}
+
+float maxAbsDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b) {
+    float maxDiff = 0.0f;
+    const int numSamples = std::min(a.getNumSamples(), b.getNumSamples());
+    for (int i = 0; i < numSamples; ++i)
+        maxDiff = std::max(maxDiff, std::abs(a.getSample(0, i) - b.getSample(0, i)));
+    return maxDiff;
+}
+
+bool readMonoWav(const juce::File& file, juce::AudioBuffer<float>& buffer, double& sampleRate) {
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatReader> reader(wavFormat.createReaderFor(file.createInputStream().release(), true));
+    if (reader == nullptr)
+        return false;
+    sampleRate = reader->sampleRate;
+    buffer.setSize(1, (int)reader->lengthInSamples);
+    // Multichannel files are mixed to mono
+    return reader->read(&buffer, 0, (int)reader->lengthInSamples, 0, true, true);
+}
+
+bool writeMonoWav(const juce::File& file, const juce::AudioBuffer<float>& buffer, double sampleRate) {
+    file.getParentDirectory().createDirectory();
+    file.deleteFile();
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(file.createOutputStream().release(), sampleRate, 1, 32, {}, 0));
+    return writer != nullptr && writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+}
+
+}  // namespace
+
+void printRegressionCheckUsage() {
+    std::cout << "check [--config <file>] [--update-reference] [--update-baseline]" << std::endl
+              << "    Compare every processing mode with the stored references and timing baseline" << std::endl
+              << "    --config <file>       Check configuration (default: check/check_config.json)" << std::endl
+              << "    --update-reference    Store the output of the reference mode as the new reference" << std::endl
+              << "    --update-baseline     Store the measured timings as the new baseline for this engine" << std::endl
+              << "    Missing references and baseline are created by the first run" << std::endl;
+}
+
+int runRegressionCheck(const juce::StringArray& args) {
+    const juce::File configFile = juce::File::getCurrentWorkingDirectory().getChildFile(getOptionValue(args, "--config", "check/check_config.json"));
+    const bool updateReference = args.contains("--update-reference");
+    const bool updateBaseline = args.contains("--update-baseline");
+
+    const juce::var config = juce::JSON::parse(configFile);
+    if (!config.isObject()) {
+        std::cerr << "Check\t|\tCould not parse configuration '" << configFile.getFullPathName() << "'" << std::endl;
+        return 1;
+    }
+    const juce::File baseDir = configFile.getParentDirectory();
+    const juce::File inputFile = baseDir.getChildFile(config["input"].toString());
+    const juce::File referenceDir = baseDir.getChildFile(config["referenceDirectory"].toString());
+    const juce::File baselineFile = baseDir.getChildFile(juce::String("baseline_") + INFERENCE_TOOLS_ENGINE + ".json");
+    const juce::String referenceMode = config["referenceMode"].toString();
+    const float analyticTolerance = (float)config["analyticTolerance"];
+    const double regressionThreshold = (double)config["regressionThreshold"];
+    const int timingRepetitions = std::max(1, (int)config["timingRepetitions"]);
+    const float timingGain = (float)config["timingGain"];
+
+    juce::AudioBuffer<float> input;
+    double sampleRate;
+    if (!readMonoWav(inputFile, input, sampleRate)) {
+        std::cerr << "Check\t|\tCould not read input '" << inputFile.getFullPathName() << "'" << std::endl;
+        return 1;
+    }
+    const double inputSeconds = input.getNumSamples() / sampleRate;
+
+    std::vector<CheckedMode> modes;
+    if (auto* modesObject = config["modes"].getDynamicObject()) {
+        for (const auto& entry : modesObject->getProperties()) {
+            const Mode* mode = findMode(entry.name.toString());
+            if (mode == nullptr) {
+                std::cerr << "Check\t|\tUnknown mode '" << entry.name.toString() << "' in configuration" << std::endl;
+                return 1;
+            }
+            if (mode->render == nullptr) {
+                std::cout << "Check\t|\tMode '" << mode->name << "' is not available with " << INFERENCE_TOOLS_ENGINE << ", skipped" << std::endl;
+                continue;
+            }
+            juce::File modelFile;
+            if (mode->needsModel) {
+                const juce::String modelPath = entry.value["model"][INFERENCE_TOOLS_ENGINE].toString();
+                modelFile = baseDir.getChildFile(modelPath);
+                if (modelPath.isEmpty() || !modelFile.existsAsFile()) {
+                    std::cout << "Check\t|\tMode '" << mode->name << "' has no model for " << INFERENCE_TOOLS_ENGINE << (modelPath.isEmpty() ? juce::String() : " ('" + modelFile.getFullPathName() + "' not found)") << ", skipped" << std::endl;
+                    continue;
+                }
+            }
+            modes.push_back({mode, (float)entry.value["tolerance"], modelFile});
+        }
+    }
+
+    if (modes.empty() || config["gains"].getArray() == nullptr) {
+        std::cerr << "Check\t|\tThe configuration must list 'modes' and 'gains'" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Check\t|\tEngine: " << INFERENCE_TOOLS_ENGINE << " | Input: " << inputFile.getFileName() << " | Modes: " << modes.size() << std::endl;
+    int failures = 0;
+    bool referencesCreated = false;
+    juce::AudioBuffer<float> output(1, input.getNumSamples()), analytic(1, input.getNumSamples()), reference;
+
+    // Numerical checks
+    for (const auto& gainVar : *config["gains"].getArray()) {
+        const float gain = (float)gainVar;
+        const float saturationGain = gain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+        for (int i = 0; i < input.getNumSamples(); ++i)
+            analytic.setSample(0, i, std::tanh(saturationGain * input.getSample(0, i)));
+
+        // The first run renders the missing references, which then have to be committed
+        const juce::File referenceFile = referenceDir.getChildFile("gain_" + juce::String(gain, 2) + ".wav");
+        if (updateReference || !referenceFile.existsAsFile()) {
+            const Mode* mode = findMode(referenceMode);
+            if (mode == nullptr || mode->render == nullptr || mode->needsModel) {
+                std::cerr << "Check\t|\tUnknown reference mode '" << referenceMode << "'" << std::endl;
+                return 1;
+            }
+            mode->render(input, sampleRate, gain, juce::File(), output);
+            if (!writeMonoWav(referenceFile, output, sampleRate)) {
+                std::cerr << "Check\t|\tCould not write reference '" << referenceFile.getFullPathName() << "'" << std::endl;
+                return 1;
+            }
+            std::cout << "Check\t|\t" << (updateReference ? "Reference updated: " : "No reference, created: ") << referenceFile.getFileName() << " (mode " << referenceMode << ")" << std::endl;
+            referencesCreated = referencesCreated || !updateReference;
+        }
+        double referenceRate;
+        const bool hasReference = readMonoWav(referenceFile, reference, referenceRate) && reference.getNumSamples() == input.getNumSamples();
+        if (!hasReference) {
+            std::cerr << "Check\t|\tUnreadable reference for gain " << gain << ", or not rendered from this input (run check/update_reference.sh)" << std::endl;
+            ++failures;
+        }
+
+        for (const auto& [mode, tolerance, modelFile] : modes) {
+            mode->render(input, sampleRate, gain, modelFile, output);
+            const float analyticError = maxAbsDifference(output, analytic);
+            const bool analyticOk = analyticError <= analyticTolerance;
+            std::cout << "Check\t|\tgain " << gain << "\t| " << mode->name << "\t| tanh error: " << analyticError << (analyticOk ? " OK" : " FAIL");
+            failures += analyticOk ? 0 : 1;
+            if (hasReference) {
+                const float referenceError = maxAbsDifference(output, reference);
+                const bool referenceOk = referenceError <= tolerance;
+                std::cout << "\t| reference error: " << referenceError << " (tolerance " << tolerance << ")" << (referenceOk ? " OK" : " FAIL");
+                failures += referenceOk ? 0 : 1;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    // Timing checks (median of the repetitions, as seconds of processing per second of audio)
+    // The first run on a machine stores its timings as the baseline, the next runs are checked against it
+    const bool createBaseline = !updateBaseline && !baselineFile.existsAsFile();
+    const bool writeBaseline = updateBaseline || createBaseline;
+    const juce::var baseline = juce::JSON::parse(baselineFile);
+    auto* newBaseline = new juce::DynamicObject();
+    for (const auto& [mode, tolerance, modelFile] : modes) {
+        juce::ignoreUnused(tolerance);
+        std::vector<double> loads;
+        for (int r = 0; r < timingRepetitions; ++r)
+            loads.push_back(mode->render(input, sampleRate, timingGain, modelFile, output) / inputSeconds);
+        std::sort(loads.begin(), loads.end());
+        const double load = loads[loads.size() / 2];
+        newBaseline->setProperty(mode->name, load);
+
+        std::cout << "Check\t|\ttiming\t| " << mode->name << "\t| " << load << " s/s (" << 1.0 / load << "x real-time)";
+        const juce::var baselineLoad = baseline[mode->name];
+        if (!writeBaseline && !baselineLoad.isVoid()) {
+            const double limit = (double)baselineLoad * (1.0 + regressionThreshold);
+            const bool timingOk = load <= limit;
+            std::cout << "\t| baseline: " << (double)baselineLoad << " (limit " << limit << ")" << (timingOk ? " OK" : " FAIL");
+            failures += timingOk ? 0 : 1;
+        } else if (!writeBaseline) {
+            std::cout << "\t| no baseline (run with --update-baseline)";
+        }
+        std::cout << std::endl;
+    }
+    const juce::var newBaselineVar(newBaseline);
+    if (writeBaseline) {
+        if (!baselineFile.replaceWithText(juce::JSON::toString(newBaselineVar))) {
+            std::cerr << "Check\t|\tCould not write baseline '" << baselineFile.getFullPathName() << "'" << std::endl;
+            return 1;
+        }
+        std::cout << "Check\t|\t" << (updateBaseline ? "Baseline updated: " : "No baseline, created from this run (timings not checked): ") << baselineFile.getFileName() << std::endl;
+    }
+    if (referencesCreated)
+        std::cout << "Check\t|\tReferences created with " << INFERENCE_TOOLS_ENGINE << ": commit " << referenceDir.getFileName() << "/ and run the check with the other engine to compare the two" << std::endl;
+
+    std::cout << "Check\t|\t" << (failures == 0 ? "PASSED" : "FAILED") << " (" << failures << " failures)" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+}  // namespace InferenceTools
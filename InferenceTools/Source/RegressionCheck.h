@@ -0,0 +1,34 @@
+/*
+ * Numerical equivalence and performance regression check
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Runs a test file at several gain settings through every processing mode listed in the check configuration
+ * (check/check_config.json) and compares:
+ *  - the output with stored reference renders, within a per-mode tolerance. References are engine-independent WAV
+ *    files, so rendering them with one engine (--update-reference) and checking with the other one verifies that
+ *    TFLite and ONNX Runtime agree (check/update_reference.sh does both);
+ *  - the output with the function the model was trained on (tanh(gain * x)), within a looser tolerance;
+ *  - the processing time of each mode with a stored JSON baseline (--update-baseline), failing if any mode got
+ *    slower than the baseline by more than the regression threshold. Baselines are specific to engine and machine.
+ * Missing references and baseline are created by the first run, which reports it (and checks only against tanh).
+ *
+ * The exit code is non-zero if any check fails, so the command can be used as a local test target.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'check' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code (0 if every check passed)
+ */
+int runRegressionCheck(const juce::StringArray& args);
+
+/** Print the usage of the 'check' command */
+void printRegressionCheckUsage();
+
+}  // namespace InferenceTools
@@ -0,0 +1,125 @@
+/*
+==============================================================================*/
+#include "SnapshotReplay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "PluginProcessor.h"  // Black-box snapshots and saturation stage of the example
+#include "ProcessorUtils.h"
+
+namespace InferenceTools {
+
+namespace {
+
+/** Difference between two samples, where two NaNs are equal and a NaN differs infinitely from any number */
+float sampleDifference(float a, float b) {
+    if (std::isnan(a) || std::isnan(b))
+        return (std::isnan(a) && std::isnan(b)) ? 0.0f : std::numeric_limits<float>::infinity();
+    if (a == b)
+        return 0.0f;  // Also equal infinities
+    return std::abs(a - b);
+}
+
+}  // namespace
+
+void printSnapshotReplayUsage() {
+    std::cout << "replay <snapshot.bbox> [options]" << std::endl
+              << "    Replay a black-box snapshot through the saturation stage and compare the output with the recorded one" << std::endl
+              << "    --tolerance <x>      Largest difference accepted (default 0, bit-exact)" << std::endl
+              << "    --timing <path>      Write the time of every block as CSV" << std::endl;
+}
+
+int runSnapshotReplay(const juce::StringArray& args) {
+    if (args.isEmpty() || args[0].startsWith("--")) {
+        printSnapshotReplayUsage();
+        return 1;
+    }
+    const juce::File snapshotFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[0]);
+    const float tolerance = getOptionValue(args, "--tolerance", "0").getFloatValue();
+    const juce::String timingPath = getOptionValue(args, "--timing");
+
+    InferenceEngine::BlackBoxSnapshot snapshot;
+    if (!snapshot.read(snapshotFile.getFullPathName().toStdString()) || snapshot.blockSizes.empty())
+        throw std::runtime_error("Could not read the snapshot " + snapshotFile.getFullPathName().toStdString());
+    if (snapshot.numChannels > 2)
+        throw std::runtime_error("Snapshots with more than 2 channels are not supported");
+    const int numChannels = snapshot.numChannels, numSamples = snapshot.getNumSamples();
+    const int maxBlockSize = *std::max_element(snapshot.blockSizes.begin(), snapshot.blockSizes.end());
+    std::cout << "Replay\t|\tSnapshot '" << snapshotFile.getFileName() << "' (" << snapshot.reason << "): " << numChannels << " channel(s), " << numSamples << " samples ("
+              << std::fixed << std::setprecision(2) << numSamples / snapshot.sampleRate << " s) in " << snapshot.blockSizes.size() << " blocks at " << snapshot.sampleRate << " Hz" << std::endl;
+
+    auto processor = createPreparedProcessor(numChannels, snapshot.sampleRate, maxBlockSize);
+    // The snapshot holds the input of the saturation stage, so it skips the stages before it and the gain parameter
+    auto* saturator = dynamic_cast<INFERENCE_TOOLS_PROCESSOR*>(processor.get());
+    if (saturator == nullptr)
+        throw std::runtime_error("The processor has no saturation stage to replay");
+    const int latency = saturator->getSaturationLatencySamples();
+
+    juce::AudioBuffer<float> replayed(numChannels, numSamples);
+    for (int channel = 0; channel < numChannels; ++channel)
+        replayed.copyFrom(channel, 0, snapshot.input[channel].data(), numSamples);
+    std::vector<double> blockTimes;  // Microseconds
+    for (size_t block = 0, pos = 0; block < snapshot.blockSizes.size(); pos += snapshot.blockSizes[block++]) {
+        juce::AudioBuffer<float> view(replayed.getArrayOfWritePointers(), numChannels, (int)pos, snapshot.blockSizes[block]);
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        saturator->processSaturationStage(view, snapshot.gains[block]);
+        blockTimes.push_back((juce::Time::getMillisecondCounterHiRes() - start) * 1000.0);
+    }
+
+    // The first 'latency' output samples depend on input recorded before the snapshot
+    float maxDifference = 0.0f;
+    juce::int64 differing = 0, firstDifference = -1;
+    int recordedNonFinite = 0, replayedNonFinite = 0;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        for (int i = 0; i < numSamples; ++i) {
+            const float recorded = snapshot.output[channel][i], output = replayed.getSample(channel, i);
+            recordedNonFinite += !std::isfinite(recorded);
+            replayedNonFinite += !std::isfinite(output);
+            if (i < latency)
+                continue;
+            const float difference = sampleDifference(recorded, output);
+            maxDifference = std::max(maxDifference, difference);
+            if (difference > 0.0f) {
+                ++differing;
+                if (firstDifference < 0 || i < firstDifference)
+                    firstDifference = i;
+            }
+        }
+    }
+
+    std::vector<double> sortedTimes = blockTimes;
+    std::sort(sortedTimes.begin(), sortedTimes.end());
+    const size_t slowest = (size_t)(std::max_element(blockTimes.begin(), blockTimes.end()) - blockTimes.begin());
+    std::cout << "Replay\t|\tCompared " << (juce::int64)std::max(0, numSamples - latency) * numChannels << " samples (latency " << latency << ") | Max difference: " << std::scientific << std::setprecision(3) << maxDifference
+              << " | Differing samples: " << differing;
+    if (firstDifference >= 0)
+        std::cout << " (first at sample " << firstDifference << ")";
+    std::cout << " | Non-finite samples recorded/replayed: " << recordedNonFinite << "/" << replayedNonFinite << std::endl;
+    std::cout << "Replay\t|\tBlock time [us] median " << std::fixed << std::setprecision(2) << sortedTimes[sortedTimes.size() / 2] << " | 99th percentile " << sortedTimes[std::min(sortedTimes.size() - 1, sortedTimes.size() * 99 / 100)]
+              << " | max " << sortedTimes.back() << " (block " << slowest << ", " << snapshot.blockSizes[slowest] << " samples)" << std::endl;
+
+    if (timingPath.isNotEmpty()) {
+        const juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(timingPath);
+        file.getParentDirectory().createDirectory();
+        juce::FileOutputStream stream(file);
+        if (!stream.openedOk())
+            throw std::runtime_error("Could not write " + file.getFullPathName().toStdString());
+        stream.setPosition(0);
+        stream.truncate();
+        stream << "block,start,samples,gain,us\n";
+        for (size_t block = 0, pos = 0; block < blockTimes.size(); pos += snapshot.blockSizes[block++])
+            stream << (int)block << "," << (juce::int64)(snapshot.firstSample + pos) << "," << snapshot.blockSizes[block] << "," << snapshot.gains[block] << "," << blockTimes[block] << "\n";
+        std::cout << "Replay\t|\tBlock times written to '" << file.getFullPathName() << "'" << std::endl;
+    }
+
+    const bool passed = maxDifference <= tolerance;
+    std::cout << "Replay\t|\t" << (passed ? (maxDifference == 0.0f ? "Bit-exact" : "Within tolerance") : "DIFFERENT") << std::endl;
+    return passed ? 0 : 1;
+}
+
+}  // namespace InferenceTools
@@ -0,0 +1,29 @@
+/*
+ * Replay of black-box snapshots
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Feeds the input of a snapshot written by the black-box recorder of a plugin (see blackboxrecorder.h) to the
+ * saturation stage of the processor, with the recorded block sizes and gains, and compares the output with the recorded
+ * one. The gains go to the model as recorded, without the gain parameter, and the stages before the saturation (e.g.
+ * the STFT of the TFLite example) are skipped, since the snapshot already holds their output. Snapshots do not
+ * depend on the engine, so a snapshot recorded by one plugin can be replayed by the tools of either engine. The time
+ * of every block is measured too, to find the blocks that were slow live.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace InferenceTools {
+
+/**
+ * @brief Run the 'replay' command
+ *
+ * @param args Command line arguments following the command name
+ * @return int Process exit code (non-zero if the output differs from the recording by more than the tolerance)
+ */
+int runSnapshotReplay(const juce::StringArray& args);
+
+/** Print the usage of the 'replay' command */
+void printSnapshotReplayUsage();
+
+}  // namespace InferenceTools
@@ -0,0 +1,12 @@
+#!/bin/bash
+# Render the references of the regression check with the TFLite tools, then check the ONNX Runtime tools against them
+# Build both tools first (see README.md), then commit check/reference/
+# Usage: check/update_reference.sh [<directory of the built tools>] (default Builds/linux-x86_64/build)
+
+set -e
+
+cd "$(dirname "$0")/.."
+TOOLS_DIR=${1:-Builds/linux-x86_64/build}
+
+"$TOOLS_DIR/TFliteInferenceTools" check --config check/check_config.json --update-reference
+"$TOOLS_DIR/OnnxInferenceTools" check --config check/check_config.json
@@ -9,7 +9,7 @@
 
 typedef juce::AudioProcessorValueTreeState::SliderAttachment SliderAttachment;
 
-class OnnxSaturatorAudioProcessorEditor  : public juce::AudioProcessorEditor
+class OnnxSaturatorAudioProcessorEditor  : public juce::AudioProcessorEditor, private juce::Timer
 {
 public:
     OnnxSaturatorAudioProcessorEditor (OnnxSaturatorAudioProcessor&);
@@ -28,5 +28,10 @@ private:
     juce::Slider gainSlider;
     std::unique_ptr<SliderAttachment> gainSliderAttachment;
 
+    // Quality tier of the processor (see USE_QUALITY_TIERS) and error of the model loading, polled by the timer
+    int shownQualityTier = -1;
+    juce::String shownLoadingError;
+    void timerCallback() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OnnxSaturatorAudioProcessorEditor)
 };
@@ -1,19 +1,196 @@
 /*
  * This file contains the basic framework code for a JUCE plugin that uses the ONNX runtime for deep inference.
+ * Only stateless models are supported: resetModelState has nothing to clear (see onnxwrapper.h), so the resets of the
+ * silence gate, of the quality tiers and after the warm-up only restart the stages around the model.
 */
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
-#define MIN_SAT_GAIN 0.1f
-#define MAX_SAT_GAIN 200.0f
-
 // Load the model and init the interpreter
 // Load either from a file in the filesystem or from JUCE binary data
 // The second is suggested for cross-platform compatibility, as the first depends on the model being on a path that is local to the target machine
 #define LOAD_MODEL_FROM_FILE 0  // If 1 load from MODEL_PATH else load from binary data
-#define MODEL_PATH "/udata/model.onnx"
+// The minimal runtime (ReleaseMinimal configuration) only loads models converted to the ORT format by
+// libs/build_onnx_minimal.sh, add sample_data/saturation_model.ort to the binary data to use it
+#if (ONNX_MINIMAL_RUNTIME)
+    #define MODEL_PATH "/udata/model.ort"
+    #define MODEL_BINARY_NAME "saturation_model.ort"
+#else
+    #define MODEL_PATH "/udata/model.onnx"
+    #define MODEL_BINARY_NAME "saturation_model.onnx"
+#endif
 
+// Load the model in the background (see modelloader.h), so that the constructor returns immediately and the instances
+// of a rig load in parallel. Until the model is loaded and prepared, processBlock outputs MODEL_LOADING_FALLBACK
+#ifndef ASYNC_MODEL_LOADING
+    #define ASYNC_MODEL_LOADING 1  // The offline tools set it to 0, as they process right after construction
+#endif
+#define MODEL_LOADING_FALLBACK 0  // Output while loading: 0 for silence, 1 for the dry input
+#define MODEL_LOADING_VERBOSE 0   // If 1 print the details of the model while loading
+// Blocks of realistic input (a sine at the current gain) run through the model at the actual block size once it is
+// prepared, to warm the caches and the lazy allocations of ONNX Runtime before the first real block
+#define MODEL_WARMUP_BLOCKS 8
+
+// Native sample rate of the saturation model: the host signal is resampled to this rate and back around the model,
+// so that the model sees the rate it was trained at and runs fewer times at higher host rates (0 to use the host rate)
+#define MODEL_SAMPLE_RATE 0
+
+// Preload the weights of other models with the graph of the saturation model (e.g. one per pedal) and switch between
+// them per block with the PRESET_ID parameter, without reloading (see weightbank.h). Set 0 is the saturation model
+// itself, the others are read from WEIGHT_SET_PATHS (separated by ';'). Activations and state are kept across a switch.
+// Each set has its own curve table for USE_QUALITY_TIERS, the shared scheduler and the sidecar always use set 0
+#define USE_WEIGHT_SETS 0
+#define WEIGHT_SET_PATHS "/udata/saturation_pedal1.onnx;/udata/saturation_pedal2.onnx"
+#define MAX_WEIGHT_SETS 8
+
+// Run the saturation model of every channel, followed by the sample-wise models of PIPELINE_MODEL_PATHS (separated by
+// ';', e.g. a tone model), as one planned pipeline (see inferencepipeline.h) instead of chaining plugin instances.
+// The channels are batched in one invocation per model and block, and independent stages run on PIPELINE_NUM_THREADS - 1
+// workers (on INFERENCE_WORKER_AFFINITY). The pipeline has its own interpreters and processes whole blocks at the host
+// rate and without latency. It does not run the pre/post chain (see prepostchain.h): a saturation model whose metadata
+// declares a chain other than the identity disables the pipeline, and is processed by the regular saturation stage.
+#define USE_MODEL_PIPELINE 0
+#define PIPELINE_MODEL_PATHS "/udata/tone_model.onnx"
+#define PIPELINE_NUM_THREADS 1
+
+// Threads used by each model invocation, including the audio thread (see threadingconfig.h)
+// With more than one thread, pin the workers to cores that do not run real-time audio
+#define INFERENCE_NUM_THREADS 1
+#define INFERENCE_WORKER_AFFINITY 0x0  // Bitmask of the CPUs allowed for the worker threads (0 to inherit)
+#define INFERENCE_WORKER_SPIN 0        // If 1 idle workers busy-wait instead of blocking
+
+// Time every operator of the saturation model (see opprofiler.h), the profile is written to INFERENCE_PROFILE_PATH
+// .json (Chrome trace) and .txt (ranked summary) when the host releases the resources, e.g. when playback stops
+#define INFERENCE_PROFILING 0
+#define INFERENCE_PROFILE_PATH "/tmp/inference_profile"
+
+// Memory arena for the model input/output tensors and the staging buffers of the processor
+// It is locked in RAM and prefaulted at construction, so that the first blocks do not page fault
+#define MEMORY_ARENA_SIZE (64 * 1024)
+#define MEMORY_ARENA_HUGE_PAGES 0  // If 1 try to back the arena with huge pages
+
+// Run a single batched inference per audio period for all the instances of the plugin in the host process
+// Requires a model whose batch dimension can be resized, and adds one block of latency (see sharedscheduler.h)
+#define USE_SHARED_SCHEDULER 0
+// Longest wait for a batch running on another instance, as a fraction of the block period. The wait spins on the
+// audio thread, then the block is processed by this instance
+#define SHARED_SCHEDULER_TIMEOUT 0.05
+
+// Skip the saturation model on silent blocks and output its response to zero input instead (see silencegate.h)
+// The gate closes after the signal stays below SILENCE_GATE_CLOSE_DB for the latency of the model plus
+// SILENCE_GATE_MODEL_TAIL samples (the memory of stateful models, 0 for the sample-wise saturator)
+#define USE_SILENCE_GATE 0
+#define SILENCE_GATE_OPEN_DB -60.0f
+#define SILENCE_GATE_CLOSE_DB -70.0f
+#define SILENCE_GATE_MODEL_TAIL 0
+
+// Keep the last BLACKBOX_SECONDS of input, gain and output of the saturation model in memory (see blackboxrecorder.h)
+// A snapshot is written to BLACKBOX_PATH_<n>_<reason>.bbox BLACKBOX_POST_TRIGGER_SECONDS after an output sample is not
+// finite or exceeds BLACKBOX_TRIGGER_LEVEL (at most BLACKBOX_MAX_SNAPSHOTS times), or on requestBlackBoxSnapshot()
+// Snapshots are replayed with 'InferenceTools replay'
+#define USE_BLACKBOX_RECORDER 0
+#define BLACKBOX_SECONDS 10.0
+#define BLACKBOX_PATH "/tmp/blackbox"
+#define BLACKBOX_TRIGGER_LEVEL 1.5f
+#define BLACKBOX_POST_TRIGGER_SECONDS 1.0
+#define BLACKBOX_MAX_SNAPSHOTS 16
+
+// Run the saturation model in a separate process (see inferencesidecar.h), so that a crash of the engine does not take
+// down the host and the model runs on its own cores and memory limit. The sidecar is 'InferenceTools sidecar' built
+// for the same engine, a watchdog restarts it when it dies or stalls. The part of a block whose output does not
+// arrive within SIDECAR_TIMEOUT_US is replaced by SIDECAR_FALLBACK
+#define USE_INFERENCE_SIDECAR 0
+#define SIDECAR_EXECUTABLE "/udata/OnnxInferenceTools"
+#define SIDECAR_CPUS 0x0                // Bitmask of the CPUs of the sidecar (0 to inherit)
+#define SIDECAR_PRIORITY 0              // SCHED_FIFO priority of the sidecar (0 for the normal scheduler)
+#define SIDECAR_MEMORY_LIMIT_MB 0       // Address space limit of the sidecar (0 for none)
+#define SIDECAR_TIMEOUT_US 1000
+#define SIDECAR_MAX_MISSED_DEADLINES 8  // Missed in a row before the sidecar is restarted
+#define SIDECAR_FALLBACK 2              // 0 for silence, 1 for the dry input, 2 for tanh(gain * x), the curve the model approximates
+
+// Replace the saturation model with a table of its curve while processBlock takes too much of the block period, with
+// a crossfade between the two (see qualitytiers.h). The table is sampled from the model while loading, so it is only
+// valid for stateless sample-wise models. The current tier is shown by the editor and reported to the host (TIER_ID),
+// which is notified from the message thread
+#define USE_QUALITY_TIERS 0
+#define QUALITY_DEGRADE_LOAD 0.5f    // Fraction of the block period above which the table replaces the model
+#define QUALITY_DEGRADE_BLOCKS 2     // Consecutive blocks above QUALITY_DEGRADE_LOAD before switching
+#define QUALITY_RECOVER_LOAD 0.25f   // The model is restored once its predicted load stays below this fraction...
+#define QUALITY_RECOVER_SECONDS 2.0  // ...for this long
+#define QUALITY_CROSSFADE_MS 20.0
+
+#if (USE_QUALITY_TIERS) && (USE_INFERENCE_SIDECAR || USE_SHARED_SCHEDULER)
+    #error "The quality tiers run and restart the model of the instance, it cannot be in a sidecar or shared"
+#endif
+#if (USE_INFERENCE_SIDECAR) && (USE_SHARED_SCHEDULER || USE_SILENCE_GATE || INFERENCE_PROFILING)
+    #error "The shared scheduler, the silence gate and the profiler need the model in-process"
+#endif
+#if (USE_MODEL_PIPELINE) && (USE_INFERENCE_SIDECAR || USE_SHARED_SCHEDULER || USE_SILENCE_GATE || USE_QUALITY_TIERS || USE_WEIGHT_SETS || MODEL_SAMPLE_RATE)
+    #error "The pipeline replaces the saturation stage with its own interpreters, the other modes of the stage do not apply to it"
+#endif
+
+// Optional classifier run on a sliding matrix of log-mel or MFCC frames (one row per frame, see featureextractor.h)
+// The number of frames and features are read from the model input shape [1 x frames x features]
+#define USE_CLASSIFIER_MODEL 0  // If 1 load the classifier model from CLASSIFIER_MODEL_PATH
+#define CLASSIFIER_MODEL_PATH "/udata/classifier_model.onnx"
+#define CLASSIFIER_FFT_ORDER 10  // 1024 samples
+#define CLASSIFIER_HOP_SIZE 512
+#define CLASSIFIER_USE_MFCC 1     // If 0 the model is fed the log-mel bands
+#define CLASSIFIER_MEL_BANDS 40  // Used only for MFCC features
+
+
+/** Threading configuration of every interpreter of the plugin */
+static InferenceEngine::ThreadingConfig getThreadingConfig() {
+    InferenceEngine::ThreadingConfig threading;
+    threading.numThreads = INFERENCE_NUM_THREADS;
+    threading.affinityMask = INFERENCE_WORKER_AFFINITY;
+    threading.spinWait = INFERENCE_WORKER_SPIN;
+    return threading;
+}
+
+/** Configuration of the inference sidecar (see USE_INFERENCE_SIDECAR) */
+static InferenceEngine::SidecarConfig getSidecarConfig() {
+    InferenceEngine::SidecarConfig sidecar;
+    sidecar.executable = SIDECAR_EXECUTABLE;
+#if (LOAD_MODEL_FROM_FILE)
+    sidecar.modelPath = MODEL_PATH;
+#endif
+    sidecar.cpuMask = SIDECAR_CPUS;
+    sidecar.priority = SIDECAR_PRIORITY;
+    sidecar.memoryLimitMB = SIDECAR_MEMORY_LIMIT_MB;
+    sidecar.timeoutUs = SIDECAR_TIMEOUT_US;
+    sidecar.maxMissedDeadlines = SIDECAR_MAX_MISSED_DEADLINES;
+    return sidecar;
+}
+
+/** Thresholds of the quality tiers (see USE_QUALITY_TIERS) */
+static InferenceEngine::QualityTierConfig getQualityTierConfig() {
+    InferenceEngine::QualityTierConfig config;
+    config.degradeLoad = QUALITY_DEGRADE_LOAD;
+    config.degradeBlocks = QUALITY_DEGRADE_BLOCKS;
+    config.recoverLoad = QUALITY_RECOVER_LOAD;
+    config.recoverSeconds = QUALITY_RECOVER_SECONDS;
+    config.crossfadeSeconds = QUALITY_CROSSFADE_MS / 1000.0;
+    return config;
+}
+
+/**
+ * Pre/post-processing of the saturation model (see prepostchain.h), from the metadata of the model (read here or by
+ * the sidecar). Set the stages here to override them in code, e.g. config.outputClip = 1.0f
+ */
+static InferenceEngine::PrePostConfig getPrePostConfig(InferenceEngine::PrePostConfig config) {
+    return config;
+}
+
+/** Output of the model for the samples that the sidecar did not return in time, between the pre and post-processing */
+static void applySidecarFallback(float* samples, int numSamples, float gain) {
+    if (SIDECAR_FALLBACK == 0)
+        std::fill(samples, samples + numSamples, 0.0f);
+    else if (SIDECAR_FALLBACK == 2)
+        for (int i = 0; i < numSamples; ++i)
+            samples[i] = std::tanh(gain * samples[i]);
+}
 
 //==============================================================================
 OnnxSaturatorAudioProcessor::OnnxSaturatorAudioProcessor()
@@ -29,19 +206,43 @@ OnnxSaturatorAudioProcessor::OnnxSaturatorAudioProcessor()
                          ),
 #endif
 {
-    // Resize input and output vectors so that no allocation is performet in the rt thread
-    onnx_input_vec.resize(2);
-    onnx_output_vec.resize(1);
+    modelLoader.start([this]() { loadModel(); }, ASYNC_MODEL_LOADING);
+#if (USE_QUALITY_TIERS)
+    // The tier is read from the atomic of the stage and written to TIER_ID outside of the audio thread
+    startTimerHz(10);
+#endif
+}
+
+OnnxSaturatorAudioProcessor::~OnnxSaturatorAudioProcessor() {
+    stopTimer();
+    modelLoader.wait();
+    cancelPendingUpdate();
+    unregisterSchedulerClients();
+    sharedScheduler.reset();
+    featureExtractor.reset();
+    InferenceEngine::deleteInterpreter(classifierInterpreter);
+    pipeline.reset();
+    for (InferenceEngine::InterpreterPtr pipelineInterpreter : pipelineInterpreters)
+        InferenceEngine::deleteInterpreter(pipelineInterpreter);
+    InferenceEngine::deleteInterpreter(interpreter);
+}
 
+void OnnxSaturatorAudioProcessor::loadModel() {
     // Load the model and init the interpreter
     // Load either from a file in the filesystem or from JUCE binary data
     // The second is suggested for cross-platform compatibility, as the first depends on the model being on a path that is local to the target machine
 
-#if (LOAD_MODEL_FROM_FILE)
+#if (USE_INFERENCE_SIDECAR)
+    // The model is loaded by the sidecar, this process only keeps the staging buffers
+    sidecar = std::make_unique<InferenceEngine::SidecarClient>(getSidecarConfig());
+#elif (LOAD_MODEL_FROM_FILE)
     // Shortcut to avoid binary data, however it depends on local absolute path
-    interpreter = InferenceEngine::createInterpreter(MODEL_PATH, true);
+    interpreter = InferenceEngine::createInterpreter(MODEL_PATH, MODEL_LOADING_VERBOSE, getThreadingConfig(), INFERENCE_PROFILING);
+    #if (USE_SHARED_SCHEDULER)
+    sharedScheduler = InferenceEngine::SharedInferenceScheduler::getInstance(MODEL_PATH, []() { return InferenceEngine::createInterpreter(MODEL_PATH, false, getThreadingConfig()); });
+    #endif
 #else
-    juce::String modelBDFilename = "saturation_model.onnx";
+    juce::String modelBDFilename = MODEL_BINARY_NAME;
     // Get model index
     size_t binresource_idx = 0;
     for (int i = 0; i < BinaryData::namedResourceListSize; i++)
@@ -54,12 +255,63 @@ OnnxSaturatorAudioProcessor::OnnxSaturatorAudioProcessor()
     int size;
     auto model_content = BinaryData::getNamedResource(binNameUTF8, size);
 
-    this->interpreter = InferenceEngine::createInterpreterFromBuffer(model_content, size, true);
+    this->interpreter = InferenceEngine::createInterpreterFromBuffer(model_content, size, MODEL_LOADING_VERBOSE, getThreadingConfig(), INFERENCE_PROFILING);
+    #if (USE_SHARED_SCHEDULER)
+    sharedScheduler = InferenceEngine::SharedInferenceScheduler::getInstance(binNameUTF8, [model_content, size]() { return InferenceEngine::createInterpreterFromBuffer(model_content, size, false, getThreadingConfig()); });
+    #endif
 #endif
+
+    // Resize input and output vectors so that no allocation is performet in the rt thread
+    // Each invocation takes modelFrameSize [sample, gain] pairs and returns modelFrameSize samples
+    modelFrameSize = (sidecar != nullptr) ? sidecar->getModelFrameSize() : (int)InferenceEngine::getModelBatchSize(interpreter);
+    memoryArena = std::make_unique<InferenceEngine::LockedArena>(MEMORY_ARENA_SIZE, MEMORY_ARENA_HUGE_PAGES);
+    const size_t tensorLockedBytes = (interpreter != nullptr) ? InferenceEngine::placeTensorsInArena(interpreter, *memoryArena, MODEL_LOADING_VERBOSE) : 0;
+    onnx_input_vec = InferenceEngine::ArenaVector<float>(2 * modelFrameSize, 0.0f, memoryArena.get());
+    onnx_output_vec = InferenceEngine::ArenaVector<float>(modelFrameSize, 0.0f, memoryArena.get());
+    // Bound after placeTensorsInArena, which moves the tensors, and validated here instead of at every invocation
+    if (interpreter != nullptr)
+        saturationEngine.bind(interpreter, 2 * modelFrameSize, modelFrameSize);
+    if (interpreter != nullptr || sidecar != nullptr) {
+        prePostConfig = getPrePostConfig(sidecar != nullptr ? sidecar->getPrePostConfig() : InferenceEngine::PrePostConfig::fromMetadata(InferenceEngine::getModelMetadata(interpreter)));
+        if (MODEL_LOADING_VERBOSE && !prePostConfig.isIdentity())
+            std::cout << "Pre/post chain\t|\tInput gain " << prePostConfig.inputGain << ", DC blocker " << prePostConfig.dcBlockHz << " Hz, mean " << prePostConfig.inputMean << ", std " << prePostConfig.inputStd
+                      << " | Output scale " << prePostConfig.outputScale << ", offset " << prePostConfig.outputOffset << ", clip " << prePostConfig.outputClip << std::endl;
+    }
+    if (MODEL_LOADING_VERBOSE)
+        std::cout << "Memory arena\t|\tLocked: " << memoryArena->getLockedBytes() + tensorLockedBytes << " bytes | Arena peak: " << memoryArena->getPeakBytes() << " of " << memoryArena->getCapacity() << " bytes"
+                  << (memoryArena->usesHugePages() ? " (huge pages)" : "") << std::endl;
+#if (USE_WEIGHT_SETS)
+    loadWeightSets();
+#endif
+#if (USE_CLASSIFIER_MODEL)
+    classifierInterpreter = InferenceEngine::createInterpreter(CLASSIFIER_MODEL_PATH, MODEL_LOADING_VERBOSE, getThreadingConfig());
+    classifier_output_vec.resize(InferenceEngine::getModelOutputSize(classifierInterpreter));
+#endif
+#if (USE_MODEL_PIPELINE)
+    loadPipelineModels();
+#endif
+#if (USE_QUALITY_TIERS)
+    buildCurveTable();
+#endif
+
+    if (MODEL_LOADING_VERBOSE) {
+        const InferenceEngine::ModelMemoryUsage memoryUsage = getMemoryUsage();
+        std::cout << "Memory\t|\tModel: " << memoryUsage.modelBytes << " bytes | Activations: " << memoryUsage.activationBytes << " bytes | Persistent: " << memoryUsage.persistentBytes << " bytes | I/O staging: " << memoryUsage.ioBytes
+                  << " bytes | Runtime (estimated): " << memoryUsage.runtimeBytes << " bytes | Total: " << memoryUsage.getTotalBytes() << " bytes" << std::endl;
+    }
+
+    // If the host already called prepareToPlay, the model is prepared here with its settings
+    std::lock_guard<std::mutex> lock(preparationMutex);
+    modelLoaded = true;
+    if (preparedBlockSize > 0) {
+        // This can be a thread of the loader, the host is notified of the latency from the message thread
+        pendingLatency.store(prepareModel(preparedSampleRate, preparedBlockSize));
+        triggerAsyncUpdate();
+    }
 }
 
-OnnxSaturatorAudioProcessor::~OnnxSaturatorAudioProcessor() {
-    InferenceEngine::deleteInterpreter(interpreter);
+void OnnxSaturatorAudioProcessor::handleAsyncUpdate() {
+    setLatencySamples(pendingLatency.load());
 }
 
 /** Create the parameters to add to the value tree state
@@ -80,6 +332,14 @@ juce::AudioProcessorValueTreeState::ParameterLayout OnnxSaturatorAudioProcessor:
                                                                                         false),
                                                                defaultGain));
 
+#if (USE_QUALITY_TIERS)
+    // Reported to the host, the processor overwrites it from the message thread at every change of tier
+    parameters.push_back(std::make_unique<juce::AudioParameterChoice>(TIER_ID, TIER_NAME, juce::StringArray{"Model", "Curve table"}, 0));
+#endif
+#if (USE_WEIGHT_SETS)
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>(PRESET_ID, PRESET_NAME, 0, MAX_WEIGHT_SETS - 1, 0));
+#endif
+
     return {parameters.begin(), parameters.end()};
 }
 
@@ -139,11 +399,311 @@ void OnnxSaturatorAudioProcessor::changeProgramName(int index, const juce::Strin
 void OnnxSaturatorAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock) {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    std::lock_guard<std::mutex> lock(preparationMutex);
+    preparedSampleRate = sampleRate;
+    preparedBlockSize = samplesPerBlock;
+    // A model that is still loading is prepared at the end of loadModel()
+    if (modelLoaded)
+        setLatencySamples(prepareModel(sampleRate, samplesPerBlock));
+}
+
+int OnnxSaturatorAudioProcessor::prepareModel(double sampleRate, int samplesPerBlock) {
+    modelReady.store(false, std::memory_order_release);
+    // Block size seen by the saturation model, at its own rate
+    int modelBlockSize = samplesPerBlock;
+    resamplingStages.clear();
+    if (MODEL_SAMPLE_RATE > 0 && std::lround(sampleRate) != MODEL_SAMPLE_RATE) {
+        resamplingStages.resize(getTotalNumInputChannels());
+        for (auto& stage : resamplingStages)
+            stage.prepare(sampleRate, MODEL_SAMPLE_RATE, samplesPerBlock);
+        modelBlockSize = resamplingStages[0].getMaxModelBlockSize();
+    }
+
+    frameAdapters.resize(getTotalNumInputChannels());
+    for (auto& adapter : frameAdapters)
+        adapter.prepare(modelFrameSize);
+    prePost.prepare(prePostConfig, resamplingStages.empty() ? sampleRate : MODEL_SAMPLE_RATE, getTotalNumInputChannels());
+
+    unregisterSchedulerClients();
+    if (sharedScheduler != nullptr) {
+        const int batchTimeoutUs = (int)(1e6 * SHARED_SCHEDULER_TIMEOUT * samplesPerBlock / sampleRate);
+        for (int channel = 0; channel < getTotalNumInputChannels(); ++channel) {
+            const int client = sharedScheduler->registerClient(modelBlockSize, interpreter, batchTimeoutUs);
+            if (client < 0) {
+                // The model cannot be batched (e.g. fixed batch dimension), every block is processed by this instance
+                unregisterSchedulerClients();
+                break;
+            }
+            schedulerClients.push_back(client);
+        }
+    }
+#if (USE_MODEL_PIPELINE)
+    preparePipeline(samplesPerBlock);
+#endif
+    // The scheduler returns each block in the next period, the frame adapters delay by one frame
+    const int modelLatency = (pipeline != nullptr) ? 0 : (schedulerClients.empty() ? modelFrameSize - 1 : modelBlockSize);
+    saturationLatency = modelLatency;
+    if (!resamplingStages.empty())
+        saturationLatency = resamplingStages[0].getLatencySamples() + (int)std::lround(modelLatency * sampleRate / MODEL_SAMPLE_RATE);
+    silenceGate.prepare(SILENCE_GATE_OPEN_DB, SILENCE_GATE_CLOSE_DB, saturationLatency + SILENCE_GATE_MODEL_TAIL);
+#if (USE_QUALITY_TIERS)
+    qualityTiers.prepare(getQualityTierConfig(), sampleRate, samplesPerBlock, getTotalNumInputChannels(), saturationLatency);
+#endif
+#if (USE_BLACKBOX_RECORDER)
+    blackBox.prepare(getTotalNumInputChannels(), sampleRate, samplesPerBlock, BLACKBOX_SECONDS);
+    blackBox.setTriggerLevel(BLACKBOX_TRIGGER_LEVEL);
+    blackBox.startWatcher(BLACKBOX_PATH, BLACKBOX_POST_TRIGGER_SECONDS, BLACKBOX_MAX_SNAPSHOTS);
+#endif
+    if (classifierInterpreter != nullptr) {
+        size_t frames, features;
+        InferenceEngine::getModelInputSize2d(classifierInterpreter, frames, features);
+        InferenceEngine::FeatureExtractorConfig config;
+        config.sampleRate = sampleRate;
+        config.fftOrder = CLASSIFIER_FFT_ORDER;
+        config.hopSize = CLASSIFIER_HOP_SIZE;
+        config.numFrames = (int)frames;
+#if (CLASSIFIER_USE_MFCC)
+        config.numMelBands = CLASSIFIER_MEL_BANDS;
+        config.numMfcc = (int)features;
+#else
+        config.numMelBands = (int)features;
+        config.numMfcc = 0;
+#endif
+        featureExtractor = std::make_unique<InferenceEngine::FeatureExtractor>(config);
+        featureExtractor->prepare();
+    }
+    warmUpModel(modelBlockSize);
+    if (INFERENCE_PERF_COUNTERS) {
+        // processBlock is measured per block size and processing mode (see perfcounters.h)
+        std::string mode = (pipeline != nullptr) ? "pipeline" : (sidecar != nullptr) ? "sidecar" : (!schedulerClients.empty() ? "shared scheduler" : "frame " + std::to_string(modelFrameSize));
+        if (!resamplingStages.empty())
+            mode += ", resampled";
+        perfRegion = InferenceEngine::getPerfRegion("ONNXruntime processBlock (block " + std::to_string(samplesPerBlock) + ", " + mode + ")");
+    }
+    modelReady.store(true, std::memory_order_release);
+    return saturationLatency;
+}
+
+void OnnxSaturatorAudioProcessor::warmUpModel(int blockSize) {
+    // As many invocations per block as processBlock runs, with the gain currently set
+    updateGain();
+    const float gain = inputGain * MAX_SAT_GAIN + MIN_SAT_GAIN;
+    const int invocationsPerBlock = (blockSize + modelFrameSize - 1) / modelFrameSize;
+    const float phaseIncrement = 2.0f * juce::MathConstants<float>::pi * 0.01f;
+    float phase = 0.0f;
+    if (sidecar != nullptr) {
+        // Blocks go through the shared memory rings as in processBlock
+        std::vector<float> block((size_t)blockSize);
+        for (int warmUpBlock = 0; warmUpBlock < MODEL_WARMUP_BLOCKS; ++warmUpBlock) {
+            for (auto& sample : block) {
+                sample = 0.5f * std::sin(phase);
+                phase = std::fmod(phase + phaseIncrement, juce::MathConstants<float>::twoPi);
+            }
+            sidecar->process(0, block.data(), blockSize, gain);
+        }
+        sidecar->reset();
+        return;
+    }
+    for (int invocation = 0; invocation < MODEL_WARMUP_BLOCKS * invocationsPerBlock; ++invocation) {
+        for (int sample = 0; sample < modelFrameSize; ++sample) {
+            onnx_input_vec[2 * sample] = 0.5f * std::sin(phase);
+            onnx_input_vec[2 * sample + 1] = gain;
+            phase = std::fmod(phase + phaseIncrement, juce::MathConstants<float>::twoPi);
+        }
+        InferenceEngine::invoke(interpreter, onnx_input_vec.data(), onnx_input_vec.size(), onnx_output_vec.data(), onnx_output_vec.size());
+    }
+    // The warm-up is not part of the signal
+    InferenceEngine::resetModelState(interpreter);
 }
 
 void OnnxSaturatorAudioProcessor::releaseResources() {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    std::lock_guard<std::mutex> lock(preparationMutex);
+    unregisterSchedulerClients();
+#if (INFERENCE_PROFILING)
+    if (modelLoaded && InferenceEngine::exportProfile(interpreter, INFERENCE_PROFILE_PATH ".json", INFERENCE_PROFILE_PATH ".txt"))
+        std::cout << "Profile\t|\tWritten to " << INFERENCE_PROFILE_PATH << ".{json,txt}" << std::endl;
+#endif
+    // Hardware counters of every instance since the start (see INFERENCE_PERF_COUNTERS in perfcounters.h)
+    if (INFERENCE_PERF_COUNTERS && InferenceEngine::arePerfCountersEnabled())
+        InferenceEngine::printPerfCounterReport(std::cout);
+}
+
+void OnnxSaturatorAudioProcessor::unregisterSchedulerClients() {
+    for (int client : schedulerClients)
+        sharedScheduler->unregisterClient(client);
+    schedulerClients.clear();
+}
+
+void OnnxSaturatorAudioProcessor::buildCurveTable() {
+    // The table replaces the whole stage, so it is sampled through the pre/post chain (without the DC blocker, which
+    // has no static curve)
+    InferenceEngine::PrePostChain staticPrePost;
+    staticPrePost.prepare(prePostConfig, 0.0, 0);
+    // One table per weight set, the table of the active set is in the stage and swapped by selectWeightSet
+    curveTables.resize((size_t)std::max(1, weightBank.getNumSets()));
+    for (int set = 0; set < (int)curveTables.size(); ++set) {
+        if (weightBank.getNumSets() > 1)
+            InferenceEngine::useWeightSet(interpreter, set);
+        // The grid of the table goes through the model one frame at a time
+        curveTables[(size_t)set].build(
+            [this, &staticPrePost](const float* inputs, float* outputs, int numSamples, float gain) {
+                for (int start = 0; start < numSamples; start += modelFrameSize) {
+                    const int count = std::min(modelFrameSize, numSamples - start);
+                    std::fill(onnx_input_vec.begin(), onnx_input_vec.end(), 0.0f);
+                    staticPrePost.writeInput(-1, inputs + start, onnx_input_vec.data(), count, &gain, 1);
+                    InferenceEngine::invoke(interpreter, onnx_input_vec.data(), onnx_input_vec.size(), onnx_output_vec.data(), onnx_output_vec.size());
+                    staticPrePost.readOutput(onnx_output_vec.data(), outputs + start, count);
+                }
+            },
+            MIN_SAT_GAIN, MIN_SAT_GAIN + MAX_SAT_GAIN);
+        // These invocations are not part of the signal
+        InferenceEngine::resetModelState(interpreter);
+    }
+    if (weightBank.getNumSets() > 1)
+        InferenceEngine::useWeightSet(interpreter, activeWeightSet);
+    std::swap(qualityTiers.getCurveTable(), curveTables[(size_t)activeWeightSet]);
+}
+
+void OnnxSaturatorAudioProcessor::timerCallback() {
+    const int tier = qualityTiers.getTier();
+    if (tier == reportedQualityTier)
+        return;
+    reportedQualityTier = tier;
+    if (auto* parameter = valueTreeState.getParameter(TIER_ID))
+        parameter->setValueNotifyingHost(parameter->convertTo0to1((float)tier));
+}
+
+InferenceEngine::ModelMemoryUsage OnnxSaturatorAudioProcessor::getMemoryUsage() const {
+    InferenceEngine::ModelMemoryUsage usage;
+    for (InferenceEngine::InterpreterPtr modelInterpreter : {interpreter, classifierInterpreter})
+        if (modelInterpreter != nullptr)
+            usage += InferenceEngine::getModelMemoryUsage(modelInterpreter);
+    for (InferenceEngine::InterpreterPtr pipelineInterpreter : pipelineInterpreters)
+        usage += InferenceEngine::getModelMemoryUsage(pipelineInterpreter);
+    // The weight sets
+    usage.modelBytes += weightBank.getBytes();
+    // The input and output tensors were placed in the arena, together with the staging buffers
+    if (memoryArena != nullptr)
+        usage.ioBytes += memoryArena->getCapacity();
+    return usage;
+}
+
+void OnnxSaturatorAudioProcessor::loadWeightSets() {
+    if (interpreter == nullptr)
+        return;
+    juce::StringArray paths = juce::StringArray::fromTokens(WEIGHT_SET_PATHS, ";", "");
+    paths.removeEmptyStrings();
+    weightBank.prepare(InferenceEngine::getWeightLayout(interpreter), juce::jmin(MAX_WEIGHT_SETS, 1 + paths.size()));
+    if (weightBank.getLayout().empty()) {
+        if (MODEL_LOADING_VERBOSE)
+            std::cout << "Weight sets\t|\tThe weights of the saturation model cannot be switched" << std::endl;
+        return;
+    }
+
+    // Set 0 is the saturation model itself
+#if (LOAD_MODEL_FROM_FILE)
+    paths.insert(0, MODEL_PATH);
+#else
+    int size = 0;
+    for (int i = 0; i < BinaryData::namedResourceListSize; i++)
+        if (juce::String(BinaryData::originalFilenames[i]) == MODEL_BINARY_NAME)
+            InferenceEngine::addWeightSet(weightBank, BinaryData::getNamedResource(BinaryData::namedResourceList[i], size), (size_t)size);
+#endif
+    for (const auto& path : paths) {
+        juce::MemoryBlock model;
+        const bool added = juce::File(path).loadFileAsData(model) && InferenceEngine::addWeightSet(weightBank, (const char*)model.getData(), model.getSize()) >= 0;
+        if (MODEL_LOADING_VERBOSE && !added)
+            std::cout << "Weight sets\t|\tSkipped '" << path << "': missing, not the graph of the saturation model, or more than MAX_WEIGHT_SETS" << std::endl;
+    }
+    if (!InferenceEngine::attachWeightBank(interpreter, weightBank)) {
+        if (MODEL_LOADING_VERBOSE)
+            std::cout << "Weight sets\t|\tThe weights of the saturation model could not be read" << std::endl;
+        weightBank.prepare({}, 0);
+        return;
+    }
+    if (MODEL_LOADING_VERBOSE)
+        std::cout << "Weight sets\t|\t" << weightBank.getNumSets() << " sets of " << weightBank.getLayout().size() << " tensors, " << weightBank.getBytes() << " bytes" << std::endl;
+}
+
+void OnnxSaturatorAudioProcessor::selectWeightSet() {
+    if (weightBank.getNumSets() <= 1)
+        return;
+    const int set = juce::jlimit(0, weightBank.getNumSets() - 1, ((juce::AudioParameterInt*)valueTreeState.getParameter(PRESET_ID))->get());
+    if (set == activeWeightSet)
+        return;
+    InferenceEngine::useWeightSet(interpreter, set);
+    if (!curveTables.empty()) {
+        // Like the native models, the tables exchange their buffers
+        std::swap(qualityTiers.getCurveTable(), curveTables[(size_t)activeWeightSet]);
+        std::swap(qualityTiers.getCurveTable(), curveTables[(size_t)set]);
+    }
+    activeWeightSet = set;
+    zeroInputGain = -1.0f;  // The response to zero input depends on the weights
+}
+
+void OnnxSaturatorAudioProcessor::loadPipelineModels() {
+    if (!prePostConfig.isIdentity()) {
+        if (MODEL_LOADING_VERBOSE)
+            std::cout << "Pipeline\t|\tThe saturation model has a pre/post chain, which the pipeline does not run: the pipeline is disabled" << std::endl;
+        return;
+    }
+    const InferenceEngine::ThreadingConfig threading = getThreadingConfig();
+    // The pipeline resizes the batch of its interpreters, so it loads the saturation model again
+#if (LOAD_MODEL_FROM_FILE)
+    pipelineInterpreters.push_back(InferenceEngine::createInterpreter(MODEL_PATH, MODEL_LOADING_VERBOSE, threading));
+#else
+    int size = 0;
+    for (int i = 0; i < BinaryData::namedResourceListSize; i++) {
+        if (juce::String(BinaryData::originalFilenames[i]) == MODEL_BINARY_NAME) {
+            const char* model = BinaryData::getNamedResource(BinaryData::namedResourceList[i], size);
+            pipelineInterpreters.push_back(InferenceEngine::createInterpreterFromBuffer(model, (size_t)size, MODEL_LOADING_VERBOSE, threading));
+        }
+    }
+#endif
+    for (const auto& path : juce::StringArray::fromTokens(PIPELINE_MODEL_PATHS, ";", ""))
+        if (path.isNotEmpty())
+            pipelineInterpreters.push_back(InferenceEngine::createInterpreter(path.toStdString(), MODEL_LOADING_VERBOSE, threading));
+}
+
+void OnnxSaturatorAudioProcessor::preparePipeline(int samplesPerBlock) {
+    if (pipelineInterpreters.empty())
+        return;
+    // One branch per channel: the saturation model takes the gain with each sample, the following models the samples only
+    pipeline = std::make_unique<InferenceEngine::InferencePipeline>();
+    for (int channel = 0; channel < getTotalNumInputChannels(); ++channel) {
+        const std::string suffix = " " + std::to_string(channel);
+        int stage = pipeline->addInput("input" + suffix);
+        stage = pipeline->addModel("saturation" + suffix, pipelineInterpreters[0], {stage}, &onnx_input_vec[1], 1);
+        for (size_t model = 1; model < pipelineInterpreters.size(); ++model)
+            stage = pipeline->addModel("model " + std::to_string(model) + suffix, pipelineInterpreters[model], {stage});
+        pipeline->addOutput(stage);
+    }
+    InferenceEngine::ThreadingConfig threading = getThreadingConfig();
+    threading.numThreads = PIPELINE_NUM_THREADS;
+    pipeline->prepare(samplesPerBlock, threading);
+    if (MODEL_LOADING_VERBOSE)
+        pipeline->printPlan(std::cout);
+}
+
+bool OnnxSaturatorAudioProcessor::hasQualityTiers() const {
+    return USE_QUALITY_TIERS;
+}
+
+float OnnxSaturatorAudioProcessor::getZeroInputResponse(float gain) {
+    if (gain != zeroInputGain) {
+        // Silence through the pre/post chain, with the DC blocker settled (channel -1 skips it)
+        const float silence = 0.0f;
+        for (int sample = 0; sample < modelFrameSize; ++sample)
+            prePost.writeInput(-1, &silence, &onnx_input_vec[2 * sample], 1, &gain, 1);
+        InferenceEngine::invoke(interpreter, onnx_input_vec.data(), onnx_input_vec.size(), onnx_output_vec.data(), onnx_output_vec.size());
+        // This invocation is not part of the signal
+        InferenceEngine::resetModelState(interpreter);
+        prePost.readOutput(onnx_output_vec.data(), &zeroInputResponse, 1);
+        zeroInputGain = gain;
+    }
+    return zeroInputResponse;
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -179,7 +739,19 @@ void OnnxSaturatorAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
+    // Until the model is loaded and prepared the output is the fallback
+    if (!modelReady.load(std::memory_order_acquire)) {
+        for (auto i = MODEL_LOADING_FALLBACK ? totalNumInputChannels : 0; i < totalNumOutputChannels; ++i)
+            buffer.clear(i, 0, buffer.getNumSamples());
+        return;
+    }
+    InferenceEngine::PerfScope perfScope(perfRegion);
+    const juce::int64 blockStart = USE_QUALITY_TIERS ? juce::Time::getHighResolutionTicks() : 0;
+
     updateGain();
+#if (USE_WEIGHT_SETS)
+    selectWeightSet();
+#endif
     onnx_input_vec[1] = inputGain * MAX_SAT_GAIN + MIN_SAT_GAIN;
 
     // In case we have more outputs than inputs, this code clears any output
@@ -191,24 +763,118 @@ void OnnxSaturatorAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
+    // The classifier sees the dry input and is invoked only when new frames are available
+    if (featureExtractor != nullptr && totalNumInputChannels > 0) {
+        if (featureExtractor->pushSamples(buffer.getReadPointer(0), buffer.getNumSamples()) > 0)
+            predictedClass = InferenceEngine::invokeFlat2D(classifierInterpreter, featureExtractor->getFeatureMatrix(), featureExtractor->getNumFrames(), featureExtractor->getNumFeatures(), classifier_output_vec.data(), classifier_output_vec.size());
+    }
+
+    // The black box records what goes in and out of the saturation stage
+    if (USE_BLACKBOX_RECORDER)
+        blackBox.recordInput(buffer.getArrayOfReadPointers(), totalNumInputChannels, buffer.getNumSamples(), onnx_input_vec[1]);
+
+    runSaturationStage(buffer, totalNumInputChannels, blockStart);
+    if (USE_BLACKBOX_RECORDER)
+        blackBox.recordOutput(buffer.getArrayOfReadPointers(), totalNumInputChannels, buffer.getNumSamples());
+}
+
+void OnnxSaturatorAudioProcessor::processSaturationStage(juce::AudioBuffer<float>& buffer, float saturationGain) {
+    juce::ScopedNoDenormals noDenormals;
+    const int totalNumInputChannels = juce::jmin(getTotalNumInputChannels(), buffer.getNumChannels());
+
+    if (!modelReady.load(std::memory_order_acquire)) {
+        for (auto i = MODEL_LOADING_FALLBACK ? totalNumInputChannels : 0; i < buffer.getNumChannels(); ++i)
+            buffer.clear(i, 0, buffer.getNumSamples());
+        return;
+    }
+    const juce::int64 blockStart = USE_QUALITY_TIERS ? juce::Time::getHighResolutionTicks() : 0;
+
+    onnx_input_vec[1] = saturationGain;
+    runSaturationStage(buffer, totalNumInputChannels, blockStart);
+}
+
+void OnnxSaturatorAudioProcessor::runSaturationStage(juce::AudioBuffer<float>& buffer, int totalNumInputChannels, juce::int64 blockStart) {
+    // With the gate closed the saturation model is skipped, and its output is the constant response to silence
+    const bool gateWasOpen = silenceGate.isOpen();
+    if (USE_SILENCE_GATE && !silenceGate.process(buffer.getArrayOfReadPointers(), totalNumInputChannels, buffer.getNumSamples())) {
+        if (gateWasOpen) {
+            // Start from a clean state when the gate opens again
+            InferenceEngine::resetModelState(interpreter);
+            prePost.reset();
+        }
+        const float response = getZeroInputResponse(onnx_input_vec[1]);
+        for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            juce::FloatVectorOperations::fill(buffer.getWritePointer(channel), response, buffer.getNumSamples());
+        return;
+    }
+
+    // Under CPU pressure the model is replaced by its curve table (see USE_QUALITY_TIERS)
+    bool runSaturationModel = true;
+    if (USE_QUALITY_TIERS) {
+        runSaturationModel = qualityTiers.beginBlock(buffer.getArrayOfReadPointers(), totalNumInputChannels, buffer.getNumSamples(), onnx_input_vec[1]);
+        if (runSaturationModel && qualityTiers.consumeModelReset()) {
+            // The model was idle, it starts again from a clean state
+            InferenceEngine::resetModelState(interpreter);
+            for (auto& adapter : frameAdapters)
+                adapter.reset();
+            for (auto& stage : resamplingStages)
+                stage.reset();
+            prePost.reset();
+        }
+    }
+
+    // The pipeline replaces the saturation stage of every channel (see USE_MODEL_PIPELINE)
+    if (runSaturationModel && pipeline != nullptr) {
+        pipeline->process(buffer.getArrayOfReadPointers(), buffer.getArrayOfWritePointers(), buffer.getNumSamples());
+        runSaturationModel = false;
+    }
+
     // This is the place where you'd normally do the guts of your plugin's
     // audio processing...
     // Make sure to reset the state if your inner loop is processing
     // the samples and the outer loop is handling the channels.
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
-    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+    for (int channel = 0; runSaturationModel && channel < totalNumInputChannels; ++channel) {
         auto* channelDataIn = buffer.getWritePointer(channel);
         auto* channelData = buffer.getWritePointer(channel);
 
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
-            onnx_input_vec[0] = channelDataIn[sample];
-
-            InferenceEngine::invoke(interpreter, onnx_input_vec, onnx_output_vec);
-            channelData[sample] = onnx_output_vec[0];
-            // std::cout << "Input: " << onnx_input_vec[0] << " Output: " << onnx_output_vec[0] << std::endl;
-        }
+        if (channel >= (int)frameAdapters.size())
+            continue;
+
+        // Saturation model, run on samples at its native rate when resampling is enabled
+        auto runModel = [this, channel](float* samples, int numSamples) {
+            // The sidecar and the shared scheduler run the bare model, the chain runs here around them
+            if (sidecar != nullptr) {
+                prePost.writeInput(channel, samples, samples, numSamples);
+                const int processed = sidecar->process(channel, samples, numSamples, onnx_input_vec[1]);
+                applySidecarFallback(samples + processed, numSamples - processed, onnx_input_vec[1]);
+                prePost.readOutput(samples, samples, numSamples);
+                return;
+            }
+            if (channel < (int)schedulerClients.size()) {
+                prePost.writeInput(channel, samples, samples, numSamples);
+                sharedScheduler->process(schedulerClients[channel], samples, numSamples, onnx_input_vec[1]);
+                prePost.readOutput(samples, samples, numSamples);
+                return;
+            }
+            // The model runs every time modelFrameSize samples are collected (zero, one or more times per block)
+            frameAdapters[channel].process(samples, numSamples, [this, channel](const float* frameIn, float* frameOut, int frameSize) {
+                // The frame is pre-processed straight into the input tensor, and post-processed out of the output tensor
+                const float gain = onnx_input_vec[1];
+                prePost.writeInput(channel, frameIn, saturationEngine.input(), frameSize, &gain, 1);
+                saturationEngine.run();
+                prePost.readOutput(saturationEngine.output(), frameOut, frameSize);
+                // std::cout << "Input: " << frameIn[0] << " Output: " << frameOut[0] << std::endl;
+            });
+        };
+        if (channel < (int)resamplingStages.size())
+            resamplingStages[channel].process(channelData, buffer.getNumSamples(), runModel);
+        else
+            runModel(channelData, buffer.getNumSamples());
     }
+    if (USE_QUALITY_TIERS)
+        qualityTiers.endBlock(buffer.getArrayOfWritePointers(), totalNumInputChannels, buffer.getNumSamples(), juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - blockStart));
 }
 
 //==============================================================================
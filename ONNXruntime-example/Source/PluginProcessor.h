@@ -6,12 +6,29 @@
 
 #include <JuceHeader.h>
 
+#include "blackboxrecorder.h"
+#include "featureextractor.h"
+#include "fixedframeadapter.h"
+#include "inferencepipeline.h"
+#include "inferencesidecar.h"
+#include "lockedarena.h"
+#include "modelloader.h"
+#include "perfcounters.h"
+#include "polyphaseresampler.h"
+#include "prepostchain.h"
+#include "qualitytiers.h"
+#include "sharedscheduler.h"
+#include "silencegate.h"
 #include "onnxwrapper.h" // Put your ONNX code here
 
+// Range of the saturation gain fed to the model together with each sample
+#define MIN_SAT_GAIN 0.1f
+#define MAX_SAT_GAIN 200.0f
+
 //==============================================================================
 /**
  */
-class OnnxSaturatorAudioProcessor : public juce::AudioProcessor {
+class OnnxSaturatorAudioProcessor : public juce::AudioProcessor, private juce::AsyncUpdater, private juce::Timer {
 public:
     //==============================================================================
     OnnxSaturatorAudioProcessor();
@@ -51,14 +68,135 @@ public:
     void setStateInformation(const void* data, int sizeInBytes) override;
 
 private:
-    InferenceEngine::InterpreterPtr interpreter;
+    // The model is loaded by loadModel(), in the background (see ASYNC_MODEL_LOADING)
+    InferenceEngine::ModelLoader modelLoader;
+    void loadModel();
+
+    // prepareToPlay and the end of the load run on different threads, the last one prepares the model
+    std::mutex preparationMutex;
+    bool modelLoaded = false;
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0;  // 0 until the host calls prepareToPlay
+    /** Prepare every stage that depends on the model and warm it up, then set modelReady, returns the latency to report */
+    int prepareModel(double sampleRate, int samplesPerBlock);
+    // Latency of a preparation at the end of a load in the background, set from the message thread
+    std::atomic<int> pendingLatency{0};
+    void handleAsyncUpdate() override;
+    /** Run MODEL_WARMUP_BLOCKS blocks of realistic input through the model */
+    void warmUpModel(int blockSize);
+    // Set once the model is loaded and prepared, processBlock outputs the fallback until then
+    std::atomic<bool> modelReady{false};
+    // Hardware performance counters of processBlock (see INFERENCE_PERF_COUNTERS in perfcounters.h)
+    InferenceEngine::PerfRegion* perfRegion = nullptr;
+
+    InferenceEngine::InterpreterPtr interpreter = nullptr;
+
+    // Locked and prefaulted memory for the model input/output tensors and the staging buffers below
+    std::unique_ptr<InferenceEngine::LockedArena> memoryArena;
+
+    InferenceEngine::ArenaVector<float> onnx_input_vec;
+    InferenceEngine::ArenaVector<float> onnx_output_vec;
+    // Tensors of the interpreter, written and read in place by the frame callback of processBlock (see modelengine.h)
+    InferenceEngine::ModelEngine<InferenceEngine::OnnxBackend> saturationEngine;
+    // Pre/post-processing of the saturation model, fused with the accesses to the tensors (see prepostchain.h)
+    InferenceEngine::PrePostConfig prePostConfig;
+    InferenceEngine::PrePostChain prePost;
+
+    // The model processes a fixed number of samples per invocation (its batch size), independently of the host block size
+    int modelFrameSize = 1;
+    std::vector<InferenceEngine::FixedFrameAdapter> frameAdapters;
+
+    // Conversion to the native rate of the model and back (see MODEL_SAMPLE_RATE), one stage per channel
+    std::vector<InferenceEngine::ResamplingStage> resamplingStages;
+
+    // Optional batching of all the instances that share the model (see USE_SHARED_SCHEDULER), one client per channel
+    std::shared_ptr<InferenceEngine::SharedInferenceScheduler> sharedScheduler;
+    std::vector<int> schedulerClients;
+    void unregisterSchedulerClients();
+
+    // Optional pipeline of models (see USE_MODEL_PIPELINE), replaces the saturation stage when not null
+    std::vector<InferenceEngine::InterpreterPtr> pipelineInterpreters;  // The saturation model first, then the models of PIPELINE_MODEL_PATHS
+    std::unique_ptr<InferenceEngine::InferencePipeline> pipeline;
+    void loadPipelineModels();
+    /** Build and plan the graph for the channels and the block size of the host */
+    void preparePipeline(int samplesPerBlock);
+
+    // Optional out-of-process saturation model (see USE_INFERENCE_SIDECAR), used instead of the interpreter
+    std::unique_ptr<InferenceEngine::SidecarClient> sidecar;
+
+    // Optional gating of the saturation model on silent blocks (see USE_SILENCE_GATE)
+    InferenceEngine::SilenceGate silenceGate;
+    float zeroInputResponse = 0.0f;
+    float zeroInputGain = -1.0f;  // Gain of the last computed zero input response (negative if none)
+    /** Output of the model for zero input at the given gain, invoked only when the gain changes */
+    float getZeroInputResponse(float gain);
+
+    // Optional recording of the saturation stage for post-mortem replay (see USE_BLACKBOX_RECORDER)
+    InferenceEngine::BlackBoxRecorder blackBox;
+    /** Saturation stage of processBlock, from the silence gate to the quality tiers (what the black box records) */
+    void runSaturationStage(juce::AudioBuffer<float>& buffer, int totalNumInputChannels, juce::int64 blockStart);
+    int saturationLatency = 0;  // Latency of the saturation stage alone, part of the latency reported to the host
+
+    // Optional switch to the curve table of the model under CPU pressure (see USE_QUALITY_TIERS)
+    InferenceEngine::QualityTierStage qualityTiers;
+    int reportedQualityTier = -1;  // Last tier written to the TIER_ID parameter
+    /** Sample the curve of the saturation model for the cheaper tier */
+    void buildCurveTable();
+    /** Write the current tier to the TIER_ID parameter when it changes (message thread) */
+    void timerCallback() override;
+
+    // Optional weight sets of the saturation model, switched per block with PRESET_ID (see USE_WEIGHT_SETS)
+    InferenceEngine::WeightBank weightBank;
+    int activeWeightSet = 0;
+    std::vector<InferenceEngine::CurveTable> curveTables;  // Curve table of each set, the active one is in qualityTiers
+    /** Read the weight sets and attach them to the saturation model */
+    void loadWeightSets();
+    /** Switch to the weight set of PRESET_ID, if it changed (real-time safe) */
+    void selectWeightSet();
+
+    // Optional 2D classifier (see USE_CLASSIFIER_MODEL), fed with log-mel/MFCC features of the first input channel
+    InferenceEngine::InterpreterPtr classifierInterpreter = nullptr;
+    std::unique_ptr<InferenceEngine::FeatureExtractor> featureExtractor;
+    std::vector<float> classifier_output_vec;
+
+public:
+    // Last class predicted by the classifier model (-1 if none)
+    std::atomic<int> predictedClass{-1};
 
-    std::vector<float> onnx_input_vec;
-    std::vector<float> onnx_output_vec;
+public:
+    /** Write a snapshot of the black box history (real-time safe, the snapshot is written by the recorder thread) */
+    void requestBlackBoxSnapshot() { blackBox.requestSnapshot(); }
+    /**
+     * @brief Run a block through the saturation stage alone, with the gain fed to the model as is (real-time safe)
+     * This replays the input of a black-box snapshot (see SnapshotReplay.h): the stages before the saturation, the gain
+     * parameter and the black box itself are skipped. The output is the fallback until the model is ready.
+     */
+    void processSaturationStage(juce::AudioBuffer<float>& buffer, float saturationGain);
+    /** Latency of processSaturationStage in samples (only once the model is ready) */
+    int getSaturationLatencySamples() const { return saturationLatency; }
+
+    /** Processing tier of the saturation stage (0 for the model, 1 for its curve table), and the load that set it */
+    bool hasQualityTiers() const;
+    int getQualityTier() const { return qualityTiers.getTier(); }
+    float getProcessingLoad() const { return qualityTiers.getLoad(); }
+
+    /** True once the model is loaded and prepared */
+    bool isModelReady() const { return modelReady.load(std::memory_order_acquire); }
+    /** Error that made the loading of the model fail, empty if it did not fail (see ModelLoader::hasFailed) */
+    std::string getLoadingError() const { return modelLoader.hasFailed() ? modelLoader.getError() : std::string(); }
+
+    /** Arena of the processor, to report locked and peak memory (only once the model is ready) */
+    const InferenceEngine::LockedArena& getMemoryArena() const { return *memoryArena; }
+    /** Memory of the model and of the staging buffers, see memoryusage.h (only once the model is ready) */
+    InferenceEngine::ModelMemoryUsage getMemoryUsage() const;
 
 public:
     // Gain parameter
     const juce::String GAIN_ID = "gain", GAIN_NAME = "gain";
+    // Quality tier, reported to the host (see USE_QUALITY_TIERS)
+    const juce::String TIER_ID = "tier", TIER_NAME = "quality tier";
+    // Weight set of the saturation model (see USE_WEIGHT_SETS)
+    const juce::String PRESET_ID = "preset", PRESET_NAME = "weight set";
     juce::AudioProcessorValueTreeState valueTreeState;
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
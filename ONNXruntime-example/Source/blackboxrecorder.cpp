@@ -0,0 +1,320 @@
+/*
+==============================================================================*/
+#include "blackboxrecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace InferenceEngine {
+
+namespace {
+
+// .bbox files: "BBOX", version, header, block sizes, gains, then input and output channel by channel
+// Values are stored in the byte order of the machine (little endian on both x86_64 and the Raspberry Pi)
+const char snapshotMagic[4] = {'B', 'B', 'O', 'X'};
+const uint32_t snapshotVersion = 1;
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value) {
+    return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void writeVector(std::ofstream& file, const std::vector<T>& values) {
+    file.write(reinterpret_cast<const char*>(values.data()), (std::streamsize)(values.size() * sizeof(T)));
+}
+
+template <typename T>
+bool readVector(std::ifstream& file, std::vector<T>& values, size_t size) {
+    values.resize(size);
+    return (bool)file.read(reinterpret_cast<char*>(values.data()), (std::streamsize)(size * sizeof(T)));
+}
+
+/** Copy numSamples samples of each channel to a ring, starting at the absolute position 'start' */
+void writeRing(std::vector<std::unique_ptr<float[]>>& ring, size_t capacity, const float* const* channels, int numChannels, int numSamples, uint64_t start) {
+    const size_t offset = (size_t)(start % capacity);
+    const size_t first = std::min<size_t>((size_t)numSamples, capacity - offset);
+    for (size_t channel = 0; channel < ring.size(); ++channel) {
+        float* destination = ring[channel].get();
+        if ((int)channel < numChannels) {
+            std::memcpy(destination + offset, channels[channel], first * sizeof(float));
+            std::memcpy(destination, channels[channel] + first, (numSamples - first) * sizeof(float));
+        } else {
+            std::fill(destination + offset, destination + offset + first, 0.0f);
+            std::fill(destination, destination + (numSamples - first), 0.0f);
+        }
+    }
+}
+
+/** Copy the samples [start, start + numSamples) of a ring channel */
+void readRing(const float* ring, size_t capacity, uint64_t start, size_t numSamples, float* destination) {
+    for (size_t i = 0; i < numSamples; ++i)
+        destination[i] = ring[(start + i) % capacity];
+}
+
+}  // namespace
+
+bool BlackBoxSnapshot::write(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(snapshotMagic, sizeof(snapshotMagic));
+    writeValue(file, snapshotVersion);
+    writeValue(file, sampleRate);
+    writeValue(file, (int32_t)numChannels);
+    writeValue(file, (int32_t)blockSizes.size());
+    writeValue(file, (int64_t)getNumSamples());
+    writeValue(file, firstSample);
+    writeValue(file, (uint32_t)reason.size());
+    file.write(reason.data(), (std::streamsize)reason.size());
+    writeVector(file, blockSizes);
+    writeVector(file, gains);
+    for (const auto& channel : input)
+        writeVector(file, channel);
+    for (const auto& channel : output)
+        writeVector(file, channel);
+    return (bool)file;
+}
+
+bool BlackBoxSnapshot::read(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    uint32_t version, reasonLength;
+    int32_t channels, numBlocks;
+    int64_t numSamples;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, snapshotMagic, sizeof(magic)) != 0 || !readValue(file, version) || version != snapshotVersion)
+        return false;
+    if (!readValue(file, sampleRate) || !readValue(file, channels) || !readValue(file, numBlocks) || !readValue(file, numSamples) || !readValue(file, firstSample) || !readValue(file, reasonLength))
+        return false;
+    if (channels <= 0 || numBlocks < 0 || numSamples < 0 || reasonLength > 64)
+        return false;
+    reason.resize(reasonLength);
+    if (!file.read(&reason[0], reasonLength) || !readVector(file, blockSizes, (size_t)numBlocks) || !readVector(file, gains, (size_t)numBlocks))
+        return false;
+    numChannels = channels;
+    input.resize((size_t)channels);
+    output.resize((size_t)channels);
+    for (auto& channel : input)
+        if (!readVector(file, channel, (size_t)numSamples))
+            return false;
+    for (auto& channel : output)
+        if (!readVector(file, channel, (size_t)numSamples))
+            return false;
+    int64_t total = 0;
+    for (int size : blockSizes)
+        total += size;
+    return total == numSamples;
+}
+
+BlackBoxRecorder::~BlackBoxRecorder() {
+    stopWatcher();
+}
+
+void BlackBoxRecorder::prepare(int numChannels, double sampleRate, int maxBlockSize, double seconds) {
+    stopWatcher();
+    this->numChannels = std::max(1, numChannels);
+    this->sampleRate = sampleRate;
+    this->maxBlockSize = std::max(1, maxBlockSize);
+    // The block being written is never part of a snapshot, so the ring holds at least two of them
+    sampleCapacity = std::max<size_t>((size_t)std::ceil(seconds * sampleRate), 2 * (size_t)this->maxBlockSize);
+    blockCapacity = sampleCapacity / 8 + 2;
+    inputRing.clear();
+    outputRing.clear();
+    for (int channel = 0; channel < this->numChannels; ++channel) {
+        inputRing.emplace_back(new float[sampleCapacity]());
+        outputRing.emplace_back(new float[sampleCapacity]());
+    }
+    blockRing.reset(new BlockRecord[blockCapacity]);
+    pendingSamples = -1;
+    samplesWritten = 0;
+    blocksWritten = 0;
+    trigger = none;
+    autoTrigger = true;
+}
+
+void BlackBoxRecorder::recordInput(const float* const* channels, int numChannels, int numSamples, float gain) {
+    pendingSamples = -1;
+    if (sampleCapacity == 0 || numSamples <= 0 || numSamples > maxBlockSize)
+        return;
+    pendingStart = samplesWritten.load(std::memory_order_relaxed);
+    writeRing(inputRing, sampleCapacity, channels, numChannels, numSamples, pendingStart);
+    pendingSamples = numSamples;
+    pendingGain = gain;
+}
+
+void BlackBoxRecorder::recordOutput(const float* const* channels, int numChannels, int numSamples) {
+    if (pendingSamples < 0 || numSamples != pendingSamples)
+        return;
+    writeRing(outputRing, sampleCapacity, channels, numChannels, numSamples, pendingStart);
+
+    uint64_t reason = none;
+    for (int channel = 0; channel < std::min(numChannels, this->numChannels) && reason != nonFinite; ++channel) {
+        for (int i = 0; i < numSamples; ++i) {
+            if (!std::isfinite(channels[channel][i])) {
+                reason = nonFinite;
+                break;
+            }
+            if (std::fabs(channels[channel][i]) > triggerLevel)
+                reason = level;
+        }
+    }
+
+    // Publish the block, its samples are complete
+    const uint64_t block = blocksWritten.load(std::memory_order_relaxed);
+    BlockRecord& record = blockRing[block % blockCapacity];
+    record.start = pendingStart;
+    record.numSamples = numSamples;
+    record.gain = pendingGain;
+    blocksWritten.store(block + 1, std::memory_order_release);
+    samplesWritten.store(pendingStart + numSamples, std::memory_order_release);
+    pendingSamples = -1;
+
+    if (reason != none && autoTrigger.load(std::memory_order_relaxed))
+        arm(reason, pendingStart + numSamples);
+}
+
+void BlackBoxRecorder::requestSnapshot() {
+    arm(request, samplesWritten.load(std::memory_order_relaxed));
+}
+
+void BlackBoxRecorder::arm(uint64_t reason, uint64_t position) {
+    uint64_t expected = none;
+    trigger.compare_exchange_strong(expected, (position << 2) | reason, std::memory_order_acq_rel);
+}
+
+bool BlackBoxRecorder::takeSnapshot(BlackBoxSnapshot& snapshot) const {
+    if (sampleCapacity == 0)
+        return false;
+    // The slot of the block being written may be torn
+    const uint64_t endBlock = blocksWritten.load(std::memory_order_acquire);
+    const uint64_t firstBlock = endBlock > blockCapacity - 1 ? endBlock - (blockCapacity - 1) : 0;
+    std::vector<BlockRecord> records;
+    records.reserve((size_t)(endBlock - firstBlock));
+    for (uint64_t block = firstBlock; block < endBlock; ++block)
+        records.push_back(blockRing[block % blockCapacity]);
+
+    // Discard the oldest records if the blocks written during the copy reused their slots
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t blocksNow = blocksWritten.load(std::memory_order_relaxed);
+    const uint64_t firstValidBlock = blocksNow > blockCapacity - 1 ? blocksNow - (blockCapacity - 1) : 0;
+    records.erase(records.begin(), records.begin() + (size_t)std::min<uint64_t>(records.size(), firstValidBlock > firstBlock ? firstValidBlock - firstBlock : 0));
+    if (records.empty())
+        return false;
+
+    // Short blocks can make the records span more than the samples still in the ring
+    const uint64_t end = records.back().start + records.back().numSamples;
+    const uint64_t oldestSample = end + maxBlockSize > sampleCapacity ? end + maxBlockSize - sampleCapacity : 0;
+    size_t oldBlocks = 0;
+    while (oldBlocks < records.size() && records[oldBlocks].start < oldestSample)
+        ++oldBlocks;
+    records.erase(records.begin(), records.begin() + oldBlocks);
+    if (records.empty())
+        return false;
+
+    const uint64_t start = records.front().start;
+    const size_t numSamples = (size_t)(end - start);
+    std::vector<std::vector<float>> input((size_t)numChannels, std::vector<float>(numSamples)), output = input;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        readRing(inputRing[channel].get(), sampleCapacity, start, numSamples, input[channel].data());
+        readRing(outputRing[channel].get(), sampleCapacity, start, numSamples, output[channel].data());
+    }
+
+    // Discard the samples that the writer may have overwritten during the copy, up to the end of the largest block it
+    // can be writing
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t samplesNow = samplesWritten.load(std::memory_order_relaxed);
+    const uint64_t firstValidSample = samplesNow + maxBlockSize > sampleCapacity ? samplesNow + maxBlockSize - sampleCapacity : 0;
+    size_t dropBlocks = 0;
+    while (dropBlocks < records.size() && records[dropBlocks].start < firstValidSample)
+        ++dropBlocks;
+    if (dropBlocks == records.size())
+        return false;
+    const size_t dropSamples = (size_t)(records[dropBlocks].start - start);
+
+    snapshot.sampleRate = sampleRate;
+    snapshot.numChannels = numChannels;
+    snapshot.firstSample = records[dropBlocks].start;
+    snapshot.blockSizes.clear();
+    snapshot.gains.clear();
+    for (size_t i = dropBlocks; i < records.size(); ++i) {
+        snapshot.blockSizes.push_back(records[i].numSamples);
+        snapshot.gains.push_back(records[i].gain);
+    }
+    snapshot.input.clear();
+    snapshot.output.clear();
+    for (int channel = 0; channel < numChannels; ++channel) {
+        snapshot.input.emplace_back(input[channel].begin() + dropSamples, input[channel].end());
+        snapshot.output.emplace_back(output[channel].begin() + dropSamples, output[channel].end());
+    }
+    return true;
+}
+
+void BlackBoxRecorder::startWatcher(const std::string& pathPrefix, double postTriggerSeconds, int maxSnapshots) {
+    stopWatcher();
+    this->pathPrefix = pathPrefix;
+    // The triggering block has to stay in the history when the snapshot is written
+    postTriggerSamples = std::min<uint64_t>((uint64_t)std::max(0.0, postTriggerSeconds * sampleRate), sampleCapacity / 2);
+    this->maxSnapshots = maxSnapshots;
+    stopping = false;
+    watcher = std::thread([this]() { watch(); });
+}
+
+void BlackBoxRecorder::stopWatcher() {
+    stopping = true;
+    if (watcher.joinable())
+        watcher.join();
+}
+
+const char* BlackBoxRecorder::getReasonName(uint64_t reason) {
+    switch (reason) {
+        case nonFinite:
+            return "nan";
+        case level:
+            return "level";
+        case request:
+            return "request";
+        default:
+            return "none";
+    }
+}
+
+void BlackBoxRecorder::watch() {
+    int snapshotIndex = 0, triggeredSnapshots = 0;
+    while (true) {
+        const bool stop = stopping.load();
+        if (!stop)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const uint64_t armed = trigger.load(std::memory_order_acquire);
+        const uint64_t reason = armed & 3, position = armed >> 2;
+        // When stopping, a pending trigger is written with the post-trigger history collected so far
+        if (armed != none && (stop || reason == request || samplesWritten.load(std::memory_order_acquire) >= position + postTriggerSamples)) {
+            BlackBoxSnapshot snapshot;
+            if (takeSnapshot(snapshot)) {
+                snapshot.reason = getReasonName(reason);
+                const std::string path = pathPrefix + "_" + std::to_string(snapshotIndex++) + "_" + snapshot.reason + ".bbox";
+                if (snapshot.write(path))
+                    std::cout << "Black box\t|\tSnapshot (" << snapshot.reason << ", " << snapshot.getNumSamples() << " samples) written to '" << path << "'" << std::endl;
+                else
+                    std::cerr << "Black box\t|\tCould not write the snapshot to '" << path << "'" << std::endl;
+            }
+            if (reason != request && ++triggeredSnapshots >= maxSnapshots) {
+                autoTrigger = false;
+                std::cout << "Black box\t|\t" << maxSnapshots << " snapshots triggered, the trigger is disabled" << std::endl;
+            }
+            trigger.store(none, std::memory_order_release);
+        }
+        if (stop)
+            return;
+    }
+}
+
+}  // namespace InferenceEngine
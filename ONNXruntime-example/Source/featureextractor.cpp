@@ -0,0 +1,185 @@
+/*
+==============================================================================*/
+#include "featureextractor.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+#endif
+
+namespace InferenceEngine {
+
+namespace {
+
+/** Dot product of two unaligned vectors, four lanes at a time with NEON or SSE (juce::FloatVectorOperations has none) */
+float dotProduct(const float* a, const float* b, int size) {
+    int k = 0;
+    float sum = 0.0f;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; k + 4 <= size; k += 4)
+        acc = vmlaq_f32(acc, vld1q_f32(a + k), vld1q_f32(b + k));
+    const float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    __m128 acc = _mm_setzero_ps();
+    for (; k + 4 <= size; k += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k)));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    sum = _mm_cvtss_f32(_mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1)));
+#endif
+    for (; k < size; ++k)
+        sum += a[k] * b[k];
+    return sum;
+}
+
+}  // namespace
+
+FeatureExtractor::FeatureExtractor(const FeatureExtractorConfig& config)
+    : config(config), fft(config.fftOrder), fftSize(1 << config.fftOrder), numBins((1 << config.fftOrder) / 2 + 1), numFeatures(config.numMfcc > 0 ? config.numMfcc : config.numMelBands) {
+    if (config.hopSize <= 0 || config.hopSize > fftSize)
+        throw std::logic_error("Error, the hop size has to be in the range [1, " + std::to_string(fftSize) + "] (Found " + std::to_string(config.hopSize) + " instead)");
+    if (config.numMfcc > config.numMelBands)
+        throw std::logic_error("Error, the number of MFCCs (" + std::to_string(config.numMfcc) + ") cannot exceed the number of mel bands (" + std::to_string(config.numMelBands) + ")");
+    if (config.numFrames <= 0)
+        throw std::logic_error("Error, the feature matrix needs at least one frame");
+}
+
+float FeatureExtractor::hzToMel(float hz) {
+    return 2595.0f * std::log10(1.0f + hz / 700.0f);
+}
+
+float FeatureExtractor::melToHz(float mel) {
+    return 700.0f * (std::pow(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+void FeatureExtractor::prepare() {
+    const int numMels = config.numMelBands;
+
+    window.resize(fftSize);
+    for (int n = 0; n < fftSize; ++n)
+        window[n] = 0.5f - 0.5f * std::cos(2.0f * juce::MathConstants<float>::pi * (float)n / (float)fftSize);
+
+    analysisBuffer.resize(fftSize);
+    fftBuffer.resize(2 * fftSize);
+
+    // Triangular filters with edges evenly spaced on the mel scale
+    const float nyquist = (float)config.sampleRate / 2.0f;
+    const float maxHz = (config.maxFrequency > 0.0f) ? std::min(config.maxFrequency, nyquist) : nyquist;
+    const float minMel = hzToMel(config.minFrequency), maxMel = hzToMel(maxHz);
+    std::vector<float> edges(numMels + 2);
+    for (int m = 0; m < numMels + 2; ++m)
+        edges[m] = melToHz(minMel + (maxMel - minMel) * (float)m / (float)(numMels + 1));
+
+    const float binWidth = (float)config.sampleRate / (float)fftSize;
+    filterFirstBin.assign(numMels, 0);
+    filterOffset.assign(numMels, 0);
+    filterLength.assign(numMels, 0);
+    filterWeights.clear();
+    for (int m = 0; m < numMels; ++m) {
+        const float lower = edges[m], center = edges[m + 1], upper = edges[m + 2];
+        int first = -1;
+        filterOffset[m] = (int)filterWeights.size();
+        for (int k = 0; k < numBins; ++k) {
+            const float f = k * binWidth;
+            float weight = 0.0f;
+            if (f > lower && f < upper)
+                weight = (f <= center) ? (f - lower) / (center - lower) : (upper - f) / (upper - center);
+            if (weight > 0.0f) {
+                if (first < 0)
+                    first = k;
+                // Keep the run contiguous, filling possible gaps with zeros
+                filterWeights.resize(filterOffset[m] + (k - first), 0.0f);
+                filterWeights.push_back(weight);
+            }
+        }
+        filterFirstBin[m] = std::max(first, 0);
+        filterLength[m] = (int)filterWeights.size() - filterOffset[m];
+    }
+    melEnergies.resize(numMels);
+
+    // Orthonormal DCT-II
+    if (config.numMfcc > 0) {
+        dctMatrix.resize(config.numMfcc * numMels);
+        for (int k = 0; k < config.numMfcc; ++k) {
+            const float scale = std::sqrt((k == 0 ? 1.0f : 2.0f) / (float)numMels);
+            for (int m = 0; m < numMels; ++m)
+                dctMatrix[k * numMels + m] = scale * std::cos(juce::MathConstants<float>::pi * (float)k * ((float)m + 0.5f) / (float)numMels);
+        }
+    }
+
+    featureRing.resize(2 * config.numFrames * numFeatures);
+
+    reset();
+}
+
+void FeatureExtractor::reset() {
+    std::fill(analysisBuffer.begin(), analysisBuffer.end(), 0.0f);
+    // Start from the features of silence rather than zeros, which would be a very loud log-mel frame
+    std::fill(featureRing.begin(), featureRing.end(), 0.0f);
+    ringHead = 0;
+    hopCounter = 0;
+    for (int frame = 0; frame < config.numFrames; ++frame)
+        analyseFrame();
+}
+
+int FeatureExtractor::pushSamples(const float* samples, int numSamples) {
+    const int hopSize = config.hopSize;
+    int newFrames = 0;
+    int pos = 0;
+    while (pos < numSamples) {
+        const int chunk = std::min(numSamples - pos, hopSize - hopCounter);
+        juce::FloatVectorOperations::copy(&analysisBuffer[fftSize - hopSize + hopCounter], samples + pos, chunk);
+        hopCounter += chunk;
+        pos += chunk;
+
+        if (hopCounter == hopSize) {
+            analyseFrame();
+            std::copy(analysisBuffer.begin() + hopSize, analysisBuffer.end(), analysisBuffer.begin());
+            hopCounter = 0;
+            ++newFrames;
+        }
+    }
+    return newFrames;
+}
+
+const float* FeatureExtractor::getFeatureMatrix() const {
+    return &featureRing[ringHead * numFeatures];
+}
+
+void FeatureExtractor::analyseFrame() {
+    const int numMels = config.numMelBands;
+
+    // Power spectrum
+    juce::FloatVectorOperations::multiply(fftBuffer.data(), analysisBuffer.data(), window.data(), fftSize);
+    juce::FloatVectorOperations::clear(fftBuffer.data() + fftSize, fftSize);
+    fft.performFrequencyOnlyForwardTransform(fftBuffer.data());
+    juce::FloatVectorOperations::multiply(fftBuffer.data(), fftBuffer.data(), numBins);
+
+    // Filterbank: one contiguous SIMD dot product per band
+    for (int m = 0; m < numMels; ++m) {
+        const float energy = dotProduct(&fftBuffer[filterFirstBin[m]], &filterWeights[filterOffset[m]], filterLength[m]);
+        melEnergies[m] = std::log(energy + config.logOffset);
+    }
+
+    // The new row is written twice so that the last numFrames rows are always contiguous
+    float* row = &featureRing[ringHead * numFeatures];
+    float* mirror = &featureRing[(ringHead + config.numFrames) * numFeatures];
+    if (config.numMfcc > 0) {
+        // DCT: one SIMD dot product per coefficient
+        for (int k = 0; k < config.numMfcc; ++k)
+            row[k] = dotProduct(&dctMatrix[k * numMels], melEnergies.data(), numMels);
+    } else {
+        juce::FloatVectorOperations::copy(row, melEnergies.data(), numMels);
+    }
+    juce::FloatVectorOperations::copy(mirror, row, numFeatures);
+
+    ringHead = (ringHead + 1) % config.numFrames;
+}
+
+}  // namespace InferenceEngine
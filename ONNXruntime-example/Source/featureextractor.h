@@ -0,0 +1,103 @@
+/*
+ * Streaming feature extractor (log-mel spectrogram / MFCC)
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * This header exposes a front end for classifier models that take a 2D feature matrix as input (see invokeFlat2D).
+ * Features are updated incrementally: every time a hop of new samples is available, a single frame is analysed and
+ * appended to a sliding [numFrames x numFeatures] matrix (one row per frame, oldest first).
+ *
+ * The matrix is stored in a mirrored ring buffer (every row is written twice, numFrames rows apart), so that the
+ * most recent numFrames rows are always contiguous in memory. getFeatureMatrix() returns a pointer to them that can
+ * be passed straight to invokeFlat2D, without shifting or copying the whole matrix at each hop.
+ *
+ * Every buffer is allocated in prepare(), so pushSamples() can be called from the real-time thread.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+namespace InferenceEngine {
+
+struct FeatureExtractorConfig {
+    double sampleRate = 48000.0;
+    int fftOrder = 10;           // log2 of the FFT size
+    int hopSize = 512;           // New samples between consecutive frames
+    int numMelBands = 40;        // Triangular filters in the mel filterbank
+    int numMfcc = 0;             // Number of cepstral coefficients (0 to output the log-mel bands instead)
+    int numFrames = 32;          // Rows of the feature matrix
+    float minFrequency = 0.0f;   // Lower edge of the filterbank (Hz)
+    float maxFrequency = 0.0f;   // Upper edge of the filterbank (Hz, 0 for Nyquist)
+    float logOffset = 1e-6f;     // Added to the mel energies before the log
+};
+
+class FeatureExtractor {
+public:
+    FeatureExtractor(const FeatureExtractorConfig& config);
+
+    /**
+     * @brief Compute filterbank and DCT tables and allocate every buffer (do not use in real time threads!)
+     */
+    void prepare();
+
+    /**
+     * @brief Clear the analysis buffer and the feature matrix
+     */
+    void reset();
+
+    /**
+     * @brief Feed new samples to the extractor, analysing a frame for every complete hop
+     *
+     * @param samples    Input samples
+     * @param numSamples Number of input samples
+     * @return int       Number of new rows appended to the feature matrix
+     */
+    int pushSamples(const float* samples, int numSamples);
+
+    /**
+     * @brief Get the current feature matrix
+     * The pointer refers to numFrames contiguous rows of numFeatures values, oldest frame first.
+     * It is only valid until the next call to pushSamples().
+     *
+     * @return const float* Flat feature matrix
+     */
+    const float* getFeatureMatrix() const;
+
+    int getNumFrames() const { return config.numFrames; }
+    int getNumFeatures() const { return numFeatures; }
+
+private:
+    /** Window, transform and reduce the current analysis frame to a row of features */
+    void analyseFrame();
+
+    static float hzToMel(float hz);
+    static float melToHz(float mel);
+
+    //--------------------------------------------------------------------------
+
+    const FeatureExtractorConfig config;
+    juce::dsp::FFT fft;
+    const int fftSize;
+    const int numBins;
+    const int numFeatures;
+
+    std::vector<float> window;          // Periodic Hann window
+    std::vector<float> analysisBuffer;  // Last fftSize input samples
+    std::vector<float> fftBuffer;       // 2*fftSize workspace for the transform
+
+    // Mel filterbank, each filter is stored as a contiguous run of weights starting from filterFirstBin
+    std::vector<int> filterFirstBin;
+    std::vector<int> filterOffset;
+    std::vector<int> filterLength;
+    std::vector<float> filterWeights;
+    std::vector<float> melEnergies;
+
+    std::vector<float> dctMatrix;  // Flat [numMfcc x numMelBands] orthonormal DCT-II
+
+    std::vector<float> featureRing;  // Mirrored ring of 2*numFrames rows
+    int ringHead = 0;                // Row written by the next frame
+    int hopCounter = 0;
+};
+
+}  // namespace InferenceEngine
@@ -0,0 +1,192 @@
+/*
+ * Planned pipeline of models and DSP stages
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * A chain of networks (e.g. a gate model feeding the saturator feeding a tone model) would otherwise take one plugin
+ * instance per model, with the host passing the audio from one to the next. An InferencePipeline runs the whole graph
+ * inside one processor. Its stages (inputs, sample-wise models and DSP functions) are declared once, and prepare()
+ * plans their execution:
+ *   - A stage that is the only reader of a stage with a single input is fused with it into one task, so chains run
+ *     back to back on the same core.
+ *   - Tasks are grouped in levels, each level after the tasks it reads from. The tasks of a level are independent and
+ *     run in parallel, on the calling (audio) thread and on numThreads - 1 worker threads.
+ *   - Model stages of a level that share an interpreter (e.g. the same model on every channel) are batched: when the
+ *     batch dimension of the model can be resized, their rows are stacked and the whole block runs in one invocation.
+ *   - The buffers between the stages come from one locked arena (see lockedarena.h), and buffers that are never live
+ *     in the same level share their memory.
+ *
+ * A model stage feeds its model one row per sample, made of the sample of each of its inputs followed by the
+ * conditioning values (e.g. the gain), and takes one output per row. This requires models that process each row
+ * independently, like the sample-wise saturator. The interpreters have to outlive the pipeline, and must not be used
+ * elsewhere once it is prepared (prepare() resizes their batch).
+ *
+ * The audio thread never waits for a task that no worker has started: it runs every task left unclaimed, and only
+ * spins on the ones that a worker is running. Pin the workers to cores that do not run real-time audio (see
+ * threadingconfig.h), a preempted worker delays the block. Idle workers spin for a while after their last task, then
+ * sleep between checks (with spinWait they always spin).
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lockedarena.h"
+#include "onnxwrapper.h"
+
+namespace InferenceEngine {
+
+class InferencePipeline {
+public:
+    /** DSP stage, writes numSamples samples to output from the blocks of its inputs (has to be real-time safe) */
+    using DspFunction = std::function<void(const float* const* inputs, int numInputs, float* output, int numSamples)>;
+
+    InferencePipeline() = default;
+    /** Stops the workers */
+    ~InferencePipeline();
+
+    InferencePipeline(const InferencePipeline&) = delete;
+    InferencePipeline& operator=(const InferencePipeline&) = delete;
+
+    /**
+     * @brief Declare an input, fed by the channel of process() with the same index as the input
+     *
+     * @return int Index of the stage, to use as input of other stages
+     */
+    int addInput(const std::string& name);
+
+    /**
+     * @brief Declare a sample-wise model stage
+     *
+     * @param name              Name of the stage (for the plan)
+     * @param interpreter       Model, with rows of inputs.size() + numConditioning values and one output per row
+     * @param inputs            Stages whose samples make the rows, in order (declared earlier)
+     * @param conditioning      Values appended to every row, read at every block (has to outlive the pipeline)
+     * @param numConditioning   Number of conditioning values
+     * @return int              Index of the stage
+     */
+    int addModel(const std::string& name, InterpreterPtr interpreter, const std::vector<int>& inputs, const float* conditioning = nullptr, int numConditioning = 0);
+
+    /**
+     * @brief Declare a DSP stage (e.g. a mix of two branches)
+     *
+     * @param name      Name of the stage (for the plan)
+     * @param function  Processing of the stage
+     * @param inputs    Stages whose blocks are passed to the function, in order (declared earlier)
+     * @return int      Index of the stage
+     */
+    int addDsp(const std::string& name, DspFunction function, const std::vector<int>& inputs);
+
+    /** Copy a stage to the channel of process() with the same index as the output */
+    void addOutput(int stage);
+
+    /**
+     * @brief Plan the graph, allocate the arena and start the workers (do not use in real time threads!)
+     * Throws std::logic_error if a model does not match its stages.
+     *
+     * @param maxBlockSize  Maximum number of samples per call of process() (longer blocks are split)
+     * @param threading     numThreads includes the calling thread, affinity and scheduling apply to the workers
+     */
+    void prepare(int maxBlockSize, const ThreadingConfig& threading = ThreadingConfig());
+    bool isPrepared() const { return prepared; }
+
+    /**
+     * @brief Run the graph on a block (real-time safe)
+     *
+     * @param inputs        One channel per input, read before any output is written (the block can be processed in place)
+     * @param outputs       One channel per output
+     * @param numSamples    Number of samples
+     */
+    void process(const float* const* inputs, float* const* outputs, int numSamples);
+
+    int getNumInputs() const { return (int)inputStages.size(); }
+    int getNumOutputs() const { return (int)outputStages.size(); }
+    int getNumLevels() const { return (int)levelEnds.size(); }
+    int getNumTasks() const { return (int)tasks.size(); }
+    int getNumWorkers() const { return (int)workers.size(); }
+    /** Bytes of the arena of the buffers between the stages */
+    size_t getArenaBytes() const { return arena != nullptr ? arena->getCapacity() : 0; }
+
+    /** Levels, tasks and buffers of the plan, one line each */
+    void printPlan(std::ostream& stream) const;
+
+private:
+    using Engine = ModelEngine<OnnxBackend>;
+
+    enum StageType { Input, Model, Dsp };
+
+    struct Stage {
+        std::string name;
+        StageType type = Input;
+        std::vector<int> inputs;
+        int numReaders = 0;  // Stages and outputs reading the stage
+        int task = -1;
+
+        int model = -1;  // Index in models
+        const float* conditioning = nullptr;
+        int numConditioning = 0;
+        DspFunction function;
+
+        float* buffer = nullptr;                 // maxBlockSize samples in the arena
+        std::vector<const float*> inputBuffers;  // Buffers of the inputs
+    };
+
+    /** Interpreter shared by one or more model stages */
+    struct ModelBinding {
+        InterpreterPtr interpreter = nullptr;
+        Engine engine;
+        size_t rowSize = 0;
+        size_t batchRows = 0;  // Rows per invocation
+        bool stacked = false;  // One invocation per block, stage i of a step at row i * maxBlockSize
+    };
+
+    /** Stages run in order on one thread, each step is one stage or model stages batched on one interpreter */
+    struct Task {
+        std::vector<std::vector<int>> steps;
+        int level = 0;
+    };
+
+    int addStage(Stage stage);
+    void plan();
+    void planBuffers();
+    void prepareModels();
+    void startWorkers(const ThreadingConfig& threading);
+    void stopWorkers();
+
+    void processChunk(const float* const* inputs, float* const* outputs, int offset, int numSamples);
+    /** Claim and run the next task of the released levels, false if there was none to claim */
+    bool runNextTask();
+    void runTask(const Task& task, int numSamples);
+    void runModelStep(const std::vector<int>& step, int numSamples);
+    void workerLoop();
+
+    std::vector<Stage> stages;
+    std::vector<int> inputStages, outputStages;
+    std::vector<ModelBinding> models;
+    std::vector<Task> tasks;          // Sorted by level
+    std::vector<uint32_t> levelEnds;  // One past the last task of each level
+    int maxBlockSize = 0;
+    bool prepared = false;
+
+    std::unique_ptr<LockedArena> arena;
+    int numBuffers = 0;
+
+    // Progress of the current block, shared with the workers. The block number is in the upper 32 bits of the task
+    // counters, so that a worker late from a previous block cannot claim a task of the current one.
+    std::atomic<uint64_t> claimedTasks{0};   // Next task to claim
+    std::atomic<uint64_t> releasedTasks{0};  // One past the last task whose inputs are ready
+    std::atomic<uint32_t> completedTasks{0};
+    uint64_t blockNumber = 0;
+    int blockSamples = 0;
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+    bool workersSpin = false;
+};
+
+}  // namespace InferenceEngine
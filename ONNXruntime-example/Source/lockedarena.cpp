@@ -0,0 +1,196 @@
+/*
+==============================================================================*/
+#include "lockedarena.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if defined(__linux__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #define LOCKED_ARENA_POSIX 1
+#else
+    #define LOCKED_ARENA_POSIX 0
+#endif
+
+namespace InferenceEngine {
+
+std::atomic<size_t> LockedArena::processLockedBytes{0};
+
+namespace {
+
+size_t getPageSize() {
+#if LOCKED_ARENA_POSIX
+    return (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/** Whole pages covering a block of memory */
+void getPageRange(void* block, size_t bytes, uintptr_t& start, size_t& length) {
+    const size_t pageSize = getPageSize();
+    start = reinterpret_cast<uintptr_t>(block) / pageSize * pageSize;
+    length = roundUp(reinterpret_cast<uintptr_t>(block) + bytes - start, pageSize);
+}
+
+#if LOCKED_ARENA_POSIX
+/**
+ * Number of lockAndPrefault() calls holding each page.
+ * Locks do not nest (one munlock unlocks a page however many times it was locked), and the blocks passed to
+ * lockAndPrefault() can share pages: weights mapped from the model buffer shared by the instances, or heap blocks
+ * next to each other. A page is unlocked only when the last block holding it is unlocked.
+ */
+std::mutex pageLocksMutex;
+std::map<uintptr_t, size_t> pageLocks;
+
+/** Call function(start, length) for each run of consecutive pages of a sorted list */
+template <typename Function>
+void forEachRun(const std::vector<uintptr_t>& pages, Function function) {
+    const size_t pageSize = getPageSize();
+    for (size_t first = 0, last = 0; first < pages.size(); first = last) {
+        for (last = first + 1; last < pages.size() && pages[last] == pages[last - 1] + pageSize; ++last) {}
+        function(pages[first], (last - first) * pageSize);
+    }
+}
+#endif
+
+}  // namespace
+
+LockedArena::LockedArena(size_t capacityBytes, bool useHugePages) {
+#if LOCKED_ARENA_POSIX
+    #if defined(MAP_HUGETLB)
+    if (useHugePages) {
+        // Explicit huge pages (needs vm.nr_hugepages), the size has to be a multiple of the huge page size
+        capacity = roundUp(capacityBytes, hugePageSize);
+        void* block = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (block != MAP_FAILED) {
+            data = static_cast<char*>(block);
+            hugePages = true;
+        }
+    }
+    #endif
+    if (data == nullptr) {
+        capacity = roundUp(capacityBytes, getPageSize());
+        void* block = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED)
+            throw std::bad_alloc();
+        data = static_cast<char*>(block);
+    #if defined(MADV_HUGEPAGE)
+        // Transparent huge pages, if enabled in the kernel
+        if (useHugePages)
+            madvise(data, capacity, MADV_HUGEPAGE);
+    #endif
+    }
+    mapped = true;
+    if (mlock(data, capacity) == 0) {
+        lockedBytes = capacity;
+        processLockedBytes += lockedBytes;
+    }
+#else
+    capacity = roundUp(capacityBytes, getPageSize());
+    data = static_cast<char*>(std::malloc(capacity));
+    if (data == nullptr)
+        throw std::bad_alloc();
+#endif
+    // Prefault every page
+    std::memset(data, 0, capacity);
+}
+
+LockedArena::~LockedArena() {
+#if LOCKED_ARENA_POSIX
+    if (lockedBytes > 0) {
+        munlock(data, capacity);
+        processLockedBytes -= lockedBytes;
+    }
+    if (mapped)
+        munmap(data, capacity);
+#else
+    std::free(data);
+#endif
+}
+
+void* LockedArena::allocate(size_t bytes, size_t alignment) {
+    const uintptr_t base = reinterpret_cast<uintptr_t>(data);
+    const size_t offset = (size_t)(roundUp(base + used, alignment) - base);
+    if (offset + bytes > capacity)
+        return nullptr;
+    used = offset + bytes;
+    if (used > peak)
+        peak = used;
+    return data + offset;
+}
+
+size_t LockedArena::lockAndPrefault(void* block, size_t bytes) {
+    if (block == nullptr || bytes == 0)
+        return 0;
+    uintptr_t start;
+    size_t length;
+    getPageRange(block, bytes, start, length);
+
+    // Read every page, since the memory can be read-only (e.g. weights mapped from the model buffer)
+    // mlock also faults in the pages of writable mappings for writing
+    const volatile char* bytesPtr = static_cast<const volatile char*>(block);
+    char sink = 0;
+    for (size_t i = 0; i < bytes; i += getPageSize())
+        sink ^= bytesPtr[i];
+    sink ^= bytesPtr[bytes - 1];
+    (void)sink;
+
+#if LOCKED_ARENA_POSIX
+    // Only the pages that no other block holds are locked here
+    std::lock_guard<std::mutex> lock(pageLocksMutex);
+    std::vector<uintptr_t> newPages;
+    for (uintptr_t page = start; page < start + length; page += getPageSize())
+        if (pageLocks.count(page) == 0)
+            newPages.push_back(page);
+    bool locked = true;
+    forEachRun(newPages, [&locked](uintptr_t runStart, size_t runLength) {
+        locked = locked && mlock(reinterpret_cast<void*>(runStart), runLength) == 0;
+    });
+    if (!locked) {
+        forEachRun(newPages, [](uintptr_t runStart, size_t runLength) { munlock(reinterpret_cast<void*>(runStart), runLength); });
+        return 0;
+    }
+    for (uintptr_t page = start; page < start + length; page += getPageSize())
+        ++pageLocks[page];
+    processLockedBytes += newPages.size() * getPageSize();
+    return length;
+#else
+    return 0;
+#endif
+}
+
+void LockedArena::unlock(void* block, size_t bytes) {
+    if (block == nullptr || bytes == 0)
+        return;
+#if LOCKED_ARENA_POSIX
+    uintptr_t start;
+    size_t length;
+    getPageRange(block, bytes, start, length);
+    std::lock_guard<std::mutex> lock(pageLocksMutex);
+    std::vector<uintptr_t> freedPages;
+    for (uintptr_t page = start; page < start + length; page += getPageSize()) {
+        auto pageLock = pageLocks.find(page);
+        if (pageLock == pageLocks.end())
+            continue;
+        if (--pageLock->second == 0) {
+            pageLocks.erase(pageLock);
+            freedPages.push_back(page);
+        }
+    }
+    forEachRun(freedPages, [](uintptr_t runStart, size_t runLength) { munlock(reinterpret_cast<void*>(runStart), runLength); });
+    processLockedBytes -= freedPages.size() * getPageSize();
+#endif
+}
+
+}  // namespace InferenceEngine
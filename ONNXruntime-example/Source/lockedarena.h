@@ -0,0 +1,130 @@
+/*
+ * Locked memory arena
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * A fixed-capacity bump allocator for the memory touched by the real-time thread (interpreter input/output tensors
+ * and the staging buffers of the processor). The whole arena is mapped at construction, optionally backed by huge
+ * pages, locked in RAM (mlock) and prefaulted by writing every page, so that the first blocks processed after the
+ * instantiation of a plugin do not pay for page faults.
+ *
+ * Allocations are cache-line aligned and are never freed individually: the arena is released as a whole when it is
+ * destroyed. Memory that is allocated elsewhere (e.g. by the interpreter) can be locked and prefaulted with
+ * lockAndPrefault(). Locking fails silently if the memlock limit (ulimit -l) is too low, getLockedBytes() reports
+ * what was actually locked.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace InferenceEngine {
+
+class LockedArena {
+public:
+    static constexpr size_t cacheLineSize = 64;
+
+    /**
+     * @brief Map, lock and prefault the arena (do not use in real time threads!)
+     *
+     * @param capacityBytes Size of the arena (rounded up to whole pages)
+     * @param useHugePages  Back the arena with huge pages if available (falls back to regular pages)
+     */
+    explicit LockedArena(size_t capacityBytes, bool useHugePages = false);
+    ~LockedArena();
+
+    LockedArena(const LockedArena&) = delete;
+    LockedArena& operator=(const LockedArena&) = delete;
+
+    /**
+     * @brief Allocate a block from the arena (real-time safe)
+     *
+     * @param bytes     Size of the block
+     * @param alignment Alignment of the block (power of two)
+     * @return void*    Pointer to the block, nullptr if the arena is exhausted
+     */
+    void* allocate(size_t bytes, size_t alignment = cacheLineSize);
+
+    /**
+     * @brief Lock and prefault memory that does not belong to an arena (do not use in real time threads!)
+     * The locks are counted per page, so blocks can share pages (e.g. weights of a model buffer shared by many
+     * interpreters): a page stays locked until every block holding it is unlocked.
+     *
+     * @return size_t Number of bytes locked (whole pages), 0 if locking failed
+     */
+    static size_t lockAndPrefault(void* data, size_t bytes);
+
+    /**
+     * @brief Unlock memory locked with lockAndPrefault(), before it is freed (do not use in real time threads!)
+     * Only call it for blocks whose lockAndPrefault() succeeded, with the same block.
+     */
+    static void unlock(void* data, size_t bytes);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsedBytes() const { return used; }
+    /** Highest number of bytes in use since the arena was created */
+    size_t getPeakBytes() const { return peak; }
+    /** Bytes of the arena locked in RAM */
+    size_t getLockedBytes() const { return lockedBytes; }
+    bool usesHugePages() const { return hugePages; }
+
+    /** Bytes locked by every arena and lockAndPrefault() call in the process */
+    static size_t getProcessLockedBytes() { return processLockedBytes.load(); }
+
+private:
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t peak = 0;
+    size_t lockedBytes = 0;
+    bool hugePages = false;
+    bool mapped = false;
+
+    static std::atomic<size_t> processLockedBytes;
+};
+
+/**
+ * Standard allocator drawing from a LockedArena, so that containers can keep their storage in locked memory.
+ * Without an arena it falls back to the default heap.
+ */
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator(LockedArena* arena = nullptr) noexcept : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (arena == nullptr)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        void* block = arena->allocate(n * sizeof(T), alignof(T) > LockedArena::cacheLineSize ? alignof(T) : LockedArena::cacheLineSize);
+        if (block == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T*>(block);
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        if (arena == nullptr)
+            ::operator delete(p);
+        // Arena blocks are released with the arena
+    }
+
+    LockedArena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+/** Vector whose storage is allocated from a LockedArena */
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace InferenceEngine
@@ -0,0 +1,76 @@
+/*
+ * Compile-time engine facade for the hot path
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * The wrappers hide the engine behind an opaque InterpreterPtr, so every invoke() is an out-of-line call that checks
+ * the sizes against the tensor dimensions, copies the input into the tensor and the output out of it (and looks for
+ * the argmax of the output, for classifiers). ModelEngine does that work once: bind() validates the shapes and keeps
+ * the raw pointers of the input and output tensors. The caller then writes the input tensor and reads the output
+ * tensor in place, through inline accessors, and run() is the only call that leaves the header.
+ *
+ * The backend is a template parameter, a struct with
+ *   using Handle = ...;                        // e.g. InterpreterPtr
+ *   static TensorBinding bind(Handle handle);  // Tensors of the handle (out of line, not real-time safe)
+ *   static void run(Handle handle);            // Invoke on the data already in the input tensor (out of line)
+ * TFLiteBackend (tflitewrapper.h) and OnnxBackend (onnxwrapper.h) are the backends of the two engines, so the engine
+ * headers stay out of the translation units of the processor.
+ *
+ * The pointers change when the engine reallocates its tensors (batch size, placeTensorsInArena): bind again afterwards.
+ */
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace InferenceEngine {
+
+/** Input and output tensors of an interpreter, as bound by its backend */
+struct TensorBinding {
+    float* input = nullptr;
+    size_t inputSize = 0;
+    const float* output = nullptr;
+    size_t outputSize = 0;
+};
+
+template <typename Backend>
+class ModelEngine {
+public:
+    using Handle = typename Backend::Handle;
+
+    /**
+     * @brief Keep the tensors of an interpreter and validate their sizes (do not use in real time threads!)
+     *
+     * @param handle        Interpreter, has to outlive the binding
+     * @param inputSize     Expected elements in the input tensor (0 to accept any)
+     * @param outputSize    Expected elements in the output tensor (0 to accept any)
+     */
+    void bind(Handle handle, size_t inputSize = 0, size_t outputSize = 0) {
+        const TensorBinding newBinding = Backend::bind(handle);
+        if (inputSize != 0 && newBinding.inputSize != inputSize)
+            throw std::logic_error("Error, the model input has to have size: " + std::to_string(inputSize) + " (Found " + std::to_string(newBinding.inputSize) + " instead)");
+        if (outputSize != 0 && newBinding.outputSize != outputSize)
+            throw std::logic_error("Error, the model output has to have size: " + std::to_string(outputSize) + " (Found " + std::to_string(newBinding.outputSize) + " instead)");
+        this->handle = handle;
+        binding = newBinding;
+    }
+    void unbind() {
+        handle = Handle();
+        binding = TensorBinding();
+    }
+    bool isBound() const { return binding.input != nullptr; }
+
+    /** Write the input here before run(), and read the output after it (real-time safe) */
+    float* input() { return binding.input; }
+    const float* output() const { return binding.output; }
+    size_t inputSize() const { return binding.inputSize; }
+    size_t outputSize() const { return binding.outputSize; }
+
+    /** Invoke the model on the input tensor, without copies or checks (real-time safe) */
+    void run() { Backend::run(handle); }
+
+private:
+    Handle handle = Handle();
+    TensorBinding binding;
+};
+
+}  // namespace InferenceEngine
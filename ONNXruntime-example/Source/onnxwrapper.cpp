@@ -2,18 +2,29 @@
 ==============================================================================*/
 #include "onnxwrapper.h"
 
+#include "lockedarena.h"
+#include "opprofiler.h"
+#include "perfcounters.h"
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <iomanip>
 #include <iostream>
 #include <limits>  // std::numeric_limits
+#include <fstream>
+#include <mutex>
 #include <numeric>
+#include <regex>
 #include <sstream>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include <unistd.h>
+
 #include "onnxruntime_cxx_api.h"
 
 namespace InferenceEngine {
@@ -44,31 +55,74 @@ std::ostream &operator<<(std::ostream &os, const std::vector<T> &v) {
 class InterpreterWrap {
 public:
     /** Constructor */
-    InterpreterWrap(const std::string &filename, bool verbose = false);            // Construct from file path
-    InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose = false);  // Construct from buffer
+    InterpreterWrap(const std::string &filename, bool verbose = false, const ThreadingConfig &threading = ThreadingConfig(), bool profiling = false);            // Construct from file path
+    InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose = false, const ThreadingConfig &threading = ThreadingConfig(), bool profiling = false);  // Construct from buffer
     void buildAndPrime(bool verbose = false);                                      // Build and prime the interpreter | Common part to the two constructors
 
     /** Destructor */
     ~InterpreterWrap();
     /** Internal interpreter invocation function, called by wrappers */
     void invoke_internal(const float inputVector[], size_t inputSize, float outputVector[], size_t outputSize, bool verbose = false);
+    /** Run on the data already in the input tensor, see ModelEngine */
+    void invokeBound();
+    TensorBinding getTensorBinding();
+    std::map<std::string, std::string> getMetadata();
+    ModelMemoryUsage getModelMemoryUsage() const;
+    std::vector<WeightTensorInfo> getWeightLayout();
+    bool attachWeightBank(const WeightBank &bank);
+    void useWeightSet(int set);
+    /** Change the first dimension of the input and output tensors (dynamic batch models only) */
+    bool resizeBatch(size_t newBatchSize);
+    /** Reallocate the input and output buffers from the arena */
+    void placeTensorsInArena(LockedArena &arena, bool verbose = false);
+    /** End profiling and convert the events of the ONNX Runtime profile */
+    bool exportProfile(const std::string &traceJsonPath, const std::string &summaryPath);
+    /** Measure the invocations in the performance counter region of the current batch size (see perfcounters.h) */
+    void updatePerfRegion();
+
+    /** Rows and columns of a [1 x rows x columns] input, 0 for inputs with fewer dimensions */
+    size_t requested2drows() const { return inputDims.size() < 3 ? 0 : (size_t)inputDims[1]; }
+    size_t requested2dcols() const { return inputDims.size() < 3 ? 0 : (size_t)inputDims[2]; }
 
     size_t inputTensorSize;
     size_t outputTensorSize;
+    size_t batchSize;
 private:
+    /** (Re)create the input and output tensors from inputDims and outputDims, and prime the session */
+    void createTensorsAndPrime();
+    /** (Re)create the tensors of every set of the weight bank, the ones of the active set follow the input tensor */
+    void createWeightTensors();
+    /** Heap allocated by the creation of the session, outside of the model and the tensors */
+    void measureRuntimeBytes(size_t heapBytesBefore);
+
     /** Load the .onnx model and create inference session */
-    Ort::Session *loadModel(const std::string &filename);
-    Ort::Session *loadModelFromBuffer(const char *buffer, size_t bufferSize);
+    Ort::Session *loadModel(const std::string &filename, const ThreadingConfig &threading, bool profiling);
+    Ort::Session *loadModelFromBuffer(const char *buffer, size_t bufferSize, const ThreadingConfig &threading, bool profiling);
 
     //--------------------------------------------------------------------------
     Ort::Session *session;
 
-    std::vector<float> inputTensorValues;
-    std::vector<float> outputTensorValues;
+    LockedArena *tensorArena = nullptr;  // Provides inputTensorValues and outputTensorValues if set
+    ArenaVector<float> inputTensorValues;
+    ArenaVector<float> outputTensorValues;
     std::vector<const char *> inputNames;
     std::vector<const char *> outputNames;
     std::vector<Ort::Value> inputTensors;
     std::vector<Ort::Value> outputTensors;
+    std::vector<int64_t> inputDims;
+    std::vector<int64_t> outputDims;
+    bool dynamicBatch = false;  // True if the model was exported with a dynamic batch dimension
+    bool profiling = false;     // True until the profile is exported
+    int numThreads = 1;
+    ThreadingConfig threading;         // Read by the intra-op workers when ONNX Runtime creates them
+    PerfRegion *perfRegion = nullptr;  // Null unless INFERENCE_PERF_COUNTERS
+    size_t modelBytes = 0;
+    size_t runtimeBytes = 0;  // See measureRuntimeBytes
+
+    const WeightBank *weightBank = nullptr;  // Null unless attachWeightBank
+    std::vector<std::string> weightNames;    // Initializers overridden at every run, after the input
+    std::vector<Ort::Value> weightValues;    // Tensors over the bank, [set][tensor], the active ones are moved to inputTensors
+    int activeWeightSet = 0;
 };
 
 size_t getModelInputSize1d(InterpreterPtr inp) {
@@ -79,31 +133,63 @@ size_t getModelOutputSize(InterpreterPtr inp) {
     return inp->outputTensorSize;
 }
 
-InterpreterWrap::InterpreterWrap(const std::string &filename, bool verbose) {
+void getModelInputSize2d(InterpreterPtr inp, size_t &rows, size_t &columns) {
+    rows = inp->requested2drows();
+    columns = inp->requested2dcols();
+    if (rows == 0 || columns == 0)
+        throw std::logic_error("Error, the model input has to be shaped [1 x rows x columns]");
+}
+
+size_t getModelBatchSize(InterpreterPtr inp) {
+    return inp->batchSize;
+}
+
+size_t placeTensorsInArena(InterpreterPtr inp, LockedArena &arena, bool verbose) {
+    inp->placeTensorsInArena(arena, verbose);
+    return 0;
+}
+
+bool setModelBatchSize(InterpreterPtr inp, size_t batchSize) {
+    if (batchSize == 0)
+        return false;
+    return inp->resizeBatch(batchSize);
+}
+
+void resetModelState(InterpreterPtr inp) {
+    (void)inp;
+}
+
+InterpreterWrap::InterpreterWrap(const std::string &filename, bool verbose, const ThreadingConfig &threading, bool profiling) : profiling(profiling), numThreads(std::max(1, threading.numThreads)), threading(threading) {
+    const size_t heapBytesBefore = getAllocatedHeapBytes();
     // Load model
     if (verbose) {
         std::cout << std::setfill('-') << std::setw(40) << "" << std::endl;
         std::cout << "Creating environment..." << std::endl;
     }
-    this->session = loadModel(filename);
+    this->session = loadModel(filename, this->threading, profiling);
     if (verbose) {
         std::cout << "Model loaded successfully." << std::endl;
         std::cout << "File: " << filename << std::endl;
     }
+    std::ifstream modelFile(filename, std::ios::binary | std::ios::ate);
+    modelBytes = modelFile ? (size_t)modelFile.tellg() : 0;
     buildAndPrime(verbose);
+    measureRuntimeBytes(heapBytesBefore);
 }
 
-InterpreterWrap::InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose) {
+InterpreterWrap::InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose, const ThreadingConfig &threading, bool profiling) : profiling(profiling), numThreads(std::max(1, threading.numThreads)), threading(threading), modelBytes(bufferSize) {
+    const size_t heapBytesBefore = getAllocatedHeapBytes();
     // Load model
     if (verbose) {
         std::cout << std::setfill('-') << std::setw(40) << "" << std::endl;
         std::cout << "Creating environment..." << std::endl;
     }
-    this->session = loadModelFromBuffer(buffer, bufferSize);
+    this->session = loadModelFromBuffer(buffer, bufferSize, this->threading, profiling);
     if (verbose) {
         std::cout << "Model created from buffer." << std::endl;
     }
     buildAndPrime(verbose);
+    measureRuntimeBytes(heapBytesBefore);
 }
 
 void InterpreterWrap::buildAndPrime(bool verbose) {
@@ -112,18 +198,23 @@ void InterpreterWrap::buildAndPrime(bool verbose) {
 
     size_t numInputNodes = session->GetInputCount();
     size_t numOutputNodes = session->GetOutputCount();
+    // Overridable initializers (see getWeightLayout) are not counted, any other input would be left unfed
+    if (numInputNodes != 1) {
+        delete session;  // Thrown from the constructor, the destructor does not run
+        throw std::logic_error("Error, the model has to have a single input, only stateless models are supported (Found " + std::to_string(numInputNodes) + " inputs instead)");
+    }
 
     const char *inputName = session->GetInputName(0, allocator);
     Ort::TypeInfo inputTypeInfo = session->GetInputTypeInfo(0);
     auto inputTensorInfo = inputTypeInfo.GetTensorTypeAndShapeInfo();
     ONNXTensorElementDataType inputType = inputTensorInfo.GetElementType();
-    std::vector<int64_t> inputDims = inputTensorInfo.GetShape();
+    inputDims = inputTensorInfo.GetShape();
 
     const char *outputName = session->GetOutputName(0, allocator);
     Ort::TypeInfo outputTypeInfo = session->GetOutputTypeInfo(0);
     auto outputTensorInfo = outputTypeInfo.GetTensorTypeAndShapeInfo();
     ONNXTensorElementDataType outputType = outputTensorInfo.GetElementType();
-    std::vector<int64_t> outputDims = outputTensorInfo.GetShape();
+    outputDims = outputTensorInfo.GetShape();
 
     if (verbose) {
         std::cout << std::setfill('-') << std::setw(40) << "" << std::endl;
@@ -147,19 +238,35 @@ void InterpreterWrap::buildAndPrime(bool verbose) {
         std::cout << std::setfill('-') << std::setw(40) << "" << std::endl;
     }
 
-    inputTensorSize = vectorProduct(inputDims);
-    inputTensorValues = std::vector<float>(inputTensorSize);
-
-    outputTensorSize = vectorProduct(outputDims);
-    outputTensorValues = std::vector<float>(outputTensorSize);
+    // A dynamic batch dimension (-1) starts at 1 and can be changed with setModelBatchSize
+    dynamicBatch = !inputDims.empty() && inputDims[0] < 0;
+    if (dynamicBatch) {
+        inputDims[0] = 1;
+        if (!outputDims.empty() && outputDims[0] < 0)
+            outputDims[0] = 1;
+    }
 
     inputNames.push_back(inputName);
     outputNames.push_back(outputName);
 
+    createTensorsAndPrime();
+}
+
+void InterpreterWrap::createTensorsAndPrime() {
+    batchSize = inputDims.empty() ? 1 : (size_t)inputDims[0];
+    inputTensorSize = vectorProduct(inputDims);
+    inputTensorValues = ArenaVector<float>(inputTensorSize, 0.0f, tensorArena);
+
+    outputTensorSize = vectorProduct(outputDims);
+    outputTensorValues = ArenaVector<float>(outputTensorSize, 0.0f, tensorArena);
+
+    inputTensors.clear();
+    outputTensors.clear();
     Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
     inputTensors.push_back(Ort::Value::CreateTensor<float>(
         memoryInfo, inputTensorValues.data(), inputTensorSize, inputDims.data(),
         inputDims.size()));
+    createWeightTensors();
     outputTensors.push_back(Ort::Value::CreateTensor<float>(
         memoryInfo, outputTensorValues.data(), outputTensorSize,
         outputDims.data(), outputDims.size()));
@@ -173,13 +280,202 @@ void InterpreterWrap::buildAndPrime(bool verbose) {
      * The priming operation should ensure that every allocation performed
      * by the Run method is perfomed here and not in the real-time thread.
      */
+    updatePerfRegion();
+}
+
+void InterpreterWrap::updatePerfRegion() {
+    if (INFERENCE_PERF_COUNTERS)
+        perfRegion = getPerfRegion("ONNXruntime invoke (batch " + std::to_string(batchSize) + ", " + std::to_string(numThreads) + " threads)");
+}
+
+bool InterpreterWrap::resizeBatch(size_t newBatchSize) {
+    if (newBatchSize == batchSize)
+        return true;
+    if (!dynamicBatch || outputDims.empty())
+        return false;
+    inputDims[0] = (int64_t)newBatchSize;
+    outputDims[0] = (int64_t)newBatchSize;
+    createTensorsAndPrime();
+    return true;
+}
+
+void InterpreterWrap::placeTensorsInArena(LockedArena &arena, bool verbose) {
+    tensorArena = &arena;
+    createTensorsAndPrime();
+    if (verbose)
+        std::cout << "Input and output buffers allocated in the memory arena (" << arena.getUsedBytes() << " bytes used)" << std::endl;
+}
+
+std::vector<WeightTensorInfo> InterpreterWrap::getWeightLayout() {
+    std::vector<WeightTensorInfo> layout;
+    Ort::AllocatorWithDefaultOptions allocator;
+    for (size_t i = 0; i < session->GetOverridableInitializerCount(); ++i) {
+        char *name = session->GetOverridableInitializerName(i, allocator);
+        WeightTensorInfo info;
+        info.name = name;
+        allocator.Free(name);
+        Ort::TypeInfo typeInfo = session->GetOverridableInitializerTypeInfo(i);
+        auto tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+        const std::vector<int64_t> shape = tensorInfo.GetShape();
+        if (tensorInfo.GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || std::any_of(shape.begin(), shape.end(), [](int64_t dim) { return dim < 0; }))
+            continue;
+        info.shape.assign(shape.begin(), shape.end());
+        info.size = (size_t)vectorProduct(shape);
+        layout.push_back(info);
+    }
+    return layout;
+}
+
+bool InterpreterWrap::attachWeightBank(const WeightBank &bank) {
+    const std::vector<WeightTensorInfo> layout = getWeightLayout();
+    if (layout.empty() || bank.getNumSets() == 0 || layout != bank.getLayout())
+        return false;
+    weightBank = &bank;
+    weightNames.clear();
+    for (const WeightTensorInfo &info : layout)
+        weightNames.push_back(info.name);
+    activeWeightSet = 0;
+    createWeightTensors();
+
+    // The run has more inputs from now on, prime it again
+    std::vector<float> pIv(inputTensorSize);
+    std::vector<float> pOv(outputTensorSize);
+    this->invoke_internal(&pIv[0], pIv.size(), &pOv[0], pOv.size());
+    return true;
+}
+
+void InterpreterWrap::createWeightTensors() {
+    inputTensors.erase(inputTensors.begin() + 1, inputTensors.end());
+    inputNames.resize(1);
+    weightValues.clear();
+    if (weightBank == nullptr)
+        return;
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    const std::vector<WeightTensorInfo> &layout = weightBank->getLayout();
+    for (int set = 0; set < weightBank->getNumSets(); ++set) {
+        for (size_t t = 0; t < layout.size(); ++t) {
+            const std::vector<int64_t> shape(layout[t].shape.begin(), layout[t].shape.end());
+            // The session only reads the initializers
+            float *values = const_cast<float *>(weightBank->getTensor(set, (int)t));
+            weightValues.push_back(Ort::Value::CreateTensor<float>(memoryInfo, values, layout[t].size, shape.data(), shape.size()));
+        }
+    }
+    for (size_t t = 0; t < layout.size(); ++t) {
+        inputNames.push_back(weightNames[t].c_str());
+        inputTensors.push_back(std::move(weightValues[(size_t)activeWeightSet * layout.size() + t]));
+    }
+}
+
+void InterpreterWrap::useWeightSet(int set) {
+    if (weightBank == nullptr || set == activeWeightSet || set < 0 || set >= weightBank->getNumSets())
+        return;
+    // Moving an Ort::Value only exchanges pointers: the tensors of the active set go back to their slot, and the
+    // ones of the new set take their place among the inputs, without allocating or releasing anything
+    const size_t numTensors = weightNames.size();
+    for (size_t t = 0; t < numTensors; ++t) {
+        std::swap(inputTensors[1 + t], weightValues[(size_t)activeWeightSet * numTensors + t]);
+        std::swap(inputTensors[1 + t], weightValues[(size_t)set * numTensors + t]);
+    }
+    activeWeightSet = set;
 }
 
 InterpreterWrap::~InterpreterWrap() {
     delete this->session;
 }
 
+bool InterpreterWrap::exportProfile(const std::string &traceJsonPath, const std::string &summaryPath) {
+    if (!profiling)
+        return false;
+    profiling = false;
+    Ort::AllocatorWithDefaultOptions allocator;
+    char *profilePath = session->EndProfiling(allocator);
+    std::ifstream profileFile(profilePath);
+    allocator.Free(profilePath);
+
+    // The profile has one event per line, operator executions are the "Node" events named <node>_kernel_time
+    struct NodeEvent {
+        std::string name;
+        int64_t ts, dur;
+    };
+    std::vector<NodeEvent> events;
+    std::vector<std::string> names;
+    const std::regex nodeRegex("\"name\"\\s*:\\s*\"([^\"]*)_kernel_time\""), opRegex("\"op_name\"\\s*:\\s*\"([^\"]*)\"");
+    const std::regex tsRegex("\"ts\"\\s*:\\s*(\\d+)"), durRegex("\"dur\"\\s*:\\s*(\\d+)");
+    std::string line;
+    while (std::getline(profileFile, line)) {
+        std::smatch node, op, ts, dur;
+        if (line.find("\"Node\"") == std::string::npos || !std::regex_search(line, node, nodeRegex) || !std::regex_search(line, ts, tsRegex) || !std::regex_search(line, dur, durRegex))
+            continue;
+        const std::string name = (std::regex_search(line, op, opRegex) ? op[1].str() + " (" + node[1].str() + ")" : node[1].str());
+        if (std::find(names.begin(), names.end(), name) == names.end())
+            names.push_back(name);
+        events.push_back({name, std::stoll(ts[1].str()), std::stoll(dur[1].str())});
+    }
+
+    OperatorProfile profile;
+    profile.prepare(names, std::max<size_t>(1, events.size()));
+    for (const auto &event : events) {
+        const int op = (int)(std::find(names.begin(), names.end(), event.name) - names.begin());
+        // ONNX Runtime times are in microseconds
+        profile.record(op, event.ts * 1000, (event.ts + event.dur) * 1000);
+    }
+    const bool traceWritten = profile.writeChromeTrace(traceJsonPath);
+    return profile.writeSummary(summaryPath) && traceWritten;
+}
+
+void InterpreterWrap::invokeBound() {
+    PerfScope perfScope(perfRegion);
+    this->session->Run(Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(), inputTensors.size(), outputNames.data(), outputTensors.data(), 1);
+}
+
+TensorBinding InterpreterWrap::getTensorBinding() {
+    TensorBinding binding;
+    binding.input = inputTensorValues.data();
+    binding.inputSize = inputTensorSize;
+    binding.output = outputTensorValues.data();
+    binding.outputSize = outputTensorSize;
+    return binding;
+}
+
+ModelMemoryUsage InterpreterWrap::getModelMemoryUsage() const {
+    ModelMemoryUsage usage;
+    usage.modelBytes = modelBytes;
+    if (tensorArena == nullptr)
+        usage.ioBytes = (inputTensorSize + outputTensorSize) * sizeof(float);
+    usage.runtimeBytes = runtimeBytes;
+    return usage;
+}
+
+void InterpreterWrap::measureRuntimeBytes(size_t heapBytesBefore) {
+    // Graph, initializers, kernels, thread pool and the growth of the shared arena, all from the heap
+    const size_t heapBytesAfter = getAllocatedHeapBytes();
+    const size_t heapBytes = (heapBytesAfter > heapBytesBefore) ? heapBytesAfter - heapBytesBefore : 0;
+    const ModelMemoryUsage usage = getModelMemoryUsage();
+    const size_t accountedBytes = usage.modelBytes + usage.ioBytes;
+    runtimeBytes = (heapBytes > accountedBytes) ? heapBytes - accountedBytes : 0;
+}
+
+std::map<std::string, std::string> InterpreterWrap::getMetadata() {
+    std::map<std::string, std::string> metadata;
+    Ort::AllocatorWithDefaultOptions allocator;
+    Ort::ModelMetadata modelMetadata = session->GetModelMetadata();
+    int64_t numKeys = 0;
+    char **keys = modelMetadata.GetCustomMetadataMapKeys(allocator, numKeys);
+    for (int64_t i = 0; i < numKeys; ++i) {
+        char *value = modelMetadata.LookupCustomMetadataMap(keys[i], allocator);
+        if (value != nullptr) {
+            metadata[keys[i]] = value;
+            allocator.Free(value);
+        }
+        allocator.Free(keys[i]);
+    }
+    if (keys != nullptr)
+        allocator.Free(keys);
+    return metadata;
+}
+
 void InterpreterWrap::invoke_internal(const float inputVector[], size_t inputSize, float outputVector[], size_t outputSize, bool verbose) {
+    PerfScope perfScope(perfRegion);
     if (inputSize != inputTensorSize)
         throw std::logic_error("Error, input vector has to have size: " + std::to_string(inputTensorSize) + " (Found " + std::to_string(inputSize) + " instead)");
 
@@ -188,7 +484,7 @@ void InterpreterWrap::invoke_internal(const float inputVector[], size_t inputSiz
         inputTensorValues[i] = inputVector[i];
 
     // Run inference
-    this->session->Run(Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(), 1, outputNames.data(), outputTensors.data(), 1);
+    this->session->Run(Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(), inputTensors.size(), outputNames.data(), outputTensors.data(), 1);
 
     if (outputSize != outputTensorSize)
         throw std::logic_error("Error, output vector has to have size: " + std::to_string(outputTensorSize) + " (Found " + std::to_string(outputSize) + " instead)");
@@ -198,42 +494,313 @@ void InterpreterWrap::invoke_internal(const float inputVector[], size_t inputSiz
         outputVector[i] = outputTensorValues.at(i);
 }
 
-Ort::Session* InterpreterWrap::loadModel(const std::string &filename) {
+/**
+ * Environment shared by every session.
+ * The CPU memory of the sessions is served by a single arena registered in the environment, which starts with a
+ * chunk of ONNX_ENV_ARENA_BYTES and then grows by exactly the requested size instead of doubling, so that the buffers
+ * used by Run are all allocated while priming.
+ */
+static Ort::Env &getEnvironment() {
     static Ort::Env env;  //()ORT_LOGGING_LEVEL_WARNING, "onnx-test");
-    Ort::SessionOptions session_options;
-    session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
-    session_options.SetOptimizedModelFilePath("optimized_model.onnx.tmp");
-    return new Ort::Session(env, filename.c_str(), session_options);
+    static const bool allocatorRegistered = []() {
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        Ort::ArenaCfg arenaConfig(0, 1 /* kSameAsRequested */, ONNX_ENV_ARENA_BYTES, -1);
+        env.CreateAndRegisterAllocator(memoryInfo, arenaConfig);
+        return true;
+    }();
+    (void)allocatorRegistered;
+    return env;
 }
 
+/**
+ * Lock and prefault ONNX_ENV_ARENA_BYTES of the arena of the environment, once per process.
+ * The arena is only reachable through a session: a block is taken from it, locked and given back, so that the buffers
+ * of Run that fit in it are served from locked pages. The arena lives as long as the process, so the block is never
+ * unlocked.
+ */
+static void lockEnvironmentArena(Ort::Session &session) {
+    static std::once_flag arenaLocked;
+    std::call_once(arenaLocked, [&session]() {
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        Ort::Allocator allocator(session, memoryInfo);
+        void *block = allocator.Alloc(ONNX_ENV_ARENA_BYTES);
+        LockedArena::lockAndPrefault(block, ONNX_ENV_ARENA_BYTES);
+        allocator.Free(block);
+    });
+}
 
-Ort::Session* InterpreterWrap::loadModelFromBuffer(const char *buffer, size_t bufferSize) {
-    static Ort::Env env;  //()ORT_LOGGING_LEVEL_WARNING, "onnx-test");
+/** Unique path of a file written by a session, as sessions of many instances can be created in parallel */
+static std::string getSessionFilePath(const std::string &name) {
+    static std::atomic<int> sessionCounter{0};
+    return "/tmp/onnx_" + name + "_" + std::to_string(getpid()) + "_" + std::to_string(sessionCounter++);
+}
+
+/** Create an intra-op worker with the affinity and scheduling policy of the ThreadingConfig passed as options */
+static OrtCustomThreadHandle createWorkerThread(void *options, OrtThreadWorkerFn workerFunction, void *workerParameter) {
+    const ThreadingConfig threading = *static_cast<const ThreadingConfig *>(options);
+    std::thread *worker = new std::thread([threading, workerFunction, workerParameter]() {
+        configureCurrentThread(threading);
+        workerFunction(workerParameter);
+    });
+    return reinterpret_cast<OrtCustomThreadHandle>(worker);
+}
+
+static void joinWorkerThread(OrtCustomThreadHandle handle) {
+    std::thread *worker = reinterpret_cast<std::thread *>(const_cast<OrtCustomHandleType *>(handle));
+    worker->join();
+    delete worker;
+}
+
+/** Options common to every session, threading has to outlive the session */
+static Ort::SessionOptions createSessionOptions(const ThreadingConfig &threading, bool profiling) {
     Ort::SessionOptions session_options;
+    if (profiling)
+        session_options.EnableProfiling(getSessionFilePath("profile").c_str());  // ONNX Runtime appends a timestamp and .json
+    session_options.AddConfigEntry("session.use_env_allocators", "1");
+#if (ONNX_MINIMAL_RUNTIME)
+    // ORT format models are optimized when converted
+    session_options.AddConfigEntry("session.load_model_format", "ORT");
+#else
     session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
-    session_options.SetOptimizedModelFilePath("/tmp/optimized_model.onnx.tmp");
-    return new Ort::Session(env, buffer, bufferSize, session_options);
+    #if (ONNX_SAVE_OPTIMIZED_MODEL)
+    session_options.SetOptimizedModelFilePath(getSessionFilePath("optimized").append(".onnx").c_str());
+    #endif
+#endif
+    // Operators run one after the other, each one split across numThreads threads (the calling thread included)
+    session_options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+    session_options.SetIntraOpNumThreads(std::max(1, threading.numThreads));
+    session_options.SetInterOpNumThreads(1);
+    if (configuresWorkerThreads(threading)) {
+        // Keep the workers off the real-time cores
+        session_options.SetCustomCreateThreadFn(createWorkerThread);
+        session_options.SetCustomThreadCreationOptions(const_cast<ThreadingConfig *>(&threading));
+        session_options.SetCustomJoinThreadFn(joinWorkerThread);
+    }
+    session_options.AddConfigEntry("session.intra_op.allow_spinning", threading.spinWait ? "1" : "0");
+    session_options.AddConfigEntry("session.inter_op.allow_spinning", threading.spinWait ? "1" : "0");
+    return session_options;
+}
+
+Ort::Session* InterpreterWrap::loadModel(const std::string &filename, const ThreadingConfig &threading, bool profiling) {
+    Ort::Env &env = getEnvironment();
+    Ort::SessionOptions session_options = createSessionOptions(threading, profiling);
+    Ort::Session *session = new Ort::Session(env, filename.c_str(), session_options);
+    lockEnvironmentArena(*session);
+    return session;
+}
+
+
+Ort::Session* InterpreterWrap::loadModelFromBuffer(const char *buffer, size_t bufferSize, const ThreadingConfig &threading, bool profiling) {
+    Ort::Env &env = getEnvironment();
+    Ort::SessionOptions session_options = createSessionOptions(threading, profiling);
+    Ort::Session *session = new Ort::Session(env, buffer, bufferSize, session_options);
+    lockEnvironmentArena(*session);
+    return session;
+}
+
+/** Minimal reader of the protobuf wire format, enough to walk the initializers of a serialized ONNX model */
+struct ProtoReader {
+    const uint8_t *position;
+    const uint8_t *end;
+
+    bool readVarint(uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && position < end; shift += 7) {
+            const uint8_t byte = *position++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    /** Key of the next field, false at the end of the message */
+    bool next(int &field, int &wireType) {
+        uint64_t key;
+        if (position >= end || !readVarint(key))
+            return false;
+        field = (int)(key >> 3);
+        wireType = (int)(key & 0x7);
+        return true;
+    }
+
+    /** Content of a length-delimited field (wire type 2) */
+    bool readBytes(ProtoReader &content) {
+        uint64_t size;
+        if (!readVarint(size) || size > (uint64_t)(end - position))
+            return false;
+        content = {position, position + size};
+        position += size;
+        return true;
+    }
+
+    bool skip(int wireType) {
+        uint64_t value;
+        ProtoReader content;
+        const size_t fixedSize = (wireType == 1) ? 8 : 4;
+        switch (wireType) {
+            case 0:
+                return readVarint(value);
+            case 2:
+                return readBytes(content);
+            case 1:
+            case 5:
+                if ((size_t)(end - position) < fixedSize)
+                    return false;
+                position += fixedSize;
+                return true;
+            default:  // Groups are not used by ONNX
+                return false;
+        }
+    }
+};
+
+/** Float initializer of a serialized ONNX model, its values point into the model (little-endian, unaligned) */
+struct OnnxInitializer {
+    std::vector<int> shape;
+    const uint8_t *values = nullptr;
+    size_t valuesBytes = 0;
+};
+
+/** Read the TensorProto of an initializer, false if it is not a float tensor stored in the model */
+static bool readOnnxInitializer(ProtoReader tensor, std::string &name, OnnxInitializer &initializer) {
+    const int floatType = 1;  // TensorProto.DataType.FLOAT
+    uint64_t dataType = 0, value;
+    int field, wireType;
+    while (tensor.next(field, wireType)) {
+        ProtoReader content;
+        if (field == 1 && wireType == 0) {  // dims
+            if (!tensor.readVarint(value))
+                return false;
+            initializer.shape.push_back((int)value);
+        } else if (field == 1 && wireType == 2) {  // dims, packed
+            if (!tensor.readBytes(content))
+                return false;
+            while (content.position < content.end && content.readVarint(value))
+                initializer.shape.push_back((int)value);
+        } else if (field == 2 && wireType == 0) {  // data_type
+            if (!tensor.readVarint(dataType))
+                return false;
+        } else if ((field == 4 || field == 9) && wireType == 2) {  // float_data (packed) or raw_data
+            if (!tensor.readBytes(content))
+                return false;
+            initializer.values = content.position;
+            initializer.valuesBytes = (size_t)(content.end - content.position);
+        } else if (field == 8 && wireType == 2) {  // name
+            if (!tensor.readBytes(content))
+                return false;
+            name.assign(reinterpret_cast<const char *>(content.position), (size_t)(content.end - content.position));
+        } else if (!tensor.skip(wireType)) {
+            return false;
+        }
+    }
+    return dataType == floatType && initializer.values != nullptr;
+}
+
+/** Float initializers of a serialized ONNX model (ModelProto.graph.initializer), by name */
+static std::map<std::string, OnnxInitializer> readOnnxInitializers(const char *buffer, size_t bufferSize) {
+    std::map<std::string, OnnxInitializer> initializers;
+    ProtoReader model{reinterpret_cast<const uint8_t *>(buffer), reinterpret_cast<const uint8_t *>(buffer) + bufferSize};
+    int field, wireType;
+    while (model.next(field, wireType)) {
+        ProtoReader graph;
+        if (field != 7 || wireType != 2) {  // ModelProto.graph
+            if (!model.skip(wireType))
+                break;
+            continue;
+        }
+        if (!model.readBytes(graph))
+            break;
+        while (graph.next(field, wireType)) {
+            ProtoReader tensor;
+            if (field != 5 || wireType != 2) {  // GraphProto.initializer
+                if (!graph.skip(wireType))
+                    break;
+                continue;
+            }
+            if (!graph.readBytes(tensor))
+                break;
+            std::string name;
+            OnnxInitializer initializer;
+            if (readOnnxInitializer(tensor, name, initializer))
+                initializers[name] = initializer;
+        }
+    }
+    return initializers;
 }
 
 /***** Handle functions *****/
-InterpreterPtr createInterpreter(const std::string &filename, bool verbose) {
-    return new InterpreterWrap(filename, verbose);
+InterpreterPtr createInterpreter(const std::string &filename, bool verbose, const ThreadingConfig &threading, bool profiling) {
+    return new InterpreterWrap(filename, verbose, threading, profiling);
 }
 
-InterpreterPtr createInterpreterFromBuffer(const char *buffer, size_t bufferSize, bool verbose) {
-    InterpreterPtr res = new InterpreterWrap(buffer, bufferSize, verbose);
+InterpreterPtr createInterpreterFromBuffer(const char *buffer, size_t bufferSize, bool verbose, const ThreadingConfig &threading, bool profiling) {
+    InterpreterPtr res = new InterpreterWrap(buffer, bufferSize, verbose, threading, profiling);
     return res;
 }
 
+bool exportProfile(InterpreterPtr inp, const std::string &traceJsonPath, const std::string &summaryPath) {
+    return inp->exportProfile(traceJsonPath, summaryPath);
+}
+
 void deleteInterpreter(InterpreterPtr cls) {
     if (cls)
         delete cls;
 }
 
+TensorBinding getTensorBinding(InterpreterPtr inp) {
+    return inp->getTensorBinding();
+}
+
+void invokeBound(InterpreterPtr inp) {
+    inp->invokeBound();
+}
+
+ModelMemoryUsage getModelMemoryUsage(InterpreterPtr inp) {
+    return inp->getModelMemoryUsage();
+}
+
+std::vector<WeightTensorInfo> getWeightLayout(InterpreterPtr inp) {
+    return inp->getWeightLayout();
+}
+
+int addWeightSet(WeightBank &bank, const char *buffer, size_t bufferSize) {
+    const std::map<std::string, OnnxInitializer> initializers = readOnnxInitializers(buffer, bufferSize);
+    std::vector<const void *> values;
+    for (const WeightTensorInfo &info : bank.getLayout()) {
+        const auto initializer = initializers.find(info.name);
+        if (initializer == initializers.end() || initializer->second.shape != info.shape || initializer->second.valuesBytes != info.size * sizeof(float))
+            return -1;
+        values.push_back(initializer->second.values);
+    }
+    return bank.addSet(values);
+}
+
+bool attachWeightBank(InterpreterPtr inp, const WeightBank &bank) {
+    return inp->attachWeightBank(bank);
+}
+
+void useWeightSet(InterpreterPtr inp, int set) {
+    inp->useWeightSet(set);
+}
+
+std::map<std::string, std::string> getModelMetadata(InterpreterPtr inp) {
+    return inp->getMetadata();
+}
+
 void invoke(InterpreterPtr cls, const float featureVector[], size_t inputSize, float outputVector[], size_t outputSize) {
     cls->invoke_internal(featureVector, inputSize, outputVector, outputSize);
 }
 
+int invokeFlat2D(InterpreterPtr inp, const float flatFeatureMatrix[], size_t nRows, size_t nCols, float outputVector[], size_t outputSize) {
+    size_t reqRows, reqCols;
+    getModelInputSize2d(inp, reqRows, reqCols);
+    if (nRows != reqRows || nCols != reqCols)
+        throw std::logic_error("Error, input vector has to have size: " + std::to_string(reqRows) + "x" + std::to_string(reqCols) + " (Found " + std::to_string(nRows) + "x" + std::to_string(nCols) + " instead)");
+    inp->invoke_internal(flatFeatureMatrix, nRows * nCols, outputVector, outputSize);
+    return outputSize > 0 ? (int)(std::max_element(outputVector, outputVector + outputSize) - outputVector) : -1;
+}
+
 void invoke(InterpreterPtr inp, std::vector<float> &inputVector, std::vector<float> &outputVector) {
     if (inputVector.size() != getModelInputSize1d(inp)) {
         std::cerr << "Interpreter\t|\tinvoke\t| Input vector size does not match model input size (" << inputVector.size() << " != " << getModelInputSize1d(inp) << ")" << std::endl;
@@ -10,26 +10,122 @@
 #include <cstdio>
 #include <iostream>
 #include <limits>  // std::numeric_limits
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "memoryusage.h"
+#include "modelengine.h"
+#include "threadingconfig.h"
+#include "weightbank.h"
+
+// If 1 the wrapper is linked against a minimal ONNX Runtime build (libs/build_onnx_minimal.sh), which only loads
+// models converted to the ORT format and cannot save optimized models
+#ifndef ONNX_MINIMAL_RUNTIME
+    #define ONNX_MINIMAL_RUNTIME 0
+#endif
+
+// If 1 every session saves its optimized graph to /tmp/onnx_optimized_<pid>_<session>.onnx, to inspect the result
+// of the graph optimizations (it slows down loading)
+#ifndef ONNX_SAVE_OPTIMIZED_MODEL
+    #define ONNX_SAVE_OPTIMIZED_MODEL 0
+#endif
+
+// First chunk of the CPU arena shared by the sessions, locked and prefaulted when the first session is created.
+// Size it to the buffers used by Run in all the sessions of the process, larger buffers come from unlocked chunks
+#ifndef ONNX_ENV_ARENA_BYTES
+    #define ONNX_ENV_ARENA_BYTES (1024 * 1024)
+#endif
+
 namespace InferenceEngine {
 
 class InterpreterWrap;                   // Forward definition of the InterpreterWrap class
 using InterpreterPtr = InterpreterWrap*;  // Opaque pointer for classifier object
+class LockedArena;                        // See lockedarena.h
+
+/** Get the total number of elements of the model input */
+size_t getModelInputSize1d(InterpreterPtr inp);
+
+/** Get the Model Batch Size (first dimension of the input tensor), i.e. samples (or frames) processed per invocation */
+size_t getModelBatchSize(InterpreterPtr inp);
+
+/** Get the total number of elements of the model output */
+size_t getModelOutputSize(InterpreterPtr inp);
 
-/** Dynamically allocate an instance of a classifier object (do not use in real time threads!) */
-InterpreterPtr createInterpreter(const std::string& filename, bool verbose = false);
+/** Get the rows and columns of a 2D model input, shaped [1 x rows x columns] (e.g. frames and features of a classifier) */
+void getModelInputSize2d(InterpreterPtr inp, size_t& rows, size_t& columns);
+
+/**
+ * @brief Change the batch size (first dimension of the input tensor) of the model (do not use in real time threads!)
+ * Only models exported with a dynamic batch dimension can be resized, for the others this succeeds only if the
+ * requested size is the one of the model.
+ *
+ * @param inp       Interpreter object
+ * @param batchSize New number of rows of the input tensor
+ * @return bool     False if the model could not be resized
+ */
+bool setModelBatchSize(InterpreterPtr inp, size_t batchSize);
+
+/**
+ * @brief Reset the internal state of the model
+ * Only stateless models are supported: an ONNX session keeps nothing between runs, and a recurrent model would have to
+ * exchange its state through extra inputs and outputs, which this wrapper does not feed (createInterpreter refuses
+ * models with more than one input). So there is no state to clear, and this only keeps the interface of the wrappers
+ * the same.
+ *
+ * @param inp Interpreter object
+ */
+void resetModelState(InterpreterPtr inp);
+
+/**
+ * @brief Allocate the buffers of the input and output tensors from a locked memory arena (do not use in real time threads!)
+ * The memory used internally by the session comes from the CPU arena shared by every session (see getEnvironment in
+ * onnxwrapper.cpp), which is filled while priming. The arena has to outlive the interpreter.
+ *
+ * @param inp       Interpreter object
+ * @param arena     Arena providing the input and output buffers
+ * @param verbose   verbose mode
+ * @return size_t   Number of bytes locked outside of the arena (always 0, the session arena is not exposed)
+ */
+size_t placeTensorsInArena(InterpreterPtr inp, LockedArena& arena, bool verbose = false);
+
+/**
+ * @brief Dynamically allocate an instance of a classifier object (do not use in real time threads!)
+ * Throws std::logic_error if the model has more than one input, like the recurrent models that take their state as an
+ * input (only stateless models are supported, see resetModelState).
+ *
+ * @param filename  path to the onnx model file
+ * @param verbose   verbose mode (to disable in real time threads)
+ * @param threading intra-op threads, spinning and placement of the worker threads (see threadingconfig.h)
+ * @param profiling enable the ONNX Runtime profiler of the session (see exportProfile)
+ * @return InterpreterPtr
+ */
+InterpreterPtr createInterpreter(const std::string& filename, bool verbose = false, const ThreadingConfig& threading = ThreadingConfig(), bool profiling = false);
 
 /**
  * @brief Dynamically allocate an instance of a Interpreter object from Buffer(do not use in real time threads!)
  *
  * @param buffer Caller-owned buffer containing the model
  * @param verbose  verbose mode (to disable in real time threads)
+ * @param threading intra-op threads, spinning and placement of the worker threads (see threadingconfig.h)
+ * @param profiling enable the ONNX Runtime profiler of the session (see exportProfile)
  * @return InterpreterPtr
  */
-InterpreterPtr createInterpreterFromBuffer(const char* buffer, size_t bufferSize, bool verbose = false);
+InterpreterPtr createInterpreterFromBuffer(const char* buffer, size_t bufferSize, bool verbose = false, const ThreadingConfig& threading = ThreadingConfig(), bool profiling = false);
+
+/**
+ * @brief Write the per-operator profile of an interpreter created with profiling enabled (do not use in real time threads!)
+ * The events are recorded by the ONNX Runtime profiler, which stores them in memory during each run (including the
+ * priming run), so use this mode for diagnosis only. The profile can be exported once per session: ONNX Runtime
+ * stops profiling when the events are written.
+ *
+ * @param inp               Interpreter object
+ * @param traceJsonPath     Chrome trace of the operator executions
+ * @param summaryPath       Operators ranked by total execution time
+ * @return bool             False if profiling is not enabled (or was already exported) or the files could not be written
+ */
+bool exportProfile(InterpreterPtr inp, const std::string& traceJsonPath, const std::string& summaryPath);
 
 /** Feed a feature array (C Array) to the model, perform inference and return the prediction */
 void invoke(InterpreterPtr cls, const float featureVector[], size_t numFeatures, float outputVector[], size_t numClasses);
@@ -64,9 +160,83 @@ void invoke(InterpreterPtr inp, std::array<float, IN_SIZE>& featureArray, std::a
  */
 void invoke(InterpreterPtr inp, std::vector<float>& inputVector, std::vector<float>& outputVector);
 
+/**
+ * @brief Feed a 2D matrix stored in a flat array (row-major) to the model, perform inference and return the prediction
+ *
+ * @param inp               Interpreter object
+ * @param flatFeatureMatrix Input matrix, e.g. the feature matrix of a FeatureExtractor (see featureextractor.h)
+ * @param nRows             Number of rows, has to be the one of the model (see getModelInputSize2d)
+ * @param nCols             Number of columns, has to be the one of the model
+ * @param outputVector      Output vector
+ * @param outputSize        Size of the output vector
+ * @return int              Classification result (index of the largest output)
+ */
+int invokeFlat2D(InterpreterPtr inp, const float flatFeatureMatrix[], size_t nRows, size_t nCols, float outputVector[], size_t outputSize);
 
 
 /** Free the classifier memory (do not use in real time threads) */
 void deleteInterpreter(InterpreterPtr cls);
 
+/**
+ * @brief Get the custom metadata of the model, by key (do not use in real time threads!)
+ * e.g. the parameters of the PrePostChain (see prepostchain.h)
+ */
+std::map<std::string, std::string> getModelMetadata(InterpreterPtr inp);
+
+/**
+ * @brief Get the weights that can be switched with a WeightBank: the float overridable initializers, in order (do not use in real time threads!)
+ * Initializers can be overridden only if the model lists them among the graph inputs as well (e.g. exported with
+ * keep_initializers_as_inputs=True), otherwise the layout is empty. Overridable initializers are not constant-folded.
+ */
+std::vector<WeightTensorInfo> getWeightLayout(InterpreterPtr inp);
+
+/**
+ * @brief Read the weights of a model into the next set of a bank (do not use in real time threads!)
+ * The model has to have the graph of the bank: its initializers are matched by name, and must have the shapes of the
+ * layout. Only ONNX models with the values inside the file (raw_data or float_data) are read, not ORT format models.
+ *
+ * @param bank          Bank prepared with the layout of the graph (see getWeightLayout)
+ * @param buffer        Caller-owned buffer containing the model, only read during the call
+ * @param bufferSize
+ * @return int          Index of the set, -1 if the model does not match or the bank is full
+ */
+int addWeightSet(WeightBank& bank, const char* buffer, size_t bufferSize);
+
+/**
+ * @brief Run the session with the weights of a bank, starting from set 0 (do not use in real time threads!)
+ * The initializers are overridden by tensors over the bank at every run, so the bank has to outlive the interpreter.
+ * The session is primed again, the input and output tensors do not move.
+ *
+ * @return bool     False if the layout of the bank is not the one of the model, or the bank is empty
+ */
+bool attachWeightBank(InterpreterPtr inp, const WeightBank& bank);
+
+/** Switch to another set of the attached bank, between two runs (real-time safe, invalid sets are ignored) */
+void useWeightSet(InterpreterPtr inp, int set);
+
+/**
+ * @brief Get the memory of the session, split as in memoryusage.h (do not use in real time threads!)
+ * The model is the size of the serialized model, which the session parses into its own graph and initializers. The
+ * intermediate tensors come from the CPU arena shared by every session, which is not exposed: the part of the arena
+ * grown by this session is in the runtime overhead, and activations and persistent state are reported as 0. Input and
+ * output buffers moved to a LockedArena (see placeTensorsInArena) belong to the owner of the arena and are not included.
+ */
+ModelMemoryUsage getModelMemoryUsage(InterpreterPtr inp);
+
+/**
+ * @brief Get the input and output tensors of the session, to use them in place (do not use in real time threads!)
+ * They change with the batch size and placeTensorsInArena, see modelengine.h
+ */
+TensorBinding getTensorBinding(InterpreterPtr inp);
+
+/** Run the session on the data already in its input tensor, without copies or checks (see getTensorBinding) */
+void invokeBound(InterpreterPtr inp);
+
+/** Backend of ModelEngine (see modelengine.h) */
+struct OnnxBackend {
+    using Handle = InterpreterPtr;
+    static TensorBinding bind(Handle handle) { return getTensorBinding(handle); }
+    static void run(Handle handle) { invokeBound(handle); }
+};
+
 }  // namespace InferenceEngine
\ No newline at end of file
@@ -0,0 +1,136 @@
+/*
+==============================================================================*/
+#include "opprofiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+
+namespace InferenceEngine {
+
+namespace {
+
+/** Escape a string for JSON */
+std::string escapeJson(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if ((unsigned char)c < 0x20)
+            continue;
+        escaped += c;
+    }
+    return escaped;
+}
+
+}  // namespace
+
+void OperatorProfile::prepare(const std::vector<std::string>& operatorNames, size_t traceCapacity) {
+    names = operatorNames;
+    stats.reset(new OperatorStats[names.size()]);
+    this->traceCapacity = std::max<size_t>(1, traceCapacity);
+    trace.reset(new TraceEvent[this->traceCapacity]);
+    reset();
+}
+
+void OperatorProfile::reset() {
+    for (size_t i = 0; i < names.size(); ++i) {
+        stats[i].count = 0;
+        stats[i].totalNs = 0;
+        stats[i].minNs = UINT64_MAX;
+        stats[i].maxNs = 0;
+    }
+    for (size_t i = 0; i < traceCapacity; ++i)
+        trace[i].op = -1;
+    traceWritten = 0;
+}
+
+int64_t OperatorProfile::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void OperatorProfile::record(int op, int64_t startNs, int64_t endNs) {
+    if (op < 0 || op >= (int)names.size())
+        return;
+    const uint64_t duration = (uint64_t)std::max<int64_t>(0, endNs - startNs);
+
+    // Single writer, so plain load/store pairs are enough (the atomics only make the concurrent export well defined)
+    OperatorStats& s = stats[op];
+    s.count.store(s.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    s.totalNs.store(s.totalNs.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+    if (duration < s.minNs.load(std::memory_order_relaxed))
+        s.minNs.store(duration, std::memory_order_relaxed);
+    if (duration > s.maxNs.load(std::memory_order_relaxed))
+        s.maxNs.store(duration, std::memory_order_relaxed);
+
+    const uint64_t written = traceWritten.load(std::memory_order_relaxed);
+    TraceEvent& event = trace[written % traceCapacity];
+    event.op.store(op, std::memory_order_relaxed);
+    event.startNs.store(startNs, std::memory_order_relaxed);
+    event.durationNs.store((int64_t)duration, std::memory_order_relaxed);
+    traceWritten.store(written + 1, std::memory_order_release);
+}
+
+bool OperatorProfile::writeChromeTrace(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    // Oldest event still in the ring first
+    const uint64_t written = traceWritten.load(std::memory_order_acquire);
+    const uint64_t numEvents = std::min<uint64_t>(written, traceCapacity);
+    const uint64_t first = written - numEvents;
+    int64_t origin = INT64_MAX;
+    for (uint64_t i = first; i < written; ++i)
+        origin = std::min(origin, trace[i % traceCapacity].startNs.load(std::memory_order_relaxed));
+
+    file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool firstEvent = true;
+    for (uint64_t i = first; i < written; ++i) {
+        const TraceEvent& event = trace[i % traceCapacity];
+        const int op = event.op.load(std::memory_order_relaxed);
+        if (op < 0 || op >= (int)names.size())
+            continue;
+        // Chrome trace times are in microseconds
+        const double ts = (event.startNs.load(std::memory_order_relaxed) - origin) / 1000.0;
+        const double dur = event.durationNs.load(std::memory_order_relaxed) / 1000.0;
+        file << (firstEvent ? "\n" : ",\n") << std::fixed << std::setprecision(3)
+             << "{\"name\": \"" << escapeJson(names[op]) << "\", \"cat\": \"operator\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": " << ts << ", \"dur\": " << dur << "}";
+        firstEvent = false;
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
+
+bool OperatorProfile::writeSummary(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    std::vector<int> order(names.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return stats[a].totalNs.load() > stats[b].totalNs.load(); });
+    uint64_t total = 0;
+    for (size_t i = 0; i < names.size(); ++i)
+        total += stats[i].totalNs.load(std::memory_order_relaxed);
+
+    file << std::left << std::setw(6) << "Rank" << std::setw(40) << "Operator" << std::right << std::setw(10) << "Count" << std::setw(14) << "Total [ms]" << std::setw(10) << "Share" << std::setw(12) << "Avg [us]"
+         << std::setw(12) << "Min [us]" << std::setw(12) << "Max [us]" << std::endl;
+    int rank = 1;
+    for (int op : order) {
+        const uint64_t count = stats[op].count.load(std::memory_order_relaxed);
+        if (count == 0)
+            continue;
+        const uint64_t opTotal = stats[op].totalNs.load(std::memory_order_relaxed);
+        file << std::left << std::setw(6) << rank++ << std::setw(40) << names[op] << std::right << std::fixed << std::setw(10) << count << std::setw(14) << std::setprecision(3) << opTotal / 1e6 << std::setw(9)
+             << std::setprecision(1) << (total > 0 ? 100.0 * opTotal / total : 0.0) << "%" << std::setw(12) << std::setprecision(2) << opTotal / 1e3 / count << std::setw(12)
+             << stats[op].minNs.load(std::memory_order_relaxed) / 1e3 << std::setw(12) << stats[op].maxNs.load(std::memory_order_relaxed) / 1e3 << std::endl;
+    }
+    file << "Total: " << std::setprecision(3) << total / 1e6 << " ms" << std::endl;
+    return (bool)file;
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,77 @@
+/*
+ * Per-operator profile of a model
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Collects the execution time of each operator of a model across many invocations, to find the layers that dominate
+ * inference time. The engine wrappers record every operator execution from the thread that invokes the model, and
+ * the profile is exported from another thread as:
+ *  - a Chrome trace (JSON, open with chrome://tracing or https://ui.perfetto.dev) of the most recent executions;
+ *  - a text summary ranking the operators by total time, with count, average, minimum and maximum.
+ *
+ * Statistics and trace are allocated in prepare(), so record() is real-time safe. There must be a single recording
+ * thread per profile; the export reads while recording continues, so it can see a slightly inconsistent snapshot.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace InferenceEngine {
+
+class OperatorProfile {
+public:
+    /**
+     * @brief Allocate statistics and trace (do not use in real time threads!)
+     *
+     * @param operatorNames Name of each operator (e.g. "FULLY_CONNECTED (node 0)"), indexed as in record()
+     * @param traceCapacity Number of most recent executions kept for the trace
+     */
+    void prepare(const std::vector<std::string>& operatorNames, size_t traceCapacity = 16384);
+
+    /** Clear statistics and trace (not while recording) */
+    void reset();
+
+    int getNumOperators() const { return (int)names.size(); }
+
+    /** Current time for record(), in nanoseconds */
+    static int64_t now();
+
+    /**
+     * @brief Record one execution of an operator (real-time safe)
+     *
+     * @param op        Operator index (executions of unknown operators are ignored)
+     * @param startNs   Start time, from now()
+     * @param endNs     End time, from now()
+     */
+    void record(int op, int64_t startNs, int64_t endNs);
+
+    /** Write the Chrome trace of the most recent executions (do not use in real time threads!) */
+    bool writeChromeTrace(const std::string& path) const;
+
+    /** Write the operators ranked by total time (do not use in real time threads!) */
+    bool writeSummary(const std::string& path) const;
+
+private:
+    struct OperatorStats {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> minNs{UINT64_MAX};
+        std::atomic<uint64_t> maxNs{0};
+    };
+    struct TraceEvent {
+        std::atomic<int> op{-1};
+        std::atomic<int64_t> startNs{0};
+        std::atomic<int64_t> durationNs{0};
+    };
+
+    std::vector<std::string> names;
+    std::unique_ptr<OperatorStats[]> stats;
+    std::unique_ptr<TraceEvent[]> trace;
+    size_t traceCapacity = 0;
+    std::atomic<uint64_t> traceWritten{0};  // Total number of executions written to the trace ring
+};
+
+}  // namespace InferenceEngine
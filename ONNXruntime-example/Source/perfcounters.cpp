@@ -0,0 +1,215 @@
+/*
+==============================================================================*/
+#include "perfcounters.h"
+
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace InferenceEngine {
+
+namespace {
+
+std::atomic<bool> countersEnabled{true};
+
+std::mutex& getRegionsMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+/** Regions are never removed, so the pointers returned by getPerfRegion stay valid */
+std::vector<std::unique_ptr<PerfRegion>>& getRegions() {
+    static std::vector<std::unique_ptr<PerfRegion>> regions;
+    return regions;
+}
+
+const char* const counterNames[numPerfCounters] = {"cycles", "instructions", "L1D misses", "L2 misses", "branch misses"};
+
+#if defined(__linux__)
+struct EventDescription {
+    uint32_t type;
+    uint64_t config;
+};
+
+EventDescription getEventDescription(int counter) {
+    // The generic cache events are not mapped on every ARM PMU, the architectural refill events are
+    const uint64_t readMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch (counter) {
+        case perfCycles:
+            return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+        case perfInstructions:
+            return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+    #if defined(__aarch64__) || defined(__arm__)
+        case perfL1dMisses:
+            return {PERF_TYPE_RAW, 0x03};  // L1D_CACHE_REFILL
+        case perfL2Misses:
+            return {PERF_TYPE_RAW, 0x17};  // L2D_CACHE_REFILL (the last level cache of the Cortex-A72)
+    #else
+        case perfL1dMisses:
+            return {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | readMiss};
+        case perfL2Misses:
+            return {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | readMiss};
+    #endif
+        default:
+            return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+    }
+}
+
+/** Counter group of a thread, read with a single read() */
+class ThreadCounters {
+public:
+    ThreadCounters() {
+        for (int counter = 0; counter < numPerfCounters; ++counter) {
+            const EventDescription event = getEventDescription(counter);
+            perf_event_attr attributes{};
+            attributes.size = sizeof(attributes);
+            attributes.type = event.type;
+            attributes.config = event.config;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_GROUP;
+            const int fd = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, leader, 0);
+            if (fd < 0)
+                continue;  // Not supported by this CPU or kernel, the counter reads 0
+            if (leader < 0)
+                leader = fd;
+            fds[numOpened] = fd;
+            positions[counter] = numOpened++;
+        }
+    }
+
+    ~ThreadCounters() {
+        for (int i = 0; i < numOpened; ++i)
+            close(fds[i]);
+    }
+
+    bool read(uint64_t* values) const {
+        uint64_t buffer[1 + numPerfCounters];  // Number of counters, then their values
+        if (leader < 0 || ::read(leader, buffer, sizeof(uint64_t) * (1 + numOpened)) <= 0)
+            return false;
+        for (int counter = 0; counter < numPerfCounters; ++counter)
+            values[counter] = (positions[counter] >= 0) ? buffer[1 + positions[counter]] : 0;
+        return true;
+    }
+
+    bool isSupported(int counter) const { return counter >= 0 && counter < numPerfCounters && positions[counter] >= 0; }
+
+private:
+    int leader = -1;
+    int numOpened = 0;
+    int fds[numPerfCounters];
+    int positions[numPerfCounters] = {-1, -1, -1, -1, -1};
+};
+
+/** Counters of the calling thread, opened the first time */
+const ThreadCounters& getThreadCounters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+#endif
+
+}  // namespace
+
+void PerfRegion::add(const uint64_t* start, const uint64_t* end) {
+    for (int counter = 0; counter < numPerfCounters; ++counter)
+        totals[counter].fetch_add(end[counter] - start[counter], std::memory_order_relaxed);
+    calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+PerfRegionStats PerfRegion::getStats() const {
+    PerfRegionStats stats;
+    stats.name = name;
+    stats.calls = calls.load(std::memory_order_relaxed);
+    for (int counter = 0; counter < numPerfCounters; ++counter)
+        stats.totals[counter] = totals[counter].load(std::memory_order_relaxed);
+    return stats;
+}
+
+void PerfRegion::reset() {
+    calls.store(0, std::memory_order_relaxed);
+    for (auto& total : totals)
+        total.store(0, std::memory_order_relaxed);
+}
+
+PerfRegion* getPerfRegion(const std::string& name) {
+    std::lock_guard<std::mutex> lock(getRegionsMutex());
+    for (const auto& region : getRegions())
+        if (region->getName() == name)
+            return region.get();
+    getRegions().push_back(std::make_unique<PerfRegion>(name));
+    return getRegions().back().get();
+}
+
+void setPerfCountersEnabled(bool enabled) {
+    countersEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool arePerfCountersEnabled() {
+    return countersEnabled.load(std::memory_order_relaxed);
+}
+
+const char* getPerfCounterName(int counter) {
+    return (counter >= 0 && counter < numPerfCounters) ? counterNames[counter] : "";
+}
+
+#if defined(__linux__)
+bool isPerfCounterSupported(int counter) {
+    return getThreadCounters().isSupported(counter);
+}
+
+bool readPerfCounters(uint64_t* values) {
+    return getThreadCounters().read(values);
+}
+#else
+bool isPerfCounterSupported(int counter) {
+    return false;
+}
+
+bool readPerfCounters(uint64_t* values) {
+    return false;
+}
+#endif
+
+std::vector<PerfRegionStats> getPerfCounterStats() {
+    std::lock_guard<std::mutex> lock(getRegionsMutex());
+    std::vector<PerfRegionStats> stats;
+    for (const auto& region : getRegions()) {
+        stats.push_back(region->getStats());
+        if (stats.back().calls == 0)
+            stats.pop_back();
+    }
+    return stats;
+}
+
+void resetPerfCounters() {
+    std::lock_guard<std::mutex> lock(getRegionsMutex());
+    for (const auto& region : getRegions())
+        region->reset();
+}
+
+void printPerfCounterReport(std::ostream& stream) {
+    stream << std::left << std::setw(48) << "Region" << std::right << std::setw(10) << "Calls" << std::setw(14) << "Cycles/call" << std::setw(14) << "Instr/call" << std::setw(8) << "IPC" << std::setw(14) << "L1D miss/ki"
+           << std::setw(14) << "L2 miss/ki" << std::setw(14) << "Br miss/ki" << std::endl;
+    for (const auto& stats : getPerfCounterStats()) {
+        const double calls = (double)stats.calls, kiloInstructions = stats.totals[perfInstructions] / 1e3;
+        stream << std::left << std::setw(48) << stats.name << std::right << std::fixed << std::setw(10) << stats.calls << std::setprecision(1) << std::setw(14) << stats.totals[perfCycles] / calls << std::setw(14)
+               << stats.totals[perfInstructions] / calls << std::setprecision(2) << std::setw(8) << (stats.totals[perfCycles] > 0 ? (double)stats.totals[perfInstructions] / stats.totals[perfCycles] : 0.0);
+        for (int counter : {perfL1dMisses, perfL2Misses, perfBranchMisses})
+            stream << std::setw(14) << (kiloInstructions > 0 ? stats.totals[counter] / kiloInstructions : 0.0);
+        stream << std::endl;
+    }
+    stream << "Counters not supported on this machine (reported as 0):";
+    int unsupported = 0;
+    for (int counter = 0; counter < numPerfCounters; ++counter)
+        if (!isPerfCounterSupported(counter))
+            stream << (unsupported++ > 0 ? ", " : " ") << getPerfCounterName(counter);
+    stream << (unsupported == 0 ? " none" : "") << std::endl;
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,154 @@
+/*
+==============================================================================*/
+#include "qualitytiers.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace InferenceEngine {
+
+void QualityGovernor::prepare(const QualityTierConfig& config, double sampleRate, int numTiers, int settleSamples) {
+    this->config = config;
+    this->sampleRate = sampleRate;
+    this->numTiers = std::max(1, (numTiers < maxTiers) ? numTiers : (int)maxTiers);
+    this->settleSamples = settleSamples;
+    reset();
+}
+
+void QualityGovernor::reset() {
+    tier.store(0, std::memory_order_relaxed);
+    load.store(0.0f, std::memory_order_relaxed);
+    averageLoads.fill(0.0f);
+    pressure = 1.0f;
+    overloadedBlocks = 0;
+    recoverySamples = 0;
+    samplesToSettle = 0;
+}
+
+int QualityGovernor::update(double blockSeconds, int numSamples) {
+    const int current = getTier();
+    if (numSamples <= 0)
+        return current;
+    const float blockLoad = (float)(blockSeconds * sampleRate / numSamples);
+    load.store(blockLoad, std::memory_order_relaxed);
+    if (samplesToSettle > 0) {
+        samplesToSettle -= numSamples;
+        return current;
+    }
+    if (blockLoad > config.degradeLoad) {
+        recoverySamples = 0;
+        if (current < numTiers - 1 && ++overloadedBlocks >= config.degradeBlocks) {
+            // How much slower the machine is than idle, to estimate the cost of the next tier the first time it runs
+            pressure = (averageLoads[current] > 0.0f) ? std::max(1.0f, blockLoad / averageLoads[current]) : 1.0f;
+            changeTier(current + 1);
+        }
+        return getTier();
+    }
+    overloadedBlocks = 0;
+    // The average follows decreases quickly and increases slowly, so that it stays close to the cost of the tier on an
+    // idle machine instead of learning the pressure that the prediction has to detect
+    float& average = averageLoads[current];
+    average = (average > 0.0f) ? average + ((blockLoad < average) ? 0.05f : 0.001f) * (blockLoad - average) : blockLoad / pressure;
+    if (current > 0 && averageLoads[current - 1] > 0.0f) {
+        // Load of this block if it had been processed by the better tier
+        const float predictedLoad = blockLoad * averageLoads[current - 1] / average;
+        recoverySamples = (predictedLoad < config.recoverLoad) ? recoverySamples + numSamples : 0;
+        if (recoverySamples >= config.recoverSeconds * sampleRate)
+            changeTier(current - 1);
+    }
+    return getTier();
+}
+
+void QualityGovernor::changeTier(int newTier) {
+    tier.store(newTier, std::memory_order_relaxed);
+    overloadedBlocks = 0;
+    recoverySamples = 0;
+    samplesToSettle = settleSamples;
+}
+
+void QualityTierStage::prepare(const QualityTierConfig& config, double sampleRate, int maxBlockSize, int numChannels, int latencySamples) {
+    const int crossfadeSamples = std::max(1, (int)std::lround(config.crossfadeSeconds * sampleRate));
+    governor.prepare(config, sampleRate, 2, latencySamples + crossfadeSamples);
+    this->latencySamples = std::max(0, latencySamples);
+    delayLines.assign((size_t)numChannels, std::vector<float>((size_t)this->latencySamples, 0.0f));
+    curveOutputs.assign((size_t)numChannels, std::vector<float>((size_t)maxBlockSize, 0.0f));
+    delayPosition = 0;
+    modelWeight = 1.0f;
+    weightStep = 1.0f / crossfadeSamples;
+    prerollSamples = 0;
+    modelRunning = true;
+    modelReset = false;
+}
+
+bool QualityTierStage::beginBlock(const float* const* channels, int numChannels, int numSamples, float gain) {
+    const bool modelTier = governor.getTier() == 0;
+    if (modelTier && !modelRunning) {
+        modelRunning = true;
+        modelReset = true;
+        prerollSamples = latencySamples;
+    }
+    const bool curveNeeded = !modelTier || modelWeight < 1.0f;
+    if (curveNeeded)
+        curveTable.setGain(gain);
+
+    // The delay lines always follow the input, so that the curve is aligned with the model as soon as it is needed
+    numChannels = std::min(numChannels, (int)delayLines.size());
+    for (int channel = 0; channel < numChannels; ++channel) {
+        float* delayed = curveOutputs[channel].data();
+        if (latencySamples == 0) {
+            std::copy(channels[channel], channels[channel] + numSamples, delayed);
+        } else {
+            float* line = delayLines[channel].data();
+            for (int i = 0, position = delayPosition; i < numSamples; ++i) {
+                delayed[i] = line[position];
+                line[position] = channels[channel][i];
+                if (++position == latencySamples)
+                    position = 0;
+            }
+        }
+        if (curveNeeded)
+            curveTable.process(delayed, delayed, numSamples);
+    }
+    if (latencySamples > 0)
+        delayPosition = (delayPosition + numSamples) % latencySamples;
+    return modelRunning;
+}
+
+bool QualityTierStage::consumeModelReset() {
+    const bool reset = modelReset;
+    modelReset = false;
+    return reset;
+}
+
+void QualityTierStage::endBlock(float* const* channels, int numChannels, int numSamples, double blockSeconds) {
+    const float targetWeight = (governor.getTier() == 0) ? 1.0f : 0.0f;
+    numChannels = std::min(numChannels, (int)curveOutputs.size());
+    if (!modelRunning) {
+        for (int channel = 0; channel < numChannels; ++channel)
+            std::copy(curveOutputs[channel].data(), curveOutputs[channel].data() + numSamples, channels[channel]);
+    } else if (modelWeight != 1.0f || targetWeight != 1.0f) {
+        // Every channel follows the same crossfade
+        float weight = modelWeight;
+        int preroll = prerollSamples;
+        for (int channel = 0; channel < numChannels; ++channel) {
+            weight = modelWeight;
+            preroll = prerollSamples;
+            const float* curve = curveOutputs[channel].data();
+            float* output = channels[channel];
+            for (int i = 0; i < numSamples; ++i) {
+                if (preroll > 0)
+                    --preroll;
+                else
+                    weight = (targetWeight > weight) ? std::min(targetWeight, weight + weightStep) : std::max(targetWeight, weight - weightStep);
+                output[i] = curve[i] + weight * (output[i] - curve[i]);
+            }
+        }
+        modelWeight = weight;
+        prerollSamples = preroll;
+        if (modelWeight == 0.0f && targetWeight == 0.0f)
+            modelRunning = false;
+    }
+    governor.update(blockSeconds, numSamples);
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,147 @@
+/*
+ * Quality tiers under CPU pressure
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * When the machine is overloaded, a plugin that keeps running the model misses the deadline and the host outputs a
+ * dropout. A cheaper approximation sounds far better than a dropout, so the processor measures the time of each block
+ * against its period (the deadline) and switches to a cheaper processing tier under pressure.
+ *
+ * The QualityGovernor picks the tier from the measured load (block time / block period). Tier 0 is the full quality
+ * path and higher tiers are cheaper. It steps down one tier after degradeBlocks consecutive blocks above degradeLoad.
+ * It steps back up only after the load predicted for the better tier stays below recoverLoad for recoverSeconds. The
+ * prediction scales the measured load by the ratio between the average loads of the two tiers on an idle machine, so
+ * a tier is not restored while the machine is still too busy to run it. The blocks of a transition are ignored, since
+ * they run both tiers.
+ *
+ * The QualityTierStage switches the saturation stage between two tiers: the model (tier 0) and the CurveTable of the
+ * model (tier 1, see curvetable.h). The curve is applied to the dry input delayed by the latency of the model, so the
+ * two tiers are aligned and the switch is a crossfade. The model is not run at all in tier 1, so when it is restored
+ * it starts from a clean state (the caller resets it, see consumeModelReset) and runs for its latency before the
+ * crossfade, to refill its buffers.
+ *
+ * Everything is allocated in prepare, the other methods can be called from the real-time thread.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "curvetable.h"
+
+namespace InferenceEngine {
+
+struct QualityTierConfig {
+    float degradeLoad = 0.5f;        // Block time over block period above which the tier steps down
+    int degradeBlocks = 2;           // Consecutive blocks above degradeLoad before stepping down
+    float recoverLoad = 0.25f;       // Predicted load of the better tier below which it is restored...
+    double recoverSeconds = 2.0;     // ...once it stays below for this long
+    double crossfadeSeconds = 0.02;  // Length of the crossfade between two tiers
+};
+
+class QualityGovernor {
+public:
+    static constexpr int maxTiers = 4;
+
+    /**
+     * @brief Set the thresholds and go back to tier 0
+     *
+     * @param config        Thresholds
+     * @param sampleRate    Sample rate of the blocks
+     * @param numTiers      Number of tiers (at most maxTiers)
+     * @param settleSamples Samples after a change of tier that are not used to decide (the transition)
+     */
+    void prepare(const QualityTierConfig& config, double sampleRate, int numTiers, int settleSamples);
+    void reset();
+
+    /**
+     * @brief Measure a block and update the tier
+     *
+     * @param blockSeconds  Time spent processing the block
+     * @param numSamples    Samples in the block
+     * @return int          Tier for the next block
+     */
+    int update(double blockSeconds, int numSamples);
+
+    /** Can be read from any thread */
+    int getTier() const { return tier.load(std::memory_order_relaxed); }
+    float getLoad() const { return load.load(std::memory_order_relaxed); }
+
+private:
+    void changeTier(int newTier);
+
+    QualityTierConfig config;
+    double sampleRate = 44100.0;
+    int numTiers = 1;
+    int settleSamples = 0;
+
+    std::atomic<int> tier{0};
+    std::atomic<float> load{0.0f};
+    std::array<float, maxTiers> averageLoads{};  // Of each tier outside overloads, 0 if never measured
+    float pressure = 1.0f;  // Load over average load of the last overload
+    int overloadedBlocks = 0;
+    int recoverySamples = 0;
+    int samplesToSettle = 0;
+};
+
+class QualityTierStage {
+public:
+    /**
+     * @brief Allocate the delay lines and go back to the model (do not use in real time threads!)
+     *
+     * @param config            Thresholds of the governor and length of the crossfade
+     * @param sampleRate        Host sample rate
+     * @param maxBlockSize      Largest block
+     * @param numChannels       Channels of the saturation stage
+     * @param latencySamples    Latency of the model path, in host samples
+     */
+    void prepare(const QualityTierConfig& config, double sampleRate, int maxBlockSize, int numChannels, int latencySamples);
+
+    /** Table of tier 1, build it before processing (its content is kept by prepare) */
+    CurveTable& getCurveTable() { return curveTable; }
+
+    /**
+     * @brief Record the dry input of a block and run the curve if it is needed
+     *
+     * @param channels      Dry input of each channel
+     * @param numChannels   Number of channels
+     * @param numSamples    Number of samples per channel (at most maxBlockSize)
+     * @param gain          Gain fed to the model
+     * @return bool         True if the model has to process the block
+     */
+    bool beginBlock(const float* const* channels, int numChannels, int numSamples, float gain);
+
+    /** True once after the model was idle, its state and buffers have to be cleared before it processes the block */
+    bool consumeModelReset();
+
+    /**
+     * @brief Mix the tiers into the output and update the governor
+     *
+     * @param channels      Output of the model, or the dry input if the model did not process the block
+     * @param numChannels   Number of channels
+     * @param numSamples    Number of samples per channel
+     * @param blockSeconds  Time spent processing the block so far
+     */
+    void endBlock(float* const* channels, int numChannels, int numSamples, double blockSeconds);
+
+    /** Can be read from any thread */
+    int getTier() const { return governor.getTier(); }
+    float getLoad() const { return governor.getLoad(); }
+
+private:
+    QualityGovernor governor;
+    CurveTable curveTable;
+
+    std::vector<std::vector<float>> delayLines;  // Dry input, latencySamples per channel
+    std::vector<std::vector<float>> curveOutputs;
+    int delayPosition = 0;
+    int latencySamples = 0;
+
+    float modelWeight = 1.0f;  // Of the model in the output, the curve has the rest
+    float weightStep = 1.0f;   // Per sample, during a crossfade
+    int prerollSamples = 0;    // Samples the restarted model runs before the crossfade
+    bool modelRunning = true;
+    bool modelReset = false;
+};
+
+}  // namespace InferenceEngine
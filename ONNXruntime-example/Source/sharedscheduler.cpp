@@ -0,0 +1,249 @@
+/*
+==============================================================================*/
+#include "sharedscheduler.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+    #include <emmintrin.h>
+#endif
+
+namespace InferenceEngine {
+
+namespace {
+
+/** Tell the core that the thread is spinning, so it does not starve its hyper-thread sibling */
+inline void cpuRelax() {
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+}  // namespace
+
+std::shared_ptr<SharedInferenceScheduler> SharedInferenceScheduler::getInstance(const std::string& modelKey, const std::function<InterpreterPtr()>& createInterpreter) {
+    static std::mutex registryMutex;
+    static std::map<std::string, std::weak_ptr<SharedInferenceScheduler>> registry;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto& entry = registry[modelKey];
+    std::shared_ptr<SharedInferenceScheduler> scheduler = entry.lock();
+    if (scheduler == nullptr) {
+        scheduler = std::make_shared<SharedInferenceScheduler>(createInterpreter());
+        entry = scheduler;
+    }
+    return scheduler;
+}
+
+SharedInferenceScheduler::SharedInferenceScheduler(InterpreterPtr sharedInterpreter)
+    : sharedInterpreter(sharedInterpreter) {
+    // Rows are [sample, gain] pairs producing one sample each
+    const size_t batch = getModelBatchSize(sharedInterpreter);
+    batchingSupported = getModelInputSize1d(sharedInterpreter) == 2 * batch && getModelOutputSize(sharedInterpreter) == batch;
+}
+
+SharedInferenceScheduler::~SharedInferenceScheduler() {
+    deleteInterpreter(sharedInterpreter);
+}
+
+int SharedInferenceScheduler::registerClient(int maxBlockSize, InterpreterPtr fallbackInterpreter, int batchTimeoutUs) {
+    while (batchLock.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+
+    int index = -1;
+    for (int i = 0; i < maxClients && index < 0 && batchingSupported && maxBlockSize > 0; ++i)
+        if (clients[i].state.load(std::memory_order_relaxed) == Unused)
+            index = i;
+
+    if (index >= 0) {
+        Client& client = clients[index];
+        client.maxBlockSize = maxBlockSize;
+        client.batchTimeout = std::chrono::microseconds(batchTimeoutUs);
+        client.fallbackInterpreter = fallbackInterpreter;
+        client.fallbackBatchSize = (int)getModelBatchSize(fallbackInterpreter);
+        client.fallbackInput.assign(2 * client.fallbackBatchSize, 0.0f);
+        client.fallbackOutput.assign(client.fallbackBatchSize, 0.0f);
+        client.pendingSize = 0;
+        client.pendingInput.assign(2 * maxBlockSize, 0.0f);
+        client.outputFifo.assign(2 * maxBlockSize, 0.0f);
+        client.fifoReadIndex = 0;
+        client.fifoWriteIndex = maxBlockSize;
+        client.absent.store(false, std::memory_order_relaxed);
+        client.state.store(Idle, std::memory_order_release);
+
+        if (!resizeBatch()) {
+            // The shared interpreter cannot take the rows of every client
+            client.state.store(Unused, std::memory_order_release);
+            resizeBatch();
+            index = -1;
+        }
+    }
+
+    batchLock.clear(std::memory_order_release);
+    return index;
+}
+
+void SharedInferenceScheduler::unregisterClient(int client) {
+    if (client < 0 || client >= maxClients)
+        return;
+    while (batchLock.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+    clients[client].state.store(Unused, std::memory_order_release);
+    resizeBatch();
+    batchLock.clear(std::memory_order_release);
+}
+
+bool SharedInferenceScheduler::resizeBatch() {
+    int rows = 0;
+    for (auto& client : clients) {
+        if (client.state.load(std::memory_order_relaxed) == Unused)
+            continue;
+        client.batchOffset = rows;
+        rows += client.maxBlockSize;
+    }
+    if (rows == 0 || rows == batchRows)
+        return true;
+    if (!setModelBatchSize(sharedInterpreter, (size_t)rows) || getModelOutputSize(sharedInterpreter) != (size_t)rows) {
+        batchingSupported = batchRows > 0;  // The model batch size cannot change at all
+        return false;
+    }
+    batchRows = rows;
+    batchInput.assign(2 * rows, 0.0f);
+    batchOutput.assign(rows, 0.0f);
+    return true;
+}
+
+void SharedInferenceScheduler::process(int client, float* data, int numSamples, float gain) {
+    Client& c = clients[client];
+    collect(c);
+    // Only the last chunk is submitted, as a submitted chunk is not finished until the other clients submit
+    for (int start = 0; start < numSamples; start += c.maxBlockSize) {
+        const int chunkSize = std::min(c.maxBlockSize, numSamples - start);
+        processChunk(c, data + start, chunkSize, gain, start + chunkSize >= numSamples);
+    }
+}
+
+void SharedInferenceScheduler::processChunk(Client& client, float* data, int numSamples, float gain, bool submit) {
+    for (int i = 0; i < numSamples; ++i) {
+        client.pendingInput[2 * i] = data[i];
+        client.pendingInput[2 * i + 1] = gain;
+    }
+    client.pendingSize = numSamples;
+
+    // The FIFO always holds maxBlockSize samples at this point
+    const int fifoSize = (int)client.outputFifo.size();
+    for (int i = 0; i < numSamples; ++i) {
+        data[i] = client.outputFifo[client.fifoReadIndex];
+        client.fifoReadIndex = (client.fifoReadIndex + 1) % fifoSize;
+    }
+
+    if (!submit) {
+        runFallback(client);
+        return;
+    }
+    client.absent.store(false, std::memory_order_relaxed);
+    client.state.store(Submitted, std::memory_order_release);
+    tryRunBatch();
+}
+
+void SharedInferenceScheduler::collect(Client& client) {
+    std::chrono::steady_clock::time_point deadline{};
+    for (;;) {
+        int state = client.state.load(std::memory_order_acquire);
+        if (state == Submitted) {
+            if (!client.state.compare_exchange_strong(state, Idle, std::memory_order_acq_rel))
+                continue;  // Claimed by a batch in the meantime
+            runFallback(client);
+            // Do not wait again for the instances that did not report in this period
+            for (auto& other : clients) {
+                const int otherState = other.state.load(std::memory_order_relaxed);
+                if (&other != &client && otherState != Unused && otherState != Submitted)
+                    other.absent.store(true, std::memory_order_relaxed);
+            }
+            return;
+        }
+        if (state == InBatch) {
+            // The batch is running on another thread
+            if (deadline == std::chrono::steady_clock::time_point{}) {
+                deadline = std::chrono::steady_clock::now() + client.batchTimeout;
+            } else if (std::chrono::steady_clock::now() > deadline && client.state.compare_exchange_strong(state, Idle, std::memory_order_acq_rel)) {
+                runFallback(client);  // The batch will not deliver this block anymore
+                return;
+            }
+            // Give the core to the batch thread if it was preempted on it
+            std::this_thread::yield();
+            continue;
+        }
+        if (state == Claimed || state == Delivering) {
+            cpuRelax();  // The rows or the output are being copied
+            continue;
+        }
+        if (state == Done)
+            client.state.store(Idle, std::memory_order_relaxed);
+        return;
+    }
+}
+
+void SharedInferenceScheduler::runFallback(Client& client) {
+    const int frame = client.fallbackBatchSize;
+    for (int row = 0; row < client.pendingSize; row += frame) {
+        const int rows = std::min(frame, client.pendingSize - row);
+        std::fill(client.fallbackInput.begin(), client.fallbackInput.end(), 0.0f);
+        std::copy(client.pendingInput.begin() + 2 * row, client.pendingInput.begin() + 2 * (row + rows), client.fallbackInput.begin());
+        invoke(client.fallbackInterpreter, client.fallbackInput.data(), client.fallbackInput.size(), client.fallbackOutput.data(), client.fallbackOutput.size());
+        pushOutput(client, client.fallbackOutput.data(), rows);
+    }
+}
+
+void SharedInferenceScheduler::tryRunBatch() {
+    bool anySubmitted = false;
+    for (auto& client : clients) {
+        const int state = client.state.load(std::memory_order_acquire);
+        if (state == Submitted)
+            anySubmitted = true;
+        else if (state != Unused && !client.absent.load(std::memory_order_relaxed))
+            return;  // Still waiting for this client
+    }
+    if (!anySubmitted || batchLock.test_and_set(std::memory_order_acquire))
+        return;
+
+    std::array<bool, maxClients> claimed{};
+    bool anyClaimed = false;
+    std::fill(batchInput.begin(), batchInput.end(), 0.0f);
+    for (int i = 0; i < maxClients; ++i) {
+        Client& client = clients[i];
+        int expected = Submitted;
+        if (client.state.compare_exchange_strong(expected, Claimed, std::memory_order_acq_rel)) {
+            std::copy(client.pendingInput.begin(), client.pendingInput.begin() + 2 * client.pendingSize, batchInput.begin() + 2 * client.batchOffset);
+            client.state.store(InBatch, std::memory_order_release);
+            claimed[i] = anyClaimed = true;
+        }
+    }
+
+    if (anyClaimed) {
+        invoke(sharedInterpreter, batchInput.data(), batchInput.size(), batchOutput.data(), batchOutput.size());
+        for (int i = 0; i < maxClients; ++i) {
+            int expected = InBatch;
+            if (!claimed[i] || !clients[i].state.compare_exchange_strong(expected, Delivering, std::memory_order_acq_rel))
+                continue;  // Taken back by the client after its timeout
+            pushOutput(clients[i], batchOutput.data() + clients[i].batchOffset, clients[i].pendingSize);
+            clients[i].state.store(Done, std::memory_order_release);
+        }
+    }
+    batchLock.clear(std::memory_order_release);
+}
+
+void SharedInferenceScheduler::pushOutput(Client& client, const float* samples, int numSamples) {
+    const int fifoSize = (int)client.outputFifo.size();
+    for (int i = 0; i < numSamples; ++i) {
+        client.outputFifo[client.fifoWriteIndex] = samples[i];
+        client.fifoWriteIndex = (client.fifoWriteIndex + 1) % fifoSize;
+    }
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,92 @@
+/*
+ * Silence gate for the inference stage
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Most tracks are silent most of the time, but the model still runs on every sample. The gate measures the RMS
+ * energy of each block (over all the channels) and tells the processor when inference can be skipped, in which
+ * case the output is replaced by the response of the model to zero input.
+ *
+ * Hysteresis avoids toggling on signals that hover around the threshold: the gate opens as soon as a block is above
+ * the open threshold, and closes only after the signal stays below the (lower) close threshold for the hold time.
+ * The hold time has to cover the latency and the tail (or state) of the model, so that when the gate closes the
+ * model has already produced the response to the last non-silent input and its buffers only contain silence.
+ * In this way the output is continuous both when the gate closes and when it opens again.
+ *
+ * There is no allocation, so every method can be called from the real-time thread.
+ */
+#pragma once
+
+#include <cmath>
+
+namespace InferenceEngine {
+
+class SilenceGate {
+public:
+    /**
+     * @brief Set the thresholds and the hold time, and open the gate
+     *
+     * @param openThresholdDb   Block RMS (dBFS) above which the gate opens
+     * @param closeThresholdDb  Block RMS (dBFS) below which the gate starts closing (at most openThresholdDb)
+     * @param holdSamples       Samples below the close threshold before the gate closes (latency + tail of the model)
+     */
+    void prepare(float openThresholdDb, float closeThresholdDb, int holdSamples) {
+        openThreshold = dbToMeanSquare(openThresholdDb);
+        closeThreshold = dbToMeanSquare(std::fmin(closeThresholdDb, openThresholdDb));
+        this->holdSamples = holdSamples;
+        reset();
+    }
+
+    /** Open the gate and restart the hold time */
+    void reset() {
+        open = true;
+        silentSamples = 0;
+    }
+
+    /**
+     * @brief Measure a block and update the state of the gate
+     *
+     * @param channels      Pointers to the samples of each channel
+     * @param numChannels   Number of channels
+     * @param numSamples    Number of samples per channel
+     * @return bool         True if the block has to go through the model, false if it can be skipped
+     */
+    bool process(const float* const* channels, int numChannels, int numSamples) {
+        if (numChannels <= 0 || numSamples <= 0)
+            return open;
+        float meanSquare = 0.0f;
+        for (int channel = 0; channel < numChannels; ++channel) {
+            float sum = 0.0f;
+            for (int i = 0; i < numSamples; ++i)
+                sum += channels[channel][i] * channels[channel][i];
+            meanSquare = std::fmax(meanSquare, sum / (float)numSamples);
+        }
+
+        if (!open) {
+            if (meanSquare > openThreshold) {
+                open = true;
+                silentSamples = 0;
+            }
+        } else if (meanSquare < closeThreshold) {
+            // Close only after the model has processed the hold time of silence, so that its output reached it
+            if (silentSamples >= holdSamples)
+                open = false;
+            else
+                silentSamples += numSamples;
+        } else {
+            silentSamples = 0;
+        }
+        return open;
+    }
+
+    bool isOpen() const { return open; }
+
+private:
+    static float dbToMeanSquare(float db) { return std::pow(10.0f, db / 10.0f); }
+
+    float openThreshold = 0.0f, closeThreshold = 0.0f;  // Mean square values
+    int holdSamples = 0;
+    int silentSamples = 0;
+    bool open = true;
+};
+
+}  // namespace InferenceEngine
@@ -0,0 +1,78 @@
+/*
+ * Preloaded weight sets for one graph
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Presets are often the same network trained on different devices (e.g. one saturator per pedal). Loading each one as
+ * a model rebuilds the engine, the interpreter and its arenas, which takes milliseconds and allocates. A WeightBank
+ * keeps the weights of several models with the same graph in one block of memory, locked and prefaulted, with every
+ * tensor aligned to a cache line. An interpreter attached to the bank (see attachWeightBank in the wrappers) switches
+ * set between two invocations by pointing its weight tensors at another set: nothing is copied or allocated, and the
+ * activations and the state of the interpreter are kept.
+ *
+ * The layout of a set (the weight tensors of the graph, in order) comes from the wrapper (getWeightLayout), and each
+ * set is read from a model with the same graph (addWeightSet). Sets are added before the bank is attached, then the
+ * bank is read-only and has to outlive the interpreters attached to it.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace InferenceEngine {
+
+/** Float weight tensor of a graph */
+struct WeightTensorInfo {
+    std::string name;
+    std::vector<int> shape;
+    size_t size = 0;  // Elements
+
+    bool operator==(const WeightTensorInfo& other) const { return name == other.name && shape == other.shape; }
+};
+
+class WeightBank {
+public:
+    WeightBank() = default;
+    ~WeightBank();
+
+    WeightBank(const WeightBank&) = delete;
+    WeightBank& operator=(const WeightBank&) = delete;
+
+    /**
+     * @brief Allocate, lock and prefault the storage of the sets, the previous sets are cleared (do not use in real time threads!)
+     *
+     * @param layout    Weight tensors of the graph, in order
+     * @param maxSets   Number of sets that can be added
+     */
+    void prepare(const std::vector<WeightTensorInfo>& layout, int maxSets);
+
+    /**
+     * @brief Copy a set into the bank (do not use in real time threads!)
+     *
+     * @param tensors   Values of each tensor of the layout, in order, as float32 (no alignment required)
+     * @return int      Index of the set, -1 if the bank is full or not prepared
+     */
+    int addSet(const std::vector<const void*>& tensors);
+
+    int getNumSets() const { return numSets; }
+    const std::vector<WeightTensorInfo>& getLayout() const { return layout; }
+    /** Bytes used by the sets added so far */
+    size_t getBytes() const { return (size_t)numSets * setStride * sizeof(float); }
+
+    /** Values of a tensor of a set (real-time safe) */
+    const float* getTensor(int set, int tensor) const { return data + (size_t)set * setStride + offsets[tensor]; }
+
+private:
+    void release();
+
+    std::vector<WeightTensorInfo> layout;
+    std::vector<size_t> offsets;  // Of each tensor in a set, in floats
+    size_t setStride = 0;         // Floats per set, a whole number of cache lines
+    int numSets = 0;
+    int maxSets = 0;
+
+    std::vector<float> storage;
+    float* data = nullptr;  // First cache line of the storage
+    size_t lockedBytes = 0;
+};
+
+}  // namespace InferenceEngine
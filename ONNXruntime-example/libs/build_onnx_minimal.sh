@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+# Minimal ONNX Runtime build, statically linked and containing only the operators used by the shipped models
+#
+# 1. Converts the models in ../sample_data (or the models/folders given as arguments) to the ORT format, which is
+#    the only format loaded by minimal builds, and collects their operators in required_operators.config
+#    The .ort files are written next to the original .onnx models
+# 2. Builds ONNX Runtime with --minimal_build, keeping only the kernels listed in required_operators.config
+# 3. Merges the static libraries in a single libonnxruntime.a, in onnxruntime-minimal-build-linux_<arch>/
+#    (libraryPath of the ReleaseMinimal configuration of the .jucer, which defines ONNX_MINIMAL_RUNTIME=1)
+#
+# Usage: ./build_onnx_minimal.sh [--arm64] [model.onnx | folder ...]
+#   --arm64 cross-compiles for the Raspberry Pi 4 with the Elk toolchain (see build_onnx_arm64.sh)
+# The conversion needs the onnxruntime python package, of the same version as the sources in ./onnxruntime
+
+set -e # Exit on error
+
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+cd $DIR
+
+CROSS=0
+MODELS=()
+for arg in "$@"; do
+    if [ "$arg" == "--arm64" ]; then
+        CROSS=1
+    else
+        MODELS+=("$(realpath $arg)")
+    fi
+done
+if [ ${#MODELS[@]} -eq 0 ]; then
+    MODELS=("$(realpath ../sample_data)")
+fi
+
+## 1. Convert the models and collect the operators
+STAGING=$DIR/ort-models
+rm -rf $STAGING
+mkdir -p $STAGING
+for model in "${MODELS[@]}"; do
+    if [ -d "$model" ]; then
+        cp $model/*.onnx $STAGING/
+    else
+        cp $model $STAGING/
+    fi
+done
+python3 onnxruntime/tools/python/convert_onnx_models_to_ort.py $STAGING
+CONFIG_FILE=$DIR/required_operators.config
+cp $STAGING/required_operators.config $CONFIG_FILE
+echo "Operators required by the models:"
+cat $CONFIG_FILE
+
+for model in "${MODELS[@]}"; do
+    if [ -d "$model" ]; then
+        for ort in $STAGING/*.ort; do
+            if [ -f "$model/$(basename ${ort%.ort}).onnx" ]; then cp $ort $model/; fi
+        done
+    else
+        cp $STAGING/$(basename ${model%.onnx}).ort $(dirname $model)/
+    fi
+done
+
+## 2. Minimal build
+BUILD_ARGS="--config MinSizeRel --minimal_build --include_ops_by_config $CONFIG_FILE --disable_ml_ops --skip_tests --parallel"
+if [ $CROSS == 1 ]; then
+    ARCH=aarch64
+    unset LD_LIBRARY_PATH
+    source /opt/elk/0.11.0/environment-setup-cortexa72-elk-linux
+
+    PROTOBUF_v="3.11.3"
+    PROTOBUF="protoc-"$PROTOBUF_v"-linux-aarch_64"
+    if [ ! -d "$PROTOBUF" ]; then
+        wget https://github.com/protocolbuffers/protobuf/releases/download/v$PROTOBUF_v/$PROTOBUF.zip
+        unzip $PROTOBUF.zip -d $PROTOBUF
+        rm $PROTOBUF.zip
+    fi
+
+    echo -n "" > cmake.tool
+    echo "SET(CMAKE_SYSTEM_NAME Linux)" >>cmake.tool
+    echo "SET(CMAKE_SYSTEM_VERSION 1)" >>cmake.tool
+    echo "SET(CMAKE_SYSTEM_PROCESSOR aarch64)" >>cmake.tool
+    echo "SET(CMAKE_C_COMPILER aarch64-elk-linux-gcc)" >>cmake.tool
+    echo "SET(CMAKE_CXX_COMPILER aarch64-elk-linux-g++)" >>cmake.tool
+    echo "SET(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)" >>cmake.tool
+    echo "SET(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)" >>cmake.tool
+    echo "SET(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)" >>cmake.tool
+    echo "SET(CMAKE_FIND_ROOT_PATH_MODE_PACKAGE ONLY)" >>cmake.tool
+    echo "SET(CMAKE_FIND_ROOT_PATH /opt/elk/0.11.0/sysroots/cortexa72-elk-linux/)" >>cmake.tool
+
+    BUILD_ARGS="$BUILD_ARGS --path_to_protoc_exe $PWD/$PROTOBUF/bin/protoc --cmake_extra_defines CMAKE_TOOLCHAIN_FILE=$(realpath cmake.tool) onnxruntime_GCC_STATIC_CPP_RUNTIME=ON"
+else
+    ARCH=$(uname -m)
+fi
+BUILD_DIR=$DIR/onnxruntime/build/Linux-minimal-$ARCH
+(cd onnxruntime; ./build.sh $BUILD_ARGS --build_dir $BUILD_DIR)
+
+## 3. Single static library for the plugin
+OUT_DIR=$DIR/onnxruntime-minimal-build-linux_$ARCH
+rm -rf $OUT_DIR
+mkdir -p $OUT_DIR
+LIBS=$(find $BUILD_DIR/MinSizeRel -name "*.a" ! -name "*test*" ! -name "libgtest*" ! -name "libgmock*")
+{
+    echo "CREATE $OUT_DIR/libonnxruntime.a"
+    for lib in $LIBS; do echo "ADDLIB $lib"; done
+    echo "SAVE"
+    echo "END"
+} | ${AR:-ar} -M
+echo "Static library written to $OUT_DIR/libonnxruntime.a ($(du -h $OUT_DIR/libonnxruntime.a | cut -f1))"
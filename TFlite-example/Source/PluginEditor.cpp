@@ -19,6 +19,8 @@ TFliteTemplatePluginAudioProcessorEditor::TFliteTemplatePluginAudioProcessorEdit
     gainSlider.setTextBoxStyle(Slider::TextBoxBelow, true, 60, 20);
     // gainSlider.setTextBoxStyle(Slider::NoTextBox, true, 0, 0);
     gainSliderAttachment.reset(new SliderAttachment(audioProcessor.valueTreeState, audioProcessor.GAIN_ID, gainSlider));
+
+    startTimerHz(4);
 }
 
 TFliteTemplatePluginAudioProcessorEditor::~TFliteTemplatePluginAudioProcessorEditor() {
@@ -43,6 +45,21 @@ void TFliteTemplatePluginAudioProcessorEditor::paint(juce::Graphics& g) {
 
     g.drawFittedText("Gain", sliderarea.removeFromTop(20), juce::Justification::centred, 1);
     gainSlider.setBounds(sliderarea);
+
+    if (shownLoadingError.isNotEmpty())
+        g.drawFittedText("Model loading failed: " + shownLoadingError, area.removeFromTop(40), juce::Justification::centred, 2);
+    if (shownQualityTier >= 0)
+        g.drawFittedText(shownQualityTier == 0 ? "Quality: model" : "Quality: curve table (CPU overload)", area.removeFromBottom(40), juce::Justification::centred, 1);
+}
+
+void TFliteTemplatePluginAudioProcessorEditor::timerCallback() {
+    const int qualityTier = audioProcessor.hasQualityTiers() ? audioProcessor.getQualityTier() : -1;
+    const juce::String loadingError(audioProcessor.getLoadingError());
+    if (qualityTier != shownQualityTier || loadingError != shownLoadingError) {
+        shownQualityTier = qualityTier;
+        shownLoadingError = loadingError;
+        repaint();
+    }
 }
 
 void TFliteTemplatePluginAudioProcessorEditor::resized() {
@@ -10,7 +10,7 @@
 
 typedef juce::AudioProcessorValueTreeState::SliderAttachment SliderAttachment;
 
-class TFliteTemplatePluginAudioProcessorEditor : public juce::AudioProcessorEditor {
+class TFliteTemplatePluginAudioProcessorEditor : public juce::AudioProcessorEditor, private juce::Timer {
 public:
     TFliteTemplatePluginAudioProcessorEditor(TFliteTemplatePluginAudioProcessor&);
     ~TFliteTemplatePluginAudioProcessorEditor() override;
@@ -28,5 +28,10 @@ private:
     Slider gainSlider;
     std::unique_ptr<SliderAttachment> gainSliderAttachment;
 
+    // Quality tier of the processor (see USE_QUALITY_TIERS) and error of the model loading, polled by the timer
+    int shownQualityTier = -1;
+    juce::String shownLoadingError;
+    void timerCallback() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TFliteTemplatePluginAudioProcessorEditor)
 };
@@ -6,12 +6,30 @@
 
 #include <JuceHeader.h>
 
+#include "featureextractor.h"
+#include "blackboxrecorder.h"
+#include "fixedframeadapter.h"
+#include "inferencepipeline.h"
+#include "inferencesidecar.h"
+#include "lockedarena.h"
+#include "modelloader.h"
+#include "perfcounters.h"
+#include "polyphaseresampler.h"
+#include "prepostchain.h"
+#include "qualitytiers.h"
+#include "sharedscheduler.h"
+#include "silencegate.h"
+#include "stftstage.h"
 #include "tflitewrapper.h"  // Put your tflite code here
 
+// Range of the saturation gain fed to the model together with each sample
+#define MIN_SAT_GAIN 0.1f
+#define MAX_SAT_GAIN 200.0f
+
 //==============================================================================
 /**
  */
-class TFliteTemplatePluginAudioProcessor : public juce::AudioProcessor {
+class TFliteTemplatePluginAudioProcessor : public juce::AudioProcessor, private juce::AsyncUpdater, private juce::Timer {
 public:
     //==============================================================================
     TFliteTemplatePluginAudioProcessor();
@@ -51,14 +69,145 @@ public:
     void setStateInformation(const void* data, int sizeInBytes) override;
 
 private:
-    InferenceEngine::InterpreterPtr interpreter;
+    // The models are loaded by loadModels(), in the background (see ASYNC_MODEL_LOADING)
+    InferenceEngine::ModelLoader modelLoader;
+    void loadModels();
+
+    // prepareToPlay and the end of the load run on different threads, the last one prepares the models
+    std::mutex preparationMutex;
+    bool modelsLoaded = false;
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0;  // 0 until the host calls prepareToPlay
+    /** Prepare every stage that depends on the models and warm them up, then set modelsReady, returns the latency to report */
+    int prepareModels(double sampleRate, int samplesPerBlock);
+    // Latency of a preparation at the end of a load in the background, set from the message thread
+    std::atomic<int> pendingLatency{0};
+    void handleAsyncUpdate() override;
+    /** Run MODEL_WARMUP_BLOCKS blocks of realistic input through the saturation model */
+    void warmUpModel(int blockSize);
+    // Set once the models are loaded and prepared, processBlock outputs the fallback until then
+    std::atomic<bool> modelsReady{false};
+    // Hardware performance counters of processBlock (see INFERENCE_PERF_COUNTERS in perfcounters.h)
+    InferenceEngine::PerfRegion* perfRegion = nullptr;
+
+    InferenceEngine::InterpreterPtr interpreter = nullptr;
+
+    // Locked and prefaulted memory for the model input/output tensors and the staging buffers below
+    std::unique_ptr<InferenceEngine::LockedArena> memoryArena;
+
+    InferenceEngine::ArenaVector<float> tflite_input_vec;
+    InferenceEngine::ArenaVector<float> tflite_output_vec;
+    // Tensors of the interpreter, written and read in place by the frame callback of processBlock (see modelengine.h)
+    InferenceEngine::ModelEngine<InferenceEngine::TFLiteBackend> saturationEngine;
+    // Pre/post-processing of the saturation model, fused with the accesses to the tensors (see prepostchain.h)
+    InferenceEngine::PrePostConfig prePostConfig;
+    InferenceEngine::PrePostChain prePost;
+
+    // The model processes a fixed number of samples per invocation (its batch size), independently of the host block size
+    int modelFrameSize = 1;
+    std::vector<InferenceEngine::FixedFrameAdapter> frameAdapters;
+
+    // Conversion to the native rate of the model and back (see MODEL_SAMPLE_RATE), one stage per channel
+    std::vector<InferenceEngine::ResamplingStage> resamplingStages;
+
+    // Optional batching of all the instances that share the model (see USE_SHARED_SCHEDULER), one client per channel
+    std::shared_ptr<InferenceEngine::SharedInferenceScheduler> sharedScheduler;
+    std::vector<int> schedulerClients;
+    void unregisterSchedulerClients();
+
+    // Optional pipeline of models (see USE_MODEL_PIPELINE), replaces the saturation stage when not null
+    std::vector<InferenceEngine::InterpreterPtr> pipelineInterpreters;  // The saturation model first, then the models of PIPELINE_MODEL_PATHS
+    std::unique_ptr<InferenceEngine::InferencePipeline> pipeline;
+    void loadPipelineModels();
+    /** Build and plan the graph for the channels and the block size of the host */
+    void preparePipeline(int samplesPerBlock);
+
+    // Optional out-of-process saturation model (see USE_INFERENCE_SIDECAR), used instead of the interpreter
+    std::unique_ptr<InferenceEngine::SidecarClient> sidecar;
+
+    // Optional gating of the saturation model on silent blocks (see USE_SILENCE_GATE)
+    InferenceEngine::SilenceGate silenceGate;
+    float zeroInputResponse = 0.0f;
+    float zeroInputGain = -1.0f;  // Gain of the last computed zero input response (negative if none)
+    /** Output of the model for zero input at the given gain, invoked only when the gain changes */
+    float getZeroInputResponse(float gain);
+
+    // Optional recording of the saturation stage for post-mortem replay (see USE_BLACKBOX_RECORDER)
+    InferenceEngine::BlackBoxRecorder blackBox;
+    /** Saturation stage of processBlock, from the silence gate to the quality tiers (what the black box records) */
+    void runSaturationStage(juce::AudioBuffer<float>& buffer, int totalNumInputChannels, juce::int64 blockStart);
+    int saturationLatency = 0;  // Latency of the saturation stage alone, part of the latency reported to the host
+
+    // Optional switch to the curve table of the model under CPU pressure (see USE_QUALITY_TIERS)
+    InferenceEngine::QualityTierStage qualityTiers;
+    int reportedQualityTier = -1;  // Last tier written to the TIER_ID parameter
+    /** Sample the curve of the saturation model for the cheaper tier */
+    void buildCurveTable();
+    /** Write the current tier to the TIER_ID parameter when it changes (message thread) */
+    void timerCallback() override;
+
+    // Optional native saturation model with the gain folded into its first layer (see USE_FOLDED_CONDITIONING)
+    InferenceEngine::ConditionedMlp foldedModel;
+    /** Extract the layers of the saturation model, it keeps running in the interpreter if they are not supported */
+    void prepareFoldedModel();
+
+    // Optional weight sets of the saturation model, switched per block with PRESET_ID (see USE_WEIGHT_SETS)
+    InferenceEngine::WeightBank weightBank;
+    int activeWeightSet = 0;
+    std::vector<InferenceEngine::CurveTable> curveTables;  // Curve table of each set, the active one is in qualityTiers
+    std::vector<InferenceEngine::ConditionedMlp> foldedWeightSets;  // Native model of each set, the active one is in foldedModel
+    /** Read the weight sets and attach them to the saturation model */
+    void loadWeightSets();
+    /** Switch to the weight set of PRESET_ID, if it changed (real-time safe) */
+    void selectWeightSet();
+
+    // Optional spectral-domain model (see USE_SPECTRAL_MODEL), one STFT stage per channel
+    InferenceEngine::InterpreterPtr spectralInterpreter = nullptr;
+    std::vector<std::unique_ptr<InferenceEngine::StftStage>> stftStages;
+
+    // Optional 2D classifier (see USE_CLASSIFIER_MODEL), fed with log-mel/MFCC features of the first input channel
+    InferenceEngine::InterpreterPtr classifierInterpreter = nullptr;
+    std::unique_ptr<InferenceEngine::FeatureExtractor> featureExtractor;
+    std::vector<float> classifier_output_vec;
+
+public:
+    // Last class predicted by the classifier model (-1 if none)
+    std::atomic<int> predictedClass{-1};
 
-    std::vector<float> tflite_input_vec;
-    std::vector<float> tflite_output_vec;
+public:
+    /** Write a snapshot of the black box history (real-time safe, the snapshot is written by the recorder thread) */
+    void requestBlackBoxSnapshot() { blackBox.requestSnapshot(); }
+    /**
+     * @brief Run a block through the saturation stage alone, with the gain fed to the model as is (real-time safe)
+     * This replays the input of a black-box snapshot (see SnapshotReplay.h): the stages before the saturation, the gain
+     * parameter and the black box itself are skipped. The output is the fallback until the models are ready.
+     */
+    void processSaturationStage(juce::AudioBuffer<float>& buffer, float saturationGain);
+    /** Latency of processSaturationStage in samples (only once the models are ready) */
+    int getSaturationLatencySamples() const { return saturationLatency; }
+
+    /** Processing tier of the saturation stage (0 for the model, 1 for its curve table), and the load that set it */
+    bool hasQualityTiers() const;
+    int getQualityTier() const { return qualityTiers.getTier(); }
+    float getProcessingLoad() const { return qualityTiers.getLoad(); }
+
+    /** True once the models are loaded and prepared */
+    bool isModelReady() const { return modelsReady.load(std::memory_order_acquire); }
+    /** Error that made the loading of the models fail, empty if it did not fail (see ModelLoader::hasFailed) */
+    std::string getLoadingError() const { return modelLoader.hasFailed() ? modelLoader.getError() : std::string(); }
+
+    /** Arena of the processor, to report locked and peak memory (only once the models are ready) */
+    const InferenceEngine::LockedArena& getMemoryArena() const { return *memoryArena; }
+    /** Memory of the models and of the staging buffers, see memoryusage.h (only once the models are ready) */
+    InferenceEngine::ModelMemoryUsage getMemoryUsage() const;
 
 public:
     // Gain parameter
     const String GAIN_ID = "gain", GAIN_NAME = "gain";
+    // Quality tier, reported to the host (see USE_QUALITY_TIERS)
+    const String TIER_ID = "tier", TIER_NAME = "quality tier";
+    // Weight set of the saturation model (see USE_WEIGHT_SETS)
+    const String PRESET_ID = "preset", PRESET_NAME = "weight set";
     juce::AudioProcessorValueTreeState valueTreeState;
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
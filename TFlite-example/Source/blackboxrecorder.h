@@ -0,0 +1,119 @@
+/*
+ * Black-box recorder of the saturation model
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Keeps the last seconds of input, gain and output of the model in preallocated circular buffers, so that when the
+ * model misbehaves live (NaN, clipping, spikes) what went in can be recovered and replayed offline
+ * ('InferenceTools replay', with either engine).
+ *
+ * The real-time thread calls recordInput() before processing each block and recordOutput() after it, without locks
+ * or allocations. recordOutput() also arms a trigger when an output sample is not finite or exceeds the trigger
+ * level. A watcher thread (startWatcher) writes a snapshot to disk once the trigger has collected its post-trigger
+ * context, or as soon as a snapshot is requested with requestSnapshot().
+ *
+ * Snapshots are taken while recording continues, as a seqlock: the buffers are copied, then the write position is
+ * read again and the blocks that the writer may have overwritten in the meantime are discarded.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InferenceEngine {
+
+/** Recorded blocks, as written to and read from .bbox files */
+struct BlackBoxSnapshot {
+    double sampleRate = 0.0;
+    int numChannels = 0;
+    std::string reason;             // "nan", "level" or "request"
+    uint64_t firstSample = 0;       // Position of the first sample since the recorder was prepared
+    std::vector<int> blockSizes;    // Samples of each block, in the order they were processed
+    std::vector<float> gains;       // Gain fed to the model with each block
+    std::vector<std::vector<float>> input, output;  // One vector per channel
+
+    int getNumSamples() const { return input.empty() ? 0 : (int)input[0].size(); }
+
+    bool write(const std::string& path) const;
+    bool read(const std::string& path);
+};
+
+class BlackBoxRecorder {
+public:
+    ~BlackBoxRecorder();
+
+    /**
+     * @brief Allocate the buffers (do not use in real time threads!), stops the watcher
+     *
+     * @param numChannels   Channels recorded
+     * @param sampleRate    Sample rate of the recorded signals
+     * @param maxBlockSize  Largest block recorded, larger blocks are skipped
+     * @param seconds       Recorded history
+     */
+    void prepare(int numChannels, double sampleRate, int maxBlockSize, double seconds);
+
+    /** Output level (absolute value) that triggers a snapshot, non-finite output always does */
+    void setTriggerLevel(float level) { triggerLevel = level; }
+
+    /** Record the input of a block and the gain fed to the model (real-time safe) */
+    void recordInput(const float* const* channels, int numChannels, int numSamples, float gain);
+
+    /** Record the output of the block passed to recordInput() and check the trigger (real-time safe) */
+    void recordOutput(const float* const* channels, int numChannels, int numSamples);
+
+    /** Ask the watcher for a snapshot of the current history (real-time safe) */
+    void requestSnapshot();
+
+    /** Copy the recorded history (do not use in real time threads!) */
+    bool takeSnapshot(BlackBoxSnapshot& snapshot) const;
+
+    /**
+     * @brief Start the thread that writes the snapshots to <pathPrefix>_<n>_<reason>.bbox
+     *
+     * @param pathPrefix            Path of the snapshots, without extension
+     * @param postTriggerSeconds    History recorded after a trigger before writing the snapshot
+     * @param maxSnapshots          Triggered snapshots written before ignoring the trigger (requests are always served)
+     */
+    void startWatcher(const std::string& pathPrefix, double postTriggerSeconds, int maxSnapshots);
+    void stopWatcher();
+
+private:
+    enum Reason : uint64_t { none = 0, nonFinite = 1, level = 2, request = 3 };
+    static const char* getReasonName(uint64_t reason);
+    /** Arm the trigger, unless another one is pending (the position is packed above the two bits of the reason) */
+    void arm(uint64_t reason, uint64_t position);
+    void watch();
+
+    struct BlockRecord {
+        uint64_t start = 0;
+        int numSamples = 0;
+        float gain = 0.0f;
+    };
+
+    int numChannels = 0, maxBlockSize = 0;
+    double sampleRate = 0.0;
+    size_t sampleCapacity = 0, blockCapacity = 0;
+    std::vector<std::unique_ptr<float[]>> inputRing, outputRing;
+    std::unique_ptr<BlockRecord[]> blockRing;
+
+    // Written by the real-time thread only
+    uint64_t pendingStart = 0;
+    int pendingSamples = -1;  // Samples of the block between recordInput and recordOutput (-1 if none or skipped)
+    float pendingGain = 0.0f;
+    std::atomic<uint64_t> samplesWritten{0}, blocksWritten{0};
+
+    float triggerLevel = 1.0e6f;
+    std::atomic<uint64_t> trigger{none};
+    std::atomic<bool> autoTrigger{true};
+
+    std::thread watcher;
+    std::atomic<bool> stopping{false};
+    std::string pathPrefix;
+    uint64_t postTriggerSamples = 0;
+    int maxSnapshots = 0;
+};
+
+}  // namespace InferenceEngine
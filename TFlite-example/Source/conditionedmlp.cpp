@@ -0,0 +1,162 @@
+/*
+==============================================================================*/
+#include "conditionedmlp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace InferenceEngine {
+
+namespace {
+
+const int chunkFrames = 64;  // Frames evaluated together, a row of activations per unit fits the L1 cache
+
+void activate(DenseActivation activation, float* values, int numValues) {
+    switch (activation) {
+        case DenseActivation::none:
+            break;
+        case DenseActivation::relu:
+            for (int i = 0; i < numValues; ++i)
+                values[i] = std::max(0.0f, values[i]);
+            break;
+        case DenseActivation::relu6:
+            for (int i = 0; i < numValues; ++i)
+                values[i] = std::min(6.0f, std::max(0.0f, values[i]));
+            break;
+        case DenseActivation::tanh:
+            for (int i = 0; i < numValues; ++i)
+                values[i] = std::tanh(values[i]);
+            break;
+        case DenseActivation::sigmoid:
+            for (int i = 0; i < numValues; ++i)
+                values[i] = 1.0f / (1.0f + std::exp(-values[i]));
+            break;
+    }
+}
+
+}  // namespace
+
+bool ConditionedMlp::prepare(const std::vector<DenseLayer>& layers, const std::vector<int>& conditioningInputs) {
+    this->layers.clear();
+    if (layers.empty())
+        return false;
+    int widest = 0;
+    for (size_t l = 0; l < layers.size(); ++l) {
+        const DenseLayer& layer = layers[l];
+        if (layer.numInputs <= 0 || layer.numOutputs <= 0 || layer.weights.size() != (size_t)layer.numInputs * layer.numOutputs || layer.bias.size() != (size_t)layer.numOutputs)
+            return false;
+        if (l > 0 && layers[l - 1].numOutputs != layer.numInputs)
+            return false;
+        widest = std::max(widest, std::max(layer.numInputs, layer.numOutputs));
+    }
+
+    // Columns of the first layer, split between per-sample and conditioning inputs
+    const DenseLayer& first = layers[0];
+    std::vector<bool> isConditioning((size_t)first.numInputs, false);
+    for (int input : conditioningInputs) {
+        if (input < 0 || input >= first.numInputs || isConditioning[input])
+            return false;
+        isConditioning[input] = true;
+    }
+    sampleInputs.clear();
+    for (int input = 0; input < first.numInputs; ++input)
+        if (!isConditioning[input])
+            sampleInputs.push_back(input);
+    if (sampleInputs.empty())
+        return false;
+    this->conditioningInputs = conditioningInputs;
+
+    DenseLayer sampleLayer;
+    sampleLayer.numInputs = (int)sampleInputs.size();
+    sampleLayer.numOutputs = first.numOutputs;
+    sampleLayer.activation = first.activation;
+    sampleLayer.bias = first.bias;
+    conditioningWeights.clear();
+    for (int output = 0; output < first.numOutputs; ++output) {
+        const float* row = &first.weights[(size_t)output * first.numInputs];
+        for (int input : sampleInputs)
+            sampleLayer.weights.push_back(row[input]);
+        for (int input : conditioningInputs)
+            conditioningWeights.push_back(row[input]);
+    }
+    baseBias = first.bias;
+    conditioning.assign(conditioningInputs.size(), 0.0f);
+    folded = conditioningInputs.empty();  // Nothing to fold, the base bias is already the effective one
+
+    this->layers = layers;
+    this->layers[0] = std::move(sampleLayer);
+    for (auto& buffer : activations)
+        buffer.assign((size_t)widest * chunkFrames, 0.0f);
+    return true;
+}
+
+void ConditionedMlp::setConditioning(const float* values) {
+    if (layers.empty() || (folded && std::equal(conditioning.begin(), conditioning.end(), values)))
+        return;
+    std::copy(values, values + conditioning.size(), conditioning.begin());
+    folded = true;
+    // The only part of the network that depends on the conditioning alone, evaluated once instead of at every frame
+    const int numConditioning = (int)conditioning.size();
+    DenseLayer& first = layers[0];
+    for (int output = 0; output < first.numOutputs; ++output) {
+        float bias = baseBias[output];
+        for (int c = 0; c < numConditioning; ++c)
+            bias += conditioningWeights[(size_t)output * numConditioning + c] * conditioning[c];
+        first.bias[output] = bias;
+    }
+}
+
+void ConditionedMlp::process(const float* inputs, float* outputs, int numFrames) {
+    if (layers.empty())
+        return;
+    const int numSampleInputs = getNumSampleInputs();
+    const int numOutputs = getNumOutputs();
+    for (int start = 0; start < numFrames; start += chunkFrames) {
+        const int frames = std::min(chunkFrames, numFrames - start);
+        float* in = activations[0].data();
+        float* out = activations[1].data();
+        for (int input = 0; input < numSampleInputs; ++input)
+            for (int frame = 0; frame < frames; ++frame)
+                in[input * frames + frame] = inputs[(size_t)(start + frame) * numSampleInputs + input];
+
+        for (const DenseLayer& layer : layers) {
+            for (int output = 0; output < layer.numOutputs; ++output) {
+                float* row = out + output * frames;
+                std::fill(row, row + frames, layer.bias[output]);
+                for (int input = 0; input < layer.numInputs; ++input) {
+                    const float weight = layer.weights[(size_t)output * layer.numInputs + input];
+                    const float* inputRow = in + input * frames;
+                    for (int frame = 0; frame < frames; ++frame)
+                        row[frame] += weight * inputRow[frame];
+                }
+            }
+            activate(layer.activation, out, layer.numOutputs * frames);
+            std::swap(in, out);
+        }
+
+        for (int output = 0; output < numOutputs; ++output)
+            for (int frame = 0; frame < frames; ++frame)
+                outputs[(size_t)(start + frame) * numOutputs + output] = in[output * frames + frame];
+    }
+}
+
+int ConditionedMlp::getMacsPerFrame() const {
+    int macs = 0;
+    for (const DenseLayer& layer : layers)
+        macs += layer.numInputs * layer.numOutputs;
+    return macs;
+}
+
+int ConditionedMlp::getUnfoldedMacsPerFrame() const {
+    return layers.empty() ? 0 : getMacsPerFrame() + (int)conditioningInputs.size() * layers[0].numOutputs;
+}
+
+size_t ConditionedMlp::getBytes() const {
+    size_t values = conditioningWeights.size() + baseBias.size() + conditioning.size() + activations[0].size() + activations[1].size();
+    for (const DenseLayer& layer : layers)
+        values += layer.weights.size() + layer.bias.size();
+    return values * sizeof(float);
+}
+
+}  // namespace InferenceEngine
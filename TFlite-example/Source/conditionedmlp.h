@@ -0,0 +1,79 @@
+/*
+ * Native evaluation of a dense model with block-rate conditioning inputs
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Some inputs of a conditioned model change at block rate (e.g. the gain of the saturator), yet the interpreter pushes
+ * them through the whole network with every sample. For a chain of dense layers they only reach the first layer, where
+ * they contribute (weights of the conditioning inputs * conditioning values) to every output, which is constant over
+ * the block. This class evaluates that part once when the conditioning changes and folds it into the effective bias
+ * of the first layer, so that the per-sample path multiplies only the columns of the per-sample inputs.
+ *
+ * The layers are extracted from the interpreter (see getDenseLayers in tflitewrapper.h) and evaluated natively, a
+ * chunk of frames at a time. The activations are planar (one row of frames per unit), so that every weight multiplies
+ * a contiguous row and the inner loops vectorize.
+ *
+ * Everything is allocated in prepare, the other methods can be called from the real-time thread.
+ */
+#pragma once
+
+#include <vector>
+
+namespace InferenceEngine {
+
+enum class DenseActivation { none, relu, relu6, tanh, sigmoid };
+
+/** Fully connected layer, outputs = activation(weights * inputs + bias) */
+struct DenseLayer {
+    int numInputs = 0;
+    int numOutputs = 0;
+    std::vector<float> weights;  // numOutputs rows of numInputs
+    std::vector<float> bias;     // numOutputs
+    DenseActivation activation = DenseActivation::none;
+};
+
+class ConditionedMlp {
+public:
+    /**
+     * @brief Split the inputs of the first layer and allocate the activations (do not use in real time threads!)
+     *
+     * @param layers                Chain of layers, the outputs of each one are the inputs of the next
+     * @param conditioningInputs    Inputs of the first layer that are constant over a block, in the order of setConditioning
+     * @return bool                 False if the layers are not a chain or an index is out of range
+     */
+    bool prepare(const std::vector<DenseLayer>& layers, const std::vector<int>& conditioningInputs);
+    bool isPrepared() const { return !layers.empty(); }
+
+    /** Fold the conditioning values into the bias of the first layer, only if they changed (real-time safe) */
+    void setConditioning(const float* values);
+
+    /**
+     * @brief Run frames through the model (real-time safe)
+     *
+     * @param inputs    Per-sample inputs of each frame, interleaved (getNumSampleInputs() per frame)
+     * @param outputs   Outputs of each frame, interleaved (getNumOutputs() per frame), in place is allowed if there
+     *                  are as many outputs as per-sample inputs
+     * @param numFrames Number of frames
+     */
+    void process(const float* inputs, float* outputs, int numFrames);
+
+    int getNumSampleInputs() const { return (int)sampleInputs.size(); }
+    int getNumOutputs() const { return layers.empty() ? 0 : layers.back().numOutputs; }
+    /** Multiply-adds per frame with and without the folding */
+    int getMacsPerFrame() const;
+    int getUnfoldedMacsPerFrame() const;
+    /** Bytes of the copy of the weights and of the activations */
+    size_t getBytes() const;
+
+private:
+    std::vector<DenseLayer> layers;  // The first one has only the columns of the per-sample inputs
+    std::vector<int> sampleInputs;
+    std::vector<int> conditioningInputs;
+    std::vector<float> conditioningWeights;  // numOutputs rows of the columns of the conditioning inputs
+    std::vector<float> baseBias;             // Bias of the first layer before the folding
+    std::vector<float> conditioning;         // Last folded values
+    bool folded = false;
+
+    std::vector<float> activations[2];  // Planar, the widest layer times the frames of a chunk
+};
+
+}  // namespace InferenceEngine
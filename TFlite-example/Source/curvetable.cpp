@@ -0,0 +1,60 @@
+/*
+==============================================================================*/
+#include "curvetable.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace InferenceEngine {
+
+void CurveTable::build(const ModelFunction& model, float minGain, float maxGain, int numGains, int numInputs, float maxDrive, float maxInput) {
+    this->numInputs = std::max(2, numInputs);
+    this->maxDrive = maxDrive;
+    numGains = std::max(1, numGains);
+    gains.resize((size_t)numGains);
+    table.resize((size_t)numGains * this->numInputs);
+    row.assign((size_t)this->numInputs, 0.0f);
+    currentGain = -1.0f;
+
+    std::vector<float> inputs((size_t)this->numInputs);
+    for (int g = 0; g < numGains; ++g) {
+        gains[g] = (numGains > 1) ? minGain * std::pow(maxGain / minGain, (float)g / (numGains - 1)) : minGain;
+        for (int i = 0; i < this->numInputs; ++i) {
+            const float drive = maxDrive * (2.0f * i / (this->numInputs - 1) - 1.0f);
+            inputs[i] = std::max(-maxInput, std::min(maxInput, drive / gains[g]));
+        }
+        model(inputs.data(), &table[(size_t)g * this->numInputs], this->numInputs, gains[g]);
+    }
+}
+
+void CurveTable::setGain(float gain) {
+    if (gain == currentGain || table.empty())
+        return;
+    currentGain = gain;
+    // Rows are spaced logarithmically, so they are interpolated on the logarithm of the gain
+    const auto upper = std::upper_bound(gains.begin(), gains.end(), gain);
+    const int second = std::min((int)gains.size() - 1, std::max(1, (int)(upper - gains.begin())));
+    const int first = std::max(0, second - 1);
+    float weight = 0.0f;
+    if (first != second)
+        weight = std::max(0.0f, std::min(1.0f, std::log(gain / gains[first]) / std::log(gains[second] / gains[first])));
+    const float* a = &table[(size_t)first * numInputs];
+    const float* b = &table[(size_t)second * numInputs];
+    for (int i = 0; i < numInputs; ++i)
+        row[i] = a[i] + weight * (b[i] - a[i]);
+}
+
+void CurveTable::process(const float* input, float* output, int numSamples) const {
+    if (row.empty())
+        return;
+    const float scale = (numInputs - 1) / (2.0f * maxDrive);
+    const float lastPosition = (float)(numInputs - 1);
+    for (int i = 0; i < numSamples; ++i) {
+        const float position = std::max(0.0f, std::min(lastPosition, (currentGain * input[i] + maxDrive) * scale));
+        const int index = std::min(numInputs - 2, (int)position);
+        const float fraction = position - index;
+        output[i] = row[index] + fraction * (row[index + 1] - row[index]);
+    }
+}
+
+}  // namespace InferenceEngine
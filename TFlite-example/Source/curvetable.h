@@ -0,0 +1,58 @@
+/*
+ * Lookup table of a sample-wise saturation model
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * The output of the saturation model depends only on the current sample and on the gain fed with it, so the model is
+ * a 2D curve that can be sampled once and interpolated afterwards at a fraction of the cost of an invocation. The
+ * table is built while preparing, by running a grid of inputs through the model for a set of gains spaced
+ * logarithmically (the shape of the curve changes the most at low gains).
+ *
+ * The inputs are sampled on the scale of the drive (gain * x), where a saturator changes shape, so the same number of
+ * points is as accurate at every gain. Inputs whose drive is beyond the table are clamped to its edges, where the
+ * curve is flat.
+ *
+ * At each block setGain() interpolates the row of the current gain once, then process() costs a linear interpolation
+ * per sample. Only stateless sample-wise models can be tabulated: the table of a model with memory is wrong.
+ */
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace InferenceEngine {
+
+class CurveTable {
+public:
+    /** Run numSamples inputs through the model at the given gain */
+    using ModelFunction = std::function<void(const float* inputs, float* outputs, int numSamples, float gain)>;
+
+    /**
+     * @brief Sample the curve of the model (do not use in real time threads!)
+     *
+     * @param model     Invokes the model, called once per gain
+     * @param minGain   Smallest gain fed to the model (greater than 0)
+     * @param maxGain   Largest gain fed to the model
+     * @param numGains  Rows of the table
+     * @param numInputs Points per row
+     * @param maxDrive  Largest drive (gain * x) in the table
+     * @param maxInput  Largest input fed to the model, larger ones are clamped
+     */
+    void build(const ModelFunction& model, float minGain, float maxGain, int numGains = 33, int numInputs = 513, float maxDrive = 8.0f, float maxInput = 2.0f);
+    bool isBuilt() const { return !table.empty(); }
+
+    /** Interpolate the row of a gain (real-time safe) */
+    void setGain(float gain);
+
+    /** Apply the curve of the current gain, in place is allowed (real-time safe) */
+    void process(const float* input, float* output, int numSamples) const;
+
+private:
+    std::vector<float> gains;  // Ascending, one per row
+    std::vector<float> table;  // numGains rows of numInputs points
+    std::vector<float> row;    // Curve of the current gain
+    int numInputs = 0;
+    float maxDrive = 0.0f;
+    float currentGain = -1.0f;
+};
+
+}  // namespace InferenceEngine
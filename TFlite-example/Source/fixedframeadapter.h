@@ -0,0 +1,107 @@
+/*
+ * Fixed-frame inference adapter
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Decouples the number of samples consumed by each model invocation (frame size) from the block size used by the
+ * host, which can be different and even change from block to block.
+ * Input samples are accumulated in a FIFO and the frame callback runs every time a full frame is available, so it
+ * can run zero, one or several times per block. Output samples are read from a second FIFO that is pre-filled with
+ * (frameSize - 1) zeros, which is the constant latency to report to the host (no latency for 1-sample frames).
+ *
+ * Both FIFOs are allocated in prepare(), so process() can be called from the real-time thread.
+ */
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace InferenceEngine {
+
+class FixedFrameAdapter {
+public:
+    /**
+     * @brief Allocate and clear the FIFOs (do not use in real time threads!)
+     *
+     * @param frameSize Number of samples consumed and produced by each invocation of the model
+     */
+    void prepare(int frameSize) {
+        if (frameSize <= 0)
+            throw std::logic_error("Error, the frame size has to be positive (Found " + std::to_string(frameSize) + " instead)");
+        this->frameSize = frameSize;
+        inputFrame.resize(frameSize);
+        outputFrame.resize(frameSize);
+        // One extra frame of room, since a chunk is read only after the frame it completes has been written
+        outputFifo.resize(2 * frameSize);
+        reset();
+    }
+
+    /**
+     * @brief Clear the FIFOs without reallocating
+     */
+    void reset() {
+        std::fill(inputFrame.begin(), inputFrame.end(), 0.0f);
+        std::fill(outputFifo.begin(), outputFifo.end(), 0.0f);
+        inputCount = 0;
+        fifoRead = 0;
+        fifoWrite = frameSize - 1;
+    }
+
+    /**
+     * @brief Get the latency introduced by the adapter, to report through setLatencySamples
+     *
+     * @return int Latency in samples
+     */
+    int getLatencySamples() const { return frameSize - 1; }
+
+    int getFrameSize() const { return frameSize; }
+
+    /**
+     * @brief Process a block of any size in place
+     * The callback is invoked as processFrame(const float* inputFrame, float* outputFrame, int frameSize) for every
+     * complete frame. It is a template parameter (usually a lambda) so that the call can be inlined.
+     *
+     * @param channelData  Samples to process, overwritten with the output
+     * @param numSamples   Number of samples in the block
+     * @param processFrame Frame callback, running the model
+     */
+    template <typename FrameCallback>
+    void process(float* channelData, int numSamples, FrameCallback&& processFrame) {
+        const int fifoSize = (int)outputFifo.size();
+        int pos = 0;
+        while (pos < numSamples) {
+            // Never cross a frame boundary within a chunk
+            const int chunk = std::min(numSamples - pos, frameSize - inputCount);
+            std::copy(channelData + pos, channelData + pos + chunk, &inputFrame[inputCount]);
+            inputCount += chunk;
+
+            if (inputCount == frameSize) {
+                processFrame((const float*)inputFrame.data(), outputFrame.data(), frameSize);
+                const int firstPart = std::min(frameSize, fifoSize - fifoWrite);
+                std::copy(outputFrame.begin(), outputFrame.begin() + firstPart, &outputFifo[fifoWrite]);
+                std::copy(outputFrame.begin() + firstPart, outputFrame.end(), &outputFifo[0]);
+                fifoWrite = (fifoWrite + frameSize) % fifoSize;
+                inputCount = 0;
+            }
+
+            const int firstPart = std::min(chunk, fifoSize - fifoRead);
+            std::copy(&outputFifo[fifoRead], &outputFifo[fifoRead] + firstPart, channelData + pos);
+            std::copy(&outputFifo[0], &outputFifo[0] + (chunk - firstPart), channelData + pos + firstPart);
+            fifoRead = (fifoRead + chunk) % fifoSize;
+
+            pos += chunk;
+        }
+    }
+
+private:
+    int frameSize = 1;
+    int inputCount = 0;
+    int fifoRead = 0, fifoWrite = 0;
+
+    std::vector<float> inputFrame;
+    std::vector<float> outputFrame;
+    std::vector<float> outputFifo;
+};
+
+}  // namespace InferenceEngine
@@ -0,0 +1,422 @@
+/*
+==============================================================================*/
+#include "inferencepipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace InferenceEngine {
+
+namespace {
+
+// Idle workers spin for a few block periods after their last task, then check for work at every sleep
+const std::chrono::milliseconds idleSpinTime(20);
+const std::chrono::microseconds idleSleepTime(500);
+
+}  // namespace
+
+InferencePipeline::~InferencePipeline() {
+    stopWorkers();
+}
+
+int InferencePipeline::addStage(Stage stage) {
+    for (int input : stage.inputs)
+        if (input < 0 || input >= (int)stages.size())
+            throw std::logic_error("Error, pipeline stage '" + stage.name + "' reads a stage that is not declared before it");
+    prepared = false;
+    stages.push_back(std::move(stage));
+    return (int)stages.size() - 1;
+}
+
+int InferencePipeline::addInput(const std::string& name) {
+    Stage stage;
+    stage.name = name;
+    stage.type = Input;
+    const int index = addStage(std::move(stage));
+    inputStages.push_back(index);
+    return index;
+}
+
+int InferencePipeline::addModel(const std::string& name, InterpreterPtr interpreter, const std::vector<int>& inputs, const float* conditioning, int numConditioning) {
+    if (interpreter == nullptr || inputs.empty() || numConditioning < 0 || (numConditioning > 0 && conditioning == nullptr))
+        throw std::logic_error("Error, pipeline stage '" + name + "' needs a model, at least one input and valid conditioning values");
+    Stage stage;
+    stage.name = name;
+    stage.type = Model;
+    stage.inputs = inputs;
+    stage.conditioning = conditioning;
+    stage.numConditioning = numConditioning;
+    // Stages on the same interpreter share its binding
+    stage.model = -1;
+    for (size_t i = 0; i < models.size() && stage.model < 0; ++i)
+        if (models[i].interpreter == interpreter)
+            stage.model = (int)i;
+    if (stage.model < 0) {
+        models.emplace_back();
+        models.back().interpreter = interpreter;
+        stage.model = (int)models.size() - 1;
+    }
+    return addStage(std::move(stage));
+}
+
+int InferencePipeline::addDsp(const std::string& name, DspFunction function, const std::vector<int>& inputs) {
+    if (!function)
+        throw std::logic_error("Error, pipeline stage '" + name + "' needs a function");
+    Stage stage;
+    stage.name = name;
+    stage.type = Dsp;
+    stage.inputs = inputs;
+    stage.function = std::move(function);
+    return addStage(std::move(stage));
+}
+
+void InferencePipeline::addOutput(int stage) {
+    if (stage < 0 || stage >= (int)stages.size())
+        throw std::logic_error("Error, pipeline output " + std::to_string(outputStages.size()) + " is not a declared stage");
+    prepared = false;
+    outputStages.push_back(stage);
+}
+
+void InferencePipeline::prepare(int maxBlockSize, const ThreadingConfig& threading) {
+    stopWorkers();
+    prepared = false;
+    if (maxBlockSize <= 0)
+        throw std::logic_error("Error, the pipeline needs a positive block size");
+    this->maxBlockSize = maxBlockSize;
+    plan();
+    planBuffers();
+    prepareModels();
+    startWorkers(threading);
+    prepared = true;
+}
+
+void InferencePipeline::plan() {
+    tasks.clear();
+    levelEnds.clear();
+    for (Stage& stage : stages) {
+        stage.numReaders = 0;
+        stage.task = -1;
+    }
+    for (const Stage& stage : stages)
+        for (int input : stage.inputs)
+            ++stages[input].numReaders;
+    for (int output : outputStages)
+        ++stages[output].numReaders;
+
+    // Depth of each stage in the graph, the inputs are written before the first level
+    std::vector<int> depths(stages.size(), -1);
+    for (size_t s = 0; s < stages.size(); ++s)
+        for (int input : stages[s].inputs)
+            depths[s] = std::max(depths[s], depths[input] + 1);
+    for (size_t s = 0; s < stages.size(); ++s)
+        if (stages[s].type != Input)
+            depths[s] = std::max(depths[s], 0);
+
+    for (size_t s = 0; s < stages.size(); ++s) {
+        Stage& stage = stages[s];
+        if (stage.type == Input)
+            continue;
+        // Batched with the model stages of the same depth on the same interpreter
+        bool batched = false;
+        for (size_t t = 0; t < tasks.size() && !batched && stage.type == Model; ++t) {
+            for (auto& step : tasks[t].steps) {
+                const Stage& first = stages[step[0]];
+                if (first.type == Model && first.model == stage.model && depths[step[0]] == depths[s]) {
+                    step.push_back((int)s);
+                    stage.task = (int)t;
+                    batched = true;
+                    break;
+                }
+            }
+        }
+        if (batched)
+            continue;
+        // Fused with the task of its input if it continues a chain
+        if (stage.inputs.size() == 1) {
+            const Stage& input = stages[stage.inputs[0]];
+            if (input.type != Input && input.numReaders == 1) {
+                Task& task = tasks[input.task];
+                const std::vector<int>& lastStep = task.steps.back();
+                if (lastStep.size() == 1 && lastStep[0] == stage.inputs[0]) {
+                    task.steps.push_back({(int)s});
+                    stage.task = input.task;
+                    continue;
+                }
+            }
+        }
+        tasks.emplace_back();
+        tasks.back().steps.push_back({(int)s});
+        stage.task = (int)tasks.size() - 1;
+    }
+
+    // Each task runs one level after the tasks it reads from (the task graph has no cycles, so this settles)
+    for (size_t iteration = 0; iteration <= tasks.size(); ++iteration) {
+        bool changed = false;
+        for (Task& task : tasks) {
+            for (const auto& step : task.steps) {
+                for (int s : step) {
+                    for (int input : stages[s].inputs) {
+                        const int inputTask = stages[input].task;
+                        if (inputTask >= 0 && &tasks[inputTask] != &task && tasks[inputTask].level + 1 > task.level) {
+                            task.level = tasks[inputTask].level + 1;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+        if (!changed)
+            break;
+    }
+
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) { return a.level < b.level; });
+    for (size_t t = 0; t < tasks.size(); ++t) {
+        for (const auto& step : tasks[t].steps)
+            for (int s : step)
+                stages[s].task = (int)t;
+        if (t + 1 == tasks.size() || tasks[t + 1].level != tasks[t].level)
+            levelEnds.push_back((uint32_t)t + 1);
+    }
+}
+
+void InferencePipeline::planBuffers() {
+    // Lifetime of each buffer, in steps of the block: 0 when the inputs are copied, level + 1 when a level runs
+    const int end = (int)levelEnds.size() + 1;
+    std::vector<int> firstUse(stages.size()), lastUse(stages.size());
+    for (size_t s = 0; s < stages.size(); ++s) {
+        firstUse[s] = stages[s].type == Input ? 0 : tasks[stages[s].task].level + 1;
+        lastUse[s] = firstUse[s];
+    }
+    for (const Stage& stage : stages)
+        for (int input : stage.inputs)
+            lastUse[input] = std::max(lastUse[input], tasks[stage.task].level + 1);
+    for (int output : outputStages)
+        lastUse[output] = end;
+
+    // Every buffer has maxBlockSize samples: in order of first use, each one takes a buffer that is no longer live
+    std::vector<int> order(stages.size());
+    for (size_t s = 0; s < stages.size(); ++s)
+        order[s] = (int)s;
+    std::stable_sort(order.begin(), order.end(), [&firstUse](int a, int b) { return firstUse[a] < firstUse[b]; });
+    std::vector<int> bufferOf(stages.size());
+    std::vector<int> bufferLastUse;
+    for (int s : order) {
+        int buffer = -1;
+        for (size_t b = 0; b < bufferLastUse.size() && buffer < 0; ++b)
+            if (bufferLastUse[b] < firstUse[s])
+                buffer = (int)b;
+        if (buffer < 0) {
+            buffer = (int)bufferLastUse.size();
+            bufferLastUse.push_back(0);
+        }
+        bufferLastUse[buffer] = lastUse[s];
+        bufferOf[s] = buffer;
+    }
+    numBuffers = (int)bufferLastUse.size();
+
+    const size_t bufferBytes = ((size_t)maxBlockSize * sizeof(float) + LockedArena::cacheLineSize - 1) / LockedArena::cacheLineSize * LockedArena::cacheLineSize;
+    arena = std::make_unique<LockedArena>(std::max(numBuffers, 1) * bufferBytes);
+    std::vector<float*> buffers;
+    for (int b = 0; b < numBuffers; ++b) {
+        buffers.push_back(static_cast<float*>(arena->allocate(bufferBytes)));
+        std::fill(buffers.back(), buffers.back() + maxBlockSize, 0.0f);
+    }
+    for (size_t s = 0; s < stages.size(); ++s)
+        stages[s].buffer = buffers[bufferOf[s]];
+    for (Stage& stage : stages) {
+        stage.inputBuffers.clear();
+        for (int input : stage.inputs)
+            stage.inputBuffers.push_back(stages[input].buffer);
+    }
+}
+
+void InferencePipeline::prepareModels() {
+    for (size_t m = 0; m < models.size(); ++m) {
+        ModelBinding& model = models[m];
+        // Widest batch of the interpreter, and the row size that all its stages have to agree on
+        size_t maxStep = 1;
+        model.rowSize = 0;
+        for (const Task& task : tasks) {
+            for (const auto& step : task.steps) {
+                const Stage& first = stages[step[0]];
+                if (first.type != Model || first.model != (int)m)
+                    continue;
+                maxStep = std::max(maxStep, step.size());
+                for (int s : step) {
+                    const size_t rowSize = stages[s].inputs.size() + (size_t)stages[s].numConditioning;
+                    if (model.rowSize != 0 && rowSize != model.rowSize)
+                        throw std::logic_error("Error, pipeline stage '" + stages[s].name + "' has rows of " + std::to_string(rowSize) + " values, other stages on its model have " + std::to_string(model.rowSize));
+                    model.rowSize = rowSize;
+                }
+            }
+        }
+
+        // A whole block per invocation if the batch can be resized, otherwise the block runs in frames of the batch
+        model.stacked = setModelBatchSize(model.interpreter, maxStep * (size_t)maxBlockSize);
+        model.batchRows = getModelBatchSize(model.interpreter);
+        if (model.stacked && model.batchRows != maxStep * (size_t)maxBlockSize)
+            model.stacked = false;
+        model.engine.bind(model.interpreter, model.batchRows * model.rowSize, model.batchRows);
+
+        // Prime at the planned batch, so that the first block does not pay for it
+        std::fill(model.engine.input(), model.engine.input() + model.engine.inputSize(), 0.0f);
+        model.engine.run();
+        resetModelState(model.interpreter);
+    }
+}
+
+void InferencePipeline::startWorkers(const ThreadingConfig& threading) {
+    // More workers than the widest level would never find a task
+    uint32_t widestLevel = 0;
+    for (size_t level = 0; level < levelEnds.size(); ++level)
+        widestLevel = std::max(widestLevel, levelEnds[level] - (level > 0 ? levelEnds[level - 1] : 0));
+    const int numWorkers = std::min(threading.numThreads - 1, (int)widestLevel - 1);
+    if (numWorkers <= 0)
+        return;
+
+    workersSpin = threading.spinWait;
+    stopping.store(false, std::memory_order_release);
+    for (int w = 0; w < numWorkers; ++w) {
+        workers.emplace_back([this, threading]() {
+            if (configuresWorkerThreads(threading))
+                configureCurrentThread(threading);
+            workerLoop();
+        });
+    }
+}
+
+void InferencePipeline::stopWorkers() {
+    stopping.store(true, std::memory_order_release);
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+void InferencePipeline::workerLoop() {
+    auto lastTask = std::chrono::steady_clock::now();
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (runNextTask()) {
+            lastTask = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (workersSpin || std::chrono::steady_clock::now() - lastTask < idleSpinTime)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(idleSleepTime);
+    }
+}
+
+void InferencePipeline::process(const float* const* inputs, float* const* outputs, int numSamples) {
+    if (!prepared)
+        return;
+    for (int offset = 0; offset < numSamples; offset += maxBlockSize)
+        processChunk(inputs, outputs, offset, std::min(maxBlockSize, numSamples - offset));
+}
+
+void InferencePipeline::processChunk(const float* const* inputs, float* const* outputs, int offset, int numSamples) {
+    for (size_t i = 0; i < inputStages.size(); ++i)
+        std::copy(inputs[i] + offset, inputs[i] + offset + numSamples, stages[inputStages[i]].buffer);
+
+    blockSamples = numSamples;
+    const uint64_t block = (++blockNumber) << 32;
+    completedTasks.store(0, std::memory_order_relaxed);
+    claimedTasks.store(block, std::memory_order_release);
+    for (uint32_t levelEnd : levelEnds) {
+        releasedTasks.store(block | levelEnd, std::memory_order_release);
+        while (runNextTask()) {
+        }
+        // Only the tasks that the workers claimed are left
+        while (completedTasks.load(std::memory_order_acquire) < levelEnd) {
+        }
+    }
+
+    for (size_t o = 0; o < outputStages.size(); ++o)
+        std::copy(stages[outputStages[o]].buffer, stages[outputStages[o]].buffer + numSamples, outputs[o] + offset);
+}
+
+bool InferencePipeline::runNextTask() {
+    const uint64_t released = releasedTasks.load(std::memory_order_acquire);
+    uint64_t claimed = claimedTasks.load(std::memory_order_acquire);
+    if ((claimed >> 32) != (released >> 32) || (uint32_t)claimed >= (uint32_t)released)
+        return false;
+    if (!claimedTasks.compare_exchange_strong(claimed, claimed + 1, std::memory_order_acq_rel))
+        return true;  // Taken by another thread, there may be more
+    runTask(tasks[(uint32_t)claimed], blockSamples);
+    completedTasks.fetch_add(1, std::memory_order_acq_rel);
+    return true;
+}
+
+void InferencePipeline::runTask(const Task& task, int numSamples) {
+    for (const auto& step : task.steps) {
+        Stage& stage = stages[step[0]];
+        if (stage.type == Model)
+            runModelStep(step, numSamples);
+        else
+            stage.function(stage.inputBuffers.data(), (int)stage.inputBuffers.size(), stage.buffer, numSamples);
+    }
+}
+
+void InferencePipeline::runModelStep(const std::vector<int>& step, int numSamples) {
+    ModelBinding& model = models[stages[step[0]].model];
+    const size_t rowSize = model.rowSize;
+    float* input = model.engine.input();
+    const float* output = model.engine.output();
+
+    // Rows [start, start + numRows) of a stage, written from row 0 of rows
+    auto writeRows = [rowSize](const Stage& stage, float* rows, int start, int numRows) {
+        const size_t numInputs = stage.inputBuffers.size();
+        for (int row = 0; row < numRows; ++row) {
+            float* values = rows + (size_t)row * rowSize;
+            for (size_t i = 0; i < numInputs; ++i)
+                values[i] = stage.inputBuffers[i][start + row];
+            for (int c = 0; c < stage.numConditioning; ++c)
+                values[numInputs + c] = stage.conditioning[c];
+        }
+    };
+
+    if (model.stacked) {
+        for (size_t i = 0; i < step.size(); ++i)
+            writeRows(stages[step[i]], input + i * (size_t)maxBlockSize * rowSize, 0, numSamples);
+        model.engine.run();
+        for (size_t i = 0; i < step.size(); ++i)
+            std::copy(output + i * (size_t)maxBlockSize, output + i * (size_t)maxBlockSize + numSamples, stages[step[i]].buffer);
+        return;
+    }
+    const int batchRows = (int)model.batchRows;
+    for (int s : step) {
+        const Stage& stage = stages[s];
+        for (int start = 0; start < numSamples; start += batchRows) {
+            const int numRows = std::min(batchRows, numSamples - start);
+            writeRows(stage, input, start, numRows);
+            std::fill(input + (size_t)numRows * rowSize, input + (size_t)batchRows * rowSize, 0.0f);
+            model.engine.run();
+            std::copy(output, output + numRows, stage.buffer + start);
+        }
+    }
+}
+
+void InferencePipeline::printPlan(std::ostream& stream) const {
+    stream << "Pipeline\t|\t" << stages.size() - inputStages.size() << " stages in " << tasks.size() << " tasks on " << levelEnds.size() << " levels | Workers: " << workers.size() << " | Arena: " << numBuffers << " buffers, "
+           << getArenaBytes() << " bytes" << std::endl;
+    for (size_t t = 0; t < tasks.size(); ++t) {
+        stream << "Pipeline\t|\tLevel " << tasks[t].level << ", task " << t << ":";
+        for (size_t i = 0; i < tasks[t].steps.size(); ++i) {
+            const std::vector<int>& step = tasks[t].steps[i];
+            stream << (i > 0 ? " ->" : "");
+            for (size_t j = 0; j < step.size(); ++j)
+                stream << (j > 0 ? " +" : "") << " " << stages[step[j]].name;
+            const Stage& first = stages[step[0]];
+            if (first.type == Model) {
+                const ModelBinding& model = models[first.model];
+                if (model.stacked)
+                    stream << " (" << (step.size() > 1 ? "batched, " : "") << "one invocation of " << model.batchRows << " rows)";
+                else
+                    stream << " (frames of " << model.batchRows << " rows)";
+            }
+        }
+        stream << std::endl;
+    }
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,395 @@
+/*
+==============================================================================*/
+#include "inferencesidecar.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <linux/futex.h>
+    #include <signal.h>
+    #include <spawn.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace InferenceEngine {
+
+namespace {
+
+const uint32_t sidecarMagic = 0x53494443;  // "SIDC"
+const uint32_t sidecarVersion = 2;
+
+/** Steady clock in nanoseconds (CLOCK_MONOTONIC, the clock of the relative futex timeouts) */
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(__linux__)
+// The futexes are shared between processes, so the private variants cannot be used
+void futexWait(std::atomic<uint32_t>& word, uint32_t expected, int64_t timeoutNs) {
+    timespec timeout;
+    timeout.tv_sec = (time_t)(timeoutNs / 1000000000);
+    timeout.tv_nsec = (long)(timeoutNs % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+std::string describeExit(int status) {
+    if (WIFSIGNALED(status))
+        return "was killed by signal " + std::to_string(WTERMSIG(status));
+    return "exited with status " + std::to_string(WEXITSTATUS(status));
+}
+#endif
+
+}  // namespace
+
+//==============================================================================
+SidecarChannel::SidecarChannel(const std::string& name, SidecarShared* shared, bool owner) : name(name), shared(shared), owner(owner) {}
+
+#if defined(__linux__)
+std::unique_ptr<SidecarChannel> SidecarChannel::create(const std::string& name) {
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Could not create the shared memory " + name + ": " + std::strerror(errno));
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(SidecarShared)) == 0)
+        memory = mmap(nullptr, sizeof(SidecarShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Could not map the shared memory " + name + ": " + std::strerror(errno));
+    }
+    // The region is zeroed by ftruncate and locked, so that the real-time thread never page faults on it
+    mlock(memory, sizeof(SidecarShared));
+    auto* shared = new (memory) SidecarShared();
+    shared->magic = sidecarMagic;
+    shared->version = sidecarVersion;
+    std::unique_ptr<SidecarChannel> channel(new SidecarChannel(name, shared, true));
+    channel->reset();
+    return channel;
+}
+
+std::unique_ptr<SidecarChannel> SidecarChannel::open(const std::string& name) {
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Could not open the shared memory " + name + ": " + std::strerror(errno));
+    struct stat info;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size == sizeof(SidecarShared))
+        memory = mmap(nullptr, sizeof(SidecarShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("Could not map the shared memory " + name + " (different build of the plugin?)");
+    auto* shared = static_cast<SidecarShared*>(memory);
+    if (shared->magic != sidecarMagic || shared->version != sidecarVersion) {
+        munmap(memory, sizeof(SidecarShared));
+        throw std::runtime_error("The shared memory " + name + " is not a sidecar channel of this version");
+    }
+    mlock(memory, sizeof(SidecarShared));
+    return std::unique_ptr<SidecarChannel>(new SidecarChannel(name, shared, false));
+}
+
+SidecarChannel::~SidecarChannel() {
+    munmap(shared, sizeof(SidecarShared));
+    if (owner)
+        shm_unlink(name.c_str());
+}
+
+bool SidecarChannel::wait(SidecarShared::Ring& ring, int64_t timeoutNs) {
+    const int64_t deadline = nowNs() + timeoutNs;
+    while (true) {
+        // The counter is read before the check, so a push between the check and the wait makes the wait return
+        const uint32_t wakeups = ring.wakeups.load(std::memory_order_acquire);
+        if (ring.head.load(std::memory_order_acquire) != ring.tail.load(std::memory_order_relaxed))
+            return true;
+        const int64_t remaining = deadline - nowNs();
+        if (remaining <= 0)
+            return false;
+        futexWait(ring.wakeups, wakeups, remaining);
+    }
+}
+#else
+std::unique_ptr<SidecarChannel> SidecarChannel::create(const std::string& name) {
+    throw std::runtime_error("The inference sidecar is only supported on Linux");
+}
+
+std::unique_ptr<SidecarChannel> SidecarChannel::open(const std::string& name) {
+    throw std::runtime_error("The inference sidecar is only supported on Linux");
+}
+
+SidecarChannel::~SidecarChannel() {}
+
+bool SidecarChannel::wait(SidecarShared::Ring& ring, int64_t timeoutNs) {
+    return false;
+}
+#endif
+
+void SidecarChannel::reset() {
+    for (auto* ring : {&shared->requests, &shared->responses}) {
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+    }
+    shared->modelFrameSize = 0;
+    shared->prePostConfig = PrePostConfig();
+    shared->heartbeat.store(0, std::memory_order_relaxed);
+    shared->state.store(SidecarShared::starting, std::memory_order_release);
+}
+
+bool SidecarChannel::push(SidecarShared::Ring& ring, uint32_t sequence, int command, int stream, float gain, const float* samples, int numSamples) {
+    const uint32_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= SidecarShared::Ring::capacity || numSamples > sidecarMaxBlockSize)
+        return false;
+    SidecarShared::Message& message = ring.messages[head % SidecarShared::Ring::capacity];
+    message.sequence = sequence;
+    message.command = command;
+    message.stream = stream;
+    message.numSamples = numSamples;
+    message.gain = gain;
+    if (numSamples > 0)
+        std::memcpy(message.samples, samples, numSamples * sizeof(float));
+    ring.head.store(head + 1, std::memory_order_release);
+    ring.wakeups.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+    futexWake(ring.wakeups);
+#endif
+    return true;
+}
+
+const SidecarShared::Message* SidecarChannel::front(SidecarShared::Ring& ring) {
+    const uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail == ring.head.load(std::memory_order_acquire))
+        return nullptr;
+    return &ring.messages[tail % SidecarShared::Ring::capacity];
+}
+
+void SidecarChannel::pop(SidecarShared::Ring& ring) {
+    ring.tail.store(ring.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//==============================================================================
+SidecarClient::SidecarClient(const SidecarConfig& config) : config(config) {
+    static std::atomic<int> instances{0};
+#if defined(__linux__)
+    const std::string name = "/inference_sidecar_" + std::to_string(getpid()) + "_" + std::to_string(instances++);
+#else
+    const std::string name;
+#endif
+    channel = SidecarChannel::create(name);
+    start();
+    std::cout << "Sidecar\t|\tStarted " << config.executable << " (pid " << pid << "), model frame size " << modelFrameSize << std::endl;
+    available.store(true, std::memory_order_release);
+    watchdog = std::thread(&SidecarClient::watch, this);
+}
+
+SidecarClient::~SidecarClient() {
+    {
+        std::lock_guard<std::mutex> lock(watchdogMutex);
+        stopping = true;
+    }
+    watchdogCondition.notify_all();
+    if (watchdog.joinable())
+        watchdog.join();
+    available.store(false);
+    stop();
+}
+
+int SidecarClient::process(int stream, float* samples, int numSamples, float gain) {
+    if (stream < 0 || stream >= sidecarMaxStreams)
+        return 0;
+    // The watchdog clears 'available' and then waits for 'inUse' to be false before touching the channel
+    inUse.store(true);
+    int processed = 0;
+    if (available.load()) {
+        const int64_t deadline = nowNs() + (int64_t)config.timeoutUs * 1000;
+        while (processed < numSamples) {
+            const int chunk = std::min(numSamples - processed, sidecarMaxBlockSize);
+            if (!request(SidecarShared::process, stream, gain, samples + processed, samples + processed, chunk, deadline))
+                break;
+            processed += chunk;
+        }
+        if (processed < numSamples)
+            missedDeadline();
+        else
+            missedInARow.store(0, std::memory_order_relaxed);
+    }
+    inUse.store(false, std::memory_order_release);
+    return processed;
+}
+
+bool SidecarClient::reset() {
+    inUse.store(true);
+    bool done = false;
+    if (available.load()) {
+        done = request(SidecarShared::reset, 0, 0.0f, nullptr, nullptr, 0, nowNs() + (int64_t)config.timeoutUs * 1000);
+        if (!done)
+            missedDeadline();
+    }
+    inUse.store(false, std::memory_order_release);
+    return done;
+}
+
+bool SidecarClient::request(int command, int stream, float gain, const float* input, float* output, int numSamples, int64_t deadlineNs) {
+    SidecarShared& shared = channel->getShared();
+    const uint32_t expected = ++sequence;
+    if (!SidecarChannel::push(shared.requests, expected, command, stream, gain, input, numSamples))
+        return false;
+    while (true) {
+        // Responses to requests that missed their deadline arrive first, and are discarded
+        if (const SidecarShared::Message* response = SidecarChannel::front(shared.responses)) {
+            const bool matches = response->sequence == expected;
+            if (matches && output != nullptr)
+                std::memcpy(output, response->samples, numSamples * sizeof(float));
+            SidecarChannel::pop(shared.responses);
+            if (matches)
+                return true;
+            continue;
+        }
+        const int64_t remaining = deadlineNs - nowNs();
+        if (remaining <= 0 || !SidecarChannel::wait(shared.responses, remaining))
+            return false;
+    }
+}
+
+void SidecarClient::missedDeadline() {
+    missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+    missedInARow.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+void SidecarClient::start() {
+    channel->reset();
+    std::vector<std::string> arguments = {config.executable, "sidecar", channel->getName(), "--parent", std::to_string(getpid())};
+    if (config.cpuMask != 0)
+        arguments.insert(arguments.end(), {"--cpus", std::to_string(config.cpuMask)});
+    if (config.priority > 0)
+        arguments.insert(arguments.end(), {"--priority", std::to_string(config.priority)});
+    if (config.memoryLimitMB > 0)
+        arguments.insert(arguments.end(), {"--memory-limit", std::to_string(config.memoryLimitMB)});
+    if (!config.modelPath.empty())
+        arguments.insert(arguments.end(), {"--model", config.modelPath});
+    std::vector<char*> argv;
+    for (auto& argument : arguments)
+        argv.push_back(&argument[0]);
+    argv.push_back(nullptr);
+
+    pid_t child;
+    const int error = posix_spawn(&child, config.executable.c_str(), nullptr, nullptr, argv.data(), environ);
+    if (error != 0)
+        throw std::runtime_error("Could not start the sidecar " + config.executable + ": " + std::strerror(error));
+    pid = child;
+
+    const SidecarShared& shared = channel->getShared();
+    const int64_t deadline = nowNs() + (int64_t)(config.startTimeoutSeconds * 1e9);
+    while (shared.state.load(std::memory_order_acquire) != SidecarShared::ready) {
+        std::string problem;
+        int status;
+        if (shared.state.load(std::memory_order_acquire) == SidecarShared::failed)
+            problem = "could not load the model";
+        else if (waitpid(pid, &status, WNOHANG) == pid) {
+            pid = -1;
+            problem = describeExit(status);
+        } else if (nowNs() > deadline)
+            problem = "did not load the model in time";
+        if (!problem.empty()) {
+            stop();
+            throw std::runtime_error("The sidecar " + problem);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // The processor is prepared for the frame size of the first sidecar
+    if (modelFrameSize != 0 && shared.modelFrameSize != modelFrameSize) {
+        stop();
+        throw std::runtime_error("The sidecar runs a model with a different frame size");
+    }
+    modelFrameSize = shared.modelFrameSize;
+    prePostConfig = shared.prePostConfig;
+    sequence = 0;
+}
+
+void SidecarClient::stop() {
+    if (pid > 0) {
+        int status;
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    pid = -1;
+}
+
+void SidecarClient::watch() {
+    const SidecarShared& shared = channel->getShared();
+    uint64_t lastHeartbeat = shared.heartbeat.load(std::memory_order_relaxed);
+    int64_t lastHeartbeatTime = nowNs(), retryTime = 0;
+    int failedRestarts = 0;
+    std::unique_lock<std::mutex> lock(watchdogMutex);
+    while (!watchdogCondition.wait_for(lock, std::chrono::milliseconds(20), [this]() { return stopping; })) {
+        if (available.load()) {
+            std::string problem;
+            int status;
+            const uint64_t heartbeat = shared.heartbeat.load(std::memory_order_relaxed);
+            if (heartbeat != lastHeartbeat) {
+                lastHeartbeat = heartbeat;
+                lastHeartbeatTime = nowNs();
+            }
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                pid = -1;
+                problem = describeExit(status);
+            } else if (nowNs() - lastHeartbeatTime > 10 * SidecarShared::heartbeatPeriodMs * 1000000LL)
+                problem = "stopped sending heartbeats";
+            else if (missedInARow.load(std::memory_order_relaxed) >= config.maxMissedDeadlines)
+                problem = "missed " + std::to_string(config.maxMissedDeadlines) + " deadlines in a row";
+            if (problem.empty())
+                continue;
+            std::cerr << "Sidecar\t|\tThe sidecar " << problem << ", restarting it" << std::endl;
+            // From here the real-time thread falls back without touching the channel
+            available.store(false);
+            while (inUse.load())
+                std::this_thread::yield();
+            stop();
+        } else if (nowNs() < retryTime) {
+            continue;
+        }
+
+        // The destructor can stop the watchdog while the new sidecar loads
+        lock.unlock();
+        try {
+            start();
+            lastHeartbeat = shared.heartbeat.load(std::memory_order_relaxed);
+            lastHeartbeatTime = nowNs();
+            failedRestarts = 0;
+            missedInARow.store(0, std::memory_order_relaxed);
+            restarts.fetch_add(1, std::memory_order_relaxed);
+            available.store(true, std::memory_order_release);
+            std::cout << "Sidecar\t|\tRestarted (pid " << pid << ")" << std::endl;
+        } catch (const std::exception& e) {
+            // Back off up to 5 s between attempts, e.g. when the model crashes the sidecar while loading
+            retryTime = nowNs() + std::min<int64_t>(5000, 100LL << std::min(failedRestarts++, 6)) * 1000000LL;
+            std::cerr << "Sidecar\t|\tRestart failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+#else
+void SidecarClient::start() {}
+
+void SidecarClient::stop() {}
+
+void SidecarClient::watch() {}
+#endif
+
+}  // namespace InferenceEngine
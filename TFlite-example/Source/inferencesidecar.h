@@ -0,0 +1,177 @@
+/*
+ * Out-of-process inference sidecar
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Runs the saturation model in a separate process ('InferenceTools sidecar', built for the same engine as the plugin),
+ * so that a crash of the engine (TFLITE_MINIMAL_CHECK calls exit) or a runaway allocation does not take down the
+ * host, and the model runs on cores and under a memory limit of its own.
+ *
+ * The two processes share a POSIX shared memory region with two single-producer single-consumer rings, one for the
+ * requests and one for the responses. Each message carries a block of samples of one stream (a channel of the
+ * plugin) and the gain, the sidecar runs them through a frame adapter per stream, so the latency is the same as
+ * in-process. The waiting side sleeps on a futex word of the ring, a block costs two wakeups.
+ *
+ * The plugin side (SidecarClient) waits for each block at most a fixed timeout: when the deadline is missed, process()
+ * returns early and the caller outputs its fallback for the rest of the block. Responses that arrive late are
+ * discarded. A watchdog thread restarts the sidecar when it exits, stops sending heartbeats or misses too many
+ * deadlines in a row, and the client is unavailable (every block falls back) until the new one is ready.
+ *
+ * Linux only, the constructor throws elsewhere.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "prepostchain.h"
+
+namespace InferenceEngine {
+
+/** Largest block carried by a message, longer blocks are split */
+constexpr int sidecarMaxBlockSize = 2048;
+/** Streams with their own frame adapter in the sidecar */
+constexpr int sidecarMaxStreams = 8;
+
+/** Layout of the shared memory region (only plain data and lock-free atomics, which are address-free) */
+struct SidecarShared {
+    enum State : uint32_t { starting = 0, ready = 1, failed = 2 };
+    enum Command : int32_t { process = 0, reset = 1 };
+
+    struct Message {
+        uint32_t sequence;
+        int32_t command;
+        int32_t stream;
+        int32_t numSamples;
+        float gain;
+        float samples[sidecarMaxBlockSize];
+    };
+
+    struct Ring {
+        static constexpr uint32_t capacity = 4;
+        std::atomic<uint32_t> head;     // Written by the producer
+        std::atomic<uint32_t> tail;     // Written by the consumer
+        std::atomic<uint32_t> wakeups;  // Futex word, incremented at every push
+        Message messages[capacity];
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> state;
+    int32_t modelFrameSize;           // Written by the sidecar before the state becomes ready
+    PrePostConfig prePostConfig;      // Read from the metadata of the model, written with modelFrameSize
+    std::atomic<uint64_t> heartbeat;  // Incremented by the sidecar at least every heartbeatPeriodMs
+    Ring requests, responses;
+
+    static constexpr int heartbeatPeriodMs = 100;
+};
+
+/** Shared memory region of a sidecar, mapped by both processes */
+class SidecarChannel {
+public:
+    /** Create and initialize the region (plugin side), it is unlinked when the channel is destroyed */
+    static std::unique_ptr<SidecarChannel> create(const std::string& name);
+    /** Map a region created by the plugin (sidecar side) */
+    static std::unique_ptr<SidecarChannel> open(const std::string& name);
+    ~SidecarChannel();
+
+    SidecarShared& getShared() { return *shared; }
+    const std::string& getName() const { return name; }
+
+    /** Empty both rings and set the state to starting, with no sidecar attached */
+    void reset();
+
+    /**
+     * @brief Copy a message to the ring and wake up the consumer (real-time safe)
+     *
+     * @return bool False if the ring is full
+     */
+    static bool push(SidecarShared::Ring& ring, uint32_t sequence, int command, int stream, float gain, const float* samples, int numSamples);
+    /** Oldest message of the ring, nullptr if it is empty (real-time safe) */
+    static const SidecarShared::Message* front(SidecarShared::Ring& ring);
+    /** Release the message returned by front() */
+    static void pop(SidecarShared::Ring& ring);
+    /**
+     * @brief Wait until the ring has a message (real-time safe, as it only blocks in the futex)
+     *
+     * @return bool False if the timeout expires first
+     */
+    static bool wait(SidecarShared::Ring& ring, int64_t timeoutNs);
+
+private:
+    SidecarChannel(const std::string& name, SidecarShared* shared, bool owner);
+
+    std::string name;
+    SidecarShared* shared;
+    bool owner;
+};
+
+struct SidecarConfig {
+    std::string executable;          // InferenceTools built for the engine of the plugin
+    std::string modelPath;           // Empty for the model embedded in the executable
+    uint64_t cpuMask = 0;            // CPUs of the sidecar (0 to inherit)
+    int priority = 0;                // SCHED_FIFO priority of the sidecar (0 for the normal scheduler)
+    int memoryLimitMB = 0;           // Address space limit of the sidecar (0 for none)
+    int timeoutUs = 1000;            // Longest wait for the output of a block
+    int maxMissedDeadlines = 8;      // Deadlines missed in a row before the sidecar is restarted
+    double startTimeoutSeconds = 30.0;
+};
+
+class SidecarClient {
+public:
+    /** Start the sidecar and wait until its model is loaded (do not use in real time threads!), throws on failure */
+    explicit SidecarClient(const SidecarConfig& config);
+    ~SidecarClient();
+
+    /** Samples per invocation of the model, the sidecar output is delayed by getModelFrameSize() - 1 samples */
+    int getModelFrameSize() const { return modelFrameSize; }
+    /** Pre/post-processing of the model, applied by the plugin around process() (see prepostchain.h) */
+    const PrePostConfig& getPrePostConfig() const { return prePostConfig; }
+
+    /**
+     * @brief Run a block of a stream through the model in the sidecar, in place (real-time safe)
+     *
+     * @return int Samples processed, less than numSamples if the deadline was missed or the sidecar is unavailable
+     */
+    int process(int stream, float* samples, int numSamples, float gain);
+
+    /** Clear the model state of every stream (real-time safe), false if the sidecar did not confirm in time */
+    bool reset();
+
+    bool isAvailable() const { return available.load(std::memory_order_acquire); }
+    uint64_t getMissedDeadlines() const { return missedDeadlines.load(std::memory_order_relaxed); }
+    int getRestarts() const { return restarts.load(std::memory_order_relaxed); }
+
+private:
+    /** Send a request and wait for its response until the deadline (steady clock, ns), copying its samples to output */
+    bool request(int command, int stream, float gain, const float* input, float* output, int numSamples, int64_t deadlineNs);
+    void missedDeadline();
+    void start();
+    void stop();
+    void watch();
+
+    SidecarConfig config;
+    std::unique_ptr<SidecarChannel> channel;
+    int modelFrameSize = 0;
+    PrePostConfig prePostConfig;
+    int pid = -1;
+
+    // Real-time thread
+    uint32_t sequence = 0;
+    std::atomic<bool> inUse{false};
+    std::atomic<int> missedInARow{0};
+    std::atomic<uint64_t> missedDeadlines{0};
+
+    std::atomic<bool> available{false};
+    std::atomic<int> restarts{0};
+    std::thread watchdog;
+    std::mutex watchdogMutex;
+    std::condition_variable watchdogCondition;
+    bool stopping = false;
+};
+
+}  // namespace InferenceEngine
@@ -0,0 +1,77 @@
+/*
+==============================================================================*/
+#include "memoryusage.h"
+
+#include <cstdio>
+
+#if defined(__linux__) || defined(__APPLE__)
+    #include <sys/resource.h>
+    #include <unistd.h>
+    #define MEMORY_USAGE_POSIX 1
+#else
+    #define MEMORY_USAGE_POSIX 0
+#endif
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#elif defined(__APPLE__)
+    #include <malloc/malloc.h>
+#endif
+
+namespace InferenceEngine {
+
+ModelMemoryUsage& ModelMemoryUsage::operator+=(const ModelMemoryUsage& other) {
+    modelBytes += other.modelBytes;
+    activationBytes += other.activationBytes;
+    persistentBytes += other.persistentBytes;
+    ioBytes += other.ioBytes;
+    runtimeBytes += other.runtimeBytes;
+    return *this;
+}
+
+size_t getAllocatedHeapBytes() {
+#if defined(__GLIBC__)
+    // Chunks in use in every malloc arena, plus the large allocations that are mapped on their own
+    #if __GLIBC_PREREQ(2, 33)
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+    #else
+    const struct mallinfo info = mallinfo();  // Counters are int, they wrap above 2 GB
+    return (size_t)(unsigned int)info.uordblks + (size_t)(unsigned int)info.hblkhd;
+    #endif
+#elif defined(__APPLE__)
+    malloc_statistics_t stats;
+    malloc_zone_statistics(nullptr, &stats);
+    return stats.size_in_use;
+#else
+    return 0;
+#endif
+}
+
+ProcessMemoryStats getProcessMemoryStats() {
+    ProcessMemoryStats stats;
+    stats.heapBytes = getAllocatedHeapBytes();
+#if MEMORY_USAGE_POSIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats.minorFaults = usage.ru_minflt;
+        stats.majorFaults = usage.ru_majflt;
+    #if defined(__APPLE__)
+        stats.peakResidentBytes = (size_t)usage.ru_maxrss;  // Bytes on macOS
+    #else
+        stats.peakResidentBytes = (size_t)usage.ru_maxrss * 1024;  // Kilobytes on Linux
+    #endif
+    }
+#endif
+#if defined(__linux__)
+    // Second field of statm, in pages
+    if (FILE* statm = std::fopen("/proc/self/statm", "r")) {
+        unsigned long sizePages = 0, residentPages = 0;
+        if (std::fscanf(statm, "%lu %lu", &sizePages, &residentPages) == 2)
+            stats.residentBytes = (size_t)residentPages * (size_t)sysconf(_SC_PAGESIZE);
+        std::fclose(statm);
+    }
+#endif
+    return stats;
+}
+
+}  // namespace InferenceEngine
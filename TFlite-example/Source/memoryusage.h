@@ -0,0 +1,51 @@
+/*
+ * Memory accounting of the model instances
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * How many instances of the plugin fit on a board depends on what each one keeps resident. ModelMemoryUsage splits
+ * the memory of an interpreter (see getModelMemoryUsage in the wrappers) and of a whole processor into:
+ *   - the model: the serialized graph and weights, as kept by the engine
+ *   - the activations: intermediate tensors (this instance's share, if they live in a shared arena)
+ *   - the persistent state: variable tensors and buffers that the kernels keep between invocations
+ *   - the I/O staging: input and output tensors, and the buffers of the processor around them
+ *   - the runtime overhead: everything else the engine allocated while it was created (graph, kernels, allocators)
+ *
+ * The runtime overhead is measured as the growth of the allocated heap during the creation of the interpreter, minus
+ * the accounted parts that come from the heap. It is exact only if no other thread allocates at the same time (e.g.
+ * the models of other instances being loaded asynchronously), so treat it as an estimate.
+ *
+ * ProcessMemoryStats samples the process (resident set, heap and page faults), e.g. to measure the cost of each
+ * additional instance (see the footprint command of InferenceTools).
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace InferenceEngine {
+
+struct ModelMemoryUsage {
+    size_t modelBytes = 0;       // Serialized graph and weights
+    size_t activationBytes = 0;  // Intermediate tensors
+    size_t persistentBytes = 0;  // State kept between invocations
+    size_t ioBytes = 0;          // Input and output tensors and staging buffers
+    size_t runtimeBytes = 0;     // Engine overhead, estimated
+
+    size_t getTotalBytes() const { return modelBytes + activationBytes + persistentBytes + ioBytes + runtimeBytes; }
+    ModelMemoryUsage& operator+=(const ModelMemoryUsage& other);
+};
+
+struct ProcessMemoryStats {
+    size_t residentBytes = 0;      // Resident set size (0 where it cannot be read)
+    size_t peakResidentBytes = 0;  // Maximum resident set size so far
+    size_t heapBytes = 0;          // See getAllocatedHeapBytes()
+    long minorFaults = 0;          // Page faults served without I/O (e.g. first touch of a page)
+    long majorFaults = 0;          // Page faults that required I/O
+};
+
+/** Sample the memory statistics of the process (do not use in real time threads!) */
+ProcessMemoryStats getProcessMemoryStats();
+
+/** Bytes currently allocated from the heap by the whole process (0 if the allocator cannot report them) */
+size_t getAllocatedHeapBytes();
+
+}  // namespace InferenceEngine
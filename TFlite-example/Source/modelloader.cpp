@@ -0,0 +1,114 @@
+/*
+==============================================================================*/
+#include "modelloader.h"
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace InferenceEngine {
+
+namespace {
+
+/** Process-wide pool that runs the load jobs of every instance, one worker per core */
+class LoadingPool {
+public:
+    static LoadingPool& getInstance() {
+        static LoadingPool pool;
+        return pool;
+    }
+
+    ~LoadingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        available.notify_one();
+    }
+
+    int getNumWorkers() const { return (int)workers.size(); }
+
+private:
+    LoadingPool() {
+        const int numWorkers = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int i = 0; i < numWorkers; ++i)
+            workers.emplace_back([this]() { work(); });
+    }
+
+    void work() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+};
+
+}  // namespace
+
+ModelLoader::~ModelLoader() {
+    wait();
+}
+
+void ModelLoader::start(std::function<void()> job, bool asynchronous) {
+    wait();
+    error.clear();
+    done.store(false, std::memory_order_release);
+    if (asynchronous)
+        LoadingPool::getInstance().submit([this, job]() { run(job); });
+    else
+        run(job);
+}
+
+void ModelLoader::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return done.load(std::memory_order_acquire); });
+}
+
+int ModelLoader::getNumWorkers() {
+    return LoadingPool::getInstance().getNumWorkers();
+}
+
+void ModelLoader::run(const std::function<void()>& job) {
+    std::string message;
+    try {
+        job();
+    } catch (const std::exception& e) {
+        message = e.what();
+        if (message.empty())
+            message = "unknown error";
+        std::cerr << "Model loader\t|\tLoading failed: " << message << std::endl;
+    }
+    // Notify while holding the lock, the waiter may destroy this object as soon as it can take it
+    std::lock_guard<std::mutex> lock(mutex);
+    error = message;
+    done.store(true, std::memory_order_release);
+    finished.notify_all();
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,65 @@
+/*
+ * Background loading of the models
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Loading, optimizing and priming a model takes from tens of milliseconds to seconds. Done in the constructor of the
+ * processor, it blocks the host, which creates the instances of a rig one after the other, so the boot time grows
+ * linearly with the number of instances.
+ * Instead each processor hands its load job to a ModelLoader, which runs it on a process-wide pool with one worker
+ * per core: the constructor returns immediately and the models of all the instances are loaded in parallel.
+ * The processor outputs a fallback signal until its models are loaded and prepared.
+ *
+ * The job runs on a pool thread, so it must synchronize with the processor (prepareToPlay in particular) on its
+ * own. Exceptions thrown by the job are logged and reported by hasFailed().
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace InferenceEngine {
+
+class ModelLoader {
+public:
+    ModelLoader() = default;
+    /** Waits for the job, so that it never outlives the objects it uses */
+    ~ModelLoader();
+
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    /**
+     * @brief Run a load job (do not use in real time threads!)
+     *
+     * @param job           Loads and prepares the models
+     * @param asynchronous  If true the job runs on the pool and start() returns immediately, otherwise it runs on the
+     *                      calling thread (e.g. for offline tools, which need the models right after construction)
+     */
+    void start(std::function<void()> job, bool asynchronous = true);
+
+    /** Block until the job has finished, successfully or not (do not use in real time threads!) */
+    void wait();
+
+    /** True once the job has finished, successfully or not (real-time safe) */
+    bool isDone() const { return done.load(std::memory_order_acquire); }
+
+    /** True if the job threw an exception, whose message is returned by getError() */
+    bool hasFailed() const { return isDone() && !error.empty(); }
+    const std::string& getError() const { return error; }
+
+    /** Number of jobs that the pool runs in parallel */
+    static int getNumWorkers();
+
+private:
+    void run(const std::function<void()>& job);
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::atomic<bool> done{true};
+    std::string error;
+};
+
+}  // namespace InferenceEngine
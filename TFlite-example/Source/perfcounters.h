@@ -0,0 +1,112 @@
+/*
+ * Hardware performance counters around inference
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Counts cycles, instructions, L1 data and L2 cache misses and branch mispredictions of the calling thread
+ * (perf_event_open) around regions of code, to tell whether a model is compute, cache or branch bound on the target
+ * CPU. The wrappers measure every invocation (one region per engine, batch size and threads) and the processors
+ * measure processBlock (one region per block size and processing mode).
+ *
+ * The counters of a thread are opened as a group the first time the thread enters a region, then each region costs
+ * two read() system calls. Totals are accumulated in lock-free atomics per region, so the debug API
+ * (getPerfCounterStats, printPerfCounterReport) can read them from any thread while the audio thread runs.
+ * Regions nest, the outer one includes the cost of reading the inner one.
+ *
+ * Compiled in only with INFERENCE_PERF_COUNTERS=1. Linux only, and only in user space (exclude_kernel), so that it works
+ * with the default perf_event_paranoid level.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef INFERENCE_PERF_COUNTERS
+    #define INFERENCE_PERF_COUNTERS 0
+#endif
+
+namespace InferenceEngine {
+
+enum PerfCounter { perfCycles = 0, perfInstructions, perfL1dMisses, perfL2Misses, perfBranchMisses, numPerfCounters };
+
+/** Totals of a region, as returned by getPerfCounterStats() */
+struct PerfRegionStats {
+    std::string name;
+    uint64_t calls = 0;
+    std::array<uint64_t, numPerfCounters> totals{};
+};
+
+/** Lock-free totals of a named region */
+class PerfRegion {
+public:
+    explicit PerfRegion(const std::string& name) : name(name) {}
+
+    const std::string& getName() const { return name; }
+
+    /** Add the counter deltas of one call (real-time safe) */
+    void add(const uint64_t* start, const uint64_t* end);
+
+    PerfRegionStats getStats() const;
+    void reset();
+
+private:
+    const std::string name;
+    std::atomic<uint64_t> calls{0};
+    std::array<std::atomic<uint64_t>, numPerfCounters> totals{};
+};
+
+/**
+ * @brief Find or create a region (do not use in real time threads!)
+ *
+ * @return PerfRegion* Valid for the lifetime of the process
+ */
+PerfRegion* getPerfRegion(const std::string& name);
+
+/** Enable or disable the measurements of every region (enabled by default) */
+void setPerfCountersEnabled(bool enabled);
+bool arePerfCountersEnabled();
+
+/** Names of the counters, and whether this machine and kernel count them (opens the counters of the calling thread) */
+const char* getPerfCounterName(int counter);
+bool isPerfCounterSupported(int counter);
+
+/** Totals of every region that was entered at least once */
+std::vector<PerfRegionStats> getPerfCounterStats();
+void resetPerfCounters();
+/** Per call averages, IPC and misses per thousand instructions of every region */
+void printPerfCounterReport(std::ostream& stream);
+
+/**
+ * @brief Read the counters of the calling thread (real-time safe once the thread has opened its counters)
+ *
+ * @return bool False if the counters cannot be opened on this thread
+ */
+bool readPerfCounters(uint64_t* values);
+
+/** Measure the enclosing scope (nothing is measured with a null region, or when the counters are disabled) */
+class PerfScope {
+public:
+    explicit PerfScope(PerfRegion* region) : region(region) {
+        if (region != nullptr && arePerfCountersEnabled())
+            active = readPerfCounters(start);
+    }
+
+    ~PerfScope() {
+        uint64_t end[numPerfCounters];
+        if (active && readPerfCounters(end))
+            region->add(start, end);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    PerfRegion* region;
+    bool active = false;
+    uint64_t start[numPerfCounters];
+};
+
+}  // namespace InferenceEngine
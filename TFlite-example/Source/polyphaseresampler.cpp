@@ -0,0 +1,98 @@
+/*
+==============================================================================*/
+#include "polyphaseresampler.h"
+
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace InferenceEngine {
+
+namespace {
+
+/** Zeroth order modified Bessel function of the first kind (for the Kaiser window) */
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum)
+            break;
+    }
+    return sum;
+}
+
+constexpr double kaiserBeta = 8.0;  // About 80 dB of stopband attenuation
+constexpr double pi = 3.14159265358979323846;
+
+}  // namespace
+
+void PolyphaseResampler::prepare(int inputRate, int outputRate, int tapsPerPhase) {
+    if (inputRate <= 0 || outputRate <= 0 || tapsPerPhase <= 0)
+        throw std::logic_error("Error, invalid resampler configuration (" + std::to_string(inputRate) + " Hz -> " + std::to_string(outputRate) + " Hz, " + std::to_string(tapsPerPhase) + " taps per phase)");
+    const int divisor = std::gcd(inputRate, outputRate);
+    upFactor = outputRate / divisor;
+    downFactor = inputRate / divisor;
+    this->tapsPerPhase = tapsPerPhase;
+
+    // Prototype low-pass at the upsampled rate, cutting at 90% of the lower Nyquist frequency
+    const int length = upFactor * tapsPerPhase;
+    const double cutoff = 0.9 * 0.5 * std::min(inputRate, outputRate) / ((double)inputRate * upFactor);  // Cycles per upsampled sample
+    const double center = (length - 1) / 2.0;
+    std::vector<double> prototype(length);
+    for (int n = 0; n < length; ++n) {
+        const double t = n - center;
+        const double sinc = (t == 0.0) ? 1.0 : std::sin(2.0 * pi * cutoff * t) / (2.0 * pi * cutoff * t);
+        const double ratio = 2.0 * n / (length - 1) - 1.0;
+        const double window = (length > 1) ? besselI0(kaiserBeta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / besselI0(kaiserBeta) : 1.0;
+        // Gain upFactor compensates for the zeros inserted by upsampling
+        prototype[n] = 2.0 * cutoff * sinc * window * upFactor;
+    }
+
+    // Branch p holds h[p + k * L] for k = 0..taps-1, stored in reverse so that it lines up with the history (oldest first)
+    branches.assign((size_t)upFactor * tapsPerPhase, 0.0f);
+    for (int p = 0; p < upFactor; ++p)
+        for (int k = 0; k < tapsPerPhase; ++k)
+            branches[(size_t)p * tapsPerPhase + (tapsPerPhase - 1 - k)] = (float)prototype[p + k * upFactor];
+
+    history.assign(2 * tapsPerPhase, 0.0f);
+    reset();
+}
+
+void PolyphaseResampler::reset() {
+    std::fill(history.begin(), history.end(), 0.0f);
+    historyIndex = 0;
+    phase = 0;
+}
+
+int PolyphaseResampler::process(const float* input, int numInput, float* output) {
+    int numOutput = 0;
+    for (int i = 0; i < numInput; ++i) {
+        // Every sample is written twice, so that the last tapsPerPhase samples start at historyIndex + 1
+        history[historyIndex] = input[i];
+        history[historyIndex + tapsPerPhase] = input[i];
+        historyIndex = (historyIndex + 1) % tapsPerPhase;
+        const float* __restrict recent = history.data() + historyIndex;
+
+        while (phase < upFactor) {
+            const float* __restrict branch = branches.data() + (size_t)phase * tapsPerPhase;
+            // Independent accumulators, so that the compiler can vectorize the dot product
+            float acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+            int k = 0;
+            for (; k + 4 <= tapsPerPhase; k += 4) {
+                acc0 += branch[k] * recent[k];
+                acc1 += branch[k + 1] * recent[k + 1];
+                acc2 += branch[k + 2] * recent[k + 2];
+                acc3 += branch[k + 3] * recent[k + 3];
+            }
+            for (; k < tapsPerPhase; ++k)
+                acc0 += branch[k] * recent[k];
+            output[numOutput++] = (acc0 + acc1) + (acc2 + acc3);
+            phase += downFactor;
+        }
+        phase -= upFactor;
+    }
+    return numOutput;
+}
+
+}  // namespace InferenceEngine
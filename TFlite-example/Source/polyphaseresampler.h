@@ -0,0 +1,141 @@
+/*
+ * Polyphase resampling around the inference stage
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Models are trained at a given sample rate, while the host can run at 48k, 96k or more. Running the model at the
+ * host rate costs proportionally more invocations and feeds the model a signal it was not trained on.
+ * ResamplingStage converts each host block to the model rate, runs the model on the converted samples and converts
+ * the result back, so that the model always sees its native rate.
+ *
+ * PolyphaseResampler implements a rational L/M converter with a Kaiser-windowed sinc prototype split in L branches
+ * of tapsPerPhase coefficients: each output sample is a single contiguous dot product between one branch and the
+ * input history (stored twice, so that the last tapsPerPhase samples are always contiguous).
+ *
+ * Since the number of model-rate samples changes from block to block (e.g. 44.1k -> 48k), the output goes through a
+ * FIFO pre-filled with a few samples of slack. The total latency is constant and reported in host samples.
+ * Every buffer is allocated in prepare(), so process() can be called from the real-time thread.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace InferenceEngine {
+
+class PolyphaseResampler {
+public:
+    /**
+     * @brief Design the filter and allocate the state (do not use in real time threads!)
+     *
+     * @param inputRate     Input sample rate (integer number of Hz)
+     * @param outputRate    Output sample rate (integer number of Hz)
+     * @param tapsPerPhase  Length of each polyphase branch
+     */
+    void prepare(int inputRate, int outputRate, int tapsPerPhase = 32);
+
+    /** Clear the input history */
+    void reset();
+
+    /**
+     * @brief Resample a block
+     *
+     * @param input      Input samples
+     * @param numInput   Number of input samples
+     * @param output     Output buffer, at least getMaxOutputSize(numInput) samples long
+     * @return int       Number of output samples
+     */
+    int process(const float* input, int numInput, float* output);
+
+    /** Maximum number of output samples for numInput input samples */
+    int getMaxOutputSize(int numInput) const { return (int)(((long long)numInput * upFactor) / downFactor) + 1; }
+
+    /** Group delay of the filter, in input samples */
+    double getDelayInInputSamples() const { return (double)(upFactor * tapsPerPhase - 1) / (2.0 * upFactor); }
+
+private:
+    int upFactor = 1, downFactor = 1;  // L and M
+    int tapsPerPhase = 0;
+    std::vector<float> branches;  // upFactor branches of tapsPerPhase coefficients, oldest sample first
+    std::vector<float> history;   // Mirrored input history (2 * tapsPerPhase)
+    int historyIndex = 0;
+    int phase = 0;  // Position of the next output sample, in upsampled samples after the newest input sample
+};
+
+class ResamplingStage {
+public:
+    /**
+     * @brief Prepare the converters and buffers (do not use in real time threads!)
+     *
+     * @param hostRate      Sample rate of the host
+     * @param modelRate     Native sample rate of the model
+     * @param maxBlockSize  Maximum number of host samples per block
+     */
+    void prepare(double hostRate, double modelRate, int maxBlockSize) {
+        this->hostRate = hostRate;
+        this->modelRate = modelRate;
+        this->maxBlockSize = maxBlockSize;
+        toModel.prepare((int)std::lround(hostRate), (int)std::lround(modelRate));
+        toHost.prepare((int)std::lround(modelRate), (int)std::lround(hostRate));
+        modelBuffer.resize(toModel.getMaxOutputSize(maxBlockSize));
+        hostBuffer.resize(toHost.getMaxOutputSize((int)modelBuffer.size()));
+        // The slack covers the variation of the number of samples produced by the two converters in a block
+        slack = 2 + (int)std::ceil(hostRate / modelRate);
+        outputFifo.resize(maxBlockSize + toHost.getMaxOutputSize((int)modelBuffer.size()) + slack);
+        reset();
+    }
+
+    /** Clear the state of the converters and the output FIFO */
+    void reset() {
+        toModel.reset();
+        toHost.reset();
+        std::fill(outputFifo.begin(), outputFifo.end(), 0.0f);
+        fifoReadIndex = 0;
+        fifoWriteIndex = slack;
+    }
+
+    /** Maximum number of model-rate samples passed to the model callback */
+    int getMaxModelBlockSize() const { return (int)modelBuffer.size(); }
+
+    /** Latency of the stage, in host samples (the latency of the model has to be added, converted to host samples) */
+    int getLatencySamples() const {
+        return slack + (int)std::lround(toModel.getDelayInInputSamples() + toHost.getDelayInInputSamples() * hostRate / modelRate);
+    }
+
+    /**
+     * @brief Process a host block in place
+     *
+     * @param data       Host samples
+     * @param numSamples Number of host samples (at most maxBlockSize)
+     * @param runModel   Called as runModel(float* modelSamples, int numModelSamples) to process in place at the model rate
+     */
+    template <typename ModelCallback>
+    void process(float* data, int numSamples, ModelCallback&& runModel) {
+        const int numModelSamples = toModel.process(data, numSamples, modelBuffer.data());
+        if (numModelSamples > 0)
+            runModel(modelBuffer.data(), numModelSamples);
+
+        // Back to the host rate, then through the FIFO
+        const int fifoSize = (int)outputFifo.size();
+        const int numConverted = toHost.process(modelBuffer.data(), numModelSamples, hostBuffer.data());
+        for (int i = 0; i < numConverted; ++i) {
+            outputFifo[fifoWriteIndex] = hostBuffer[i];
+            fifoWriteIndex = (fifoWriteIndex + 1) % fifoSize;
+        }
+        for (int i = 0; i < numSamples; ++i) {
+            data[i] = outputFifo[fifoReadIndex];
+            fifoReadIndex = (fifoReadIndex + 1) % fifoSize;
+        }
+    }
+
+private:
+    double hostRate = 48000.0, modelRate = 48000.0;
+    int maxBlockSize = 0;
+    PolyphaseResampler toModel, toHost;
+    std::vector<float> modelBuffer, hostBuffer;
+    std::vector<float> outputFifo;
+    int fifoReadIndex = 0, fifoWriteIndex = 0;
+    int slack = 0;
+};
+
+}  // namespace InferenceEngine
@@ -0,0 +1,111 @@
+/*
+==============================================================================*/
+#include "prepostchain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace InferenceEngine {
+
+namespace {
+
+const double twoPi = 6.283185307179586;
+
+/** Rows of the input tensor without the recursive stage, the number of conditioning values is fixed to vectorize */
+template <int NUM_CONDITIONING>
+void writeAffineRows(const float* samples, float* tensor, int numSamples, float scale, float offset, const float* conditioning) {
+    // Local copy, the compiler cannot tell that the tensor does not alias the conditioning values
+    float values[NUM_CONDITIONING + 1];
+    for (int c = 0; c < NUM_CONDITIONING; ++c)
+        values[c] = conditioning[c];
+    for (int i = 0; i < numSamples; ++i) {
+        tensor[i * (1 + NUM_CONDITIONING)] = scale * samples[i] + offset;
+        for (int c = 0; c < NUM_CONDITIONING; ++c)
+            tensor[i * (1 + NUM_CONDITIONING) + 1 + c] = values[c];
+    }
+}
+
+void readMetadataValue(const std::map<std::string, std::string>& metadata, const std::string& key, float& value) {
+    const auto entry = metadata.find(key);
+    if (entry == metadata.end())
+        return;
+    char* end = nullptr;
+    const float parsed = std::strtof(entry->second.c_str(), &end);
+    if (end != entry->second.c_str() && std::isfinite(parsed))
+        value = parsed;
+}
+
+}  // namespace
+
+PrePostConfig PrePostConfig::fromMetadata(const std::map<std::string, std::string>& metadata) {
+    PrePostConfig config;
+    readMetadataValue(metadata, "pre.gain", config.inputGain);
+    readMetadataValue(metadata, "pre.dc_block_hz", config.dcBlockHz);
+    readMetadataValue(metadata, "pre.mean", config.inputMean);
+    readMetadataValue(metadata, "pre.std", config.inputStd);
+    readMetadataValue(metadata, "post.scale", config.outputScale);
+    readMetadataValue(metadata, "post.offset", config.outputOffset);
+    readMetadataValue(metadata, "post.clip", config.outputClip);
+    if (config.inputStd == 0.0f)
+        config.inputStd = 1.0f;
+    return config;
+}
+
+bool PrePostConfig::isIdentity() const {
+    return inputGain == 1.0f && dcBlockHz <= 0.0f && inputMean == 0.0f && inputStd == 1.0f && outputScale == 1.0f && outputOffset == 0.0f && outputClip <= 0.0f;
+}
+
+void PrePostChain::prepare(const PrePostConfig& config, double sampleRate, int numChannels) {
+    this->config = config;
+    const float inputStd = (config.inputStd != 0.0f) ? config.inputStd : 1.0f;
+    // The DC blocker is linear, so the gain can be applied after it, together with the normalization
+    inputScale = config.inputGain / inputStd;
+    inputOffset = -config.inputMean / inputStd;
+    dcCoefficient = (config.dcBlockHz > 0.0f && sampleRate > 0.0) ? (float)std::exp(-twoPi * config.dcBlockHz / sampleRate) : 0.0f;
+    dcBlockers.assign((size_t)std::max(0, numChannels), DcBlockerState());
+}
+
+void PrePostChain::reset() {
+    std::fill(dcBlockers.begin(), dcBlockers.end(), DcBlockerState());
+}
+
+void PrePostChain::writeInput(int channel, const float* samples, float* tensor, int numSamples, const float* conditioning, int numConditioning) {
+    const int stride = 1 + numConditioning;
+    if (dcCoefficient != 0.0f && channel >= 0 && channel < (int)dcBlockers.size()) {
+        DcBlockerState& state = dcBlockers[channel];
+        for (int i = 0; i < numSamples; ++i) {
+            const float input = samples[i];
+            state.lastOutput = input - state.lastInput + dcCoefficient * state.lastOutput;
+            state.lastInput = input;
+            tensor[i * stride] = inputScale * state.lastOutput + inputOffset;
+            for (int c = 0; c < numConditioning; ++c)
+                tensor[i * stride + 1 + c] = conditioning[c];
+        }
+        return;
+    }
+    if (numConditioning == 0) {
+        writeAffineRows<0>(samples, tensor, numSamples, inputScale, inputOffset, conditioning);
+    } else if (numConditioning == 1) {
+        writeAffineRows<1>(samples, tensor, numSamples, inputScale, inputOffset, conditioning);
+    } else {
+        for (int i = 0; i < numSamples; ++i) {
+            tensor[i * stride] = inputScale * samples[i] + inputOffset;
+            for (int c = 0; c < numConditioning; ++c)
+                tensor[i * stride + 1 + c] = conditioning[c];
+        }
+    }
+}
+
+void PrePostChain::readOutput(const float* tensor, float* samples, int numSamples) const {
+    const float scale = config.outputScale, offset = config.outputOffset, clip = config.outputClip;
+    if (clip > 0.0f) {
+        for (int i = 0; i < numSamples; ++i)
+            samples[i] = std::min(clip, std::max(-clip, scale * tensor[i] + offset));
+    } else {
+        for (int i = 0; i < numSamples; ++i)
+            samples[i] = scale * tensor[i] + offset;
+    }
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,87 @@
+/*
+ * Fused pre/post-processing around a model
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * Models usually need some conditioning of the signal around the network: an input gain, a DC blocker, the
+ * normalization used in training, and an output scale and clip. Done as separate passes, each one reads and writes
+ * the whole block again. The PrePostChain is declared with a PrePostConfig (set in code or read from the metadata of
+ * the model) and runs the whole pre-processing in a single loop that writes the rows of the input tensor, conditioning
+ * columns included, and the whole post-processing in a single loop that reads the output tensor.
+ *
+ * The stages are linear up to the clip, so the gain and the normalization are folded into one multiply-add. Without
+ * the DC blocker (the only recursive stage) both loops vectorize.
+ *
+ * Everything is allocated in prepare, the other methods can be called from the real-time thread.
+ */
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace InferenceEngine {
+
+struct PrePostConfig {
+    // Pre-processing, in this order
+    float inputGain = 1.0f;
+    float dcBlockHz = 0.0f;  // Cutoff of the DC blocker (one-pole high-pass), 0 for none
+    float inputMean = 0.0f;  // Normalization, (x - inputMean) / inputStd
+    float inputStd = 1.0f;
+    // Post-processing, in this order
+    float outputScale = 1.0f;
+    float outputOffset = 0.0f;
+    float outputClip = 0.0f;  // Hard clip to [-outputClip, outputClip], 0 for none
+
+    /**
+     * @brief Read the stages from the metadata of a model (see getModelMetadata in the wrappers)
+     * Keys: pre.gain, pre.dc_block_hz, pre.mean, pre.std, post.scale, post.offset, post.clip
+     * Missing or invalid values keep the defaults (no processing).
+     */
+    static PrePostConfig fromMetadata(const std::map<std::string, std::string>& metadata);
+    bool isIdentity() const;
+};
+
+class PrePostChain {
+public:
+    /**
+     * @brief Fold the stages and allocate the state of the DC blockers (do not use in real time threads!)
+     *
+     * @param config        Stages
+     * @param sampleRate    Sample rate seen by the model
+     * @param numChannels   Channels processed (each one has its own DC blocker)
+     */
+    void prepare(const PrePostConfig& config, double sampleRate, int numChannels);
+    /** Clear the DC blockers, e.g. when the model restarts from a clean state */
+    void reset();
+
+    /**
+     * @brief Pre-process samples into the rows of the input tensor, [sample, conditioning...] (real-time safe)
+     *
+     * @param channel           Channel of the samples, for the DC blocker
+     * @param samples           Input samples
+     * @param tensor            First row to write, in place is allowed without conditioning
+     * @param numSamples        Number of samples (rows)
+     * @param conditioning      Values copied after the sample in every row (e.g. the gain of the saturator)
+     * @param numConditioning   Number of conditioning values
+     */
+    void writeInput(int channel, const float* samples, float* tensor, int numSamples, const float* conditioning = nullptr, int numConditioning = 0);
+
+    /** Post-process the output tensor into samples, in place is allowed (real-time safe) */
+    void readOutput(const float* tensor, float* samples, int numSamples) const;
+
+    const PrePostConfig& getConfig() const { return config; }
+
+private:
+    PrePostConfig config;
+    float inputScale = 1.0f;   // inputGain / inputStd
+    float inputOffset = 0.0f;  // -inputMean / inputStd
+    float dcCoefficient = 0.0f;  // Pole of the DC blocker, 0 if disabled
+
+    struct DcBlockerState {
+        float lastInput = 0.0f;
+        float lastOutput = 0.0f;
+    };
+    std::vector<DcBlockerState> dcBlockers;
+};
+
+}  // namespace InferenceEngine
@@ -0,0 +1,113 @@
+/*
+==============================================================================*/
+#include "scratcharena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <thread>
+
+#include "lockedarena.h"
+
+namespace InferenceEngine {
+
+namespace {
+
+std::mutex& getGroupsMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<int, std::weak_ptr<ScratchArena>>& getGroups() {
+    static std::map<int, std::weak_ptr<ScratchArena>> groups;
+    return groups;
+}
+
+/** Cache-line aligned block, the pointer to free is stored right before it */
+char* allocateAligned(size_t bytes) {
+    void* block = std::malloc(bytes + LockedArena::cacheLineSize + sizeof(void*));
+    if (block == nullptr)
+        throw std::bad_alloc();
+    const uintptr_t first = reinterpret_cast<uintptr_t>(block) + sizeof(void*);
+    char* aligned = reinterpret_cast<char*>((first + LockedArena::cacheLineSize - 1) & ~(uintptr_t)(LockedArena::cacheLineSize - 1));
+    reinterpret_cast<void**>(aligned)[-1] = block;
+    return aligned;
+}
+
+void freeAligned(char* data) {
+    if (data != nullptr)
+        std::free(reinterpret_cast<void**>(data)[-1]);
+}
+
+}  // namespace
+
+std::shared_ptr<ScratchArena> ScratchArena::getGroup(int group) {
+    std::lock_guard<std::mutex> lock(getGroupsMutex());
+    std::shared_ptr<ScratchArena> arena = getGroups()[group].lock();
+    if (arena == nullptr) {
+        arena = std::shared_ptr<ScratchArena>(new ScratchArena(group));
+        getGroups()[group] = arena;
+    }
+    return arena;
+}
+
+ScratchArena::~ScratchArena() {
+    if (lockedBytes > 0)
+        LockedArena::unlock(data, capacity);
+    freeAligned(data);
+}
+
+int ScratchArena::join(size_t bytes, RebindFunction rebind) {
+    std::lock_guard<std::mutex> lock(membersMutex);
+    char* oldData = nullptr;
+    size_t oldCapacity = 0, oldLockedBytes = 0;
+    if (bytes > capacity) {
+        // Prepare the new buffer first, the arena is held only while the members move
+        const size_t newCapacity = (bytes + LockedArena::cacheLineSize - 1) & ~(LockedArena::cacheLineSize - 1);
+        char* newData = allocateAligned(newCapacity);
+        const size_t newLockedBytes = LockedArena::lockAndPrefault(newData, newCapacity);
+        acquire();
+        for (const auto& member : members)
+            member.rebind(newData);
+        oldData = data;
+        oldCapacity = capacity;
+        oldLockedBytes = lockedBytes;
+        data = newData;
+        capacity = newCapacity;
+        lockedBytes = newLockedBytes;
+        release();
+    }
+    rebind(data);
+    members.push_back({nextMemberId, std::move(rebind)});
+
+    if (oldLockedBytes > 0)
+        LockedArena::unlock(oldData, oldCapacity);
+    freeAligned(oldData);
+    return nextMemberId++;
+}
+
+void ScratchArena::leave(int member) {
+    std::lock_guard<std::mutex> lock(membersMutex);
+    members.erase(std::remove_if(members.begin(), members.end(), [member](const Member& m) { return m.id == member; }), members.end());
+}
+
+void ScratchArena::acquire() {
+    if (!held.exchange(true, std::memory_order_acquire))
+        return;
+    contendedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+    for (int spins = 0; held.exchange(true, std::memory_order_acquire); ++spins)
+        if (spins >= 64)
+            std::this_thread::yield();
+}
+
+void ScratchArena::release() {
+    held.store(false, std::memory_order_release);
+}
+
+int ScratchArena::getNumMembers() const {
+    std::lock_guard<std::mutex> lock(membersMutex);
+    return (int)members.size();
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,103 @@
+/*
+ * Scratch arena shared by interpreters
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * The intermediate tensors (activations) of a model are only live during an invocation, so interpreters that are
+ * never invoked at the same time can keep them in the same memory. Interpreters created with the same
+ * ThreadingConfig::scratchArenaGroup move their intermediate tensors to the arena of the group, at the offsets planned
+ * by the engine, and keep private only their persistent memory (weights, variable tensors, input and output tensors).
+ * With N plugin instances running on one audio thread, the activations take the size of the largest plan instead of
+ * the sum of all of them, and consecutive instances work on the same cache lines.
+ *
+ * The arena grows when an interpreter with a larger plan joins the group (do not use in real time threads!): the
+ * buffer is replaced and every member moves its tensors to the new one. Invocations hold the arena, so interpreters
+ * of the same group that are invoked from different threads are serialized instead of overwriting each other's
+ * activations. Contended acquisitions are counted: they mean that the group spans more than one thread and should be
+ * split.
+ *
+ * The buffer is cache-line aligned, locked in RAM and prefaulted (see lockedarena.h).
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace InferenceEngine {
+
+class ScratchArena {
+public:
+    /** Called with the new base of the arena, while the arena is held */
+    using RebindFunction = std::function<void(char* data)>;
+
+    /** Get the arena of a group, created at the first request and released with its last member */
+    static std::shared_ptr<ScratchArena> getGroup(int group);
+    ~ScratchArena();
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    /**
+     * @brief Add a member that needs 'bytes' of scratch memory (do not use in real time threads!)
+     * The arena grows if needed, then rebind is called with the current buffer, and again every time it moves.
+     *
+     * @return int Identifier of the member, for leave()
+     */
+    int join(size_t bytes, RebindFunction rebind);
+    /** Remove a member, its rebind function is not called anymore (do not use in real time threads!) */
+    void leave(int member);
+
+    /** Hold the arena for an invocation (real-time safe, it spins while another thread holds it) */
+    void acquire();
+    void release();
+
+    int getGroupId() const { return group; }
+    size_t getCapacity() const { return capacity; }
+    int getNumMembers() const;
+    /** Acquisitions that had to wait for another thread */
+    uint64_t getContendedAcquisitions() const { return contendedAcquisitions.load(std::memory_order_relaxed); }
+
+    /** Holds the arena for the enclosing scope (nothing is held with a null arena) */
+    class Lease {
+    public:
+        explicit Lease(ScratchArena* arena) : arena(arena) {
+            if (arena != nullptr)
+                arena->acquire();
+        }
+        ~Lease() {
+            if (arena != nullptr)
+                arena->release();
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+    private:
+        ScratchArena* arena;
+    };
+
+private:
+    explicit ScratchArena(int group) : group(group) {}
+
+    struct Member {
+        int id;
+        RebindFunction rebind;
+    };
+
+    const int group;
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t lockedBytes = 0;
+
+    mutable std::mutex membersMutex;  // Members, buffer replacement
+    std::vector<Member> members;
+    int nextMemberId = 0;
+
+    std::atomic<bool> held{false};
+    std::atomic<uint64_t> contendedAcquisitions{0};
+};
+
+}  // namespace InferenceEngine
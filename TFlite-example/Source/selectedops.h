@@ -0,0 +1,17 @@
+/*
+ * Operators used by the shipped models, generated by libs/generate_op_resolver.py (do not edit)
+ * Models: saturation_model.tflite
+ */
+#pragma once
+
+#include "tensorflow/lite/kernels/builtin_op_kernels.h"
+#include "tensorflow/lite/mutable_op_resolver.h"
+
+namespace InferenceEngine {
+
+inline void registerSelectedOps(tflite::MutableOpResolver& resolver) {
+    resolver.AddBuiltin(tflite::BuiltinOperator_FULLY_CONNECTED, tflite::ops::builtin::Register_FULLY_CONNECTED(), 1, 1);
+    resolver.AddBuiltin(tflite::BuiltinOperator_LOGISTIC, tflite::ops::builtin::Register_LOGISTIC(), 1, 1);
+}
+
+}  // namespace InferenceEngine
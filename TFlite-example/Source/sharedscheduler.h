@@ -0,0 +1,120 @@
+/*
+ * Process-wide inference scheduler
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * When the same model is loaded by several plugin instances in the same host process (e.g. sushi running the
+ * saturator on multiple tracks), every instance would invoke its own interpreter within the same audio period.
+ * The scheduler collects the [sample, gain] rows of every registered client (one per instance channel) and runs a
+ * single batched invocation of a shared interpreter, whose batch dimension is resized to fit all the clients.
+ * This requires a model that processes each row independently, like the sample-wise saturator.
+ *
+ * Each period a client submits its block and collects the output of the block it submitted in the previous
+ * period, so the scheduler adds one block (the maximum block size) of latency.
+ * The batch runs on the thread of the last client that submits in a period. If a client finds its previous block
+ * still waiting for the batch (some other instance did not report in time), it processes the block with its own
+ * interpreter, and the instances that did not submit are excluded from the batch until they submit again. If the
+ * batch is running on another thread, the client waits for it up to its timeout, then processes the block alone too.
+ * Only one block per period joins the batch: the chunks of a block longer than the maximum block size run on the
+ * interpreter of the client, each one finished before the next, and the last chunk is submitted.
+ * All buffers are allocated at registration, so process() does not allocate or lock.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tflitewrapper.h"
+
+namespace InferenceEngine {
+
+class SharedInferenceScheduler {
+public:
+    /** Maximum number of clients (instance channels) per model */
+    static constexpr int maxClients = 32;
+
+    /**
+     * @brief Get the scheduler of a model, creating it on first use (do not use in real time threads!)
+     * The scheduler lives as long as some instance holds the returned pointer.
+     *
+     * @param modelKey          Name that identifies the model (file path or binary data name)
+     * @param createInterpreter Called once to create the shared interpreter
+     * @return std::shared_ptr<SharedInferenceScheduler>
+     */
+    static std::shared_ptr<SharedInferenceScheduler> getInstance(const std::string& modelKey, const std::function<InterpreterPtr()>& createInterpreter);
+
+    explicit SharedInferenceScheduler(InterpreterPtr sharedInterpreter);
+    ~SharedInferenceScheduler();
+
+    /**
+     * @brief Register a client and resize the shared interpreter (do not use in real time threads!)
+     *
+     * @param maxBlockSize          Maximum number of samples per block, which is also the latency of the client
+     * @param fallbackInterpreter   Interpreter of the instance, used when the batch does not run in time
+     * @param batchTimeoutUs        Longest wait for a batch running on another thread, in microseconds. The wait spins
+     *                              on the audio thread, keep it a small fraction of the block period
+     * @return int Client index, or -1 if there is no free client or the model batch size cannot be changed
+     */
+    int registerClient(int maxBlockSize, InterpreterPtr fallbackInterpreter, int batchTimeoutUs);
+
+    /** Unregister a client and shrink the shared interpreter (do not use in real time threads!) */
+    void unregisterClient(int client);
+
+    /**
+     * @brief Submit a block and replace it with the output of the previous one (real-time safe)
+     *
+     * @param client     Index returned by registerClient
+     * @param data       Block to process in place
+     * @param numSamples Number of samples (blocks longer than the maximum block size are split)
+     * @param gain       Saturation gain fed to the model together with each sample
+     */
+    void process(int client, float* data, int numSamples, float gain);
+
+private:
+    // A block is Claimed while the batch copies its rows, then InBatch until the batch starts Delivering its output.
+    // Only a block InBatch can be taken back by the client, after its timeout.
+    enum ClientState { Unused, Idle, Submitted, Claimed, InBatch, Delivering, Done };
+
+    struct Client {
+        std::atomic<int> state{Unused};
+        std::atomic<bool> absent{false};  // Did not submit in time for the last period, not waited for
+        int maxBlockSize = 0;
+        std::chrono::microseconds batchTimeout{0};
+        int batchOffset = 0;  // First row of the client in the shared batch
+        InterpreterPtr fallbackInterpreter = nullptr;
+        int fallbackBatchSize = 1;
+
+        int pendingSize = 0;
+        std::vector<float> pendingInput;  // Interleaved [sample, gain] rows of the submitted block
+        std::vector<float> fallbackInput, fallbackOutput;
+
+        // Output FIFO, holding maxBlockSize samples before each read (the latency of the client)
+        std::vector<float> outputFifo;
+        int fifoReadIndex = 0, fifoWriteIndex = 0;
+    };
+
+    /** Swap a chunk with the output in the FIFO, then submit it or process it with the interpreter of the client */
+    void processChunk(Client& client, float* data, int numSamples, float gain, bool submit);
+    /** Wait for the previous block of the client, processing it locally if the batch did not run */
+    void collect(Client& client);
+    void runFallback(Client& client);
+    /** Run the shared batch if every client that is not absent has submitted */
+    void tryRunBatch();
+    void pushOutput(Client& client, const float* samples, int numSamples);
+    /** Recompute the batch layout and resize the shared interpreter, with the batch lock held */
+    bool resizeBatch();
+
+    InterpreterPtr sharedInterpreter;
+    bool batchingSupported = true;
+
+    std::array<Client, maxClients> clients;
+    std::atomic_flag batchLock = ATOMIC_FLAG_INIT;  // Held while the batch runs or the layout changes
+    int batchRows = 0;
+    std::vector<float> batchInput, batchOutput;
+};
+
+}  // namespace InferenceEngine
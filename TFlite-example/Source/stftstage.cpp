@@ -0,0 +1,142 @@
+/*
+==============================================================================*/
+#include "stftstage.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace InferenceEngine {
+
+StftStage::StftStage(InterpreterPtr interpreter, int fftOrder, int hopSize)
+    : interpreter(interpreter), fft(fftOrder), fftSize(1 << fftOrder), hopSize(hopSize), numBins((1 << fftOrder) / 2 + 1) {
+    if (hopSize <= 0 || fftSize % hopSize != 0)
+        throw std::logic_error("Error, the FFT size (" + std::to_string(fftSize) + ") has to be a multiple of the hop size (Found " + std::to_string(hopSize) + ")");
+    // The squared sqrt-Hann windows only sum to a constant when they overlap by at least half
+    if (hopSize > fftSize / 2)
+        throw std::logic_error("Error, the hop size cannot exceed half the FFT size (" + std::to_string(fftSize / 2) + ") (Found " + std::to_string(hopSize) + ")");
+}
+
+void StftStage::prepare() {
+    // The batch size (frames per invocation) is dictated by the model
+    size_t rows, cols;
+    getModelInputSize2d(interpreter, rows, cols);
+    if ((int)cols != numBins)
+        throw std::logic_error("Error, the spectral model has to have " + std::to_string(numBins) + " columns for an FFT of size " + std::to_string(fftSize) + " (Found " + std::to_string(cols) + " instead)");
+    if (getModelOutputSize(interpreter) != rows * cols)
+        throw std::logic_error("Error, the spectral model has to output a mask of size " + std::to_string(rows * cols) + " (Found " + std::to_string(getModelOutputSize(interpreter)) + " instead)");
+    framesPerCall = (int)rows;
+
+    // Periodic sqrt-Hann window, applied both before the forward and after the inverse transform
+    window.resize(fftSize);
+    for (int n = 0; n < fftSize; ++n)
+        window[n] = std::sqrt(0.5f - 0.5f * std::cos(2.0f * juce::MathConstants<float>::pi * (float)n / (float)fftSize));
+
+    // Compensate the gain of the overlapping squared windows, so that an all-ones mask is an identity: every sample
+    // is covered by fftSize / hopSize windows, which sum on average to the energy of the window over one hop
+    double windowEnergy = 0.0;
+    for (int n = 0; n < fftSize; ++n)
+        windowEnergy += (double)window[n] * window[n];
+    olaScale = (float)(hopSize / windowEnergy);
+
+    analysisBuffer.resize(fftSize);
+    spectra.resize(framesPerCall * 2 * fftSize);
+    featureMatrix.resize(framesPerCall * numBins);
+    maskMatrix.resize(framesPerCall * numBins);
+    olaBuffer.resize(fftSize + (framesPerCall - 1) * hopSize);
+    // One extra hop of room, since a chunk is read only after the batch it completes has been written
+    outputFifo.resize((framesPerCall + 1) * hopSize);
+
+    reset();
+}
+
+void StftStage::reset() {
+    std::fill(analysisBuffer.begin(), analysisBuffer.end(), 0.0f);
+    std::fill(olaBuffer.begin(), olaBuffer.end(), 0.0f);
+    std::fill(outputFifo.begin(), outputFifo.end(), 0.0f);
+    hopCounter = 0;
+    currentFrame = 0;
+    // The fifo starts with (framesPerCall * hopSize - 1) zeros, which is the minimum
+    // that keeps the output flowing until the first batch is resynthesized
+    fifoRead = 0;
+    fifoWrite = framesPerCall * hopSize - 1;
+}
+
+int StftStage::getLatencySamples() const {
+    return fftSize + (framesPerCall - 1) * hopSize - 1;
+}
+
+void StftStage::process(float* channelData, int numSamples) {
+    const int fifoSize = (int)outputFifo.size();
+    int pos = 0;
+    while (pos < numSamples) {
+        // Never cross a hop boundary within a chunk
+        const int chunk = std::min(numSamples - pos, hopSize - hopCounter);
+
+        juce::FloatVectorOperations::copy(&analysisBuffer[fftSize - hopSize + hopCounter], channelData + pos, chunk);
+        hopCounter += chunk;
+
+        if (hopCounter == hopSize) {
+            analyseFrame();
+            hopCounter = 0;
+            if (++currentFrame == framesPerCall) {
+                processBatch();
+                currentFrame = 0;
+            }
+        }
+
+        // Read the output (at most two contiguous segments of the circular fifo)
+        const int firstPart = std::min(chunk, fifoSize - fifoRead);
+        juce::FloatVectorOperations::copy(channelData + pos, &outputFifo[fifoRead], firstPart);
+        if (chunk > firstPart)
+            juce::FloatVectorOperations::copy(channelData + pos + firstPart, &outputFifo[0], chunk - firstPart);
+        fifoRead = (fifoRead + chunk) % fifoSize;
+
+        pos += chunk;
+    }
+}
+
+void StftStage::analyseFrame() {
+    float* spectrum = &spectra[currentFrame * 2 * fftSize];
+
+    juce::FloatVectorOperations::multiply(spectrum, analysisBuffer.data(), window.data(), fftSize);
+    juce::FloatVectorOperations::clear(spectrum + fftSize, fftSize);
+    fft.performRealOnlyForwardTransform(spectrum, true);
+
+    float* features = &featureMatrix[currentFrame * numBins];
+    for (int k = 0; k < numBins; ++k)
+        features[k] = std::sqrt(spectrum[2 * k] * spectrum[2 * k] + spectrum[2 * k + 1] * spectrum[2 * k + 1]);
+
+    // Slide the analysis window by one hop
+    std::copy(analysisBuffer.begin() + hopSize, analysisBuffer.end(), analysisBuffer.begin());
+}
+
+void StftStage::processBatch() {
+    invokeFlat2D(interpreter, featureMatrix.data(), framesPerCall, numBins, maskMatrix.data(), maskMatrix.size());
+
+    for (int frame = 0; frame < framesPerCall; ++frame) {
+        float* spectrum = &spectra[frame * 2 * fftSize];
+        const float* mask = &maskMatrix[frame * numBins];
+        for (int k = 0; k < numBins; ++k) {
+            spectrum[2 * k] *= mask[k];
+            spectrum[2 * k + 1] *= mask[k];
+        }
+        fft.performRealOnlyInverseTransform(spectrum);
+        juce::FloatVectorOperations::multiply(spectrum, window.data(), fftSize);
+        juce::FloatVectorOperations::addWithMultiply(&olaBuffer[frame * hopSize], spectrum, olaScale, fftSize);
+    }
+
+    // The first (framesPerCall * hopSize) samples will not be touched by later frames
+    const int completed = framesPerCall * hopSize;
+    const int fifoSize = (int)outputFifo.size();
+    const int firstPart = std::min(completed, fifoSize - fifoWrite);
+    juce::FloatVectorOperations::copy(&outputFifo[fifoWrite], olaBuffer.data(), firstPart);
+    if (completed > firstPart)
+        juce::FloatVectorOperations::copy(&outputFifo[0], &olaBuffer[firstPart], completed - firstPart);
+    fifoWrite = (fifoWrite + completed) % fifoSize;
+
+    std::copy(olaBuffer.begin() + completed, olaBuffer.end(), olaBuffer.begin());
+    std::fill(olaBuffer.end() - completed, olaBuffer.end(), 0.0f);
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,99 @@
+/*
+ * STFT Overlap-Add processing stage
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * This header exposes a frame-processing stage that feeds spectral-domain models (e.g. denoising or masking
+ * models) through the 2D invocation path of the InferenceEngine wrapper.
+ *
+ * The incoming audio is cut into windowed frames (sqrt-Hann, configurable FFT size and hop), transformed with
+ * juce::dsp::FFT and the magnitude spectra of N_ROWS consecutive hops are batched into the flat [N_ROWS x N_BINS]
+ * input matrix of the model. The model is expected to return a real-valued mask of the same shape, that is applied
+ * to the complex spectra before resynthesis with inverse FFT and overlap-add.
+ *
+ * Every buffer is allocated in prepare(), so process() can be called from the real-time thread.
+ */
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+#include "tflitewrapper.h"
+
+namespace InferenceEngine {
+
+class StftStage {
+public:
+    /**
+     * @brief Construct a new STFT stage around an existing interpreter (do not use in real time threads!)
+     * The number of frames batched in each invocation is read from the model input (rows), while the number of
+     * columns has to match the number of non-negative frequency bins (fftSize/2 + 1).
+     *
+     * @param interpreter Interpreter of a 2D spectral model (caller-owned)
+     * @param fftOrder    log2 of the FFT size (e.g. 10 for 1024 samples)
+     * @param hopSize     Analysis/synthesis hop in samples (fftSize has to be a multiple of it, at most fftSize / 2)
+     */
+    StftStage(InterpreterPtr interpreter, int fftOrder, int hopSize);
+
+    /**
+     * @brief Allocate and clear every internal buffer (do not use in real time threads!)
+     */
+    void prepare();
+
+    /**
+     * @brief Clear the internal state without reallocating
+     */
+    void reset();
+
+    /**
+     * @brief Process a block of samples in place
+     * Any block size is accepted, blocks longer than a hop trigger multiple frames (and possibly multiple model
+     * invocations) within the same call.
+     *
+     * @param channelData Samples to process, overwritten with the output
+     * @param numSamples  Number of samples in the block
+     */
+    void process(float* channelData, int numSamples);
+
+    /**
+     * @brief Get the latency introduced by the stage, to report through setLatencySamples
+     *
+     * @return int Latency in samples
+     */
+    int getLatencySamples() const;
+
+    int getFftSize() const { return fftSize; }
+    int getHopSize() const { return hopSize; }
+    int getFramesPerInvocation() const { return framesPerCall; }
+
+private:
+    /** Window, transform and batch the most recent analysis frame */
+    void analyseFrame();
+    /** Run the model on the batch, then resynthesize and overlap-add every frame */
+    void processBatch();
+
+    //--------------------------------------------------------------------------
+
+    InterpreterPtr interpreter;
+
+    juce::dsp::FFT fft;
+    const int fftSize;
+    const int hopSize;
+    const int numBins;
+    int framesPerCall = 1;
+
+    std::vector<float> window;           // sqrt-Hann, used for both analysis and synthesis
+    std::vector<float> analysisBuffer;   // Last fftSize input samples
+    std::vector<float> spectra;          // framesPerCall interleaved complex spectra (2*fftSize floats each)
+    std::vector<float> featureMatrix;    // Flat [framesPerCall x numBins] model input
+    std::vector<float> maskMatrix;       // Flat [framesPerCall x numBins] model output
+    std::vector<float> olaBuffer;        // Overlap-add accumulator
+    std::vector<float> outputFifo;       // Circular buffer of resynthesized samples
+
+    float olaScale = 1.0f;
+    int hopCounter = 0;
+    int currentFrame = 0;
+    int fifoRead = 0, fifoWrite = 0;
+};
+
+}  // namespace InferenceEngine
@@ -2,6 +2,11 @@
 ==============================================================================*/
 #include "tflitewrapper.h"
 
+#include "lockedarena.h"
+#include "opprofiler.h"
+#include "perfcounters.h"
+#include "scratcharena.h"
+
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
@@ -9,11 +14,24 @@
 #include <limits>  // std::numeric_limits
 #include <utility>
 
+#include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/core/api/profiler.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
 #include "tensorflow/lite/optional_debug_tools.h"
 
+// If 1 register only the operators of the shipped models (selectedops.h, generated by libs/generate_op_resolver.py)
+// instead of every builtin, so that only their kernels are linked from the static tensorflow-lite library
+#ifndef TFLITE_SELECTED_OPS
+    #define TFLITE_SELECTED_OPS 0
+#endif
+#if (TFLITE_SELECTED_OPS)
+    #include "selectedops.h"
+#endif
+
 namespace InferenceEngine {
 
 #define LOG(x) std::cerr
@@ -26,17 +44,82 @@ using namespace tflite;
         exit(1);                                                 \
     }
 
+/** Forwards the operator events of an interpreter to an OperatorProfile, one entry per node */
+class OperatorProfiler : public tflite::Profiler {
+public:
+    explicit OperatorProfiler(const Interpreter &interpreter) {
+        std::vector<std::string> names;
+        for (size_t node = 0; node < interpreter.nodes_size(); ++node) {
+            const TfLiteRegistration &registration = interpreter.node_and_registration((int)node)->second;
+            const std::string opName = (registration.custom_name != nullptr) ? registration.custom_name : EnumNameBuiltinOperator((BuiltinOperator)registration.builtin_code);
+            names.push_back(opName + " (node " + std::to_string(node) + ")");
+        }
+        profile.prepare(names);
+    }
+
+    uint32_t BeginEvent(const char *tag, EventType eventType, int64_t eventMetadata1, int64_t eventMetadata2) override {
+        // Operator events of the primary subgraph carry the node index, and do not nest
+        if (eventType != EventType::OPERATOR_INVOKE_EVENT || eventMetadata2 != 0)
+            return 0;
+        currentNode = (int)eventMetadata1;
+        currentStart = OperatorProfile::now();
+        return 1;
+    }
+
+    void EndEvent(uint32_t eventHandle) override {
+        if (eventHandle == 1)
+            profile.record(currentNode, currentStart, OperatorProfile::now());
+    }
+
+    OperatorProfile profile;
+
+private:
+    int currentNode = -1;
+    int64_t currentStart = 0;
+};
+
 // Definition of the Interpreter class
 class InterpreterWrap {
 public:
     /** Constructor */
-    InterpreterWrap(const std::string &filename, bool verbose = false);            // Construct from file path
-    InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose = false);  // Construct from buffer
-    void buildAndPrime(bool verbose = false);                                      // Build and prime the interpreter | Common part to the two constructors
+    InterpreterWrap(const std::string &filename, bool verbose = false, const ThreadingConfig &threading = ThreadingConfig());            // Construct from file path
+    InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose = false, const ThreadingConfig &threading = ThreadingConfig());  // Construct from buffer
+    void buildAndPrime(bool verbose = false, const ThreadingConfig &threading = ThreadingConfig());                                      // Build and prime the interpreter | Common part to the two constructors
+    void measureRuntimeBytes(size_t heapBytesBefore);                                                                                    // Heap allocated by the creation, outside of the tensors
+    /** Destructor */
+    ~InterpreterWrap();
     /** Internal interpreter invocation function, called by wrappers */
     int invoke_internal(const float inputVector[], size_t inputSize, float outputVector[], size_t outputSize, bool verbose = false);
+    /** Invocation on the data already in the input tensor, see ModelEngine */
+    void invokeBound();
+    TensorBinding getTensorBinding() const;
+
+    /** Resize the first dimension of the input tensor and reallocate the tensors */
+    bool resizeBatch(int batchSize, bool verbose = false);
+    /** Allocate the input and output tensors from the arena and lock the memory of the other tensors */
+    size_t placeTensorsInArena(LockedArena &arena, bool verbose = false);
+    /** Clear the variable tensors of the model */
+    void resetState();
+    /** Attach an operator profiler to the interpreter */
+    void enableProfiling();
+    bool exportProfile(const std::string &traceJsonPath, const std::string &summaryPath) const;
+    /** Measure the invocations in the performance counter region of the current batch size (see perfcounters.h) */
+    void updatePerfRegion();
+    /** Move the intermediate tensors to the scratch arena of a group (see scratcharena.h) */
+    void shareScratchArena(int group, bool verbose = false);
+    TensorMemoryUsage getTensorMemoryUsage() const;
+    size_t getPrivateArenaBytes() const;
+    ModelMemoryUsage getModelMemoryUsage() const;
+    std::map<std::string, std::string> getMetadata() const;
+    /** Extract the layers of a chain of fully connected operators */
+    bool getDenseLayers(std::vector<DenseLayer> &layers) const;
+    /** Float constant tensors, and their indices in the interpreter */
+    std::vector<WeightTensorInfo> getWeightLayout(std::vector<int> *indices = nullptr) const;
+    bool attachWeightBank(const WeightBank &bank);
+    void useWeightSet(int set);
 
     int requestedInputSize() const;
+    int requestedBatchSize() const;
     int requested2drows() const;
     int requested2dcols() const;
     int requestedOutputSize() const;
@@ -55,43 +138,76 @@ private:
 
     //--------------------------------------------------------------------------
 
+    std::unique_ptr<OperatorProfiler> profiler;  // Declared first, so that it outlives the interpreter
     std::unique_ptr<FlatBufferModel> model;
     std::unique_ptr<Interpreter> interpreter;
 
     float *inputTensorPtr, *outputTensorPtr;
+
+    /** Tensor memory locked with LockedArena::lockAndPrefault, unlocked in the destructor */
+    std::vector<std::pair<char *, size_t>> lockedRegions;
+
+    int numThreads = 1;
+    ThreadingConfig threadingConfig;   // Passed to the workers created by later invocations (they can add workers)
+    PerfRegion *perfRegion = nullptr;  // Null unless INFERENCE_PERF_COUNTERS
+
+    /** Intermediate tensor moved to the shared scratch arena, at the offset planned by TFLite */
+    struct ScratchTensor {
+        int index;
+        size_t offset;
+        size_t bytes;
+    };
+    std::vector<ScratchTensor> scratchTensors;
+    std::shared_ptr<ScratchArena> scratchArena;  // Null unless ThreadingConfig::scratchArenaGroup >= 0
+    int scratchMember = -1;
+    size_t scratchBytes = 0;
+
+    size_t runtimeBytes = 0;  // See measureRuntimeBytes
+
+    const WeightBank *weightBank = nullptr;  // Null unless attachWeightBank
+    std::vector<int> weightTensors;          // Indices of the tensors of the layout of the bank
 };
 
-InterpreterWrap::InterpreterWrap(const std::string &filename, bool verbose) {
+InterpreterWrap::InterpreterWrap(const std::string &filename, bool verbose, const ThreadingConfig &threading) {
+    const size_t heapBytesBefore = getAllocatedHeapBytes();
     // Load model
     if (verbose)
         std::cout << "Interpreter\t|\tconstructor\t| Loading model from path: '" << filename << "'..." << std::endl;
     this->model = loadModel(filename);
 
-    buildAndPrime(verbose);
+    buildAndPrime(verbose, threading);
+    measureRuntimeBytes(heapBytesBefore);
 }
 
-InterpreterWrap::InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose) {
+InterpreterWrap::InterpreterWrap(const char *buffer, size_t bufferSize, bool verbose, const ThreadingConfig &threading) {
+    const size_t heapBytesBefore = getAllocatedHeapBytes();
     // Load model
     if (verbose)
         std::cout << "Interpreter\t|\tconstructor\t| Loading model from buffer..." << std::endl;
     this->model = loadModelFromBuffer(buffer, bufferSize);
 
-    buildAndPrime(verbose);
+    buildAndPrime(verbose, threading);
+    measureRuntimeBytes(heapBytesBefore);
 }
 
-void InterpreterWrap::buildAndPrime(bool verbose) {
-    // Build the interpreter
-    if (verbose)
-        std::cout << "Interpreter\t|\tconstructor\t| Done.\nInterpreter\t|\tconstructor\t| Building interpreter..." << std::endl;
-    this->interpreter = buildInterpreter(model);
-    // Allocate tensor buffers.
-    if (verbose)
-        std::cout << "Interpreter\t|\tconstructor\t| Done.\nInterpreter\t|\tconstructor\t| Allocating tensor buffers..." << std::endl;
-    TFLITE_MINIMAL_CHECK(interpreter->AllocateTensors() == kTfLiteOk);
+void InterpreterWrap::buildAndPrime(bool verbose, const ThreadingConfig &threading) {
+    // Worker threads are created by the interpreter (by the delegates when they are applied, by ruy at the first
+    // invocation), so these calls run where the workers inherit their affinity and scheduling policy
+    threadingConfig = threading;
+    runAsWorkerCreator(threading, [this, verbose]() {
+        // Build the interpreter
+        if (verbose)
+            std::cout << "Interpreter\t|\tconstructor\t| Done.\nInterpreter\t|\tconstructor\t| Building interpreter..." << std::endl;
+        this->interpreter = buildInterpreter(model);
+        // Allocate tensor buffers.
+        if (verbose)
+            std::cout << "Interpreter\t|\tconstructor\t| Done.\nInterpreter\t|\tconstructor\t| Allocating tensor buffers..." << std::endl;
+        TFLITE_MINIMAL_CHECK(interpreter->AllocateTensors() == kTfLiteOk);
+    });
     // assert(interpreter != nullptr);
     // Configure the interpreter
     interpreter->SetAllowFp16PrecisionForFp32(true);
-    interpreter->SetNumThreads(1);
+    interpreter->SetNumThreads(std::max(1, threading.numThreads));
 
     if (interpreter == nullptr)
         throw std::runtime_error("Interpreter\t|\tconstructor\t| Failed to build interpreter. Return value is NULL.");
@@ -180,17 +296,430 @@ void InterpreterWrap::buildAndPrime(bool verbose) {
     }
     std::vector<float> pOv;
     pOv.resize(this->requestedOutputSize());
-    this->invoke_internal(&pIv[0], pIv.size(), &pOv[0], pOv.size(), verbose);
+    runAsWorkerCreator(threading, [&]() { this->invoke_internal(&pIv[0], pIv.size(), &pOv[0], pOv.size(), verbose); });
     if (verbose)
         std::cout << "Interpreter\t|\tconstructor\t| Done.\nInterpreter\t|\tconstructor\t| Interpreter primed." << std::endl;
 
+    if (verbose)
+        std::cout << "Interpreter\t|\tconstructor\t| Threads: " << threading.numThreads << " | Worker threads configured: " << (configuresWorkerThreads(threading) ? "yes" : "no") << std::endl;
+    numThreads = std::max(1, threading.numThreads);
+    updatePerfRegion();
+    if (threading.scratchArenaGroup >= 0)
+        shareScratchArena(threading.scratchArenaGroup, verbose);
+
     /*
      * The priming operation should ensure that every allocation performed
      * by the Invoke method is perfomed here and not in the real-time thread.
      */
 }
 
+InterpreterWrap::~InterpreterWrap() {
+    if (scratchArena != nullptr)
+        scratchArena->leave(scratchMember);
+    for (const auto &region : lockedRegions)
+        LockedArena::unlock(region.first, region.second);
+}
+
+size_t InterpreterWrap::placeTensorsInArena(LockedArena &arena, bool verbose) {
+    // Custom allocations have to be aligned like the TFLite arena (64 bytes)
+    for (int tensorIndex : {interpreter->inputs()[0], interpreter->outputs()[0]}) {
+        const size_t bytes = interpreter->tensor(tensorIndex)->bytes;
+        TfLiteCustomAllocation allocation{arena.allocate(bytes, LockedArena::cacheLineSize), bytes};
+        if (allocation.data == nullptr)
+            throw std::runtime_error("Error, the memory arena is too small for the tensors of the model (" + std::to_string(arena.getCapacity() - arena.getUsedBytes()) + " bytes left, " + std::to_string(bytes) + " requested)");
+        TFLITE_MINIMAL_CHECK(interpreter->SetCustomAllocationForTensor(tensorIndex, allocation) == kTfLiteOk);
+    }
+    // The TFLite arena only grows, release it so that it is allocated again without the I/O tensors
+    TFLITE_MINIMAL_CHECK(interpreter->ReleaseNonPersistentMemory() == kTfLiteOk);
+    TFLITE_MINIMAL_CHECK(interpreter->AllocateTensors() == kTfLiteOk);
+    this->inputTensorPtr = interpreter->typed_input_tensor<float>(0);
+    this->outputTensorPtr = interpreter->typed_output_tensor<float>(0);
+
+    // Lock the remaining tensors where they are, merging overlapping regions (tensors share the TFLite arena)
+    // The weights are in the model buffer shared by the interpreters, the locks are counted per page by LockedArena
+    for (const auto &region : lockedRegions)
+        LockedArena::unlock(region.first, region.second);
+    lockedRegions.clear();
+    std::vector<std::pair<char *, size_t>> tensorRegions, regions;
+    for (size_t i = 0; i < interpreter->tensors_size(); ++i) {
+        const TfLiteTensor *tensor = interpreter->tensor((int)i);
+        if (tensor->data.raw != nullptr && tensor->bytes > 0 && tensor->allocation_type != kTfLiteCustom)
+            tensorRegions.push_back({tensor->data.raw, tensor->bytes});
+    }
+    std::sort(tensorRegions.begin(), tensorRegions.end());
+    for (const auto &region : tensorRegions) {
+        if (!regions.empty() && region.first <= regions.back().first + regions.back().second)
+            regions.back().second = std::max(regions.back().second, (size_t)(region.first + region.second - regions.back().first));
+        else
+            regions.push_back(region);
+    }
+    size_t lockedBytes = 0;
+    for (const auto &region : regions) {
+        const size_t regionLockedBytes = LockedArena::lockAndPrefault(region.first, region.second);
+        if (regionLockedBytes > 0)
+            lockedRegions.push_back(region);  // Only unlock what was locked
+        lockedBytes += regionLockedBytes;
+    }
+    if (verbose)
+        std::cout << "Interpreter\t|\tplaceTensorsInArena\t| I/O tensors in arena (" << arena.getUsedBytes() << " bytes used), " << lockedBytes << " bytes of tensor memory locked" << std::endl;
+
+    // Prime again with the new buffers
+    std::vector<float> pIv(requestedInputSize()), pOv(requestedOutputSize());
+    runAsWorkerCreator(threadingConfig, [&]() { this->invoke_internal(pIv.data(), pIv.size(), pOv.data(), pOv.size(), verbose); });
+    return lockedBytes;
+}
+
+bool InterpreterWrap::resizeBatch(int batchSize, bool verbose) {
+    if (scratchArena != nullptr) {
+        if (verbose)
+            std::cout << "Interpreter\t|\tresizeBatch\t| Interpreters that share a scratch arena cannot be resized" << std::endl;
+        return false;  // The tensors in the scratch arena would keep their old size
+    }
+    const int input = interpreter->inputs()[0];
+    TfLiteIntArray *dims = interpreter->tensor(input)->dims;
+    const int oldBatchSize = dims->data[0];
+    const int oldOutputSize = requestedOutputSize();
+    std::vector<int> newDims(dims->data, dims->data + dims->size);
+    newDims[0] = batchSize;
+    if (verbose)
+        std::cout << "Interpreter\t|\tresizeBatch\t| Resizing batch from " << oldBatchSize << " to " << batchSize << "..." << std::endl;
+    if (interpreter->ResizeInputTensor(input, newDims) != kTfLiteOk || interpreter->AllocateTensors() != kTfLiteOk)
+        return false;
+
+    // Tensor buffers are reallocated
+    this->inputTensorPtr = interpreter->typed_input_tensor<float>(0);
+    this->outputTensorPtr = interpreter->typed_output_tensor<float>(0);
+    if (inputTensorPtr == nullptr || outputTensorPtr == nullptr)
+        return false;
+    if (requestedOutputSize() != oldOutputSize / oldBatchSize * batchSize)
+        return false;  // The output does not scale with the batch
+
+    // Prime again, so that the first real-time invocation does not allocate
+    std::vector<float> pIv(requestedInputSize()), pOv(requestedOutputSize());
+    runAsWorkerCreator(threadingConfig, [&]() { this->invoke_internal(pIv.data(), pIv.size(), pOv.data(), pOv.size(), verbose); });
+    updatePerfRegion();
+    return true;
+}
+
+void InterpreterWrap::shareScratchArena(int group, bool verbose) {
+    // Input and output tensors stay private, and kernel temporaries are reset by the kernels at every AllocateTensors
+    std::vector<bool> excluded(interpreter->tensors_size(), false);
+    for (int tensorIndex : interpreter->inputs())
+        excluded[tensorIndex] = true;
+    for (int tensorIndex : interpreter->outputs())
+        excluded[tensorIndex] = true;
+    for (size_t node = 0; node < interpreter->nodes_size(); ++node) {
+        const TfLiteIntArray *temporaries = interpreter->node_and_registration((int)node)->first.temporaries;
+        for (int i = 0; temporaries != nullptr && i < temporaries->size; ++i)
+            excluded[temporaries->data[i]] = true;
+    }
+    std::vector<int> indices;
+    char *lowest = nullptr;
+    for (size_t i = 0; i < interpreter->tensors_size(); ++i) {
+        const TfLiteTensor *tensor = interpreter->tensor((int)i);
+        if (excluded[i] || tensor->allocation_type != kTfLiteArenaRw || tensor->is_variable || tensor->data.raw == nullptr || tensor->bytes == 0)
+            continue;
+        indices.push_back((int)i);
+        if (lowest == nullptr || tensor->data.raw < lowest)
+            lowest = tensor->data.raw;
+    }
+    if (indices.empty()) {
+        if (verbose)
+            std::cout << "Interpreter\t|\tshareScratchArena\t| The model has no intermediate tensors to share" << std::endl;
+        return;
+    }
+
+    // Keeping the offsets of the TFLite plan keeps the reuse of memory between tensors that are not live together
+    for (int tensorIndex : indices) {
+        const TfLiteTensor *tensor = interpreter->tensor(tensorIndex);
+        scratchTensors.push_back({tensorIndex, (size_t)(tensor->data.raw - lowest), tensor->bytes});
+        scratchBytes = std::max(scratchBytes, scratchTensors.back().offset + tensor->bytes);
+    }
+    scratchArena = ScratchArena::getGroup(group);
+    scratchMember = scratchArena->join(scratchBytes, [this](char *data) {
+        for (const auto &tensor : scratchTensors)
+            TFLITE_MINIMAL_CHECK(interpreter->SetCustomAllocationForTensor(tensor.index, {data + tensor.offset, tensor.bytes}) == kTfLiteOk);
+    });
+    // Without the release the private arena would keep the size of the first plan, and nothing would be saved
+    TFLITE_MINIMAL_CHECK(interpreter->ReleaseNonPersistentMemory() == kTfLiteOk);
+    TFLITE_MINIMAL_CHECK(interpreter->AllocateTensors() == kTfLiteOk);
+    this->inputTensorPtr = interpreter->typed_input_tensor<float>(0);
+    this->outputTensorPtr = interpreter->typed_output_tensor<float>(0);
+    if (verbose)
+        std::cout << "Interpreter\t|\tshareScratchArena\t| " << scratchTensors.size() << " intermediate tensors (" << scratchBytes << " bytes) in the scratch arena of group " << group << " (" << scratchArena->getCapacity() << " bytes, "
+                  << scratchArena->getNumMembers() << " interpreters), private arena down to " << getPrivateArenaBytes() << " bytes" << std::endl;
+
+    // Prime again with the shared buffer
+    std::vector<float> pIv(requestedInputSize()), pOv(requestedOutputSize());
+    runAsWorkerCreator(threadingConfig, [&]() { this->invoke_internal(pIv.data(), pIv.size(), pOv.data(), pOv.size(), verbose); });
+}
+
+size_t InterpreterWrap::getPrivateArenaBytes() const {
+    // The arena is allocated at the size of the current plan (it is released whenever tensors leave it), and the
+    // planned tensors overlap in it, so its size is the span of the tensors
+    char *lowest = nullptr, *highest = nullptr;
+    for (size_t i = 0; i < interpreter->tensors_size(); ++i) {
+        const TfLiteTensor *tensor = interpreter->tensor((int)i);
+        if (tensor->allocation_type != kTfLiteArenaRw || tensor->data.raw == nullptr || tensor->bytes == 0)
+            continue;
+        lowest = (lowest == nullptr) ? tensor->data.raw : std::min(lowest, tensor->data.raw);
+        highest = std::max(highest, tensor->data.raw + tensor->bytes);
+    }
+    return (lowest != nullptr) ? (size_t)(highest - lowest) : 0;
+}
+
+TensorMemoryUsage InterpreterWrap::getTensorMemoryUsage() const {
+    TensorMemoryUsage usage;
+    usage.privateBytes = getPrivateArenaBytes();
+    for (size_t i = 0; i < interpreter->tensors_size(); ++i) {
+        const TfLiteTensor *tensor = interpreter->tensor((int)i);
+        if (tensor->allocation_type == kTfLiteArenaRwPersistent && tensor->data.raw != nullptr)
+            usage.privateBytes += tensor->bytes;
+    }
+    usage.scratchBytes = scratchBytes;
+    if (scratchArena != nullptr) {
+        usage.sharedScratchBytes = scratchArena->getCapacity();
+        usage.scratchArenaGroup = scratchArena->getGroupId();
+        usage.scratchArenaMembers = scratchArena->getNumMembers();
+    }
+    return usage;
+}
+
+ModelMemoryUsage InterpreterWrap::getModelMemoryUsage() const {
+    ModelMemoryUsage usage;
+    usage.modelBytes = (model->allocation() != nullptr) ? model->allocation()->bytes() : 0;
+    const int inputIndex = interpreter->inputs()[0], outputIndex = interpreter->outputs()[0];
+    char *lowest = nullptr, *highest = nullptr;
+    for (size_t i = 0; i < interpreter->tensors_size(); ++i) {
+        const TfLiteTensor *tensor = interpreter->tensor((int)i);
+        if (tensor->data.raw == nullptr || tensor->bytes == 0)
+            continue;
+        if ((int)i == inputIndex || (int)i == outputIndex) {
+            if (tensor->allocation_type != kTfLiteCustom)
+                usage.ioBytes += tensor->bytes;
+            continue;
+        }
+        switch (tensor->allocation_type) {
+            case kTfLiteArenaRwPersistent:  // Variable tensors and persistent buffers of the kernels
+                usage.persistentBytes += tensor->bytes;
+                break;
+            case kTfLiteArenaRw:  // Overlapping in the arena, so its size is the span of the tensors
+                lowest = (lowest == nullptr) ? tensor->data.raw : std::min(lowest, tensor->data.raw);
+                highest = std::max(highest, tensor->data.raw + tensor->bytes);
+                break;
+            case kTfLiteDynamic:
+                usage.activationBytes += tensor->bytes;
+                break;
+            default:  // Weights are part of the model, the other custom allocations are in the scratch arena
+                break;
+        }
+    }
+    if (lowest != nullptr)
+        usage.activationBytes += (size_t)(highest - lowest);
+    if (scratchArena != nullptr)
+        usage.activationBytes += scratchArena->getCapacity() / (size_t)std::max(1, scratchArena->getNumMembers());
+    usage.runtimeBytes = runtimeBytes;
+    return usage;
+}
+
+void InterpreterWrap::measureRuntimeBytes(size_t heapBytesBefore) {
+    // The tensors come from the heap as well (TFLite arena), the flatbuffer does not
+    const size_t heapBytesAfter = getAllocatedHeapBytes();
+    const size_t heapBytes = (heapBytesAfter > heapBytesBefore) ? heapBytesAfter - heapBytesBefore : 0;
+    const ModelMemoryUsage usage = getModelMemoryUsage();
+    const size_t tensorBytes = usage.activationBytes + usage.persistentBytes + usage.ioBytes;
+    runtimeBytes = (heapBytes > tensorBytes) ? heapBytes - tensorBytes : 0;
+}
+
+std::map<std::string, std::string> InterpreterWrap::getMetadata() const {
+    std::map<std::string, std::string> metadata;
+    const tflite::Model *flatModel = model->GetModel();
+    if (flatModel->metadata() == nullptr || flatModel->buffers() == nullptr)
+        return metadata;
+    for (const auto *entry : *flatModel->metadata()) {
+        if (entry->name() == nullptr || entry->buffer() >= flatModel->buffers()->size())
+            continue;
+        const auto *data = flatModel->buffers()->Get(entry->buffer())->data();
+        metadata[entry->name()->str()] = (data != nullptr) ? std::string(reinterpret_cast<const char *>(data->data()), data->size()) : std::string();
+    }
+    return metadata;
+}
+
+bool InterpreterWrap::getDenseLayers(std::vector<DenseLayer> &layers) const {
+    layers.clear();
+    auto isConstantFloat = [](const TfLiteTensor *tensor) { return tensor->type == kTfLiteFloat32 && tensor->allocation_type == kTfLiteMmapRo && tensor->data.f != nullptr; };
+    // Each operator has to consume the output of the previous one, starting from the input of the model
+    int current = interpreter->inputs()[0];
+    for (int nodeIndex : interpreter->execution_plan()) {
+        const auto *nodeAndRegistration = interpreter->node_and_registration(nodeIndex);
+        const TfLiteNode &node = nodeAndRegistration->first;
+        const int op = nodeAndRegistration->second.builtin_code;
+        if (node.inputs->size < 1 || node.inputs->data[0] != current || node.outputs->size != 1)
+            break;
+        if (op == kTfLiteBuiltinFullyConnected && node.inputs->size >= 2) {
+            const TfLiteTensor *weights = interpreter->tensor(node.inputs->data[1]);
+            const TfLiteTensor *bias = (node.inputs->size > 2 && node.inputs->data[2] >= 0) ? interpreter->tensor(node.inputs->data[2]) : nullptr;
+            const auto *params = reinterpret_cast<const TfLiteFullyConnectedParams *>(node.builtin_data);
+            if (params == nullptr || params->weights_format != kTfLiteFullyConnectedWeightsFormatDefault || !isConstantFloat(weights) || weights->dims->size != 2 || (bias != nullptr && !isConstantFloat(bias)))
+                break;
+            DenseLayer layer;
+            layer.numOutputs = weights->dims->data[0];
+            layer.numInputs = weights->dims->data[1];
+            if (!layers.empty() && layers.back().numOutputs != layer.numInputs)
+                break;
+            layer.weights.assign(weights->data.f, weights->data.f + layer.numOutputs * layer.numInputs);
+            if (bias != nullptr)
+                layer.bias.assign(bias->data.f, bias->data.f + layer.numOutputs);
+            else
+                layer.bias.assign(layer.numOutputs, 0.0f);
+            if (params->activation == kTfLiteActRelu)
+                layer.activation = DenseActivation::relu;
+            else if (params->activation == kTfLiteActRelu6)
+                layer.activation = DenseActivation::relu6;
+            else if (params->activation == kTfLiteActTanh)
+                layer.activation = DenseActivation::tanh;
+            else if (params->activation == kTfLiteActSigmoid)
+                layer.activation = DenseActivation::sigmoid;
+            else if (params->activation != kTfLiteActNone)
+                break;
+            layers.push_back(std::move(layer));
+        } else if (op == kTfLiteBuiltinLogistic || op == kTfLiteBuiltinTanh || op == kTfLiteBuiltinRelu || op == kTfLiteBuiltinRelu6) {
+            // Standalone activation, merged into the layer before it
+            if (layers.empty() || layers.back().activation != DenseActivation::none)
+                break;
+            layers.back().activation = (op == kTfLiteBuiltinLogistic) ? DenseActivation::sigmoid : (op == kTfLiteBuiltinTanh) ? DenseActivation::tanh : (op == kTfLiteBuiltinRelu) ? DenseActivation::relu : DenseActivation::relu6;
+        } else {
+            break;
+        }
+        current = node.outputs->data[0];
+    }
+    const TfLiteTensor *input = interpreter->input_tensor(0);
+    if (layers.empty() || current != interpreter->outputs()[0] || input->dims->size < 1 || input->dims->data[input->dims->size - 1] != layers[0].numInputs) {
+        layers.clear();
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+bool isWeightTensor(const TfLiteTensor *tensor) {
+    return tensor->type == kTfLiteFloat32 && tensor->allocation_type == kTfLiteMmapRo && tensor->name != nullptr && tensor->data.raw != nullptr;
+}
+
+/**
+ * True for the operators known to read their constant inputs at every Eval. Others may derive data from the weights
+ * once and cache it (e.g. the multithreaded CONV_2D transposes its filter, hybrid kernels cache row sums), and would
+ * silently keep the first set.
+ */
+bool readsWeightsAtEveryEval(const TfLiteRegistration &registration, const TfLiteNode &node) {
+    switch (registration.builtin_code) {
+        case kTfLiteBuiltinFullyConnected: {
+            const auto *params = reinterpret_cast<const TfLiteFullyConnectedParams *>(node.builtin_data);
+            return params != nullptr && params->weights_format == kTfLiteFullyConnectedWeightsFormatDefault;
+        }
+        case kTfLiteBuiltinAdd:
+        case kTfLiteBuiltinSub:
+        case kTfLiteBuiltinMul:
+        case kTfLiteBuiltinConcatenation:
+        case kTfLiteBuiltinReshape:
+        case kTfLiteBuiltinTanh:
+        case kTfLiteBuiltinLogistic:
+        case kTfLiteBuiltinRelu:
+        case kTfLiteBuiltinRelu6:
+            return true;
+        default:
+            return false;
+    }
+}
+
+}  // namespace
+
+std::vector<WeightTensorInfo> InterpreterWrap::getWeightLayout(std::vector<int> *indices) const {
+    std::vector<WeightTensorInfo> layout;
+    // Every operator reading a weight tensor has to re-read it at every invocation (a delegate never does)
+    for (int nodeIndex : interpreter->execution_plan()) {
+        const auto *nodeAndRegistration = interpreter->node_and_registration(nodeIndex);
+        const TfLiteNode &node = nodeAndRegistration->first;
+        if (nodeAndRegistration->second.builtin_code == kTfLiteBuiltinDelegate)
+            return layout;
+        for (int i = 0; i < node.inputs->size; ++i)
+            if (node.inputs->data[i] >= 0 && isWeightTensor(interpreter->tensor(node.inputs->data[i])) && !readsWeightsAtEveryEval(nodeAndRegistration->second, node))
+                return layout;
+    }
+    for (size_t i = 0; i < interpreter->tensors_size(); ++i) {
+        const TfLiteTensor *tensor = interpreter->tensor((int)i);
+        if (!isWeightTensor(tensor))
+            continue;
+        WeightTensorInfo info;
+        info.name = tensor->name;
+        info.shape.assign(tensor->dims->data, tensor->dims->data + tensor->dims->size);
+        info.size = tensor->bytes / sizeof(float);
+        layout.push_back(info);
+        if (indices != nullptr)
+            indices->push_back((int)i);
+    }
+    return layout;
+}
+
+bool InterpreterWrap::attachWeightBank(const WeightBank &bank) {
+    std::vector<int> indices;
+    const std::vector<WeightTensorInfo> layout = getWeightLayout(&indices);
+    if (layout.empty() || bank.getNumSets() == 0 || layout != bank.getLayout())
+        return false;
+    weightBank = &bank;
+    weightTensors = indices;
+    useWeightSet(0);
+    return true;
+}
+
+void InterpreterWrap::useWeightSet(int set) {
+    if (weightBank == nullptr || set < 0 || set >= weightBank->getNumSets())
+        return;
+    // The operators of the graph read their weights at every invocation (see getWeightLayout)
+    for (size_t t = 0; t < weightTensors.size(); ++t)
+        interpreter->tensor(weightTensors[t])->data.raw = const_cast<char *>(reinterpret_cast<const char *>(weightBank->getTensor(set, (int)t)));
+}
+
+void InterpreterWrap::resetState() {
+    interpreter->ResetVariableTensors();
+}
+
+void InterpreterWrap::enableProfiling() {
+    profiler = std::make_unique<OperatorProfiler>(*interpreter);
+    interpreter->SetProfiler(profiler.get());
+}
+
+bool InterpreterWrap::exportProfile(const std::string &traceJsonPath, const std::string &summaryPath) const {
+    if (profiler == nullptr)
+        return false;
+    const bool traceWritten = profiler->profile.writeChromeTrace(traceJsonPath);
+    return profiler->profile.writeSummary(summaryPath) && traceWritten;
+}
+
+void InterpreterWrap::updatePerfRegion() {
+    if (INFERENCE_PERF_COUNTERS)
+        perfRegion = getPerfRegion("TFLite invoke (batch " + std::to_string(requestedBatchSize()) + ", " + std::to_string(numThreads) + " threads)");
+}
+
+void InterpreterWrap::invokeBound() {
+    PerfScope perfScope(perfRegion);
+    ScratchArena::Lease scratchLease(scratchArena.get());
+    TFLITE_MINIMAL_CHECK(interpreter->Invoke() == kTfLiteOk);
+}
+
+TensorBinding InterpreterWrap::getTensorBinding() const {
+    TensorBinding binding;
+    binding.input = inputTensorPtr;
+    binding.inputSize = (size_t)requestedInputSize();
+    binding.output = outputTensorPtr;
+    binding.outputSize = (size_t)requestedOutputSize();
+    return binding;
+}
+
 int InterpreterWrap::invoke_internal(const float inputVector[], size_t inputSize, float outputVector[], size_t outputSize, bool verbose) {
+    PerfScope perfScope(perfRegion);
+    ScratchArena::Lease scratchLease(scratchArena.get());
     if (verbose) {
         std::cout << "Interpreter\t|\tinvoke_internal\t| Input size: " << inputSize << " | Output size: " << outputSize << std::endl;
         std::cout << "Interpreter\t|\tinvoke_internal\t| Filling input tensor..." << std::endl
@@ -270,10 +799,16 @@ std::unique_ptr<tflite::FlatBufferModel> InterpreterWrap::loadModelFromBuffer(co
 /** STEP 2 */
 std::unique_ptr<Interpreter> InterpreterWrap::buildInterpreter(const std::unique_ptr<tflite::FlatBufferModel> &model) {
     // Build the interpreter
+#if (TFLITE_SELECTED_OPS)
+    tflite::MutableOpResolver resolver;
+    registerSelectedOps(resolver);
+#else
     tflite::ops::builtin::BuiltinOpResolver resolver;
+#endif
     InterpreterBuilder builder(*model, resolver);
     std::unique_ptr<Interpreter> interpreter;
-    builder(&interpreter);
+    if (builder(&interpreter) != kTfLiteOk && TFLITE_SELECTED_OPS)
+        std::cerr << "Interpreter\t|\tbuildInterpreter\t| The model uses operators missing from selectedops.h, run libs/generate_op_resolver.py on it" << std::endl;
     TFLITE_MINIMAL_CHECK(interpreter != nullptr);
 
     return interpreter;
@@ -297,10 +832,18 @@ int InterpreterWrap::requestedInputSize() const {
     int input = this->interpreter->inputs()[0];
     TfLiteIntArray *dims = this->interpreter->tensor(input)->dims;
 
-    int wanted_size = dims->data[1];
+    // Total number of elements, so that batched models (batch, features) are filled entirely
+    int wanted_size = 1;
+    for (int i = 0; i < dims->size; ++i)
+        wanted_size *= dims->data[i];
     return wanted_size;
 }
 
+int InterpreterWrap::requestedBatchSize() const {
+    int input = this->interpreter->inputs()[0];
+    return this->interpreter->tensor(input)->dims->data[0];
+}
+
 int InterpreterWrap::requested2drows() const {
     int input = this->interpreter->inputs()[0];
     return this->interpreter->tensor(input)->dims->data[1];
@@ -314,22 +857,34 @@ int InterpreterWrap::requested2dcols() const {
 int InterpreterWrap::requestedOutputSize() const {
     int output_index = this->interpreter->outputs()[0];
     TfLiteIntArray *output_dims = this->interpreter->tensor(output_index)->dims;
-    // assume output dims to be something like (1, 1, ... ,size)
-    auto output_size = output_dims->data[output_dims->size - 1];
+    // Total number of elements, so that 2D outputs (e.g. spectral masks) are read entirely
+    // For outputs shaped like (1, 1, ... ,size) this is equal to the last dimension
+    int output_size = 1;
+    for (int i = 0; i < output_dims->size; ++i)
+        output_size *= output_dims->data[i];
     return output_size;
 }
 
 /***** Handle functions *****/
-InterpreterPtr createInterpreter(const std::string &filename, bool verbose) {
-    InterpreterPtr res = new InterpreterWrap(filename, verbose);
+InterpreterPtr createInterpreter(const std::string &filename, bool verbose, const ThreadingConfig &threading, bool profiling) {
+    InterpreterPtr res = new InterpreterWrap(filename, verbose, threading);
+    // Attached after priming, so that the first invocation is not part of the profile
+    if (profiling)
+        res->enableProfiling();
     return res;
 }
 
-InterpreterPtr createInterpreterFromBuffer(const char *buffer, size_t bufferSize, bool verbose) {
-    InterpreterPtr res = new InterpreterWrap(buffer, bufferSize, verbose);
+InterpreterPtr createInterpreterFromBuffer(const char *buffer, size_t bufferSize, bool verbose, const ThreadingConfig &threading, bool profiling) {
+    InterpreterPtr res = new InterpreterWrap(buffer, bufferSize, verbose, threading);
+    if (profiling)
+        res->enableProfiling();
     return res;
 }
 
+bool exportProfile(InterpreterPtr inp, const std::string &traceJsonPath, const std::string &summaryPath) {
+    return inp->exportProfile(traceJsonPath, summaryPath);
+}
+
 void deleteInterpreter(InterpreterPtr inp) {
     if (inp)
         delete inp;
@@ -386,6 +941,87 @@ size_t getModelInputSize1d(InterpreterPtr inp) {
     return (size_t)(inp->requestedInputSize());
 }
 
+size_t getModelBatchSize(InterpreterPtr inp) {
+    return (size_t)(inp->requestedBatchSize());
+}
+
+bool setModelBatchSize(InterpreterPtr inp, size_t batchSize) {
+    if (batchSize == 0)
+        return false;
+    return inp->resizeBatch((int)batchSize);
+}
+
+size_t placeTensorsInArena(InterpreterPtr inp, LockedArena &arena, bool verbose) {
+    return inp->placeTensorsInArena(arena, verbose);
+}
+
+TensorMemoryUsage getTensorMemoryUsage(InterpreterPtr inp) {
+    return inp->getTensorMemoryUsage();
+}
+
+ModelMemoryUsage getModelMemoryUsage(InterpreterPtr inp) {
+    return inp->getModelMemoryUsage();
+}
+
+TensorBinding getTensorBinding(InterpreterPtr inp) {
+    return inp->getTensorBinding();
+}
+
+void invokeBound(InterpreterPtr inp) {
+    inp->invokeBound();
+}
+
+std::map<std::string, std::string> getModelMetadata(InterpreterPtr inp) {
+    return inp->getMetadata();
+}
+
+bool getDenseLayers(InterpreterPtr inp, std::vector<DenseLayer> &layers) {
+    return inp->getDenseLayers(layers);
+}
+
+std::vector<WeightTensorInfo> getWeightLayout(InterpreterPtr inp) {
+    return inp->getWeightLayout();
+}
+
+int addWeightSet(WeightBank &bank, const char *buffer, size_t bufferSize) {
+    std::unique_ptr<tflite::FlatBufferModel> model = tflite::FlatBufferModel::VerifyAndBuildFromBuffer(buffer, bufferSize);
+    if (model == nullptr)
+        return -1;
+    const tflite::Model *flatModel = model->GetModel();
+    if (flatModel->subgraphs() == nullptr || flatModel->subgraphs()->size() == 0 || flatModel->subgraphs()->Get(0)->tensors() == nullptr || flatModel->buffers() == nullptr)
+        return -1;
+    const auto *tensors = flatModel->subgraphs()->Get(0)->tensors();
+    std::vector<const void *> values;
+    for (const WeightTensorInfo &info : bank.getLayout()) {
+        const void *value = nullptr;
+        for (const auto *tensor : *tensors) {
+            if (tensor->name() == nullptr || tensor->name()->str() != info.name)
+                continue;
+            const auto *data = (tensor->buffer() < flatModel->buffers()->size()) ? flatModel->buffers()->Get(tensor->buffer())->data() : nullptr;
+            const std::vector<int> shape = (tensor->shape() != nullptr) ? std::vector<int>(tensor->shape()->begin(), tensor->shape()->end()) : std::vector<int>();
+            if (tensor->type() == tflite::TensorType_FLOAT32 && data != nullptr && data->size() == info.size * sizeof(float) && shape == info.shape)
+                value = data->data();
+            break;
+        }
+        if (value == nullptr)
+            return -1;
+        values.push_back(value);
+    }
+    return bank.addSet(values);
+}
+
+bool attachWeightBank(InterpreterPtr inp, const WeightBank &bank) {
+    return inp->attachWeightBank(bank);
+}
+
+void useWeightSet(InterpreterPtr inp, int set) {
+    inp->useWeightSet(set);
+}
+
+void resetModelState(InterpreterPtr inp) {
+    inp->resetState();
+}
+
 void getModelInputSize2d(InterpreterPtr inp, size_t &rows, size_t &columns) {
     rows = (size_t)(inp->requested2drows());
     columns = (size_t)(inp->requested2dcols());
@@ -16,14 +16,22 @@
 #include <cstdio>
 #include <iostream>
 #include <limits>  // std::numeric_limits
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "conditionedmlp.h"
+#include "memoryusage.h"
+#include "modelengine.h"
+#include "threadingconfig.h"
+#include "weightbank.h"
+
 namespace InferenceEngine {
 
 class InterpreterWrap;                    // Forward definition of the Interpreter class
 using InterpreterPtr = InterpreterWrap*;  // Opaque pointer for Interpreter object
+class LockedArena;                        // See lockedarena.h
 
 /**
  * @brief Get the Model Input Size for 1dimentional input models
@@ -33,6 +41,35 @@ using InterpreterPtr = InterpreterWrap*;  // Opaque pointer for Interpreter obje
  */
 size_t getModelInputSize1d(InterpreterPtr inp);
 
+/**
+ * @brief Get the Model Batch Size (first dimension of the input tensor)
+ * Models with a fixed batch size process that many samples (or frames) per invocation
+ *
+ * @param inp
+ * @return size_t
+ */
+size_t getModelBatchSize(InterpreterPtr inp);
+
+/**
+ * @brief Change the batch size (first dimension of the input tensor) of the model (do not use in real time threads!)
+ * The tensors are reallocated and the interpreter is primed again. Only models whose layers operate on each row
+ * independently (e.g. sample-wise MLPs) produce a proportionally larger output.
+ * Interpreters that share a scratch arena (ThreadingConfig::scratchArenaGroup) cannot be resized.
+ *
+ * @param inp
+ * @param batchSize New number of rows of the input tensor
+ * @return bool False if the model could not be resized
+ */
+bool setModelBatchSize(InterpreterPtr inp, size_t batchSize);
+
+/**
+ * @brief Reset the internal state of the model (variable tensors, e.g. the state of stateful recurrent layers)
+ * It only clears memory, so it can be called from the real-time thread. Stateless models are not affected.
+ *
+ * @param inp
+ */
+void resetModelState(InterpreterPtr inp);
+
 /**
  * @brief Get the Model Input Size2d object
  *
@@ -50,23 +87,143 @@ void getModelInputSize2d(InterpreterPtr inp, size_t& rows, size_t& columns);
  */
 size_t getModelOutputSize(InterpreterPtr inp);
 
+/** Tensor memory planned by TFLite for an interpreter, see getTensorMemoryUsage() */
+struct TensorMemoryUsage {
+    size_t privateBytes = 0;        // Arena of the interpreter, as allocated, and its persistent tensors
+    size_t scratchBytes = 0;        // Intermediate tensors in the shared scratch arena
+    size_t sharedScratchBytes = 0;  // Capacity of the shared scratch arena (the largest plan of its group)
+    int scratchArenaGroup = -1;     // -1 if the interpreter does not share its intermediate tensors
+    int scratchArenaMembers = 0;    // Interpreters sharing the scratch arena
+};
+
+/**
+ * @brief Get the memory of the tensors of the interpreter (do not use in real time threads!)
+ * The private arena is released and allocated again when tensors move to the scratch arena or to a LockedArena, so it
+ * is reported at its current size. The weights of the model are not included.
+ *
+ * @param inp
+ * @return TensorMemoryUsage
+ */
+TensorMemoryUsage getTensorMemoryUsage(InterpreterPtr inp);
+
+/**
+ * @brief Get the memory of the interpreter, split as in memoryusage.h (do not use in real time threads!)
+ * The model is the flatbuffer, mapped from the file or the caller-owned buffer (shared by the interpreters created from
+ * the same buffer). The activations include an even share of the shared scratch arena. Input and output tensors moved
+ * to a LockedArena (see placeTensorsInArena) belong to the owner of the arena and are not included.
+ *
+ * @param inp
+ * @return ModelMemoryUsage
+ */
+ModelMemoryUsage getModelMemoryUsage(InterpreterPtr inp);
+
+/**
+ * @brief Get the metadata entries of the model, by name (do not use in real time threads!)
+ * Values are the raw content of the metadata buffers, e.g. the parameters of the PrePostChain (see prepostchain.h)
+ *
+ * @param inp
+ * @return std::map<std::string, std::string>
+ */
+std::map<std::string, std::string> getModelMetadata(InterpreterPtr inp);
+
+/**
+ * @brief Get the layers of a model that is a chain of fully connected layers (do not use in real time threads!)
+ * Supported operators are FULLY_CONNECTED with constant float weights, each optionally followed by one LOGISTIC, TANH,
+ * RELU or RELU6. The layers can be evaluated natively, see conditionedmlp.h.
+ *
+ * @param inp
+ * @param layers    Filled with the layers, from the input to the output
+ * @return bool     False if the model has any other operator (the layers are left empty)
+ */
+bool getDenseLayers(InterpreterPtr inp, std::vector<DenseLayer>& layers);
+
+/**
+ * @brief Get the weights that can be switched with a WeightBank: the named float constant tensors, in order (do not use in real time threads!)
+ * Empty if any operator reading a weight is not known to read it at every invocation: delegates keep their own copy of
+ * the weights, and kernels like the multithreaded CONV_2D cache data derived from them. Only FULLY_CONNECTED (default
+ * weights format), ADD, SUB, MUL, CONCATENATION, RESHAPE and the activations are accepted.
+ *
+ * @param inp
+ * @return std::vector<WeightTensorInfo>
+ */
+std::vector<WeightTensorInfo> getWeightLayout(InterpreterPtr inp);
+
+/**
+ * @brief Read the weights of a model into the next set of a bank (do not use in real time threads!)
+ * The model has to have the graph of the bank: its tensors are matched by name, and must have the shapes of the layout.
+ *
+ * @param bank          Bank prepared with the layout of the graph (see getWeightLayout)
+ * @param buffer        Caller-owned buffer containing the model, only read during the call
+ * @param bufferSize
+ * @return int          Index of the set, -1 if the model does not match or the bank is full
+ */
+int addWeightSet(WeightBank& bank, const char* buffer, size_t bufferSize);
+
+/**
+ * @brief Run the interpreter with the weights of a bank, starting from set 0 (do not use in real time threads!)
+ * The weight tensors point into the bank from now on, so the bank has to outlive the interpreter. Models whose
+ * weights cannot be switched (see getWeightLayout) are refused.
+ *
+ * @param inp
+ * @param bank
+ * @return bool     False if the layout of the bank is not the one of the model, or the bank is empty
+ */
+bool attachWeightBank(InterpreterPtr inp, const WeightBank& bank);
+
+/**
+ * @brief Switch to another set of the attached bank, between two invocations (real-time safe)
+ * Only pointers change: the activations and the state of the model are kept. Invalid sets are ignored.
+ *
+ * @param inp
+ * @param set
+ */
+void useWeightSet(InterpreterPtr inp, int set);
+
+/**
+ * @brief Move the input and output tensors to a locked memory arena (do not use in real time threads!)
+ * The other tensors (weights and intermediate activations) stay in the TFLite arena (or in the shared scratch arena),
+ * but their pages are locked and prefaulted as well. The interpreter is primed again afterwards. The arena has to outlive the interpreter.
+ *
+ * @param inp
+ * @param arena  Arena providing the input and output tensors
+ * @param verbose
+ * @return size_t Number of bytes locked outside of the arena
+ */
+size_t placeTensorsInArena(InterpreterPtr inp, LockedArena& arena, bool verbose = false);
+
 /**
  * @brief Dynamically allocate an instance of a Interpreter object (do not use in real time threads!)
  *
- * @param filename path to the tflite model file
- * @param verbose  verbose mode (to disable in real time threads)
+ * @param filename  path to the tflite model file
+ * @param verbose   verbose mode (to disable in real time threads)
+ * @param threading number of threads and placement of the worker threads (see threadingconfig.h)
+ * @param profiling time every operator of the model at each invocation (see exportProfile)
  * @return InterpreterPtr
  */
-InterpreterPtr createInterpreter(const std::string& filename, bool verbose = false);
+InterpreterPtr createInterpreter(const std::string& filename, bool verbose = false, const ThreadingConfig& threading = ThreadingConfig(), bool profiling = false);
 
 /**
  * @brief Dynamically allocate an instance of a Interpreter object from Buffer(do not use in real time threads!)
  *
  * @param buffer Caller-owned buffer containing the model
  * @param verbose  verbose mode (to disable in real time threads)
+ * @param threading number of threads and placement of the worker threads (see threadingconfig.h)
+ * @param profiling time every operator of the model at each invocation (see exportProfile)
  * @return InterpreterPtr
  */
-InterpreterPtr createInterpreterFromBuffer(const char* buffer, size_t bufferSize, bool verbose = false);
+InterpreterPtr createInterpreterFromBuffer(const char* buffer, size_t bufferSize, bool verbose = false, const ThreadingConfig& threading = ThreadingConfig(), bool profiling = false);
+
+/**
+ * @brief Write the per-operator profile of an interpreter created with profiling enabled (do not use in real time threads!)
+ * Operator timings are aggregated without allocating in the invoking thread (see opprofiler.h), so the profile can be
+ * exported any number of times while the interpreter keeps running.
+ *
+ * @param inp               pointer to the Interpreter object
+ * @param traceJsonPath     Chrome trace of the most recent operator executions
+ * @param summaryPath       Operators ranked by total execution time
+ * @return bool             False if profiling is not enabled or the files could not be written
+ */
+bool exportProfile(InterpreterPtr inp, const std::string& traceJsonPath, const std::string& summaryPath);
 
 /**
  * @brief Free the Interpreter memory (do not use in real time threads)
@@ -161,4 +318,28 @@ int invokeFlat2D(InterpreterPtr inp, std::array<float, N_ROWS * N_COLS>& flatInp
  */
 int invokeFlat2D(InterpreterPtr inp, std::vector<float>& flatInputMatrix, size_t nRows, size_t nCols, std::vector<float>& outputVector, bool verbose = false);
 
+/**
+ * @brief Get the input and output tensors of the interpreter, to use them in place (do not use in real time threads!)
+ * They change with the batch size, placeTensorsInArena and the scratch arena, see modelengine.h
+ *
+ * @param inp
+ * @return TensorBinding
+ */
+TensorBinding getTensorBinding(InterpreterPtr inp);
+
+/**
+ * @brief Invoke the interpreter on the data already in its input tensor, without copies or checks
+ * The output is left in the output tensor (see getTensorBinding)
+ *
+ * @param inp
+ */
+void invokeBound(InterpreterPtr inp);
+
+/** Backend of ModelEngine (see modelengine.h) */
+struct TFLiteBackend {
+    using Handle = InterpreterPtr;
+    static TensorBinding bind(Handle handle) { return getTensorBinding(handle); }
+    static void run(Handle handle) { invokeBound(handle); }
+};
+
 }  // namespace InferenceEngine
\ No newline at end of file
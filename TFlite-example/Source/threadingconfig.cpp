@@ -0,0 +1,62 @@
+/*
+==============================================================================*/
+#include "threadingconfig.h"
+
+#include <exception>
+#include <iostream>
+#include <thread>
+
+#if defined(__linux__)
+    #include <sched.h>
+#endif
+
+namespace InferenceEngine {
+
+bool configuresWorkerThreads(const ThreadingConfig& config) {
+    return config.affinityMask != 0 || config.schedulingPolicy >= 0;
+}
+
+bool configureCurrentThread(const ThreadingConfig& config) {
+    bool ok = true;
+#if defined(__linux__)
+    if (config.affinityMask != 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu)
+            if (config.affinityMask & (uint64_t(1) << cpu))
+                CPU_SET(cpu, &cpus);
+        ok = sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+    }
+    if (config.schedulingPolicy >= 0) {
+        sched_param param{};
+        param.sched_priority = config.schedulingPriority;
+        ok = sched_setscheduler(0, config.schedulingPolicy, &param) == 0 && ok;
+    }
+    if (!ok)
+        std::cerr << "Interpreter\t|\tconfigureCurrentThread\t| Could not configure worker thread" << std::endl;
+#else
+    (void)config;
+#endif
+    return ok;
+}
+
+void runAsWorkerCreator(const ThreadingConfig& config, const std::function<void()>& function) {
+    if (!configuresWorkerThreads(config)) {
+        function();
+        return;
+    }
+    std::exception_ptr error;
+    std::thread creator([&config, &function, &error]() {
+        configureCurrentThread(config);
+        try {
+            function();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+    creator.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+}  // namespace InferenceEngine
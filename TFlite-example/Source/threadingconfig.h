@@ -0,0 +1,56 @@
+/*
+ * Threading configuration of the inference engines
+ * Author: Domenico Stefani (domenico.stefani96@gmail.com)
+ *
+ * With numThreads > 1 the engines split each invocation between the calling (audio) thread and a pool of worker
+ * threads (ruy for TFLite, the intra-op pool for ONNX Runtime). The audio thread waits for the workers, so they
+ * have to run on cores where they cannot preempt the audio thread or other real-time work.
+ *
+ * The affinity and scheduling policy are applied only to the workers of the engine (Linux only), never to the other
+ * threads of the host:
+ *   - ONNX Runtime creates its workers through a custom thread creation function, which configures each worker
+ *     before it runs.
+ *   - ruy does not expose the creation of its workers, so the wrapper runs the calls that create them (building,
+ *     allocating and priming the interpreter) on a temporary thread configured as a worker (runAsWorkerCreator()).
+ *     Threads inherit the affinity and scheduling policy of the thread that creates them.
+ *
+ * The defaults (single thread, no spinning) never create workers, which is the safe choice on Elk. When using more
+ * threads on Elk, set affinityMask to cores that do not run real-time audio, so the workers cannot compete with it.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace InferenceEngine {
+
+struct ThreadingConfig {
+    int numThreads = 1;          // Threads used by each invocation, including the calling thread
+    uint64_t affinityMask = 0;   // Bit i allows the workers on CPU i (0 to keep the affinity they inherit)
+    bool spinWait = false;       // Let idle workers busy-wait instead of blocking (ONNX Runtime only, ruy decides itself)
+    int schedulingPolicy = -1;   // Policy of the workers (e.g. SCHED_OTHER, SCHED_FIFO), -1 to keep the inherited one
+    int schedulingPriority = 0;  // Priority for SCHED_FIFO/SCHED_RR
+    int scratchArenaGroup = -1;  // Share the intermediate tensors with the interpreters of the same group, -1 for none
+                                 // (TFLite only, see scratcharena.h, ONNX Runtime sessions share the environment arena)
+};
+
+/** True if the configuration sets the affinity or the scheduling policy of the workers */
+bool configuresWorkerThreads(const ThreadingConfig& config);
+
+/**
+ * @brief Apply the affinity and scheduling policy of the configuration to the calling thread
+ *
+ * @param config    Threading configuration
+ * @return bool     False if they could not be applied (e.g. SCHED_FIFO without the permission)
+ */
+bool configureCurrentThread(const ThreadingConfig& config);
+
+/**
+ * @brief Run a function on a temporary thread with the affinity and scheduling policy of the workers (do not use in
+ * real time threads!)
+ * The threads created by the function inherit them. Exceptions thrown by the function are rethrown to the caller.
+ * Without affinity and scheduling policy the function runs on the calling thread.
+ */
+void runAsWorkerCreator(const ThreadingConfig& config, const std::function<void()>& function);
+
+}  // namespace InferenceEngine
@@ -0,0 +1,68 @@
+/*
+==============================================================================*/
+#include "weightbank.h"
+
+#include "lockedarena.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace InferenceEngine {
+
+namespace {
+
+const size_t floatsPerLine = LockedArena::cacheLineSize / sizeof(float);
+
+size_t roundUpToLine(size_t floats) {
+    return (floats + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+}
+
+}  // namespace
+
+WeightBank::~WeightBank() {
+    release();
+}
+
+void WeightBank::release() {
+    if (lockedBytes > 0)
+        LockedArena::unlock(data, lockedBytes);
+    lockedBytes = 0;
+    storage = std::vector<float>();
+    data = nullptr;
+    numSets = 0;
+    maxSets = 0;
+}
+
+void WeightBank::prepare(const std::vector<WeightTensorInfo>& layout, int maxSets) {
+    release();
+    this->layout = layout;
+    offsets.clear();
+    setStride = 0;
+    for (const WeightTensorInfo& tensor : layout) {
+        offsets.push_back(setStride);
+        setStride += roundUpToLine(tensor.size);
+    }
+    if (maxSets <= 0 || setStride == 0)
+        return;
+
+    // One line more, to align the first set
+    storage.assign((size_t)maxSets * setStride + floatsPerLine, 0.0f);
+    const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+    const uintptr_t aligned = (address + LockedArena::cacheLineSize - 1) / LockedArena::cacheLineSize * LockedArena::cacheLineSize;
+    data = storage.data() + (aligned - address) / sizeof(float);
+    this->maxSets = maxSets;
+    // Switching to a set that was not used for a while must not page fault
+    if (LockedArena::lockAndPrefault(data, (size_t)maxSets * setStride * sizeof(float)) > 0)
+        lockedBytes = (size_t)maxSets * setStride * sizeof(float);
+}
+
+int WeightBank::addSet(const std::vector<const void*>& tensors) {
+    if (numSets >= maxSets || tensors.size() != layout.size())
+        return -1;
+    float* set = data + (size_t)numSets * setStride;
+    for (size_t t = 0; t < layout.size(); ++t)
+        std::memcpy(set + offsets[t], tensors[t], layout[t].size * sizeof(float));
+    return numSets++;
+}
+
+}  // namespace InferenceEngine
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Generate Source/selectedops.h, registering in a tflite::MutableOpResolver only the builtin operators used by a set
+of .tflite models (by default the ones in ../sample_data/).
+
+With TFLITE_SELECTED_OPS=1 (ReleaseSelectedOps configuration of the .jucer) the wrapper uses this resolver instead
+of BuiltinOpResolver. Since nothing references the other kernels any more, the linker takes only the needed object
+files from the static tensorflow-lite library built by compile-libs-*.sh, which is left unchanged.
+Models loaded at runtime (e.g. the spectral and classifier models in /udata) have to be passed too.
+
+The models are read directly (no tensorflow or flatbuffers package needed), the operator names are taken from the
+schema of the TFLite sources cloned in this folder (tensorflow/tensorflow/lite/schema/schema.fbs).
+
+Usage: python3 generate_op_resolver.py [model.tflite | folder ...] [--schema path/to/schema.fbs] [--output path]
+"""
+
+import argparse
+import glob
+import os
+import re
+import struct
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_SCHEMA = os.path.join(SCRIPT_DIR, "tensorflow", "tensorflow", "lite", "schema", "schema.fbs")
+DEFAULT_MODELS = os.path.join(SCRIPT_DIR, "..", "sample_data")
+DEFAULT_OUTPUT = os.path.join(SCRIPT_DIR, "..", "Source", "selectedops.h")
+
+
+class FlatBufferTable:
+    """Minimal read-only access to a flatbuffer table"""
+
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        self.vtable = pos - struct.unpack_from("<i", buf, pos)[0]
+        self.vtable_size = struct.unpack_from("<H", buf, self.vtable)[0]
+
+    def field_offset(self, index):
+        entry = 4 + 2 * index
+        if entry >= self.vtable_size:
+            return 0
+        return struct.unpack_from("<H", self.buf, self.vtable + entry)[0]
+
+    def scalar(self, index, fmt, default=0):
+        offset = self.field_offset(index)
+        return struct.unpack_from(fmt, self.buf, self.pos + offset)[0] if offset else default
+
+    def indirect(self, index):
+        offset = self.field_offset(index)
+        if not offset:
+            return None
+        return self.pos + offset + struct.unpack_from("<I", self.buf, self.pos + offset)[0]
+
+    def table_vector(self, index):
+        start = self.indirect(index)
+        if start is None:
+            return []
+        length = struct.unpack_from("<I", self.buf, start)[0]
+        tables = []
+        for i in range(length):
+            element = start + 4 + 4 * i
+            tables.append(FlatBufferTable(self.buf, element + struct.unpack_from("<I", self.buf, element)[0]))
+        return tables
+
+    def string(self, index):
+        start = self.indirect(index)
+        if start is None:
+            return None
+        length = struct.unpack_from("<I", self.buf, start)[0]
+        return self.buf[start + 4:start + 4 + length].decode("utf-8")
+
+
+def read_operator_codes(path):
+    """Return a list of (builtin code, custom code, version) used by a model"""
+    with open(path, "rb") as f:
+        buf = f.read()
+    if buf[4:8] != b"TFL3":
+        raise ValueError("'%s' is not a TFLite model" % path)
+    model = FlatBufferTable(buf, struct.unpack_from("<I", buf, 0)[0])
+    codes = []
+    # Model.operator_codes is field 1, OperatorCode fields are deprecated_builtin_code (int8), custom_code,
+    # version and builtin_code (int32). The larger of the two builtin codes is the valid one.
+    for op in model.table_vector(1):
+        deprecated = op.scalar(0, "<b")
+        builtin = op.scalar(3, "<i")
+        codes.append((max(deprecated, builtin), op.string(1), op.scalar(2, "<i", 1)))
+    return codes
+
+
+def read_builtin_names(schema_path):
+    """Map the values of the BuiltinOperator enum of schema.fbs to their names"""
+    with open(schema_path) as f:
+        schema = f.read()
+    match = re.search(r"enum\s+BuiltinOperator\s*:\s*\w+\s*\{(.*?)\}", schema, re.S)
+    if match is None:
+        raise ValueError("BuiltinOperator not found in '%s'" % schema_path)
+    names = {}
+    for name, value in re.findall(r"^\s*(\w+)\s*=\s*(-?\d+)", re.sub(r"//.*", "", match.group(1)), re.M):
+        names[int(value)] = name
+    return names
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a selective TFLite op resolver from models")
+    parser.add_argument("models", nargs="*", default=[DEFAULT_MODELS], help="Models or folders with .tflite models")
+    parser.add_argument("--schema", default=DEFAULT_SCHEMA, help="TFLite schema.fbs")
+    parser.add_argument("--output", default=DEFAULT_OUTPUT, help="Generated header")
+    args = parser.parse_args()
+
+    paths = []
+    for entry in args.models:
+        paths += sorted(glob.glob(os.path.join(entry, "*.tflite"))) if os.path.isdir(entry) else [entry]
+    if not paths:
+        sys.exit("No .tflite models found in " + ", ".join(args.models))
+
+    names = read_builtin_names(args.schema)
+    versions = {}  # Operator name -> (min version, max version)
+    for path in paths:
+        for code, custom, version in read_operator_codes(path):
+            if code == 32:  # BuiltinOperator_CUSTOM
+                sys.exit("Model '%s' uses the custom operator '%s', register it by hand" % (path, custom))
+            if code not in names:
+                sys.exit("Unknown builtin operator %d in '%s', is the schema older than the model?" % (code, path))
+            low, high = versions.get(names[code], (version, version))
+            versions[names[code]] = (min(low, version), max(high, version))
+
+    lines = [
+        "/*",
+        " * Operators used by the shipped models, generated by libs/generate_op_resolver.py (do not edit)",
+        " * Models: " + ", ".join(os.path.basename(p) for p in paths),
+        " */",
+        "#pragma once",
+        "",
+        '#include "tensorflow/lite/kernels/builtin_op_kernels.h"',
+        '#include "tensorflow/lite/mutable_op_resolver.h"',
+        "",
+        "namespace InferenceEngine {",
+        "",
+        "inline void registerSelectedOps(tflite::MutableOpResolver& resolver) {",
+    ]
+    for name in sorted(versions):
+        low, high = versions[name]
+        lines.append("    resolver.AddBuiltin(tflite::BuiltinOperator_%s, tflite::ops::builtin::Register_%s(), %d, %d);" % (name, name, low, high))
+    lines += ["}", "", "}  // namespace InferenceEngine", ""]
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(lines))
+    print("Wrote %s (%s)" % (args.output, ", ".join(sorted(versions))))
+
+
+if __name__ == "__main__":
+    main()